@@ -0,0 +1,53 @@
+/** -----------------------------------------------------------------------------------------------------
+ * @file adc_decimator.h
+ *
+ * @brief Oversampling and decimation of a continuous ADC stream into the published sample rate
+ * @version 0.1
+ * @date 2024-2025
+ *  ----------------------------------------------------------------------------------------------------- **/
+
+#pragma once
+
+/** -----------------------------------------------------------------------------------------------------
+ * $ INCLUDES
+ *  ----------------------------------------------------------------------------------------------------- **/
+
+#include <stdint.h>
+#include <stddef.h>
+
+/**
+ * @brief Boxcar decimator, one output per decimation consecutive 12-bit codes
+ *
+ * Every output is the mean of its window (a first-order CIC filter). White noise drops by sqrt(decimation), about
+ * one extra bit per factor four, and interference at multiples of the output rate cancels exactly, e.g. 50 and 60 Hz
+ * mains at a 1 Hz or 10 Hz output. Outputs keep FRACTION_BITS below the 12-bit code. The window sum is exact in 32
+ * bits for up to MAX_DECIMATION codes. Blocks may end anywhere in a window.
+ */
+class AdcDecimator
+{
+public:
+    constexpr static const uint8_t  FRACTION_BITS  = 4;
+    constexpr static const uint32_t MAX_DECIMATION = 1UL << 20;
+
+    explicit AdcDecimator(uint32_t decimation);
+
+    /**
+     * @brief Feed a block of codes, completed outputs (code << FRACTION_BITS) are written to dest
+     *
+     * @return number of outputs written, windows that complete once dest is full are dropped
+     */
+    size_t push(const uint16_t* codes, size_t count, uint16_t* dest, size_t capacity);
+
+    /**
+     * @brief Round an output to the 12-bit code scale
+     *
+     */
+    static uint16_t to_code(uint16_t output) { return (output + (1U << (FRACTION_BITS - 1))) >> FRACTION_BITS; }
+
+    uint32_t decimation() const { return window; }
+
+private:
+    uint32_t window;
+    uint32_t sum    = 0;
+    uint32_t filled = 0;  // Codes in the current window
+};
@@ -0,0 +1,164 @@
+/** -----------------------------------------------------------------------------------------------------
+ * @file async_http_server.h
+ *
+ * @brief Event-driven HTTP/1.1 server with keep-alive on top of non-blocking BSD sockets (lwIP or POSIX)
+ * @version 0.1
+ * @date 2024-2025
+ *  ----------------------------------------------------------------------------------------------------- **/
+
+#pragma once
+
+/** -----------------------------------------------------------------------------------------------------
+ * $ INCLUDES
+ *  ----------------------------------------------------------------------------------------------------- **/
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include <atomic>
+#include <string>
+
+#include "hal.h"
+
+#ifndef WEBSERVER_MAX_CONNECTIONS
+    #define WEBSERVER_MAX_CONNECTIONS 8
+#endif
+
+#ifndef WEBSERVER_MAX_STREAMS
+    #define WEBSERVER_MAX_STREAMS 4
+#endif
+
+/**
+ * @brief Single-threaded HTTP server that multiplexes all connections with select()
+ *
+ * handleClient() runs one iteration of the event loop: it waits until a socket is readable or writable (at most
+ * poll_timeout_ms), accepts new connections, reads requests, dispatches complete ones to the registered handlers and
+ * writes responses without blocking. A slow client therefore only occupies its own connection slot. Connections are
+ * kept alive (HTTP/1.1 default) until the client closes them or they are idle for keep_alive_timeout_ms.
+ *
+ * Handlers keep the WebServer programming model: they run inside handleClient() and answer with send(), which
+ * queues the response on the connection that is being dispatched. sendFile() streams the file in chunks as the
+ * socket drains, so only one chunk per connection is held in RAM.
+ *
+ * One route can be registered as a Server-Sent Events stream. Producers call notify() from any task, the event loop
+ * wakes up, formats the newest event once and writes it to every subscriber whose previous event has drained. A slow
+ * subscriber therefore skips intermediate events instead of queueing them, and is dropped when its pending event does
+ * not drain within keep_alive_timeout_ms. The producer never waits for the network.
+ */
+class AsyncHttpServer : public hal::HttpServer
+{
+public:
+    /**
+     * @brief Writes the data of the current event into dest (without the "data: " framing)
+     *
+     * @return length of the data, 0 if there is no event to send
+     */
+    using EventFormatter = size_t (*)(char* dest, size_t size);
+
+    explicit AsyncHttpServer(uint16_t port, uint32_t poll_timeout_ms = 250, uint32_t keep_alive_timeout_ms = 5'000);
+
+    /**
+     * @brief Register a handler for an exact path (query strings are ignored), uri must outlive the server
+     *
+     */
+    void on(const char* uri, hal::HttpHandler handler) override;
+    void collectHeaders(const char** names, size_t count) override {}
+    void begin() override;
+    void handleClient() override;
+    bool header(const char* name, char* dest, size_t size) override;
+    bool arg(const char* name, char* dest, size_t size) override;
+    void sendHeader(const char* name, const char* value) override;
+    void send(int code, const char* content_type, const char* content, size_t length) override;
+    bool sendFile(const char* content_type, const char* path) override;
+
+    /**
+     * @brief Serve uri as a text/event-stream, at most WEBSERVER_MAX_STREAMS subscribers (others get a 503)
+     *
+     */
+    void on_event_stream(const char* uri, EventFormatter formatter);
+
+    /**
+     * @brief Signal that a new event is available for the stream, safe to call from any task
+     *
+     */
+    void notify();
+
+    uint8_t open_connections() const;
+    uint8_t open_streams() const;
+
+private:
+    constexpr static const uint8_t  MAX_ROUTES      = 16;
+    constexpr static const uint16_t RX_BUFFER_SIZE  = 1'024;
+    constexpr static const uint8_t  MAX_CONNECTIONS = WEBSERVER_MAX_CONNECTIONS;
+    constexpr static const uint8_t  MAX_STREAMS     = WEBSERVER_MAX_STREAMS;
+    constexpr static const uint16_t FILE_CHUNK_SIZE = 1'024;
+    constexpr static const uint16_t EVENT_DATA_SIZE = 256;
+    constexpr static const uint32_t HEARTBEAT_MS    = 15'000;
+
+    struct Route
+    {
+        const char*      uri;
+        hal::HttpHandler handler;
+    };
+
+    struct Connection
+    {
+        int         socket            = -1;
+        uint32_t    last_activity_ms  = 0;
+        char        rx[RX_BUFFER_SIZE] = {'\0'};
+        size_t      rx_length         = 0;
+        std::string tx;
+        size_t      tx_offset         = 0;
+        bool        close_after_flush = false;
+        FILE*       file              = nullptr;  // Rest of the response body, read into tx as it drains
+        bool        is_stream         = false;
+        uint32_t    event_version     = 0;  // Last stream event queued on this connection
+
+        bool is_sending() const { return tx_offset < tx.size() || file != nullptr; }
+    };
+
+    struct Request
+    {
+        const char* path;
+        size_t      path_length;
+        const char* query;
+        size_t      query_length;
+        const char* headers;
+        size_t      headers_length;
+    };
+
+    void accept_connections(uint32_t now_ms);
+    void receive(Connection& connection, uint32_t now_ms);
+    void process(Connection& connection);
+    bool flush(Connection& connection);
+    void close_connection(Connection& connection);
+    void send_error(Connection& connection, int code);
+    void append_head(int code, const char* content_type, size_t length);
+    void open_stream(Connection& connection);
+    void push_events(uint32_t now_ms);
+    void open_wake_socket();
+
+    uint16_t   port;
+    uint32_t   poll_timeout_ms;
+    uint32_t   keep_alive_timeout_ms;
+    int        listen_socket = -1;
+    Route      routes[MAX_ROUTES];
+    uint8_t    route_count = 0;
+    Connection connections[MAX_CONNECTIONS];
+
+    // Event stream, published_version is bumped by notify() and compared against the formatted event
+    const char*           stream_uri         = nullptr;
+    EventFormatter        stream_formatter   = nullptr;
+    std::atomic<uint32_t> published_version  = 0;
+    uint32_t              formatted_version  = 0;
+    std::string           event;
+    int                   wake_socket        = -1;  // Readable after notify(), part of the select() set
+    int                   wake_notify_socket = -1;  // Connected to wake_socket, written by notify()
+
+    // State of the request being dispatched to a handler
+    Connection*    current_connection = nullptr;
+    const Request* current_request    = nullptr;
+    bool           current_keep_alive = true;
+    bool           current_answered   = false;
+    std::string    pending_headers;
+};
@@ -0,0 +1,379 @@
+/** -----------------------------------------------------------------------------------------------------
+ * @file coroutine_runtime.h
+ *
+ * @brief Cooperative C++20 coroutines on one task: frames from a fixed arena, awaitable sleeps, queues, ADC and sockets
+ * @version 0.1
+ * @date 2024-2025
+ *  ----------------------------------------------------------------------------------------------------- **/
+
+#pragma once
+
+/** -----------------------------------------------------------------------------------------------------
+ * $ INCLUDES
+ *  ----------------------------------------------------------------------------------------------------- **/
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include <coroutine>
+#include <exception>
+
+#include "hal.h"
+#include "seqlock.h"
+
+class CoroutineScheduler;
+
+/**
+ * @brief Fixed-size slots for coroutine frames in memory given once, no heap after that
+ *
+ * A frame that does not fit a slot, or a full arena, fails the call of the coroutine (its Coroutine is empty) instead
+ * of allocating. largest_request in the stats is the biggest frame asked for, slot_size can be trimmed to it.
+ * Not thread-safe: frames are created and destroyed by the task of the scheduler, or before it runs.
+ */
+class CoroutineArena
+{
+public:
+    CoroutineArena(void* storage, size_t size, size_t slot_size);
+
+    void* allocate(size_t size);
+
+    /**
+     * @brief Return frame to the arena it came from
+     *
+     */
+    static void release(void* frame);
+
+    size_t slot_size() const { return frame_size; }
+    size_t slot_count() const { return count; }
+    size_t slots_used() const { return used; }
+    size_t slots_max_used() const { return max_used; }
+    size_t largest_request() const { return largest; }
+
+private:
+    // Every slot starts with the arena it belongs to, aligned like the frame behind it
+    struct alignas(alignof(max_align_t)) SlotHeader
+    {
+        CoroutineArena* arena;
+    };
+
+    struct FreeSlot
+    {
+        FreeSlot* next;
+    };
+
+    size_t    frame_size;
+    size_t    count     = 0;
+    size_t    used      = 0;
+    size_t    max_used  = 0;
+    size_t    largest   = 0;
+    FreeSlot* free_list = nullptr;
+};
+
+/**
+ * @brief Return type of a coroutine: lazily started, either spawned on a scheduler or awaited by another coroutine
+ *
+ * The frame comes from the arena of the scheduler, which has to be the only parameter of the coroutine (a free
+ * function, not a member): Coroutine sampling(CoroutineScheduler& scheduler). Anything else compiles to no
+ * allocation function rather than falling back to the heap. co_await on a child runs it to its end and yields true,
+ * false when there was no room for its frame. A spawned coroutine frees its frame when it returns.
+ */
+class Coroutine
+{
+public:
+    struct promise_type
+    {
+        explicit promise_type(CoroutineScheduler& scheduler) : scheduler(scheduler) {}
+
+        // Not templates: GCC pairs a template operator new with no operator delete and warns at every coroutine
+        static void* operator new(size_t size, CoroutineScheduler& scheduler) noexcept;
+        static void  operator delete(void* frame) { CoroutineArena::release(frame); }
+
+        static Coroutine get_return_object_on_allocation_failure() { return Coroutine(nullptr); }
+
+        Coroutine get_return_object() { return Coroutine(std::coroutine_handle<promise_type>::from_promise(*this)); }
+
+        std::suspend_always initial_suspend() noexcept { return {}; }
+
+        struct FinalAwaiter
+        {
+            bool                    await_ready() noexcept { return false; }
+            std::coroutine_handle<> await_suspend(std::coroutine_handle<promise_type> handle) noexcept;
+            void                    await_resume() noexcept {}
+        };
+
+        FinalAwaiter final_suspend() noexcept { return {}; }
+
+        void return_void() {}
+        void unhandled_exception() { std::terminate(); }
+
+        CoroutineScheduler&     scheduler;
+        std::coroutine_handle<> continuation = nullptr;  // Awaiting parent, resumed when this one returns
+        bool                    is_spawned   = false;    // Owned by the scheduler, freed by it at the end
+    };
+
+    using Handle = std::coroutine_handle<promise_type>;
+
+    explicit Coroutine(Handle handle) : handle(handle) {}
+    Coroutine(Coroutine&& other) noexcept : handle(other.handle) { other.handle = nullptr; }
+    ~Coroutine()
+    {
+        if (handle) { handle.destroy(); }
+    }
+
+    Coroutine(const Coroutine&)            = delete;
+    Coroutine& operator=(const Coroutine&) = delete;
+    Coroutine& operator=(Coroutine&&)      = delete;
+
+    explicit operator bool() const { return static_cast<bool>(handle); }
+
+    auto operator co_await() && noexcept
+    {
+        struct ChildAwaiter
+        {
+            bool await_ready() noexcept { return !child; }
+
+            // Symmetric transfer: the child runs right away on this stack, it resumes the parent when it returns
+            std::coroutine_handle<> await_suspend(std::coroutine_handle<> parent) noexcept
+            {
+                child.promise().continuation = parent;
+                return child;
+            }
+
+            bool await_resume() noexcept { return static_cast<bool>(child); }
+
+            Handle child;
+        };
+
+        return ChildAwaiter{.child = handle};
+    }
+
+private:
+    friend class CoroutineScheduler;
+
+    Handle handle;
+};
+
+/**
+ * @brief Suspends the coroutine that awaits it until poll() succeeds or the deadline passes
+ *
+ * co_await yields true when the event came and false on timeout. The awaiters below cover the waits of the firmware,
+ * a new kind of event only needs a subclass with its own poll().
+ */
+class CoroutineWait
+{
+public:
+    bool await_ready();
+    void await_suspend(std::coroutine_handle<> handle);
+    bool await_resume() const { return is_done; }
+
+protected:
+    /**
+     * @param timeout_ms from now, hal::WAIT_FOREVER for none
+     * @param is_polled poll() is asked every time the scheduler wakes, otherwise only the deadline counts
+     */
+    CoroutineWait(CoroutineScheduler& scheduler, uint32_t timeout_ms, bool is_polled);
+    CoroutineWait(CoroutineScheduler& scheduler, uint64_t deadline_us);
+
+    /**
+     * @brief Take the event without blocking, true if there was one
+     *
+     */
+    virtual bool poll() { return false; }
+
+private:
+    friend class CoroutineScheduler;
+
+    CoroutineScheduler&     scheduler;
+    uint64_t                deadline_us;  // UINT64_MAX for none
+    bool                    is_polled;
+    bool                    is_done = false;
+    std::coroutine_handle<> handle  = nullptr;
+};
+
+class CoroutineSleep : public CoroutineWait
+{
+public:
+    CoroutineSleep(CoroutineScheduler& scheduler, uint64_t wake_us) : CoroutineWait(scheduler, wake_us) {}
+};
+
+class CoroutineReceive : public CoroutineWait
+{
+public:
+    CoroutineReceive(CoroutineScheduler& scheduler, hal::Queue& queue, void* item, uint32_t timeout_ms) :
+        CoroutineWait(scheduler, timeout_ms, true), queue(queue), item(item)
+    {
+    }
+
+protected:
+    bool poll() override { return queue.receive(item, 0); }
+
+private:
+    hal::Queue& queue;
+    void*       item;
+};
+
+/**
+ * @brief Next frame of the ADC stream, co_await yields the number of codes copied into dest, 0 on timeout
+ *
+ */
+class CoroutineAdcFrame : public CoroutineWait
+{
+public:
+    CoroutineAdcFrame(CoroutineScheduler& scheduler, uint16_t* dest, size_t capacity, uint32_t timeout_ms) :
+        CoroutineWait(scheduler, timeout_ms, true), dest(dest), capacity(capacity)
+    {
+    }
+
+    size_t await_resume() const { return count; }
+
+protected:
+    bool poll() override
+    {
+        count = hal::adc_stream_read(dest, capacity, 0);
+        return count > 0;
+    }
+
+private:
+    uint16_t* dest;
+    size_t    capacity;
+    size_t    count = 0;
+};
+
+class CoroutineReadable : public CoroutineWait
+{
+public:
+    CoroutineReadable(CoroutineScheduler& scheduler, int socket, uint32_t timeout_ms) :
+        CoroutineWait(scheduler, timeout_ms, true), socket(socket)
+    {
+    }
+
+protected:
+    bool poll() override;
+
+private:
+    int socket;
+};
+
+/**
+ * @brief Any condition without a queue of its own, e.g. a non-blocking take: condition(context) true ends the wait
+ *
+ */
+class CoroutineCondition : public CoroutineWait
+{
+public:
+    using Condition = bool (*)(void* context);
+
+    CoroutineCondition(CoroutineScheduler& scheduler, Condition condition, void* context, uint32_t timeout_ms) :
+        CoroutineWait(scheduler, timeout_ms, true), condition(condition), context(context)
+    {
+    }
+
+protected:
+    bool poll() override { return condition(context); }
+
+private:
+    Condition condition;
+    void*     context;
+};
+
+struct CoroutineStats
+{
+    uint32_t resumes;        // Switches into a coroutine
+    uint32_t wakeups;        // Waits of the task for the next deadline or notify()
+    uint8_t  coroutines;     // Spawned and not returned yet
+    uint8_t  waiting;        // Suspended on a CoroutineWait
+    uint16_t arena_slot_size;
+    uint8_t  arena_slots;
+    uint8_t  arena_slots_used;
+    uint8_t  arena_slots_max_used;
+    uint16_t arena_largest_request;
+};
+
+/**
+ * @brief Runs coroutines on the task that calls run(), each until it awaits, in the order they became ready
+ *
+ * Instead of one FreeRTOS task (and stack) per loop, the loops are coroutines on one task: a suspended coroutine
+ * costs its frame in the arena, not a stack. The price is that they share the task: a coroutine runs until its next
+ * co_await, so a long computation delays the others and is best split with yield().
+ *
+ * When nothing is ready the task sleeps until the earliest deadline or the next notify(). Events of other tasks
+ * (queues, ADC frames, sockets) only reach it that way, so by default the waits on them are also polled every poll_ms
+ * while any exists. When every producer calls notify() after sending, or sends to notify_queue() from its interrupt,
+ * NO_POLLING lets the task sleep until then. Deadlines have the resolution of the scheduler tick (1 ms on the board).
+ */
+class CoroutineScheduler
+{
+public:
+    constexpr static const uint8_t  MAX_COROUTINES = 16;
+    constexpr static const uint32_t NO_POLLING     = 0;  // poll_ms: waits are checked only on notify and deadlines
+
+    CoroutineScheduler(CoroutineArena& arena, uint32_t poll_ms = 10);
+
+    /**
+     * @brief Create the wake queue, before the first notify()
+     *
+     */
+    bool begin();
+
+    /**
+     * @brief Hand coroutine over to the scheduler, it starts on the next round
+     *
+     * @return false if it has no frame (arena full) or MAX_COROUTINES are running
+     */
+    bool spawn(Coroutine&& coroutine);
+
+    [[noreturn]] void run();
+
+    /**
+     * @brief One round: wake the waits that are done, resume everything ready and sleep if nothing is left ready
+     *
+     */
+    void run_once();
+
+    /**
+     * @brief Wake the scheduler from any task, e.g. after sending to a queue a coroutine receives from
+     *
+     */
+    void notify();
+
+    /**
+     * @brief Sending any byte to it is notify(), for interrupts (pin_interrupt_once(), adc_stream_begin())
+     *
+     */
+    hal::Queue* notify_queue() { return wake_queue; }
+
+    CoroutineSleep     sleep_ms(uint32_t ms) { return CoroutineSleep(*this, hal::micros() + ms * 1'000ULL); }
+    CoroutineSleep     sleep_until_us(uint64_t wake_us) { return CoroutineSleep(*this, wake_us); }
+    CoroutineSleep     yield() { return CoroutineSleep(*this, 0); }  // To the back of the ready coroutines
+    CoroutineReceive   receive(hal::Queue& queue, void* item, uint32_t timeout_ms = hal::WAIT_FOREVER);
+    CoroutineAdcFrame  adc_frame(uint16_t* dest, size_t capacity, uint32_t timeout_ms = hal::WAIT_FOREVER);
+    CoroutineReadable  readable(int socket, uint32_t timeout_ms = hal::WAIT_FOREVER);
+    CoroutineCondition until(CoroutineCondition::Condition condition,
+                             void*                         context,
+                             uint32_t                      timeout_ms = hal::WAIT_FOREVER);
+
+    CoroutineArena& arena() { return frames; }
+
+    bool stats(CoroutineStats& dest) const { return published.try_read(dest); }
+
+private:
+    friend class Coroutine;
+    friend class CoroutineWait;
+
+    void make_ready(std::coroutine_handle<> handle);
+    void park(CoroutineWait& wait);
+    void publish();
+
+    CoroutineArena&         frames;
+    uint32_t                poll_ms;
+    hal::Queue*             wake_queue                 = nullptr;
+    std::coroutine_handle<> ready[MAX_COROUTINES]      = {};  // Ring
+    uint8_t                 ready_head                 = 0;
+    uint8_t                 ready_count                = 0;
+    CoroutineWait*          waits[MAX_COROUTINES]      = {};  // In the order they were parked
+    uint8_t                 wait_count                 = 0;
+    uint8_t                 coroutine_count            = 0;
+    std::coroutine_handle<> finished                   = nullptr;  // Spawned coroutine that returned during resume()
+    CoroutineStats          totals                     = {};
+    Seqlock<CoroutineStats> published;
+};
@@ -0,0 +1,213 @@
+/** -----------------------------------------------------------------------------------------------------
+ * @file display_renderer.h
+ *
+ * @brief Single owner of the display and its SPI bus, drawing widgets from a command queue between touch samples
+ * @version 0.1
+ * @date 2024-2025
+ *  ----------------------------------------------------------------------------------------------------- **/
+
+#pragma once
+
+/** -----------------------------------------------------------------------------------------------------
+ * $ INCLUDES
+ *  ----------------------------------------------------------------------------------------------------- **/
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include <atomic>
+
+#include "hal.h"
+#include "seqlock.h"
+#include "touch_gestures.h"
+
+constexpr static const size_t DISPLAY_TEXT_SIZE = 96;
+
+enum DisplayFlags : uint8_t
+{
+    DISPLAY_CLEAR_SCREEN = 0x01,  // Clear the screen before the widget is drawn
+    DISPLAY_TOUCH_WAKE   = 0x02,  // Sent by the touch interrupt, start sampling the touch controller
+};
+
+struct DisplayCommand
+{
+    uint8_t  widget;     // Index into the widget table of the renderer
+    uint8_t  flags;      // DisplayFlags
+    uint16_t color;      // Foreground color, widgets may ignore it
+    uint32_t posted_us;  // micros() when posted, for the latency statistics
+    char     text[DISPLAY_TEXT_SIZE];
+};
+
+struct DisplayRect
+{
+    int16_t x;
+    int16_t y;
+    int16_t w;
+    int16_t h;
+
+    bool contains(int32_t px, int32_t py) const { return px >= x && px < x + w && py >= y && py < y + h; }
+    bool intersects(const DisplayRect& other) const
+    {
+        return x < other.x + other.w && other.x < x + w && y < other.y + other.h && other.y < y + h;
+    }
+};
+
+/**
+ * @brief Draws a widget into a sprite that covers part of the screen, area is the widget bounds in sprite coordinates
+ *
+ */
+using DisplayDraw = void (*)(hal::Sprite& sprite, const DisplayRect& area, const DisplayCommand& command);
+
+struct DisplayWidget
+{
+    DisplayRect bounds;         // Screen area the widget owns, also its touch area
+    DisplayDraw draw;           // nullptr for text: one line per row of line_height, only changed spans are redrawn
+    uint8_t     font;           // Text font and size, text widgets only
+    uint8_t     text_size;
+    int16_t     line_height;
+    bool        is_persistent;  // Redrawn with its last command after a screen clear, otherwise cleared with it
+    bool        is_touchable;   // Found by hit_test()
+};
+
+struct DisplayStats
+{
+    uint32_t frames;           // Render passes that drew at least one widget
+    uint32_t commands;         // Taken from the queue
+    uint32_t coalesced;        // Replaced by a newer command for the same widget before they were drawn
+    uint32_t dropped;          // Not posted because the queue stayed full
+    uint32_t touch_samples;    // Touch controller reads, only while a press is in progress
+    uint32_t touches;          // Touch events passed on to take_touch()
+    uint32_t latency_max_us;   // From post() to the draw call of the command
+    uint32_t latency_mean_us;
+    uint64_t pixels_pushed;    // Sprite and screen clear pixels sent to the display
+    uint32_t frame_max_us;     // From the start of a frame until its last transfer completed
+    uint32_t frame_mean_us;
+};
+
+/**
+ * @brief Only the render task draws or reads touch, every other task posts compact commands
+ *
+ * Each pass waits for commands until the next touch sample is due, takes everything that is queued and keeps only
+ * the newest command per widget, so a burst of updates to one widget costs a single draw. The staged widgets are then
+ * drawn in the order of their newest commands.
+ *
+ * Touch is interrupt driven: while nobody touches the panel the render task sleeps on the queue and the touch
+ * controller is not read at all. The falling edge of its IRQ line posts a wake command, then the controller is sampled
+ * every TOUCH_PERIOD_MS between frames, never while the bus is busy drawing, until the press has ended. The samples
+ * go through TouchGestures and each press reaches the touch task as one event through take_touch().
+ *
+ * The screen is retained: the renderer remembers what every widget shows and only pushes the rectangles that
+ * changed. A text line that keeps its color is redrawn from its first changed character to the end of the longer of
+ * the old and new line, so a turbidity refresh that changes a few digits pushes a few hundred pixels instead of its
+ * rows across the full width. Dirty rectangles are drawn into off-screen sprites of at most MAX_SPRITE_PIXELS and
+ * pushed with DMA, alternating two sprites so the next one is drawn while the previous one is sent. Nothing is
+ * cleared on screen before it is drawn, so nothing flickers.
+ */
+class DisplayRenderer
+{
+public:
+    constexpr static const uint8_t  MAX_WIDGETS       = 8;
+    constexpr static const uint8_t  QUEUE_DEPTH       = 16;
+    constexpr static const uint8_t  TOUCH_DEPTH       = 4;
+    constexpr static const uint32_t TOUCH_PERIOD_MS   = 20;
+    constexpr static const uint32_t POST_TIMEOUT_MS   = 20;      // About one frame, how long post() waits for room
+    constexpr static const int32_t  MAX_SPRITE_PIXELS = 12'288;  // 24 kB per RGB565 sprite, larger areas go in bands
+
+    constexpr static const TouchGestures::Config TOUCH_GESTURES = {
+        .press_ms      = 20,
+        .release_ms    = 60,
+        .long_press_ms = 800,
+        .swipe_px      = 40,
+    };
+
+    DisplayRenderer(hal::Display& display, const DisplayWidget* widgets, uint8_t count);
+
+    using TouchCallback = void (*)();
+
+    /**
+     * @brief Create the queues and arm the touch interrupt on touch_irq_pin (active low), before any task posts
+     *
+     * on_touch is called on the render task after each event that take_touch() can now return, for a reader that
+     * does not block in take_touch().
+     */
+    bool begin(uint8_t touch_irq_pin, TouchCallback on_touch = nullptr);
+
+    /**
+     * @brief Queue text for widget, safe to call from any task except the render task
+     *
+     * @return false if the queue stayed full for timeout_ms, the command is dropped
+     */
+    bool post(uint8_t     widget,
+              const char* text,
+              uint16_t    color      = hal::COLOR_WHITE,
+              uint8_t     flags      = 0,
+              uint32_t    timeout_ms = POST_TIMEOUT_MS);
+
+    /**
+     * @brief Render task body: start the display in rotation, allocate the sprites and render() forever
+     *
+     * @param on_first_frame called once from the render task after the first frame was pushed, may be nullptr
+     */
+    [[noreturn]] void run(uint8_t rotation, void (*on_first_frame)() = nullptr);
+
+    /**
+     * @brief One pass: wait up to wait_ms for commands, draw them coalesced and sample touch when it is due
+     *
+     * run() waits forever while no press is in progress.
+     */
+    void render(uint32_t wait_ms);
+
+    /**
+     * @brief Wait up to timeout_ms for the next touch event, in raw display coordinates
+     *
+     */
+    bool take_touch(TouchEvent& event, uint32_t timeout_ms);
+
+    /**
+     * @brief Touchable widget whose bounds contain the point in screen coordinates, safe to call from any task
+     *
+     * @return Widget index, or -1 if no touchable widget is there
+     */
+    int8_t hit_test(int32_t x, int32_t y) const;
+
+    DisplayStats stats() const;
+
+private:
+    void stage(const DisplayCommand& command);
+    void draw_staged();
+    void draw_text(uint8_t widget);
+    void push_area(uint8_t widget, const DisplayRect& area, const char* line, int16_t line_y);
+    void sample_touch();
+    void arm_touch();
+
+    hal::Display&         display;
+    const DisplayWidget*  widgets;
+    uint8_t               count;
+    hal::Queue*           commands   = nullptr;
+    hal::Queue*           touches    = nullptr;
+    hal::Sprite*          sprites[2] = {};  // Alternated, one is drawn while the other is pushed
+    std::atomic<uint32_t> dropped    = 0;
+    Seqlock<DisplayStats> published;
+    uint8_t               touch_irq_pin = 0;
+    DisplayCommand        touch_wake    = {};  // Copied into the queue by the touch interrupt
+    TouchCallback         on_touch      = nullptr;
+
+    // Owned by the render task
+    DisplayCommand current[MAX_WIDGETS]   = {};  // Newest command per widget, redrawn after a screen clear
+    DisplayCommand drawn[MAX_WIDGETS]     = {};  // Command on screen, text lines are diffed against it
+    uint32_t       order[MAX_WIDGETS]     = {};  // Sequence of the newest command, widgets are drawn in this order
+    bool           is_shown[MAX_WIDGETS]  = {};
+    bool           is_dirty[MAX_WIDGETS]  = {};
+    bool           is_posted[MAX_WIDGETS] = {};  // Staged from the queue, not only redrawn after a clear
+    bool           is_stale[MAX_WIDGETS]  = {};  // Overdrawn by another widget, drawn again in full
+    bool           is_clear_pending       = false;
+    uint32_t       sequence               = 0;
+    uint32_t       last_touch_ms          = 0;
+    bool           is_touch_awake         = false;  // Sampling until gestures has no press in progress
+    TouchGestures  gestures{TOUCH_GESTURES};
+    uint64_t       latency_total_us       = 0;
+    uint32_t       latency_count          = 0;
+    uint8_t        next_sprite            = 0;
+    uint64_t       frame_total_us         = 0;
+    DisplayStats   totals                 = {};
+};
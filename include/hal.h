@@ -0,0 +1,420 @@
+/** -----------------------------------------------------------------------------------------------------
+ * @file hal.h
+ *
+ * @brief Thin hardware abstraction layer between the control pipeline and the board.
+ *
+ * The firmware (env:lolin32) implements this interface on top of Arduino, FreeRTOS, TFT_eSPI, the RMT
+ * peripheral, WebServer and WiFiManager in hal_esp32.cpp. The host build (env:native) implements it with fakes in
+ * hal_native.cpp, so the sampling, conversion, clean-detection and pump logic can be built and run on Linux.
+ * @version 0.1
+ * @date 2024-2025
+ *  ----------------------------------------------------------------------------------------------------- **/
+
+#pragma once
+
+/** -----------------------------------------------------------------------------------------------------
+ * $ INCLUDES
+ *  ----------------------------------------------------------------------------------------------------- **/
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdarg.h>
+#include <stdio.h>
+
+#ifdef ARDUINO
+    #include <esp32-hal-log.h>
+    #include <pins_arduino.h>
+#else
+    #define log_e(format, ...) hal::log('E', format, ##__VA_ARGS__)
+    #define log_w(format, ...) hal::log('W', format, ##__VA_ARGS__)
+    #define log_i(format, ...) hal::log('I', format, ##__VA_ARGS__)
+    #define log_d(format, ...) hal::log('D', format, ##__VA_ARGS__)
+#endif
+
+namespace hal
+{
+    /** -------------------------------------------------------------------------------------------------
+     * $ TYPES
+     *  ------------------------------------------------------------------------------------------------- **/
+
+    /**
+     * @brief RGB565 colors, values identical to the TFT_eSPI color definitions
+     *
+     */
+    enum Color : uint16_t
+    {
+        COLOR_BLACK  = 0x0000,
+        COLOR_WHITE  = 0xFFFF,
+        COLOR_RED    = 0xF800,
+        COLOR_GREEN  = 0x07E0,
+        COLOR_YELLOW = 0xFFE0,
+        COLOR_ORANGE = 0xFDA0,
+    };
+
+    /**
+     * @brief Text reference points, values identical to the TFT_eSPI datum definitions
+     *
+     */
+    enum Datum : uint8_t
+    {
+        DATUM_TOP_LEFT      = 0,
+        DATUM_MIDDLE_CENTER = 4,
+    };
+
+    /**
+     * @brief Heap of the data memory, largest_free_block against free_bytes shows how fragmented it is
+     *
+     */
+    struct HeapInfo
+    {
+        size_t free_bytes;
+        size_t minimum_free_bytes;  // Lowest free_bytes since boot
+        size_t largest_free_block;  // Largest single allocation that would succeed now
+    };
+
+    /**
+     * @brief State of one task, see task_list()
+     *
+     */
+    struct TaskInfo
+    {
+        char     name[16];
+        uint32_t run_time_us;     // CPU time since boot, wraps; differences give the CPU share, 0 without statistics
+        uint32_t stack_size;      // Bytes, 0 unless the task was created with task_create()
+        uint32_t stack_free_min;  // Least free stack in bytes since the task started (high-water mark), 0 if unknown
+        uint8_t  priority;
+        int8_t   core;            // -1 when the task may run on either core
+        bool     is_idle;         // Idle task of its core, its CPU time is what the core had to spare
+    };
+
+    constexpr static const uint32_t WAIT_FOREVER = UINT32_MAX;  // Timeout of a Queue call that never gives up
+
+    using TaskFunction  = void (*)(void*);
+    using HttpHandler   = void (*)();
+    using PortalHandler = void (*)(const char* portal_ssid, const char* portal_ip);
+    using FsListHandler = void (*)(const char* name, void* context);
+
+    /**
+     * @brief Mutex with a bounded take, backed by a FreeRTOS mutex or a std::timed_mutex
+     *
+     */
+    class Mutex
+    {
+    public:
+        virtual ~Mutex() = default;
+
+        virtual bool take(uint32_t timeout_ms) = 0;
+        virtual void give()                    = 0;
+    };
+
+    /**
+     * @brief Fixed-size FIFO of fixed-size items between tasks, backed by a FreeRTOS queue or a condition variable
+     *
+     * Items are copied in and out. Both calls wait up to timeout_ms, 0 polls and WAIT_FOREVER blocks.
+     */
+    class Queue
+    {
+    public:
+        virtual ~Queue() = default;
+
+        virtual bool send(const void* item, uint32_t timeout_ms) = 0;
+        virtual bool receive(void* item, uint32_t timeout_ms)    = 0;
+    };
+
+    /**
+     * @brief Display and touch controller (TFT_eSPI), all drawing goes through sprites
+     *
+     * Drawing and touch share the SPI bus. Sprites are pushed between startFrame() and endFrame(), which hold the bus
+     * for the frame and wait for the last DMA transfer. Not thread-safe, only the task of the DisplayRenderer calls it.
+     */
+    class Display
+    {
+    public:
+        virtual ~Display() = default;
+
+        virtual void    begin()                            = 0;
+        virtual int16_t width()                            = 0;
+        virtual int16_t height()                           = 0;
+        virtual void    setRotation(uint8_t rotation)      = 0;
+        virtual void    fillScreen(uint16_t color)         = 0;
+        virtual void    startFrame()                       = 0;
+        virtual void    endFrame()                         = 0;
+        virtual bool    getTouch(uint16_t* x, uint16_t* y) = 0;
+    };
+
+    /**
+     * @brief Off-screen RGB565 canvas (TFT_eSprite), drawn in its own coordinates and clipped to its size
+     *
+     * push() starts a DMA transfer to the display and returns, so the next sprite can be drawn while it runs. Only one
+     * transfer runs at a time. create() waits while the transfer of this sprite is still running, so alternating two
+     * sprites overlaps drawing with pushing. endFrame() waits for the last transfer.
+     */
+    class Sprite
+    {
+    public:
+        virtual ~Sprite() = default;
+
+        /**
+         * @brief (Re)allocate the pixels for w x h, keeps the buffer when the size is unchanged
+         *
+         */
+        virtual bool    create(int16_t w, int16_t h)                                                 = 0;
+        virtual void    fill(uint16_t color)                                                         = 0;
+        virtual void    fillRoundRect(int32_t x, int32_t y, int32_t w, int32_t h, int32_t r, uint16_t color) = 0;
+        virtual void    drawRoundRect(int32_t x, int32_t y, int32_t w, int32_t h, int32_t r, uint16_t color) = 0;
+        virtual void    setTextFont(uint8_t font)                                                    = 0;
+        virtual void    setTextColor(uint16_t fg_color, uint16_t bg_color)                           = 0;
+        virtual void    setTextSize(uint8_t size)                                                    = 0;
+        virtual void    setTextDatum(uint8_t datum)                                                  = 0;
+        virtual int16_t textWidth(const char* text)                                                  = 0;
+        virtual void    drawString(const char* text, int32_t x, int32_t y)                           = 0;
+        virtual void    push(int16_t x, int16_t y)                                                   = 0;
+    };
+
+    /**
+     * @brief Hardware pulse train on the STEP input of the motor driver (RMT on the ESP32)
+     *
+     * The peripheral times the pulses, intervals are in STEP_TICK_HZ ticks. run() holds the STEP line low for wait
+     * ticks (the rest of the step in progress), emits a stretch of a ramp table, ramp[from] up to ramp[to - 1] when
+     * from < to or ramp[from - 1] down to ramp[to] when from > to, and then repeats interval until the next call (0
+     * ends the pulse train after the ramp). stop() ends the pulse train at once and leaves the STEP line low. Not
+     * thread-safe, StepEngine serialises the calls.
+     */
+    class StepGenerator
+    {
+    public:
+        constexpr static const uint32_t STEP_TICK_HZ      = 1'000'000;
+        constexpr static const uint32_t MIN_STEP_INTERVAL = 4;       // Ticks, 250 kHz
+        constexpr static const uint32_t MAX_STEP_INTERVAL = 65'534;  // Ticks, two 15-bit RMT durations
+        constexpr static const uint16_t MAX_RAMP_STEPS    = 256;
+
+        virtual ~StepGenerator() = default;
+
+        virtual bool begin(uint8_t step_pin, uint8_t direction_pin)                                          = 0;
+        virtual void setDirection(bool forward)                                                              = 0;
+        virtual bool run(const uint16_t* ramp, uint16_t from, uint16_t to, uint32_t interval, uint32_t wait) = 0;
+        virtual void stop()                                                                                  = 0;
+    };
+
+    /**
+     * @brief Subset of the WebServer API used by the web interface
+     *
+     * header() and arg() copy a request header or query parameter into dest. sendFile() answers with a file of the
+     * data partition (status 200), a path ending in ".gz" is sent with Content-Encoding: gzip like
+     * WebServer::streamFile() does. It returns false if the file cannot be opened.
+     */
+    class HttpServer
+    {
+    public:
+        virtual ~HttpServer() = default;
+
+        virtual void on(const char* uri, HttpHandler handler)                                     = 0;
+        virtual void collectHeaders(const char** names, size_t count)                             = 0;
+        virtual void begin()                                                                      = 0;
+        virtual void handleClient()                                                               = 0;
+        virtual bool header(const char* name, char* dest, size_t size)                            = 0;
+        virtual bool arg(const char* name, char* dest, size_t size)                               = 0;
+        virtual void sendHeader(const char* name, const char* value)                              = 0;
+        virtual void send(int code, const char* content_type, const char* content, size_t length) = 0;
+        virtual bool sendFile(const char* content_type, const char* path)                         = 0;
+
+        void send(int code, const char* content_type, const char* content);
+    };
+
+    /**
+     * @brief Serial console (Serial on the board, stdout on the host)
+     *
+     */
+    class Console
+    {
+    public:
+        virtual ~Console() = default;
+
+        virtual void begin(uint32_t baud_rate) = 0;
+        virtual void print(const char* text)   = 0;
+
+        void println(const char* text = "");
+        void printf(const char* format, ...) __attribute__((format(printf, 2, 3)));
+    };
+
+    /** -------------------------------------------------------------------------------------------------
+     * $ DEVICES
+     *  ------------------------------------------------------------------------------------------------- **/
+
+    Display&       display();
+    Sprite*        sprite_create();
+    StepGenerator& step_generator();
+    HttpServer&    http_server();
+    Console&       console();
+
+    /** -------------------------------------------------------------------------------------------------
+     * $ GPIO & ADC
+     *  ------------------------------------------------------------------------------------------------- **/
+
+    void     pin_input(uint8_t pin);
+    void     pin_output(uint8_t pin);
+    void     pin_write(uint8_t pin, bool high);
+    bool     pin_read(uint8_t pin);
+    uint16_t adc_read(uint8_t pin);
+
+    /**
+     * @brief Send item to queue from the interrupt of the next falling edge of pin, once
+     *
+     * The first call makes pin an input with pull-up. The interrupt disarms itself when it sends, so a bouncing or
+     * toggling line costs one item; call again to wait for the next edge. item is copied when the edge comes and has
+     * to stay valid until then.
+     */
+    bool pin_interrupt_once(uint8_t pin, Queue* queue, const void* item);
+
+    /**
+     * @brief Convert pin continuously at sample_rate_hz into DMA frames of block_samples codes (adc_continuous)
+     *
+     * The pin then belongs to the stream, adc_read() must not be used on it any more. The ESP32 supports 20 kHz to
+     * 2 MHz on ADC1 pins.
+     *
+     * With frame_queue, item is sent to it from the conversion-done interrupt of every frame, so a reader that does
+     * not block in adc_stream_read() learns when to call it. A full queue drops the item. item has to stay valid.
+     */
+    bool adc_stream_begin(uint8_t     pin,
+                          uint32_t    sample_rate_hz,
+                          size_t      block_samples,
+                          Queue*      frame_queue = nullptr,
+                          const void* item        = nullptr);
+
+    /**
+     * @brief Wait up to timeout_ms for the next frame and copy its 12-bit codes into dest
+     *
+     * @return number of codes, 0 on timeout
+     */
+    size_t adc_stream_read(uint16_t* dest, size_t capacity, uint32_t timeout_ms);
+
+    /** -------------------------------------------------------------------------------------------------
+     * $ CLOCK
+     *  ------------------------------------------------------------------------------------------------- **/
+
+    uint32_t millis();
+    uint64_t micros();
+    void     delay_ms(uint32_t ms);
+
+    /**
+     * @brief Sleep until micros() reaches wake_us, returns at once when it has passed
+     *
+     * The board sleeps in whole scheduler ticks, so it wakes within a tick (1 ms) of wake_us.
+     */
+    void delay_until_us(uint64_t wake_us);
+
+    /**
+     * @brief Free-running cycle counter of the calling core, wraps every 2^32 cycles (about 18 s at 240 MHz)
+     *
+     * Every task is pinned to a core, so the difference of two reads in one task is the time between them.
+     */
+    uint32_t cycle_count();
+    uint32_t cycles_per_us();
+
+    /**
+     * @brief Seconds since the Unix epoch, 0 while the clock is not synchronised (SNTP starts on the first connection)
+     *
+     */
+    uint32_t unix_time();
+
+    /** -------------------------------------------------------------------------------------------------
+     * $ TASKS
+     *  ------------------------------------------------------------------------------------------------- **/
+
+    Mutex* mutex_create();
+    Queue* queue_create(size_t length, size_t item_size);
+    bool   task_create(TaskFunction function,
+                       const char*  name,
+                       uint32_t     stack_size,
+                       void*        parameter,
+                       uint8_t      priority,
+                       int8_t       core);
+
+    /**
+     * @brief Copy the state of up to capacity tasks into dest, system tasks included where the scheduler reports them
+     *
+     * Not thread-safe, meant for a single profiler.
+     *
+     * @return number of tasks copied
+     */
+    size_t task_list(TaskInfo* dest, size_t capacity);
+
+    /** -------------------------------------------------------------------------------------------------
+     * $ FILE SYSTEM
+     *  ------------------------------------------------------------------------------------------------- **/
+
+    /**
+     * @brief Mount the data partition (LittleFS on the board, the data/ directory of the project on the host)
+     *
+     */
+    bool fs_mount();
+
+    /**
+     * @brief stdio path of a file on the data partition, path is relative to its root (e.g. "/www/index.html.gz")
+     *
+     */
+    void fs_path(const char* path, char* dest, size_t size);
+
+    FILE* fs_open(const char* path, const char* mode);
+    bool  fs_remove(const char* path);
+    bool  fs_mkdir(const char* path);
+
+    /**
+     * @brief Call handler with the name of every entry in directory path
+     *
+     * @return false if the directory cannot be opened
+     */
+    bool fs_list(const char* path, FsListHandler handler, void* context);
+
+    /** -------------------------------------------------------------------------------------------------
+     * $ NETWORK & SYSTEM
+     *  ------------------------------------------------------------------------------------------------- **/
+
+    /**
+     * @brief Start joining the network of the stored credentials and return at once, wifi_connected() tells the outcome
+     *
+     * With use_cached the scan is skipped and the access point (BSSID and channel) of the last connection is joined
+     * directly, which takes a fraction of the time. The first connection starts SNTP.
+     *
+     * @return false if there are no stored credentials
+     */
+    bool wifi_begin(bool use_cached);
+
+    /**
+     * @brief Abandon the current connection or attempt, the credentials stay stored
+     *
+     */
+    void wifi_disconnect();
+
+    /**
+     * @brief Open the configuration portal (an access point named portal_ssid) without waiting for it
+     *
+     * on_portal is called once the access point is up. The portal closes itself after timeout_s without a client.
+     */
+    bool wifi_portal_begin(const char* portal_ssid, uint16_t timeout_s, PortalHandler on_portal);
+
+    /**
+     * @brief Serve the open portal, call it every few tens of ms
+     *
+     * Saving credentials in the portal joins that network, which blocks the caller until it succeeds or times out.
+     *
+     * @return false once the portal has closed
+     */
+    bool wifi_portal_process();
+
+    bool wifi_connected();
+
+    /**
+     * @brief The attempt started by wifi_begin() has given up, e.g. the access point was not found or refused it
+     *
+     */
+    bool wifi_failed();
+
+    void wifi_local_ip(char* dest, size_t size);
+    void wifi_reset_settings();
+    void restart();
+
+    HeapInfo heap_info();
+
+    void log(char level, const char* format, ...) __attribute__((format(printf, 2, 3)));
+}  // namespace hal
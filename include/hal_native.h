@@ -0,0 +1,112 @@
+/** -----------------------------------------------------------------------------------------------------
+ * @file hal_native.h
+ *
+ * @brief Controls for the fakes behind the host (env:native) hardware abstraction layer
+ * @version 0.1
+ * @date 2024-2025
+ *  ----------------------------------------------------------------------------------------------------- **/
+
+#pragma once
+
+/** -----------------------------------------------------------------------------------------------------
+ * $ INCLUDES
+ *  ----------------------------------------------------------------------------------------------------- **/
+
+#include <stdint.h>
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "hal.h"
+
+namespace hal::native
+{
+    using AdcSource   = uint16_t (*)(uint8_t pin);
+    using HttpHeaders = std::map<std::string, std::string>;
+
+    struct HttpResponse
+    {
+        int         code = 0;
+        std::string content_type;
+        std::string content;
+        HttpHeaders headers;
+    };
+
+    struct StepTiming
+    {
+        uint32_t steps;          // Since boot or step_timing_reset()
+        uint32_t interval;       // Programmed step interval in STEP_TICK_HZ ticks (us), 0 when stopped
+        uint64_t full_speed_us;  // From the last run() to its first step at interval, 0 before
+        double   mean_interval_us;
+        uint32_t min_interval_us;
+        uint32_t max_interval_us;
+        double   jitter_rms_us;  // Deviation of the measured from the programmed interval
+        double   jitter_max_us;
+    };
+
+    /**
+     * @brief Replace the fake ADC with a custom source (e.g. a recorded trace), nullptr restores the fixed values
+     *
+     */
+    void set_adc_source(AdcSource source);
+
+    /**
+     * @brief Set the fixed 12-bit value returned by the fake ADC for a pin
+     *
+     */
+    void set_adc_value(uint8_t pin, uint16_t value);
+
+    /**
+     * @brief Level last written to an output pin
+     *
+     */
+    bool pin_state(uint8_t pin);
+
+    /**
+     * @brief Drive an input pin, a falling edge fires the interrupt armed by pin_interrupt_once()
+     *
+     */
+    void set_pin_input(uint8_t pin, bool high);
+
+    /**
+     * @brief Press the fake touch panel at x, y or release it, getTouch() reports it from then on
+     *
+     */
+    void set_touch(bool touched, uint16_t x = 0, uint16_t y = 0);
+
+    /**
+     * @brief getTouch() calls since boot, each one is an SPI transaction on the board
+     *
+     */
+    uint32_t touch_reads();
+
+    /**
+     * @brief Timing of the steps recorded by the simulated step generator since boot or step_timing_reset()
+     *
+     * Intervals are compared with the programmed ones (ramp and cruise) within one run() command, over the last 4096
+     * steps.
+     */
+    StepTiming step_timing();
+
+    /**
+     * @brief Host timestamps (micros()) of the last 4096 steps, oldest first
+     *
+     */
+    std::vector<uint64_t> step_timestamps();
+
+    void step_timing_reset();
+
+    /**
+     * @brief Dispatch a request to the handler registered for uri, as if a client requested it
+     *
+     * @return false if no handler is registered for uri
+     */
+    bool http_request(const char* uri, HttpResponse& response, const HttpHeaders& request_headers = {});
+
+    /**
+     * @brief Text lines drawn into sprites since the last call, one per line, used to inspect the TFT rows
+     *
+     */
+    std::string display_take_text();
+}  // namespace hal::native
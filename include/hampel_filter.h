@@ -0,0 +1,120 @@
+/** -----------------------------------------------------------------------------------------------------
+ * @file hampel_filter.h
+ *
+ * @brief Sliding median and Hampel outlier test over the last N 12-bit ADC codes in O(log 4096) per sample
+ * @version 0.1
+ * @date 2024-2025
+ *  ----------------------------------------------------------------------------------------------------- **/
+
+#pragma once
+
+/** -----------------------------------------------------------------------------------------------------
+ * $ INCLUDES
+ *  ----------------------------------------------------------------------------------------------------- **/
+
+#include <math.h>
+#include <stdint.h>
+
+/**
+ * @brief Flags a sample as an outlier when it lies more than sigmas robust standard deviations from the window median
+ *
+ * The robust standard deviation is 1.4826 * MAD, the median absolute deviation from the median, so a spike or bubble
+ * cannot widen its own acceptance band the way it would with a mean and standard deviation. The window counts how
+ * often each code occurs in a Fenwick tree over the 4096 codes: the median is one descent of the tree and the MAD test
+ * one range count, so the cost per sample does not depend on N. A real step in turbidity is flagged until it holds
+ * the majority of the window, about N / 2 samples.
+ *
+ * @tparam N window size, the newest sample is part of its own window
+ */
+template<uint16_t N>
+class HampelFilter
+{
+    static_assert(N >= 3, "HampelFilter needs a window of at least three samples");
+
+public:
+    constexpr static const uint16_t CODES = 4'096;
+
+    explicit HampelFilter(float sigmas) : scale(sigmas * 1.4826F) {}
+
+    /**
+     * @brief Add code to the window, evicting the oldest one
+     *
+     * @return true if code is an outlier with respect to the window it now belongs to
+     */
+    bool push(uint16_t code)
+    {
+        if (code >= CODES) { code = CODES - 1; }
+
+        if (filled == N) { add(samples[head], -1); }
+        else { filled++; }
+        samples[head] = code;
+        add(code, 1);
+        head = (head + 1) % N;
+
+        if (filled < 3) { return false; }
+
+        // |code - median| > scale * MAD  <=>  MAD < deviation / scale  <=>  MAD <= limit for integer deviations
+        uint16_t middle    = (filled + 1) / 2;
+        uint16_t median    = select(middle);
+        int32_t  deviation = code > median ? code - median : median - code;
+        int32_t  limit     = static_cast<int32_t>(ceilf(static_cast<float>(deviation) / scale)) - 1;
+
+        return limit >= 0 && count_between(median - limit, median + limit) >= middle;
+    }
+
+    /**
+     * @brief Lower median of the window, 0 while it is empty
+     *
+     */
+    uint16_t median() const { return filled > 0 ? select((filled + 1) / 2) : 0; }
+
+    uint16_t           count() const { return filled; }
+    constexpr uint16_t size() const { return N; }
+
+private:
+    void add(uint16_t code, int16_t delta)
+    {
+        for (uint16_t i = code + 1; i <= CODES; i += i & -i) { tree[i] += delta; }
+    }
+
+    /**
+     * @brief Number of samples with a code up to and including code
+     *
+     */
+    uint16_t count_upto(int32_t code) const
+    {
+        if (code < 0) { return 0; }
+        if (code >= CODES) { return filled; }
+
+        uint16_t total = 0;
+        for (int32_t i = code + 1; i > 0; i -= i & -i) { total += tree[i]; }
+        return total;
+    }
+
+    uint16_t count_between(int32_t low, int32_t high) const { return count_upto(high) - count_upto(low - 1); }
+
+    /**
+     * @brief Code of the rank-th smallest sample (1-based), rank must not exceed the number of samples
+     *
+     */
+    uint16_t select(uint16_t rank) const
+    {
+        uint16_t position = 0;
+        for (uint16_t step = CODES; step > 0; step >>= 1)
+        {
+            if (position + step <= CODES && tree[position + step] < rank)
+            {
+                position += step;
+                rank -= tree[position];
+            }
+        }
+
+        return position;  // Tree index position + 1 holds the code position
+    }
+
+    uint16_t tree[CODES + 1] = {};  // Fenwick tree of the code counts, 1-based
+    uint16_t samples[N]      = {};
+    uint16_t head            = 0;  // Slot of the oldest sample, overwritten by the next push
+    uint16_t filled          = 0;
+    float    scale;
+};
@@ -0,0 +1,213 @@
+/** -----------------------------------------------------------------------------------------------------
+ * @file metrics.h
+ *
+ * @brief Counters, gauges and fixed-bucket latency histograms on the cycle counter, exported as Prometheus text
+ * @version 0.1
+ * @date 2024-2025
+ *  ----------------------------------------------------------------------------------------------------- **/
+
+#pragma once
+
+/** -----------------------------------------------------------------------------------------------------
+ * $ INCLUDES
+ *  ----------------------------------------------------------------------------------------------------- **/
+
+#include <stdint.h>
+
+#include <atomic>
+#include <string>
+
+#include "hal.h"
+
+#ifndef METRICS_ENABLED
+    #define METRICS_ENABLED false
+#endif
+
+/**
+ * @brief Upper bounds of the histogram buckets in microseconds, shared by every histogram, +Inf follows the last
+ *
+ */
+constexpr static const uint32_t METRIC_BUCKETS_US[] = {
+    10, 25, 50, 100, 250, 500, 1'000, 2'500, 5'000, 10'000, 25'000, 50'000, 100'000, 250'000, 1'000'000,
+};
+constexpr static const uint8_t METRIC_BUCKET_COUNT = sizeof(METRIC_BUCKETS_US) / sizeof(METRIC_BUCKETS_US[0]);
+
+#if METRICS_ENABLED
+
+/**
+ * @brief Named value in the export, every metric registers itself when it is constructed
+ *
+ * Metrics are meant to be static objects: they link themselves into a list during static initialisation and are
+ * never removed, so recording a value never allocates or takes a lock, it is one or two relaxed atomic operations.
+ * Metrics that share a name (one per label value) have to be declared next to each other, they are exported under a
+ * single HELP and TYPE line. label and label_value are optional, e.g. "handler" and "data".
+ */
+class Metric
+{
+public:
+    Metric(const char* type, const char* name, const char* help, const char* label, const char* label_value);
+    virtual ~Metric() = default;
+
+    Metric(const Metric&)            = delete;
+    Metric& operator=(const Metric&) = delete;
+
+    /**
+     * @brief Append every registered metric to dest in the Prometheus text format (version 0.0.4)
+     *
+     */
+    static void format_all(std::string& dest);
+
+protected:
+    virtual void format(std::string& dest) const = 0;
+
+    /**
+     * @brief Append name, suffix and the labels (plus le when it is not nullptr) to dest, without the value
+     *
+     */
+    void append_series(std::string& dest, const char* suffix, const char* le = nullptr) const;
+
+    const char* type;
+    const char* name;
+    const char* help;
+    const char* label;
+    const char* label_value;
+    Metric*     next = nullptr;
+};
+
+/**
+ * @brief Monotonic count of events, safe to add to from any task
+ *
+ */
+class MetricCounter : public Metric
+{
+public:
+    MetricCounter(const char* name,
+                  const char* help,
+                  const char* label       = nullptr,
+                  const char* label_value = nullptr) :
+        Metric("counter", name, help, label, label_value)
+    {
+    }
+
+    void add(uint32_t amount = 1) { value.fetch_add(amount, std::memory_order_relaxed); }
+
+protected:
+    void format(std::string& dest) const override;
+
+private:
+    std::atomic<uint32_t> value = 0;
+};
+
+/**
+ * @brief Last value set, e.g. the free heap when /metrics is read
+ *
+ */
+class MetricGauge : public Metric
+{
+public:
+    MetricGauge(const char* name,
+                const char* help,
+                const char* label       = nullptr,
+                const char* label_value = nullptr) :
+        Metric("gauge", name, help, label, label_value)
+    {
+    }
+
+    void set(int32_t new_value) { value.store(new_value, std::memory_order_relaxed); }
+
+protected:
+    void format(std::string& dest) const override;
+
+private:
+    std::atomic<int32_t> value = 0;
+};
+
+/**
+ * @brief Durations counted into the METRIC_BUCKETS_US buckets, exported in seconds
+ *
+ * The sum is kept in whole microseconds in 32 bits and wraps after about 71 minutes of accumulated time, which
+ * Prometheus handles like a counter reset. Buckets and sum are read one by one, a scrape that overlaps an
+ * observation can be off by that one observation.
+ */
+class MetricHistogram : public Metric
+{
+public:
+    MetricHistogram(const char* name,
+                    const char* help,
+                    const char* label       = nullptr,
+                    const char* label_value = nullptr) :
+        Metric("histogram", name, help, label, label_value)
+    {
+    }
+
+    void observe_us(uint32_t duration_us);
+    void observe_cycles(uint32_t cycles) { observe_us(cycles / hal::cycles_per_us()); }
+
+protected:
+    void format(std::string& dest) const override;
+
+private:
+    std::atomic<uint32_t> buckets[METRIC_BUCKET_COUNT + 1] = {};  // Not cumulative, the last one is +Inf
+    std::atomic<uint32_t> sum_us                           = 0;
+};
+
+/**
+ * @brief Observes the cycles from its construction to the end of its scope into a histogram
+ *
+ */
+class MetricTimer
+{
+public:
+    explicit MetricTimer(MetricHistogram& histogram) : histogram(histogram), start(hal::cycle_count()) {}
+    ~MetricTimer() { histogram.observe_cycles(hal::cycle_count() - start); }
+
+    MetricTimer(const MetricTimer&)            = delete;
+    MetricTimer& operator=(const MetricTimer&) = delete;
+
+private:
+    MetricHistogram& histogram;
+    uint32_t         start;
+};
+
+#else
+
+// Metrics compiled out: the same interface without state, every call is an empty inline function
+
+class Metric
+{
+public:
+    static void format_all(std::string& dest) {}
+};
+
+class MetricCounter
+{
+public:
+    constexpr MetricCounter(const char*, const char*, const char* = nullptr, const char* = nullptr) {}
+
+    void add(uint32_t amount = 1) {}
+};
+
+class MetricGauge
+{
+public:
+    constexpr MetricGauge(const char*, const char*, const char* = nullptr, const char* = nullptr) {}
+
+    void set(int32_t new_value) {}
+};
+
+class MetricHistogram
+{
+public:
+    constexpr MetricHistogram(const char*, const char*, const char* = nullptr, const char* = nullptr) {}
+
+    void observe_us(uint32_t duration_us) {}
+    void observe_cycles(uint32_t cycles) {}
+};
+
+class MetricTimer
+{
+public:
+    explicit MetricTimer(MetricHistogram& histogram) {}
+};
+
+#endif
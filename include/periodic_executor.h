@@ -0,0 +1,116 @@
+/** -----------------------------------------------------------------------------------------------------
+ * @file periodic_executor.h
+ *
+ * @brief Fixed-rate jobs on absolute release times, with jitter, deadline miss and overrun accounting per job
+ * @version 0.1
+ * @date 2024-2025
+ *  ----------------------------------------------------------------------------------------------------- **/
+
+#pragma once
+
+/** -----------------------------------------------------------------------------------------------------
+ * $ INCLUDES
+ *  ----------------------------------------------------------------------------------------------------- **/
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "hal.h"
+#include "seqlock.h"
+
+using PeriodicJob = void (*)(void* context);
+
+struct JobStats
+{
+    const char* name;
+    uint32_t    period_us;
+    uint32_t    runs;
+    uint32_t    deadline_misses;  // Finished after release + deadline
+    uint32_t    overruns;         // Releases skipped because the job was still running or started too late
+    uint32_t    jitter_max_us;    // From the release to the start of the job
+    uint32_t    jitter_mean_us;
+    uint32_t    duration_max_us;
+    uint32_t    duration_mean_us;
+};
+
+struct ExecutorStats
+{
+    constexpr static const uint8_t MAX_JOBS = 8;
+
+    uint8_t  job_count;
+    JobStats jobs[MAX_JOBS];
+};
+
+/**
+ * @brief Runs registered jobs at fixed rates from one task, earliest deadline first
+ *
+ * Every job has an absolute release time that advances by exactly its period, so neither the time a job takes nor
+ * a late wake-up shifts the later releases: the rate does not drift. poll() runs every released job, the one with
+ * the earliest deadline first, and returns the next release; run() sleeps until then with hal::delay_until_us().
+ * A wake-up before the release finds nothing to run and sleeps again.
+ * Jobs are not preempted by each other, a long job delays the others and shows up as their jitter.
+ *
+ * A job that falls a whole period or more behind skips the releases it missed instead of running them back to
+ * back, each skipped release counts as an overrun. The phase of the job is kept.
+ *
+ * Time comes from the clock and sleep functions given to the constructor, hal::micros() and hal::delay_until_us()
+ * by default. A host harness passes a simulated clock whose sleep advances it, which makes a run deterministic.
+ * Only the executor task calls add(), poll() and run(), stats() can be read from any task.
+ */
+class PeriodicExecutor
+{
+public:
+    using Clock = uint64_t (*)();
+    using Sleep = void (*)(uint64_t wake_us);
+
+    explicit PeriodicExecutor(Clock clock = hal::micros, Sleep sleep = hal::delay_until_us);
+
+    /**
+     * @brief Register job every period_us, first released at the next poll() plus offset_us
+     *
+     * @param deadline_us relative to each release, 0 means the period
+     * @return false if MAX_JOBS are registered already or period_us is 0
+     */
+    bool add(const char* name,
+             PeriodicJob job,
+             void*       context,
+             uint32_t    period_us,
+             uint32_t    deadline_us = 0,
+             uint32_t    offset_us   = 0);
+
+    /**
+     * @brief Run every released job once, earliest deadline first
+     *
+     * @return release time of the next job, in clock microseconds
+     */
+    uint64_t poll();
+
+    /**
+     * @brief Executor task body: poll() and sleep until the next release, forever
+     *
+     */
+    [[noreturn]] void run();
+
+    bool stats(ExecutorStats& dest) const { return published.try_read(dest); }
+
+private:
+    struct Job
+    {
+        PeriodicJob function;
+        void*       context;
+        uint32_t    deadline_us;
+        uint32_t    offset_us;
+        uint64_t    release_us;  // Absolute, set by the first poll()
+        uint64_t    jitter_total_us;
+        uint64_t    duration_total_us;
+    };
+
+    void execute(uint8_t index, uint64_t start_us);
+
+    Clock                  clock;
+    Sleep                  sleep;
+    Job                    jobs[ExecutorStats::MAX_JOBS] = {};
+    ExecutorStats          totals                        = {};
+    bool                   is_started                    = false;
+    Seqlock<ExecutorStats> published;
+};
@@ -0,0 +1,108 @@
+/** -----------------------------------------------------------------------------------------------------
+ * @file pump_control.h
+ *
+ * @brief Pump state machine driven by events from touch, HTTP, the sampler and the control task timer
+ * @version 0.1
+ * @date 2024-2025
+ *  ----------------------------------------------------------------------------------------------------- **/
+
+#pragma once
+
+/** -----------------------------------------------------------------------------------------------------
+ * $ INCLUDES
+ *  ----------------------------------------------------------------------------------------------------- **/
+
+#include <stdint.h>
+
+enum PumpEventType : uint8_t
+{
+    PUMP_EVENT_START,        // Pump on, from the ON button or /pump/on
+    PUMP_EVENT_STOP,         // Pump off, from the OFF button or /pump/off
+    PUMP_EVENT_SAMPLE,       // New turbidity sample, is_valid and is_clean are set
+    PUMP_EVENT_TICK,         // Periodic, checks that samples keep coming
+    PUMP_EVENT_MOTOR_FAULT,  // The step engine refused to start
+};
+
+enum PumpEventSource : uint8_t
+{
+    PUMP_SOURCE_TOUCH,
+    PUMP_SOURCE_HTTP,
+    PUMP_SOURCE_SAMPLER,
+    PUMP_SOURCE_TIMER,
+    PUMP_SOURCE_CONTROL,
+};
+
+struct PumpEvent
+{
+    uint8_t  type;       // PumpEventType
+    uint8_t  source;     // PumpEventSource
+    bool     is_valid;   // PUMP_EVENT_SAMPLE only
+    bool     is_clean;
+    uint32_t posted_us;  // micros() when posted, for the command-to-actuation latency
+};
+
+enum class PumpState : uint8_t
+{
+    IDLE,         // Off
+    PUMPING,      // On until the water is clean
+    MANUAL_HOLD,  // Started while the water was already clean, on until stopped or the water turns dirty
+    FAULT,        // Off, the sensor stopped delivering valid samples or the motor refused to start
+};
+
+/**
+ * @brief State of the pump control task, published lock-free after every event it handled
+ *
+ */
+struct PumpStatus
+{
+    PumpState state;
+    bool      is_clean;
+    uint32_t  events;           // Handled, ticks included
+    uint32_t  commands;         // START and STOP events
+    uint32_t  latency_max_us;   // From posting a START or STOP until the motor was commanded
+    uint32_t  latency_mean_us;
+};
+
+/**
+ * @brief One owner for every pump decision, each event is handled against a single consistent state
+ *
+ * Without the sensor (use_sensor false) the pump only follows START and STOP. With it, PUMPING stops once a sample
+ * reports clean water, and a START while the water is already clean is a manual hold that lasts until STOP or until
+ * the water turns dirty, after which the pump stops again on clean water. When samples stay invalid for
+ * invalid_limit samples in a row, or stop coming for sample_timeout_ms once the first one arrived, the pump stops and
+ * the controller is in FAULT. START is refused there, the first valid sample clears it back to IDLE.
+ */
+class PumpController
+{
+public:
+    struct Config
+    {
+        bool     use_sensor;
+        uint32_t sample_timeout_ms;  // Longest gap between samples before the sensor counts as lost
+        uint16_t invalid_limit;      // Invalid samples in a row before the sensor counts as faulty
+    };
+
+    PumpController(const Config& config, bool is_pumping);
+
+    /**
+     * @brief Handle event at now_ms
+     *
+     * @return the state afterwards, the pump has to run in PUMPING and MANUAL_HOLD
+     */
+    PumpState handle(const PumpEvent& event, uint32_t now_ms);
+
+    PumpState state() const { return current; }
+    bool      is_pumping() const { return is_pumping_state(current); }
+    bool      is_clean() const { return clean; }
+
+    static bool        is_pumping_state(PumpState state);
+    static const char* state_name(PumpState state);
+
+private:
+    Config    config;
+    PumpState current        = PumpState::IDLE;
+    bool      clean          = false;
+    bool      has_sample     = false;
+    uint16_t  invalid_count  = 0;
+    uint32_t  last_sample_ms = 0;
+};
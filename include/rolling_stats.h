@@ -0,0 +1,121 @@
+/** -----------------------------------------------------------------------------------------------------
+ * @file rolling_stats.h
+ *
+ * @brief Ring buffer with O(1) running mean and least-squares slope over the last N samples
+ * @version 0.1
+ * @date 2024-2025
+ *  ----------------------------------------------------------------------------------------------------- **/
+
+#pragma once
+
+/** -----------------------------------------------------------------------------------------------------
+ * $ INCLUDES
+ *  ----------------------------------------------------------------------------------------------------- **/
+
+#include <stdint.h>
+
+#include <type_traits>
+
+/**
+ * @brief Sliding window of N samples that keeps Σy, Σx, Σxy, Σx² and the valid-count up to date on every push
+ *
+ * x is the position of a sample in the window (0 = oldest, N - 1 = newest), so the slope is expressed in units per
+ * sample. Samples pushed as invalid are kept in the ring (they still age out) but do not contribute to any sum.
+ * Integral sample types accumulate in int64_t, which keeps the sums exact over any uptime; floating point samples
+ * accumulate in double.
+ *
+ * @tparam T sample type (e.g. the raw 12-bit ADC code)
+ * @tparam N window size
+ */
+template<typename T, uint16_t N>
+class RollingStats
+{
+    static_assert(N > 0, "RollingStats needs a window of at least one sample");
+
+public:
+    using Accumulator = std::conditional_t<std::is_integral_v<T>, int64_t, double>;
+
+    /**
+     * @brief Replace the oldest sample with value, in O(1)
+     *
+     */
+    void push(T value, bool valid)
+    {
+        // Evict the oldest sample, it sits at x = 0 so it only contributes to Σy and the count
+        if (valid_flags[head])
+        {
+            sum_y -= static_cast<Accumulator>(samples[head]);
+            valid_count--;
+        }
+
+        // Age the remaining samples by one position: x -> x - 1
+        sum_x_square += valid_count - 2 * sum_x;
+        sum_x -= valid_count;
+        sum_xy -= sum_y;
+
+        // Insert the newest sample at x = N - 1
+        samples[head]     = value;
+        valid_flags[head] = valid;
+        if (valid)
+        {
+            constexpr int64_t x = N - 1;
+
+            sum_y += static_cast<Accumulator>(value);
+            sum_x += x;
+            sum_x_square += x * x;
+            sum_xy += static_cast<Accumulator>(x) * static_cast<Accumulator>(value);
+            valid_count++;
+        }
+
+        head = (head + 1) % N;
+    }
+
+    /**
+     * @brief Mean of the valid samples, 0 when there are none
+     *
+     */
+    float mean() const
+    {
+        return valid_count > 0 ? static_cast<float>(sum_y) / static_cast<float>(valid_count) : 0.0F;
+    }
+
+    /**
+     * @brief Least-squares slope of the valid samples per sample position, 0 when it is undefined
+     *
+     */
+    float slope() const
+    {
+        if (valid_count < 2) { return 0.0F; }
+
+        Accumulator n           = static_cast<Accumulator>(valid_count);
+        Accumulator numerator   = (n * sum_xy) - (static_cast<Accumulator>(sum_x) * sum_y);
+        int64_t     denominator = (valid_count * sum_x_square) - (sum_x * sum_x);
+
+        return denominator != 0 ? static_cast<float>(numerator) / static_cast<float>(denominator) : 0.0F;
+    }
+
+    /**
+     * @brief Sample at position i of the window (0 = oldest)
+     *
+     */
+    T at(uint16_t i) const { return samples[(head + i) % N]; }
+
+    /**
+     * @brief Whether the sample at position i of the window (0 = oldest) was pushed as valid
+     *
+     */
+    bool is_valid(uint16_t i) const { return valid_flags[(head + i) % N]; }
+
+    uint16_t           count() const { return static_cast<uint16_t>(valid_count); }
+    constexpr uint16_t size() const { return N; }
+
+private:
+    T           samples[N]     = {};
+    bool        valid_flags[N] = {};
+    uint16_t    head           = 0;  // Slot of the oldest sample, overwritten by the next push
+    int64_t     valid_count    = 0;
+    int64_t     sum_x          = 0;
+    int64_t     sum_x_square   = 0;
+    Accumulator sum_y          = 0;
+    Accumulator sum_xy         = 0;
+};
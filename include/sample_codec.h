@@ -0,0 +1,113 @@
+/** -----------------------------------------------------------------------------------------------------
+ * @file sample_codec.h
+ *
+ * @brief Lossless bit-packed encoding of turbidity sample blocks (delta-of-delta timestamps, ADC code deltas)
+ * @version 0.1
+ * @date 2024-2025
+ *  ----------------------------------------------------------------------------------------------------- **/
+
+#pragma once
+
+/** -----------------------------------------------------------------------------------------------------
+ * $ INCLUDES
+ *  ----------------------------------------------------------------------------------------------------- **/
+
+#include <stdint.h>
+#include <stddef.h>
+
+enum SampleFlag : uint8_t
+{
+    SAMPLE_FLAG_VALID = 0x01,
+    SAMPLE_FLAG_CLEAN = 0x02,
+};
+
+/**
+ * @brief One sample, voltage and NTU are derived from the ADC code when it is read back
+ *
+ */
+struct SampleRecord
+{
+    uint32_t timestamp;     // Unix time in seconds
+    uint16_t analog_value;  // 12-bit ADC code
+    uint8_t  flags;         // SampleFlag bits
+    uint8_t  reserved;
+};
+
+/**
+ * @brief Appends records to a block as a bit stream, most significant bit first
+ *
+ * The first record of a block is stored as is (32-bit timestamp, 16-bit ADC code, 8-bit flags). Every following
+ * record stores:
+ *   - timestamp, delta-of-delta d (zigzag): '0' d = 0 | '10' 7 bits | '110' 16 bits | '111' 32-bit raw delta
+ *   - ADC code, delta v (zigzag):           '0' v = 0 | '10' 3 bits | '110' 6 bits  | '111' 16-bit raw code
+ *   - flags:                                '0' unchanged | '1' 8 bits
+ *
+ * A 1 Hz trace of a slowly varying signal therefore costs about one byte per sample instead of eight. A block is
+ * self-contained, decoding needs its byte length and record count.
+ */
+class SampleEncoder
+{
+public:
+    constexpr static const size_t MAX_RECORD_BYTES = 8;  // Worst case of one record (63 bits)
+
+    SampleEncoder(uint8_t* dest, size_t capacity);
+
+    /**
+     * @brief Append record, nothing is written if it does not fit
+     *
+     */
+    bool append(const SampleRecord& record);
+
+    /**
+     * @brief Start a new, empty block in the same buffer
+     *
+     */
+    void reset();
+
+    size_t   size() const { return (bit_count + 7) / 8; }
+    size_t   remaining() const { return capacity - size(); }
+    uint16_t count() const { return records; }
+
+private:
+    void write(uint32_t value, uint8_t bits);
+
+    uint8_t* dest;
+    size_t   capacity;
+    size_t   bit_count          = 0;
+    uint16_t records            = 0;
+    uint32_t previous_timestamp = 0;
+    uint32_t previous_delta     = 0;
+    uint16_t previous_value     = 0;
+    uint8_t  previous_flags     = 0;
+};
+
+/**
+ * @brief Reads the records of a block written by SampleEncoder
+ *
+ */
+class SampleDecoder
+{
+public:
+    SampleDecoder(const uint8_t* source, size_t size, uint16_t count);
+
+    /**
+     * @brief Decode the next record
+     *
+     * @return false at the end of the block or if the block is truncated
+     */
+    bool next(SampleRecord& dest);
+
+private:
+    bool read(uint8_t bits, uint32_t& dest);
+    bool read_prefix(uint8_t& dest);
+
+    const uint8_t* source;
+    size_t         bit_size;
+    size_t         bit_offset = 0;
+    uint16_t       remaining;
+    uint16_t       records            = 0;
+    uint32_t       previous_timestamp = 0;
+    uint32_t       previous_delta     = 0;
+    uint16_t       previous_value     = 0;
+    uint8_t        previous_flags     = 0;
+};
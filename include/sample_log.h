@@ -0,0 +1,146 @@
+/** -----------------------------------------------------------------------------------------------------
+ * @file sample_log.h
+ *
+ * @brief Persistent append-only log of turbidity samples on the data partition, split into rotating segments
+ * @version 0.1
+ * @date 2024-2025
+ *  ----------------------------------------------------------------------------------------------------- **/
+
+#pragma once
+
+/** -----------------------------------------------------------------------------------------------------
+ * $ INCLUDES
+ *  ----------------------------------------------------------------------------------------------------- **/
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "hal.h"
+#include "sample_codec.h"
+
+#ifndef SAMPLE_LOG_PAGE_SIZE
+    #define SAMPLE_LOG_PAGE_SIZE 1024
+#endif
+
+#ifndef SAMPLE_LOG_SEGMENT_PAGES
+    #define SAMPLE_LOG_SEGMENT_PAGES 64
+#endif
+
+#ifndef SAMPLE_LOG_MAX_SEGMENTS
+    #define SAMPLE_LOG_MAX_SEGMENTS 16
+#endif
+
+struct SampleLogStats
+{
+    uint32_t samples_appended;  // Since boot
+    uint32_t pages_written;     // Since boot
+    uint32_t bytes_written;     // Since boot, whole pages including headers and unused payload
+    uint8_t  segments;
+};
+
+/**
+ * @brief Append-only sample log: RAM page buffer, whole-page writes and a time index per segment
+ *
+ * Samples are encoded into a RAM page with SampleEncoder (about one byte per sample) and written as one
+ * SAMPLE_LOG_PAGE_SIZE write once the page is full, so flash is written in whole pages instead of once per sample. A
+ * page carries a magic, its first timestamp, a record count, the payload length and a CRC32 of the payload, pages that
+ * fail the check after a power loss are skipped. Segments hold SAMPLE_LOG_SEGMENT_PAGES pages, the oldest segment is
+ * removed once there are SAMPLE_LOG_MAX_SEGMENTS. Only the unwritten RAM page is lost on power loss (about 15 minutes
+ * at 1 Hz with 1 KiB pages), flush() writes it early.
+ *
+ * Range queries start at the last segment that begins before from (RAM index) and binary search its page headers, so
+ * they read only the pages that overlap the range. All methods are thread-safe.
+ */
+class SampleLog
+{
+public:
+    /**
+     * @brief Called for every record in a queried range, return false to stop the query
+     *
+     */
+    using Visitor = bool (*)(const SampleRecord& record, void* context);
+
+    /**
+     * @brief directory on the data partition (e.g. "/log"), must outlive the log
+     *
+     */
+    explicit SampleLog(const char* directory);
+
+    /**
+     * @brief Rebuild the segment index from the data partition, call after hal::fs_mount()
+     *
+     */
+    bool begin();
+
+    /**
+     * @brief Buffer a record, timestamps that go backwards (clock corrections) are clamped to the previous one
+     *
+     */
+    bool append(const SampleRecord& record);
+
+    /**
+     * @brief Write the partially filled RAM page, e.g. before a restart
+     *
+     */
+    bool flush();
+
+    /**
+     * @brief Visit the records with from <= timestamp <= to in time order
+     *
+     * @return number of records visited
+     */
+    size_t query(uint32_t from, uint32_t to, Visitor visitor, void* context);
+
+    SampleLogStats stats();
+
+private:
+    constexpr static const uint16_t PAGE_SIZE     = SAMPLE_LOG_PAGE_SIZE;
+    constexpr static const uint16_t SEGMENT_PAGES = SAMPLE_LOG_SEGMENT_PAGES;
+    constexpr static const uint8_t  MAX_SEGMENTS  = SAMPLE_LOG_MAX_SEGMENTS;
+    constexpr static const uint32_t PAGE_MAGIC    = 0x3247474C;  // "LGG2", pages of encoded records
+
+    struct PageHeader
+    {
+        uint32_t magic;
+        uint32_t first_timestamp;
+        uint16_t count;
+        uint16_t length;  // Bytes of payload in use
+        uint32_t crc;     // CRC32 of the used payload
+    };
+
+    struct Page
+    {
+        PageHeader header;
+        uint8_t    payload[PAGE_SIZE - sizeof(PageHeader)];
+    };
+
+    static_assert(sizeof(Page) == PAGE_SIZE, "SAMPLE_LOG_PAGE_SIZE must be a multiple of 4");
+    static_assert(PAGE_SIZE >= 64, "SAMPLE_LOG_PAGE_SIZE too small for a page header and a few records");
+
+    struct Segment
+    {
+        uint32_t id;
+        uint32_t first_timestamp;
+        uint16_t pages;
+        bool     is_sealed;  // Full or torn, the next page starts a new segment
+    };
+
+    bool write_pending();
+    bool read_page(FILE* file, uint16_t page, bool header_only);
+    bool visit_page(const Page& page, uint32_t from, uint32_t to, Visitor visitor, void* context, size_t& count);
+    void segment_path(uint32_t id, char* dest, size_t size) const;
+    void add_segment(uint32_t id);
+
+    const char* directory;
+    hal::Mutex* mutex = nullptr;
+
+    Segment  segments[MAX_SEGMENTS];  // Oldest first
+    uint8_t  segment_count  = 0;
+    uint32_t last_timestamp = 0;
+
+    Page          pending = {};  // Filled by append()
+    SampleEncoder encoder{pending.payload, sizeof(pending.payload)};
+    Page          scratch = {};  // Read buffer of query(), too large for a task stack
+
+    SampleLogStats counters = {};
+};
@@ -0,0 +1,94 @@
+/** -----------------------------------------------------------------------------------------------------
+ * @file seqlock.h
+ *
+ * @brief Single-writer / multi-reader publication of fixed-size snapshots without locks or allocations
+ * @version 0.1
+ * @date 2024-2025
+ *  ----------------------------------------------------------------------------------------------------- **/
+
+#pragma once
+
+/** -----------------------------------------------------------------------------------------------------
+ * $ INCLUDES
+ *  ----------------------------------------------------------------------------------------------------- **/
+
+#include <stdint.h>
+#include <string.h>
+
+#include <atomic>
+#include <type_traits>
+
+/**
+ * @brief Sequence lock holding one trivially copyable value
+ *
+ * The writer never waits: it makes the sequence odd, stores the value word by word and makes the sequence even
+ * again. Readers copy the words and retry when the sequence was odd or changed during the copy, so they never block
+ * the writer and never take a lock. Only one task may call publish() at a time.
+ *
+ * @tparam T snapshot type, must be trivially copyable
+ */
+template<typename T>
+class Seqlock
+{
+    static_assert(std::is_trivially_copyable_v<T>, "Seqlock snapshots must be trivially copyable");
+
+public:
+    /**
+     * @brief Publish a new value (single writer)
+     *
+     */
+    void publish(const T& value)
+    {
+        uint32_t words_local[WORD_COUNT] = {0};
+        memcpy(words_local, &value, sizeof(T));
+
+        uint32_t sequence_local = sequence.load(std::memory_order_relaxed);
+        sequence.store(sequence_local + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+
+        for (size_t i = 0; i < WORD_COUNT; i++) { words[i].store(words_local[i], std::memory_order_relaxed); }
+
+        sequence.store(sequence_local + 2, std::memory_order_release);
+    }
+
+    /**
+     * @brief Copy the last published value into dest
+     *
+     * @param attempts number of copies to try while the writer is active before giving up
+     * @return false if nothing was published yet or every attempt overlapped with a publish
+     */
+    bool try_read(T& dest, uint16_t attempts = 64) const
+    {
+        uint32_t words_local[WORD_COUNT];
+
+        for (; attempts > 0; attempts--)
+        {
+            uint32_t sequence_begin = sequence.load(std::memory_order_acquire);
+            if (sequence_begin == 0) { return false; }
+            if (sequence_begin & 1U) { continue; }
+
+            for (size_t i = 0; i < WORD_COUNT; i++) { words_local[i] = words[i].load(std::memory_order_relaxed); }
+
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (sequence.load(std::memory_order_relaxed) == sequence_begin)
+            {
+                memcpy(&dest, words_local, sizeof(T));
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    /**
+     * @brief Number of values published so far, changes whenever a new value is visible to readers
+     *
+     */
+    uint32_t version() const { return sequence.load(std::memory_order_acquire) / 2; }
+
+private:
+    constexpr static const size_t WORD_COUNT = (sizeof(T) + sizeof(uint32_t) - 1) / sizeof(uint32_t);
+
+    std::atomic<uint32_t> sequence          = 0;
+    std::atomic<uint32_t> words[WORD_COUNT] = {};
+};
@@ -0,0 +1,84 @@
+/** -----------------------------------------------------------------------------------------------------
+ * @file step_engine.h
+ *
+ * @brief Start/stop control of the hardware step pulse train through a lock-free command word
+ * @version 0.1
+ * @date 2024-2025
+ *  ----------------------------------------------------------------------------------------------------- **/
+
+#pragma once
+
+/** -----------------------------------------------------------------------------------------------------
+ * $ INCLUDES
+ *  ----------------------------------------------------------------------------------------------------- **/
+
+#include <stdint.h>
+
+#include <atomic>
+
+#include "hal.h"
+#include "step_ramp.h"
+
+/**
+ * @brief Drives the pump motor with a hal::StepGenerator, no task polls the motor
+ *
+ * start() and stop() publish the wanted state as one command word (run bit and step interval) and apply it to the
+ * generator. When two tasks command at the same time the one that is already applying picks up the newer word, so
+ * callers never block on each other and the generator always ends up in the state of the last command.
+ *
+ * Speed changes follow the ramp table: the engine estimates the current ramp position from the time the last command
+ * was applied and has the generator play the table from there up to the new speed, or back down to the start speed
+ * before it stops. The generator only reads precomputed intervals, there is no arithmetic per step. The driver has to
+ * stay enabled until that stop ramp has played out, time_to_standstill_us() tells when.
+ */
+class StepEngine
+{
+public:
+    StepEngine(hal::StepGenerator& generator, const StepRamp& ramp);
+
+    bool begin(uint8_t step_pin, uint8_t direction_pin, bool direction_inverted);
+
+    /**
+     * @brief Run at steps_per_second, safe to call from any task
+     *
+     * @param wake_us from standstill the first step comes this much later, the time the driver needs out of sleep
+     * @return false if the rate is outside the range of the generator
+     */
+    bool start(float steps_per_second, uint32_t wake_us = 0);
+
+    /**
+     * @brief Stop the pulse train, safe to call from any task
+     *
+     */
+    void stop();
+
+    /**
+     * @brief Microseconds until the stop ramp has played out and the motor stands still, 0 once it does
+     *
+     * Valid once stop() has returned, a running engine returns UINT32_MAX.
+     */
+    uint32_t time_to_standstill_us() const;
+
+    bool     is_running() const { return (command.load(std::memory_order_acquire) & RUN_BIT) != 0; }
+    uint32_t step_interval() const { return command.load(std::memory_order_acquire) & INTERVAL_MASK; }
+
+private:
+    constexpr static const uint32_t RUN_BIT       = 0x80000000U;
+    constexpr static const uint32_t INTERVAL_MASK = 0x7FFFFFFFU;
+
+    void     apply();
+    uint16_t ramp_position(uint64_t now_us, uint32_t& wait) const;
+
+    hal::StepGenerator&   generator;
+    StepRamp              ramp;
+    std::atomic<uint32_t> command       = 0;
+    std::atomic_flag      applying      = ATOMIC_FLAG_INIT;
+    std::atomic<uint32_t> standstill_us = 0;  // Low word of hal::micros() at the end of the last stop ramp
+    std::atomic<uint32_t> wake_delay_us = 0;  // wake_us of the last start()
+
+    // Owned by the task that holds applying
+    uint32_t applied       = 0;
+    uint16_t ramp_from     = 0;  // Stretch of the ramp table played by the last command
+    uint16_t ramp_to       = 0;
+    uint64_t ramp_start_us = 0;
+};
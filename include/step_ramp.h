@@ -0,0 +1,107 @@
+/** -----------------------------------------------------------------------------------------------------
+ * @file step_ramp.h
+ *
+ * @brief Compile-time trapezoidal acceleration ramps as step interval tables
+ * @version 0.1
+ * @date 2024-2025
+ *  ----------------------------------------------------------------------------------------------------- **/
+
+#pragma once
+
+/** -----------------------------------------------------------------------------------------------------
+ * $ INCLUDES
+ *  ----------------------------------------------------------------------------------------------------- **/
+
+#include <stdint.h>
+
+#include "hal.h"
+
+/**
+ * @brief View of a ramp table, position p means p ramp steps have been taken from the start speed
+ *
+ */
+struct StepRamp
+{
+    const uint16_t* intervals = nullptr;  // Ticks of ramp step i, decreasing
+    const uint32_t* elapsed   = nullptr;  // Ticks from the start of the ramp to the start of step i, count + 1 entries
+    uint16_t        count     = 0;
+
+    /**
+     * @brief First position whose step is at least as fast as interval, the ramp ends there for that speed
+     *
+     */
+    constexpr uint16_t position_of(uint32_t interval) const
+    {
+        uint16_t position = 0;
+        while (position < count && intervals[position] > interval) { position++; }
+        return position;
+    }
+};
+
+/**
+ * @brief Constant acceleration from start_sps to target_sps, built by make_step_ramp()
+ *
+ * Step n of a ramp with start speed v0 and acceleration a starts at t(n) = (sqrt(v0^2 + 2an) - v0) / a, so every
+ * interval t(n + 1) - t(n) is exact instead of an approximation that accumulates. Playback only reads the table.
+ */
+template <uint16_t COUNT>
+struct StepRampTable
+{
+    uint16_t intervals[COUNT > 0 ? COUNT : 1] = {};
+    uint32_t elapsed[COUNT + 1]               = {};
+
+    constexpr StepRamp ramp() const { return {.intervals = intervals, .elapsed = elapsed, .count = COUNT}; }
+    constexpr uint32_t duration() const { return elapsed[COUNT]; }  // Ticks from the start speed to the target
+};
+
+constexpr double step_ramp_sqrt(double value)
+{
+    double root = value > 1.0 ? value : 1.0;
+    for (uint8_t i = 0; i < 64 && value > 0.0; i++)
+    {
+        double next = 0.5 * (root + value / root);
+        if (next == root) { break; }
+        root = next;
+    }
+
+    return value > 0.0 ? root : 0.0;
+}
+
+/**
+ * @brief Number of ramp steps from start_sps to target_sps at acceleration (steps/s^2)
+ *
+ */
+constexpr uint16_t step_ramp_length(double start_sps, double target_sps, double acceleration)
+{
+    if (acceleration <= 0.0 || target_sps <= start_sps) { return 0; }
+
+    double steps = (target_sps * target_sps - start_sps * start_sps) / (2.0 * acceleration);
+    return static_cast<uint16_t>(steps) + (steps > static_cast<uint16_t>(steps) ? 1 : 0);
+}
+
+template <uint16_t COUNT>
+constexpr StepRampTable<COUNT> make_step_ramp(double start_sps, double target_sps, double acceleration)
+{
+    constexpr double tick_hz = hal::StepGenerator::STEP_TICK_HZ;
+
+    StepRampTable<COUNT> table;
+    double               target_interval = tick_hz / target_sps;
+    double               start_time      = 0.0;
+
+    for (uint16_t n = 0; n < COUNT; n++)
+    {
+        double end_time =
+            (step_ramp_sqrt(start_sps * start_sps + 2.0 * acceleration * (n + 1)) - start_sps) / acceleration;
+        double interval = (end_time - start_time) * tick_hz;
+
+        // The last step may average above the target speed, the ramp never passes the cruise speed
+        if (interval < target_interval) { interval = target_interval; }
+        if (interval > hal::StepGenerator::MAX_STEP_INTERVAL) { interval = hal::StepGenerator::MAX_STEP_INTERVAL; }
+
+        table.intervals[n]   = static_cast<uint16_t>(interval + 0.5);
+        table.elapsed[n + 1] = table.elapsed[n] + table.intervals[n];
+        start_time           = end_time;
+    }
+
+    return table;
+}
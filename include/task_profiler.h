@@ -0,0 +1,81 @@
+/** -----------------------------------------------------------------------------------------------------
+ * @file task_profiler.h
+ *
+ * @brief Per-task CPU share, stack high-water marks and heap, sampled periodically and published lock-free
+ * @version 0.1
+ * @date 2024-2025
+ *  ----------------------------------------------------------------------------------------------------- **/
+
+#pragma once
+
+/** -----------------------------------------------------------------------------------------------------
+ * $ INCLUDES
+ *  ----------------------------------------------------------------------------------------------------- **/
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "hal.h"
+#include "seqlock.h"
+
+struct TaskLoad
+{
+    constexpr static const uint16_t UNKNOWN_PERMILLE = UINT16_MAX;  // The scheduler keeps no run-time statistics
+
+    char     name[16];
+    uint16_t cpu_permille;    // Share of one core over the last window, 1000 is the whole core
+    uint32_t stack_size;      // Bytes, 0 for tasks the firmware did not create
+    uint32_t stack_free_min;  // High-water mark, bytes never used since the task started
+    uint8_t  priority;
+    int8_t   core;            // -1 when the task may run on either core
+};
+
+struct TaskProfile
+{
+    constexpr static const uint8_t MAX_TASKS = 24;
+    constexpr static const uint8_t CORES     = 2;
+
+    uint32_t timestamp_ms;
+    uint32_t window_ms;                  // Time the CPU shares were measured over
+    uint16_t core_busy_permille[CORES];  // All but the idle task, or the pinned tasks where there is none, or unknown
+    uint32_t heap_free;
+    uint32_t heap_minimum_free;
+    uint32_t heap_largest_block;
+    uint8_t  task_count;
+    TaskLoad tasks[MAX_TASKS];
+};
+
+/**
+ * @brief Turns two task lists into CPU shares, one sample() per window
+ *
+ * The scheduler only counts the run time of every task since boot, so each sample() takes the difference to the
+ * previous one and divides it by the wall time in between. A share is of one core: a task pinned to core 0 at 500
+ * kept that core half busy. The first sample has no previous one and reports its tasks with a share of 0. Without
+ * configGENERATE_RUN_TIME_STATS every run time is 0, the shares and core loads are then UNKNOWN_PERMILLE instead of
+ * an idle task that never ran and a core that looks fully busy.
+ *
+ * Only the task that calls sample() writes, any task can read the last profile without waiting.
+ */
+class TaskProfiler
+{
+public:
+    void sample();
+
+    bool profile(TaskProfile& dest) const { return published.try_read(dest); }
+
+private:
+    struct RunTime
+    {
+        char     name[16];
+        uint32_t run_time_us;
+    };
+
+    bool previous_run_time(const char* name, uint32_t& run_time_us) const;
+
+    hal::TaskInfo        tasks[TaskProfile::MAX_TASKS]    = {};
+    RunTime              previous[TaskProfile::MAX_TASKS] = {};
+    uint8_t              previous_count                   = 0;
+    uint64_t             previous_us                      = 0;
+    TaskProfile          current                          = {};
+    Seqlock<TaskProfile> published;
+};
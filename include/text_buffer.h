@@ -0,0 +1,92 @@
+/** -----------------------------------------------------------------------------------------------------
+ * @file text_buffer.h
+ *
+ * @brief Fixed-capacity text formatter for telemetry (JSON and TFT rows) that never allocates
+ * @version 0.1
+ * @date 2024-2025
+ *  ----------------------------------------------------------------------------------------------------- **/
+
+#pragma once
+
+/** -----------------------------------------------------------------------------------------------------
+ * $ INCLUDES
+ *  ----------------------------------------------------------------------------------------------------- **/
+
+#include <stdint.h>
+#include <string.h>
+
+#include <charconv>
+
+/**
+ * @brief Null-terminated text of at most N - 1 characters, built with std::to_chars in place
+ *
+ * Appends that do not fit are cut off and mark the buffer as truncated, the content stays null-terminated.
+ *
+ * @tparam N capacity in bytes, including the terminating null character
+ */
+template<size_t N>
+class TextBuffer
+{
+    static_assert(N > 1, "TextBuffer needs room for at least one character");
+
+public:
+    TextBuffer& append(const char* text) { return append(text, strlen(text)); }
+
+    TextBuffer& append(const char* text, size_t text_length)
+    {
+        size_t available = N - 1 - length;
+        if (text_length > available)
+        {
+            text_length = available;
+            truncated   = true;
+        }
+
+        memcpy(buffer + length, text, text_length);
+        length += text_length;
+        buffer[length] = '\0';
+
+        return *this;
+    }
+
+    TextBuffer& append(char character) { return append(&character, 1); }
+
+    /**
+     * @brief Append value in fixed notation with the given number of decimals (like "%.2f")
+     *
+     */
+    TextBuffer& append(float value, uint8_t decimals)
+    {
+        return finish(std::to_chars(buffer + length, buffer + N - 1, value, std::chars_format::fixed, decimals));
+    }
+
+    TextBuffer& append(uint32_t value) { return finish(std::to_chars(buffer + length, buffer + N - 1, value)); }
+
+    TextBuffer& append(int32_t value) { return finish(std::to_chars(buffer + length, buffer + N - 1, value)); }
+
+    void clear()
+    {
+        length    = 0;
+        truncated = false;
+        buffer[0] = '\0';
+    }
+
+    const char*      c_str() const { return buffer; }
+    size_t           size() const { return length; }
+    bool             is_truncated() const { return truncated; }
+    constexpr size_t capacity() const { return N - 1; }
+
+private:
+    TextBuffer& finish(std::to_chars_result result)
+    {
+        if (result.ec == std::errc()) { length = static_cast<size_t>(result.ptr - buffer); }
+        else { truncated = true; }
+
+        buffer[length] = '\0';
+
+        return *this;
+    }
+
+    char   buffer[N] = {'\0'};
+    size_t length    = 0;
+    bool   truncated = false;
+};
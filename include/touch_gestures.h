@@ -0,0 +1,87 @@
+/** -----------------------------------------------------------------------------------------------------
+ * @file touch_gestures.h
+ *
+ * @brief Debounced touch samples to one tap, long press or swipe event per press
+ * @version 0.1
+ * @date 2024-2025
+ *  ----------------------------------------------------------------------------------------------------- **/
+
+#pragma once
+
+/** -----------------------------------------------------------------------------------------------------
+ * $ INCLUDES
+ *  ----------------------------------------------------------------------------------------------------- **/
+
+#include <stdint.h>
+
+enum TouchEventType : uint8_t
+{
+    TOUCH_TAP,         // Released before long_press_ms without moving swipe_px
+    TOUCH_LONG_PRESS,  // Held for long_press_ms without moving swipe_px, sent while still held
+    TOUCH_SWIPE,       // Moved swipe_px or more before the release, dx and dy give the direction
+};
+
+struct TouchEvent
+{
+    uint8_t  type;         // TouchEventType
+    uint16_t x;            // Where the press started
+    uint16_t y;
+    int16_t  dx;           // From the start to the last touched point
+    int16_t  dy;
+    uint32_t duration_ms;  // From the press to the event
+};
+
+/**
+ * @brief Turns raw touch samples into gestures, exactly one event per press
+ *
+ * A press counts once the panel reports touch for press_ms, shorter contacts are bounces or noise. It ends once the
+ * panel reports no touch for release_ms, so the pressure dropping out for a sample or two during a drag does not
+ * split it. A press that is held in place for long_press_ms is a long press right away, its release sends nothing
+ * more. Every other press is a tap or a swipe when it ends, depending on how far it moved.
+ */
+class TouchGestures
+{
+public:
+    struct Config
+    {
+        uint32_t press_ms;       // Touched this long before a press counts
+        uint32_t release_ms;     // Untouched this long before a press ends
+        uint32_t long_press_ms;  // Held this long in place for a long press
+        uint16_t swipe_px;       // Moved this far along either axis for a swipe
+    };
+
+    explicit TouchGestures(const Config& config);
+
+    /**
+     * @brief Take the sample at now_ms, x and y are ignored when the panel is not touched
+     *
+     * @return true if event was set
+     */
+    bool update(bool is_touched, uint16_t x, uint16_t y, uint32_t now_ms, TouchEvent& event);
+
+    /**
+     * @brief A press is in progress or being debounced, the panel has to be sampled until this is false again
+     *
+     */
+    bool is_active() const { return state != State::IDLE; }
+
+private:
+    enum class State : uint8_t
+    {
+        IDLE,
+        PRESSING,  // Touched, not yet for press_ms
+        PRESSED,
+        HELD,      // Long press sent
+    };
+
+    Config   config;
+    State    state      = State::IDLE;
+    bool     is_swiping = false;
+    bool     is_lifting = false;
+    uint16_t start_x    = 0;
+    uint16_t start_y    = 0;
+    uint16_t last_x     = 0;
+    uint16_t last_y     = 0;
+    uint32_t start_ms   = 0;
+    uint32_t lifted_ms  = 0;
+};
@@ -0,0 +1,67 @@
+/** -----------------------------------------------------------------------------------------------------
+ * @file trend_estimator.h
+ *
+ * @brief Kalman level-and-slope tracking of the sensor voltage with a predictive, hysteretic clean decision
+ * @version 0.1
+ * @date 2024-2025
+ *  ----------------------------------------------------------------------------------------------------- **/
+
+#pragma once
+
+/** -----------------------------------------------------------------------------------------------------
+ * $ INCLUDES
+ *  ----------------------------------------------------------------------------------------------------- **/
+
+#include <stdint.h>
+
+/**
+ * @brief Tracks the voltage as a level moving at a slope, the clean decision uses their uncertainty
+ *
+ * A constant-velocity Kalman filter: the level follows the measurements with a gain that depends on how noisy they
+ * are, and the slope follows from how the level keeps moving, in V/s regardless of the sample rate. Unlike a mean
+ * over a fixed window it lags a clearing curve by about a sample instead of half the window.
+ *
+ * The water counts as clean once the level predicted lead_s seconds ahead is above threshold by confidence standard
+ * deviations, i.e. the crossing is both certain and close enough to stop the pump now. It only counts as dirty again
+ * once the predicted level is confidently below threshold - hysteresis, so noise around the threshold cannot toggle
+ * the pump. A falling slope pulls the prediction down and holds the pump on, as the old !is_falling check did.
+ */
+class TrendEstimator
+{
+public:
+    struct Config
+    {
+        float threshold;       // V, clean above
+        float hysteresis;      // V below threshold before the water is dirty again
+        float lead_s;          // Prediction horizon of the clean decision
+        float confidence;      // Standard deviations the prediction has to clear a band by
+        float measurement_sd;  // V, noise of one sample
+        float slope_drift;     // V/s per sqrt(s), how quickly the slope itself may change
+    };
+
+    explicit TrendEstimator(const Config& config);
+
+    /**
+     * @brief Advance by dt_s seconds and take voltage into account, an invalid sample only advances the prediction
+     *
+     */
+    void update(float voltage, bool valid, float dt_s);
+
+    float level() const { return state_level; }
+    float slope() const { return state_slope; }  // V/s
+    bool  is_clean() const { return clean; }
+    bool  is_rising() const;
+    bool  is_falling() const;
+
+private:
+    float predicted(float horizon_s, float& sd) const;
+
+    Config config;
+    bool   has_level   = false;
+    bool   clean       = false;
+    float  state_level = 0.0F;
+    float  state_slope = 0.0F;
+    float  p00         = 0.0F;  // Covariance of level and slope
+    float  p01         = 0.0F;
+    float  p11         = 0.0F;
+};
@@ -0,0 +1,102 @@
+/** -----------------------------------------------------------------------------------------------------
+ * @file turbidity_table.h
+ *
+ * @brief Fixed-point lookup table from 12-bit ADC code to sensor voltage and NTU, with per-device calibration
+ * @version 0.1
+ * @date 2024-2025
+ *  ----------------------------------------------------------------------------------------------------- **/
+
+#pragma once
+
+/** -----------------------------------------------------------------------------------------------------
+ * $ INCLUDES
+ *  ----------------------------------------------------------------------------------------------------- **/
+
+#include <stdint.h>
+#include <stddef.h>
+
+constexpr static const uint16_t TURBIDITY_ADC_CODES    = 4'096;
+constexpr static const float    TURBIDITY_VOLTAGE_UNIT = 0.0001F;  // V per voltage step of an entry
+constexpr static const float    TURBIDITY_NTU_UNIT     = 0.1F;     // NTU per turbidity step of an entry
+
+struct TurbidityEntry
+{
+    uint16_t voltage;  // TURBIDITY_VOLTAGE_UNIT steps
+    uint16_t ntu;      // TURBIDITY_NTU_UNIT steps
+};
+
+struct TurbidityEntries
+{
+    TurbidityEntry entries[TURBIDITY_ADC_CODES];
+};
+
+constexpr uint16_t turbidity_fixed(float value, float unit)
+{
+    float steps = value / unit + 0.5F;
+    return steps <= 0.0F ? 0 : steps >= 65'535.0F ? 65'535 : static_cast<uint16_t>(steps);
+}
+
+/**
+ * @brief Evaluate the sensor formulas for every ADC code, meant for a constexpr table in flash
+ *
+ * voltage_of maps an ADC code to volts, ntu_of maps volts to NTU.
+ * Rounding to the entry units bounds the error against the formulas to half a unit, about 50 uV and 0.05 NTU.
+ */
+template <typename VoltageOf, typename NtuOf>
+constexpr TurbidityEntries make_turbidity_entries(VoltageOf voltage_of, NtuOf ntu_of)
+{
+    TurbidityEntries table = {};
+    for (uint16_t code = 0; code < TURBIDITY_ADC_CODES; code++)
+    {
+        float voltage       = voltage_of(code);
+        table.entries[code] = {
+            .voltage = turbidity_fixed(voltage, TURBIDITY_VOLTAGE_UNIT),
+            .ntu     = turbidity_fixed(ntu_of(voltage), TURBIDITY_NTU_UNIT),
+        };
+    }
+
+    return table;
+}
+
+/**
+ * @brief ADC code to voltage and NTU as one indexed load
+ *
+ * Starts on the table built from the sensor formulas. load_calibration() replaces the NTU column with a piecewise
+ * linear curve measured on the device, stored on the data partition as text with one "<volts> <NTU>" point per line
+ * ('#' starts a comment), at least two and at most MAX_POINTS points in rising voltage order. Voltages outside the
+ * measured range take the NTU of the nearest point. Load the calibration before the tasks that convert samples start.
+ */
+class TurbidityTable
+{
+public:
+    constexpr static const uint8_t MAX_POINTS = 16;
+
+    explicit TurbidityTable(const TurbidityEntries& defaults);
+
+    /**
+     * @brief Rebuild the table from the calibration file at path
+     *
+     * @return false if the file is missing or invalid, the current table is kept
+     */
+    bool load_calibration(const char* path);
+
+    float voltage(uint16_t code) const { return entries[code % TURBIDITY_ADC_CODES].voltage * TURBIDITY_VOLTAGE_UNIT; }
+    float ntu(uint16_t code) const { return entries[code % TURBIDITY_ADC_CODES].ntu * TURBIDITY_NTU_UNIT; }
+
+    bool    is_calibrated() const { return calibrated != nullptr; }
+    uint8_t calibration_points() const { return point_count; }
+
+private:
+    struct Point
+    {
+        float voltage;
+        float ntu;
+    };
+
+    float interpolate(float voltage) const;
+
+    const TurbidityEntry* entries;
+    TurbidityEntry*       calibrated = nullptr;  // Allocated by the first successful load_calibration()
+    Point                 points[MAX_POINTS];
+    uint8_t               point_count = 0;
+};
@@ -0,0 +1,44 @@
+"""
+Gzip the web interface sources (web/) into the LittleFS image directory (data/www/).
+
+Runs before every PlatformIO build (extra_scripts = pre:scripts/gzip_web.py), so `pio run -t buildfs` and
+`pio run -t uploadfs` always pack the current assets. Can also be run on its own: python scripts/gzip_web.py
+"""
+
+import gzip
+import os
+
+
+def gzip_web_assets(source_dir, target_dir):
+    os.makedirs(target_dir, exist_ok=True)
+
+    sources = sorted(name for name in os.listdir(source_dir) if os.path.isfile(os.path.join(source_dir, name)))
+    for name in sources:
+        source = os.path.join(source_dir, name)
+        target = os.path.join(target_dir, name + ".gz")
+        if os.path.exists(target) and os.path.getmtime(target) >= os.path.getmtime(source):
+            continue
+
+        with open(source, "rb") as source_file:
+            content = source_file.read()
+
+        # mtime=0 keeps the output, and with it the ETag on the device, stable for unchanged sources
+        with open(target, "wb") as target_file:
+            target_file.write(gzip.compress(content, compresslevel=9, mtime=0))
+
+        print("gzip_web: %s %d -> %d bytes" % (name, len(content), os.path.getsize(target)))
+
+    # Assets that were removed from web/ must not linger in the image
+    for name in os.listdir(target_dir):
+        if name.endswith(".gz") and name[:-3] not in sources:
+            os.remove(os.path.join(target_dir, name))
+
+
+if __name__ == "__main__":
+    project_dir = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+    gzip_web_assets(os.path.join(project_dir, "web"), os.path.join(project_dir, "data", "www"))
+else:
+    Import("env")  # noqa: F821 (provided by SCons)
+
+    gzip_web_assets(os.path.join(env.subst("$PROJECT_DIR"), "web"),  # noqa: F821
+                    os.path.join(env.subst("$PROJECT_DATA_DIR"), "www"))  # noqa: F821
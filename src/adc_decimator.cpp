@@ -0,0 +1,50 @@
+/** -----------------------------------------------------------------------------------------------------
+ * @file adc_decimator.cpp
+ *
+ * @brief Oversampling and decimation of a continuous ADC stream into the published sample rate
+ * @version 0.1
+ * @date 2024-2025
+ *  ----------------------------------------------------------------------------------------------------- **/
+
+/** -----------------------------------------------------------------------------------------------------
+ * $ INCLUDES
+ *  ----------------------------------------------------------------------------------------------------- **/
+
+#include "adc_decimator.h"
+
+/** -----------------------------------------------------------------------------------------------------
+ * $ FUNCTION DECLARATIONS
+ *  ----------------------------------------------------------------------------------------------------- **/
+
+AdcDecimator::AdcDecimator(uint32_t decimation) :
+    window(decimation == 0 ? 1 : decimation > MAX_DECIMATION ? MAX_DECIMATION : decimation)
+{
+}
+
+size_t AdcDecimator::push(const uint16_t* codes, size_t count, uint16_t* dest, size_t capacity)
+{
+    size_t outputs = 0;
+    while (count > 0)
+    {
+        // Sum the part of the block that belongs to the current window in one tight loop
+        size_t   taken = window - filled < count ? window - filled : count;
+        uint32_t block = 0;
+        for (size_t i = 0; i < taken; i++) { block += codes[i] & 0x0FFFU; }
+
+        sum += block;
+        filled += taken;
+        codes += taken;
+        count -= taken;
+
+        if (filled == window)
+        {
+            uint64_t scaled = (static_cast<uint64_t>(sum) << FRACTION_BITS) + window / 2;
+            if (outputs < capacity) { dest[outputs++] = static_cast<uint16_t>(scaled / window); }
+
+            sum    = 0;
+            filled = 0;
+        }
+    }
+
+    return outputs;
+}
@@ -0,0 +1,669 @@
+/** -----------------------------------------------------------------------------------------------------
+ * @file async_http_server.cpp
+ *
+ * @brief Event-driven HTTP/1.1 server with keep-alive on top of non-blocking BSD sockets (lwIP or POSIX)
+ * @version 0.1
+ * @date 2024-2025
+ *  ----------------------------------------------------------------------------------------------------- **/
+
+/** -----------------------------------------------------------------------------------------------------
+ * $ INCLUDES
+ *  ----------------------------------------------------------------------------------------------------- **/
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+#include <sys/select.h>
+
+#ifdef ARDUINO
+    #include <lwip/sockets.h>
+#else
+    #include <netinet/in.h>
+    #include <netinet/tcp.h>
+    #include <sys/socket.h>
+#endif
+
+#include "async_http_server.h"
+
+#ifndef MSG_NOSIGNAL
+    #define MSG_NOSIGNAL 0
+#endif
+
+/** -----------------------------------------------------------------------------------------------------
+ * $ FUNCTION DECLARATIONS
+ *  ----------------------------------------------------------------------------------------------------- **/
+
+static const char* status_text(int code)
+{
+    switch (code)
+    {
+        case 200: return "OK";
+        case 204: return "No Content";
+        case 303: return "See Other";
+        case 304: return "Not Modified";
+        case 400: return "Bad Request";
+        case 404: return "Not Found";
+        case 413: return "Payload Too Large";
+        case 500: return "Internal Server Error";
+        case 503: return "Service Unavailable";
+        default: return "Unknown";
+    }
+}
+
+static bool set_non_blocking(int socket)
+{
+    int flags = fcntl(socket, F_GETFL, 0);
+    return flags >= 0 && fcntl(socket, F_SETFL, flags | O_NONBLOCK) == 0;
+}
+
+/**
+ * @brief Find header name in a raw header block ("Name: value\r\n..."), case-insensitive
+ *
+ */
+static bool find_header(const char* headers, size_t length, const char* name, const char** value, size_t* value_length)
+{
+    size_t      name_length = strlen(name);
+    const char* line        = headers;
+    const char* end         = headers + length;
+
+    while (line < end)
+    {
+        const char* line_end = static_cast<const char*>(memchr(line, '\r', end - line));
+        if (line_end == nullptr) { line_end = end; }
+
+        if (static_cast<size_t>(line_end - line) > name_length && line[name_length] == ':'
+            && strncasecmp(line, name, name_length) == 0)
+        {
+            const char* start = line + name_length + 1;
+            while (start < line_end && *start == ' ') { start++; }
+
+            *value        = start;
+            *value_length = line_end - start;
+            return true;
+        }
+
+        line = line_end + 2;
+    }
+
+    return false;
+}
+
+static bool path_equals(const char* uri, const char* path, size_t path_length)
+{
+    return strlen(uri) == path_length && strncmp(uri, path, path_length) == 0;
+}
+
+AsyncHttpServer::AsyncHttpServer(uint16_t port, uint32_t poll_timeout_ms, uint32_t keep_alive_timeout_ms) :
+    port(port),
+    poll_timeout_ms(poll_timeout_ms),
+    keep_alive_timeout_ms(keep_alive_timeout_ms)
+{
+}
+
+void AsyncHttpServer::on(const char* uri, hal::HttpHandler handler)
+{
+    if (route_count < MAX_ROUTES) { routes[route_count++] = {uri, handler}; }
+    else { log_w("AsyncHttpServer route table full, %s not registered", uri); }
+}
+
+void AsyncHttpServer::begin()
+{
+    listen_socket = socket(AF_INET, SOCK_STREAM, 0);
+    if (listen_socket < 0)
+    {
+        log_e("AsyncHttpServer socket failed: %d", errno);
+        return;
+    }
+
+    int enable = 1;
+    setsockopt(listen_socket, SOL_SOCKET, SO_REUSEADDR, &enable, sizeof(enable));
+
+    sockaddr_in address     = {};
+    address.sin_family      = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_ANY);
+    address.sin_port        = htons(port);
+
+    if (bind(listen_socket, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0
+        || listen(listen_socket, MAX_CONNECTIONS) != 0 || !set_non_blocking(listen_socket))
+    {
+        log_e("AsyncHttpServer could not listen on port %u: %d", port, errno);
+        close(listen_socket);
+        listen_socket = -1;
+        return;
+    }
+
+    if (stream_uri != nullptr) { open_wake_socket(); }
+}
+
+void AsyncHttpServer::open_wake_socket()
+{
+    // A UDP socket connected to itself over loopback, the portable way to let another task interrupt select()
+    wake_socket        = socket(AF_INET, SOCK_DGRAM, 0);
+    wake_notify_socket = socket(AF_INET, SOCK_DGRAM, 0);
+
+    sockaddr_in address     = {};
+    address.sin_family      = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    address.sin_port        = 0;
+    socklen_t address_size  = sizeof(address);
+
+    if (wake_socket < 0 || wake_notify_socket < 0
+        || bind(wake_socket, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0
+        || getsockname(wake_socket, reinterpret_cast<sockaddr*>(&address), &address_size) != 0
+        || connect(wake_notify_socket, reinterpret_cast<sockaddr*>(&address), address_size) != 0
+        || !set_non_blocking(wake_socket) || !set_non_blocking(wake_notify_socket))
+    {
+        // Events are still pushed, only delayed by up to poll_timeout_ms
+        log_w("AsyncHttpServer wake socket failed: %d", errno);
+        if (wake_socket >= 0) { close(wake_socket); }
+        if (wake_notify_socket >= 0) { close(wake_notify_socket); }
+        wake_socket        = -1;
+        wake_notify_socket = -1;
+    }
+}
+
+void AsyncHttpServer::handleClient()
+{
+    if (listen_socket < 0) { return; }
+
+    fd_set read_set;
+    fd_set write_set;
+    FD_ZERO(&read_set);
+    FD_ZERO(&write_set);
+
+    int  max_socket    = -1;
+    bool has_free_slot = false;
+    for (Connection& connection : connections)
+    {
+        if (connection.socket < 0)
+        {
+            has_free_slot = true;
+            continue;
+        }
+
+        // A connection either waits for its response to drain or for the next request
+        if (connection.is_sending()) { FD_SET(connection.socket, &write_set); }
+        else { FD_SET(connection.socket, &read_set); }
+
+        if (connection.socket > max_socket) { max_socket = connection.socket; }
+    }
+
+    // New connections stay in the listen backlog while every slot is busy
+    if (has_free_slot)
+    {
+        FD_SET(listen_socket, &read_set);
+        if (listen_socket > max_socket) { max_socket = listen_socket; }
+    }
+
+    if (wake_socket >= 0)
+    {
+        FD_SET(wake_socket, &read_set);
+        if (wake_socket > max_socket) { max_socket = wake_socket; }
+    }
+
+    timeval timeout = {
+        .tv_sec  = static_cast<decltype(timeval::tv_sec)>(poll_timeout_ms / 1'000),
+        .tv_usec = static_cast<decltype(timeval::tv_usec)>((poll_timeout_ms % 1'000) * 1'000),
+    };
+
+    int ready = select(max_socket + 1, &read_set, &write_set, nullptr, &timeout);
+    if (ready < 0 && errno != EINTR) { log_w("AsyncHttpServer select failed: %d", errno); }
+
+    uint32_t now_ms = hal::millis();
+
+    if (ready > 0)
+    {
+        for (Connection& connection : connections)
+        {
+            if (connection.socket < 0) { continue; }
+
+            if (FD_ISSET(connection.socket, &write_set))
+            {
+                connection.last_activity_ms = now_ms;
+                if (flush(connection)) { process(connection); }
+            }
+            else if (FD_ISSET(connection.socket, &read_set)) { receive(connection, now_ms); }
+        }
+
+        if (FD_ISSET(listen_socket, &read_set)) { accept_connections(now_ms); }
+
+        if (wake_socket >= 0 && FD_ISSET(wake_socket, &read_set))
+        {
+            char drain[16];
+            while (recv(wake_socket, drain, sizeof(drain), 0) > 0) {}
+        }
+    }
+
+    push_events(now_ms);
+
+    for (Connection& connection : connections)
+    {
+        if (connection.socket < 0) { continue; }
+
+        // Idle subscribers stay open, a subscriber whose pending event does not drain is dropped like an idle client
+        if ((!connection.is_stream || connection.is_sending())
+            && now_ms - connection.last_activity_ms > keep_alive_timeout_ms)
+        {
+            close_connection(connection);
+        }
+    }
+}
+
+void AsyncHttpServer::accept_connections(uint32_t now_ms)
+{
+    for (Connection& connection : connections)
+    {
+        if (connection.socket >= 0) { continue; }
+
+        int client_socket = accept(listen_socket, nullptr, nullptr);
+        if (client_socket < 0) { return; }
+
+        int enable = 1;
+        setsockopt(client_socket, IPPROTO_TCP, TCP_NODELAY, &enable, sizeof(enable));
+        set_non_blocking(client_socket);
+
+        connection.socket            = client_socket;
+        connection.last_activity_ms  = now_ms;
+        connection.rx_length         = 0;
+        connection.tx_offset         = 0;
+        connection.close_after_flush = false;
+        connection.is_stream         = false;
+        connection.event_version     = 0;
+        connection.tx.clear();
+    }
+}
+
+void AsyncHttpServer::receive(Connection& connection, uint32_t now_ms)
+{
+    size_t available = RX_BUFFER_SIZE - 1 - connection.rx_length;
+    if (available == 0)
+    {
+        send_error(connection, 413);
+        return;
+    }
+
+    ssize_t received = recv(connection.socket, connection.rx + connection.rx_length, available, 0);
+    if (received == 0 || (received < 0 && errno != EWOULDBLOCK && errno != EAGAIN))
+    {
+        close_connection(connection);
+        return;
+    }
+    if (received < 0) { return; }
+
+    // Subscribers only listen, anything they send is discarded
+    if (connection.is_stream) { return; }
+
+    connection.rx_length += received;
+    connection.rx[connection.rx_length] = '\0';
+    connection.last_activity_ms         = now_ms;
+
+    process(connection);
+}
+
+void AsyncHttpServer::process(Connection& connection)
+{
+    // Pipelined requests are answered one at a time, the next one once the previous response has drained
+    while (connection.socket >= 0 && !connection.is_sending() && !connection.close_after_flush && !connection.is_stream)
+    {
+        char* header_end = strstr(connection.rx, "\r\n\r\n");
+        if (header_end == nullptr)
+        {
+            if (connection.rx_length >= RX_BUFFER_SIZE - 1) { send_error(connection, 413); }
+            return;
+        }
+
+        size_t head_length = header_end + 4 - connection.rx;
+
+        // Request line: METHOD SP TARGET SP VERSION CRLF
+        char* target_start = static_cast<char*>(memchr(connection.rx, ' ', head_length));
+        char* target_end   = target_start != nullptr
+                                 ? static_cast<char*>(memchr(target_start + 1, ' ', header_end - target_start - 1))
+                                 : nullptr;
+        char* line_end     = strstr(connection.rx, "\r\n");
+        if (target_start == nullptr || target_end == nullptr || target_end > line_end)
+        {
+            send_error(connection, 400);
+            return;
+        }
+
+        Request request         = {};
+        request.path            = target_start + 1;
+        const char* query_start = static_cast<const char*>(memchr(request.path, '?', target_end - request.path));
+        request.path_length     = (query_start != nullptr ? query_start : target_end) - request.path;
+        request.query           = query_start != nullptr ? query_start + 1 : target_end;
+        request.query_length    = target_end - request.query;
+        request.headers         = line_end + 2;
+        request.headers_length  = header_end + 2 - request.headers;
+
+        bool        http_1_0     = strncmp(target_end + 1, "HTTP/1.0", 8) == 0;
+        const char* value        = nullptr;
+        size_t      value_length = 0;
+
+        // Request bodies are not used by any route, they are skipped once they are fully buffered
+        size_t body_length = 0;
+        if (find_header(request.headers, request.headers_length, "Content-Length", &value, &value_length))
+        {
+            body_length = strtoul(value, nullptr, 10);
+        }
+        // The length on its own first, a huge Content-Length would wrap the sum on the 32-bit board
+        if (body_length > RX_BUFFER_SIZE || head_length + body_length > RX_BUFFER_SIZE - 1)
+        {
+            send_error(connection, 413);
+            return;
+        }
+        if (connection.rx_length < head_length + body_length) { return; }
+
+        current_keep_alive = !http_1_0;
+        if (find_header(request.headers, request.headers_length, "Connection", &value, &value_length))
+        {
+            current_keep_alive = strncasecmp(value, "keep-alive", 10) == 0
+                                 || (!http_1_0 && strncasecmp(value, "close", 5) != 0);
+        }
+
+        hal::HttpHandler handler = nullptr;
+        for (uint8_t i = 0; i < route_count; i++)
+        {
+            if (path_equals(routes[i].uri, request.path, request.path_length))
+            {
+                handler = routes[i].handler;
+                break;
+            }
+        }
+
+        current_connection = &connection;
+        current_request    = &request;
+        current_answered   = false;
+        pending_headers.clear();
+
+        if (stream_uri != nullptr && path_equals(stream_uri, request.path, request.path_length))
+        {
+            open_stream(connection);
+        }
+        else if (handler != nullptr) { handler(); }
+        else { send(404, "text/plain", "Not Found", 9); }
+        if (!current_answered) { send(500, "text/plain", "No Response", 11); }
+
+        current_connection = nullptr;
+        current_request    = nullptr;
+
+        // Drop the handled request from the receive buffer
+        size_t consumed = head_length + body_length;
+        memmove(connection.rx, connection.rx + consumed, connection.rx_length - consumed);
+        connection.rx_length -= consumed;
+        connection.rx[connection.rx_length] = '\0';
+
+        flush(connection);
+    }
+}
+
+bool AsyncHttpServer::flush(Connection& connection)
+{
+    while (connection.is_sending())
+    {
+        if (connection.tx_offset >= connection.tx.size())
+        {
+            // Refill tx with the next chunk of the file, the capacity is reused for every chunk
+            connection.tx.resize(FILE_CHUNK_SIZE);
+            size_t length = fread(connection.tx.data(), 1, FILE_CHUNK_SIZE, connection.file);
+            connection.tx.resize(length);
+            connection.tx_offset = 0;
+
+            if (length < FILE_CHUNK_SIZE)
+            {
+                // A read error leaves the body short of its Content-Length, closing tells the client
+                if (ferror(connection.file)) { connection.close_after_flush = true; }
+                fclose(connection.file);
+                connection.file = nullptr;
+            }
+            continue;
+        }
+
+        ssize_t sent = ::send(connection.socket,
+                              connection.tx.data() + connection.tx_offset,
+                              connection.tx.size() - connection.tx_offset,
+                              MSG_NOSIGNAL);
+        if (sent < 0)
+        {
+            if (errno != EWOULDBLOCK && errno != EAGAIN) { close_connection(connection); }
+            return false;
+        }
+
+        connection.tx_offset += sent;
+    }
+
+    // Keep the capacity for the next response on this connection
+    connection.tx.clear();
+    connection.tx_offset = 0;
+
+    if (connection.close_after_flush)
+    {
+        close_connection(connection);
+        return false;
+    }
+
+    return true;
+}
+
+void AsyncHttpServer::close_connection(Connection& connection)
+{
+    if (connection.socket >= 0) { close(connection.socket); }
+    if (connection.file != nullptr) { fclose(connection.file); }
+
+    connection.socket            = -1;
+    connection.file              = nullptr;
+    connection.rx_length         = 0;
+    connection.rx[0]             = '\0';
+    connection.tx_offset         = 0;
+    connection.close_after_flush = false;
+    connection.is_stream         = false;
+    connection.event_version     = 0;
+    connection.tx.clear();
+}
+
+void AsyncHttpServer::send_error(Connection& connection, int code)
+{
+    // Also after a request this connection or another one answered before, send() ignores an answered request
+    current_connection = &connection;
+    current_keep_alive = false;
+    current_answered   = false;
+    pending_headers.clear();
+
+    send(code, "text/plain", status_text(code), strlen(status_text(code)));
+
+    current_connection   = nullptr;
+    connection.rx_length = 0;
+    connection.rx[0]     = '\0';
+
+    flush(connection);
+}
+
+void AsyncHttpServer::open_stream(Connection& connection)
+{
+    if (open_streams() >= MAX_STREAMS)
+    {
+        send(503, "text/plain", status_text(503), strlen(status_text(503)));
+        return;
+    }
+
+    // No Content-Length, the response lasts as long as the connection. The first event follows in push_events()
+    connection.tx.append("HTTP/1.1 200 OK\r\nContent-Type: text/event-stream\r\nCache-Control: no-cache\r\n"
+                         "Connection: keep-alive\r\n\r\nretry: 2000\n\n");
+    connection.is_stream     = true;
+    connection.event_version = 0;
+    current_answered         = true;
+}
+
+void AsyncHttpServer::push_events(uint32_t now_ms)
+{
+    if (stream_formatter == nullptr) { return; }
+
+    // Format once per published version, however many subscribers there are
+    uint32_t version = published_version.load(std::memory_order_acquire);
+    if (version != formatted_version)
+    {
+        char   data[EVENT_DATA_SIZE];
+        size_t length     = stream_formatter(data, sizeof(data));
+        formatted_version = version;
+
+        event.clear();
+        if (length > 0 && length < sizeof(data))
+        {
+            char id[24];
+            snprintf(id, sizeof(id), "id: %lu\n", static_cast<unsigned long>(version));
+            event.append(id).append("data: ").append(data, length).append("\n\n");
+        }
+    }
+
+    for (Connection& connection : connections)
+    {
+        // Coalescing: a subscriber that is still draining gets the newest event once it is done
+        if (connection.socket < 0 || !connection.is_stream || connection.is_sending()) { continue; }
+
+        if (!event.empty() && connection.event_version != formatted_version)
+        {
+            connection.tx.append(event);
+            connection.event_version = formatted_version;
+        }
+        else if (now_ms - connection.last_activity_ms > HEARTBEAT_MS) { connection.tx.append(":\n\n"); }
+        else { continue; }
+
+        connection.last_activity_ms = now_ms;
+        flush(connection);
+    }
+}
+
+bool AsyncHttpServer::header(const char* name, char* dest, size_t size)
+{
+    const char* value        = nullptr;
+    size_t      value_length = 0;
+
+    if (current_request == nullptr
+        || !find_header(current_request->headers, current_request->headers_length, name, &value, &value_length))
+    {
+        return false;
+    }
+
+    snprintf(dest, size, "%.*s", static_cast<int>(value_length), value);
+    return true;
+}
+
+bool AsyncHttpServer::arg(const char* name, char* dest, size_t size)
+{
+    if (current_request == nullptr) { return false; }
+
+    size_t      name_length = strlen(name);
+    const char* parameter   = current_request->query;
+    const char* end         = current_request->query + current_request->query_length;
+
+    while (parameter < end)
+    {
+        const char* parameter_end = static_cast<const char*>(memchr(parameter, '&', end - parameter));
+        if (parameter_end == nullptr) { parameter_end = end; }
+
+        if (static_cast<size_t>(parameter_end - parameter) >= name_length && strncmp(parameter, name, name_length) == 0
+            && (parameter + name_length == parameter_end || parameter[name_length] == '='))
+        {
+            const char* value = parameter + name_length + (parameter + name_length < parameter_end ? 1 : 0);
+            snprintf(dest, size, "%.*s", static_cast<int>(parameter_end - value), value);
+            return true;
+        }
+
+        parameter = parameter_end + 1;
+    }
+
+    return false;
+}
+
+void AsyncHttpServer::on_event_stream(const char* uri, EventFormatter formatter)
+{
+    stream_uri       = uri;
+    stream_formatter = formatter;
+}
+
+void AsyncHttpServer::notify()
+{
+    published_version.fetch_add(1, std::memory_order_release);
+
+    // Best effort, a full or missing wake socket only delays the event until the next poll
+    if (wake_notify_socket >= 0) { ::send(wake_notify_socket, "", 1, 0); }
+}
+
+void AsyncHttpServer::sendHeader(const char* name, const char* value)
+{
+    pending_headers.append(name).append(": ").append(value).append("\r\n");
+}
+
+void AsyncHttpServer::send(int code, const char* content_type, const char* content, size_t length)
+{
+    if (current_connection == nullptr || current_answered) { return; }
+
+    append_head(code, content_type, length);
+    current_connection->tx.append(content, length);
+}
+
+bool AsyncHttpServer::sendFile(const char* content_type, const char* path)
+{
+    if (current_connection == nullptr || current_answered) { return false; }
+
+    FILE* file = hal::fs_open(path, "rb");
+    if (file == nullptr) { return false; }
+
+    long length = fseek(file, 0, SEEK_END) == 0 ? ftell(file) : -1;
+    if (length < 0 || fseek(file, 0, SEEK_SET) != 0)
+    {
+        fclose(file);
+        return false;
+    }
+
+    size_t path_length = strlen(path);
+    if (path_length > 3 && strcmp(path + path_length - 3, ".gz") == 0) { sendHeader("Content-Encoding", "gzip"); }
+
+    append_head(200, content_type, static_cast<size_t>(length));
+    current_connection->file = file;
+    return true;
+}
+
+void AsyncHttpServer::append_head(int code, const char* content_type, size_t length)
+{
+    char status_line[128];
+    snprintf(status_line,
+             sizeof(status_line),
+             "HTTP/1.1 %d %s\r\nContent-Type: %s\r\nContent-Length: %u\r\nConnection: %s\r\n",
+             code,
+             status_text(code),
+             content_type,
+             static_cast<unsigned>(length),
+             current_keep_alive ? "keep-alive" : "close");
+
+    current_connection->tx.append(status_line).append(pending_headers).append("\r\n");
+
+    current_connection->close_after_flush = !current_keep_alive;
+    current_answered                      = true;
+    pending_headers.clear();
+}
+
+uint8_t AsyncHttpServer::open_connections() const
+{
+    uint8_t count = 0;
+    for (const Connection& connection : connections)
+    {
+        if (connection.socket >= 0) { count++; }
+    }
+
+    return count;
+}
+
+uint8_t AsyncHttpServer::open_streams() const
+{
+    uint8_t count = 0;
+    for (const Connection& connection : connections)
+    {
+        if (connection.socket >= 0 && connection.is_stream) { count++; }
+    }
+
+    return count;
+}
@@ -0,0 +1,269 @@
+/** -----------------------------------------------------------------------------------------------------
+ * @file coroutine_runtime.cpp
+ *
+ * @brief Cooperative C++20 coroutines on one task: frames from a fixed arena, awaitable sleeps, queues, ADC and sockets
+ * @version 0.1
+ * @date 2024-2025
+ *  ----------------------------------------------------------------------------------------------------- **/
+
+/** -----------------------------------------------------------------------------------------------------
+ * $ INCLUDES
+ *  ----------------------------------------------------------------------------------------------------- **/
+
+#include <stdint.h>
+#include <sys/select.h>
+
+#ifdef ARDUINO
+    #include <lwip/sockets.h>
+#endif
+
+#include "coroutine_runtime.h"
+
+/** -----------------------------------------------------------------------------------------------------
+ * $ FUNCTION DECLARATIONS
+ *  ----------------------------------------------------------------------------------------------------- **/
+
+CoroutineArena::CoroutineArena(void* storage, size_t size, size_t slot_size) :
+    // Rounded up so every slot, and the frame behind its header, stays aligned
+    frame_size((slot_size + alignof(SlotHeader) - 1) / alignof(SlotHeader) * alignof(SlotHeader))
+{
+    uintptr_t address = reinterpret_cast<uintptr_t>(storage);
+    uintptr_t aligned = (address + alignof(SlotHeader) - 1) / alignof(SlotHeader) * alignof(SlotHeader);
+    size_t    usable  = size > aligned - address ? size - (aligned - address) : 0;
+    size_t    stride  = sizeof(SlotHeader) + frame_size;
+
+    count = usable / stride;
+    for (size_t i = count; i > 0; i--)
+    {
+        FreeSlot* slot = reinterpret_cast<FreeSlot*>(aligned + (i - 1) * stride);
+        slot->next     = free_list;
+        free_list      = slot;
+    }
+}
+
+void* CoroutineArena::allocate(size_t size)
+{
+    if (size > largest) { largest = size; }
+    if (size > frame_size || free_list == nullptr)
+    {
+        log_w("No coroutine slot for a %u byte frame (%u of %u used, %u bytes each)",
+              static_cast<unsigned>(size),
+              static_cast<unsigned>(used),
+              static_cast<unsigned>(count),
+              static_cast<unsigned>(frame_size));
+        return nullptr;
+    }
+
+    SlotHeader* header = reinterpret_cast<SlotHeader*>(free_list);
+    free_list          = free_list->next;
+    header->arena      = this;
+
+    used++;
+    if (used > max_used) { max_used = used; }
+
+    return header + 1;
+}
+
+void CoroutineArena::release(void* frame)
+{
+    SlotHeader*     header = static_cast<SlotHeader*>(frame) - 1;
+    CoroutineArena* arena  = header->arena;
+
+    FreeSlot* slot   = reinterpret_cast<FreeSlot*>(header);
+    slot->next       = arena->free_list;
+    arena->free_list = slot;
+    arena->used--;
+}
+
+void* Coroutine::promise_type::operator new(size_t size, CoroutineScheduler& scheduler) noexcept
+{
+    return scheduler.arena().allocate(size);
+}
+
+std::coroutine_handle<> Coroutine::promise_type::FinalAwaiter::await_suspend(
+    std::coroutine_handle<promise_type> handle) noexcept
+{
+    promise_type&           promise      = handle.promise();
+    std::coroutine_handle<> continuation = promise.continuation;
+
+    // Nobody awaits a spawned coroutine, the scheduler frees its frame once resume() has returned
+    if (promise.is_spawned) { promise.scheduler.finished = handle; }
+
+    return continuation ? continuation : std::noop_coroutine();
+}
+
+CoroutineWait::CoroutineWait(CoroutineScheduler& scheduler, uint32_t timeout_ms, bool is_polled) :
+    scheduler(scheduler),
+    deadline_us(timeout_ms == hal::WAIT_FOREVER ? UINT64_MAX : hal::micros() + timeout_ms * 1'000ULL),
+    is_polled(is_polled)
+{
+}
+
+CoroutineWait::CoroutineWait(CoroutineScheduler& scheduler, uint64_t deadline_us) :
+    scheduler(scheduler), deadline_us(deadline_us), is_polled(false)
+{
+}
+
+bool CoroutineWait::await_ready()
+{
+    // An event that is already there costs no switch, a passed deadline still suspends (which makes a yield)
+    is_done = is_polled && poll();
+    return is_done;
+}
+
+void CoroutineWait::await_suspend(std::coroutine_handle<> handle)
+{
+    this->handle = handle;
+    scheduler.park(*this);
+}
+
+bool CoroutineReadable::poll()
+{
+    fd_set read_set;
+    FD_ZERO(&read_set);
+    FD_SET(socket, &read_set);
+
+    timeval timeout = {.tv_sec = 0, .tv_usec = 0};
+    return select(socket + 1, &read_set, nullptr, nullptr, &timeout) > 0;
+}
+
+CoroutineScheduler::CoroutineScheduler(CoroutineArena& arena, uint32_t poll_ms) : frames(arena), poll_ms(poll_ms) {}
+
+bool CoroutineScheduler::begin()
+{
+    wake_queue = hal::queue_create(1, sizeof(uint8_t));
+    return wake_queue != nullptr;
+}
+
+bool CoroutineScheduler::spawn(Coroutine&& coroutine)
+{
+    if (!coroutine.handle || coroutine_count == MAX_COROUTINES) { return false; }
+
+    Coroutine::Handle handle    = coroutine.handle;
+    handle.promise().is_spawned = true;
+    coroutine.handle            = nullptr;
+
+    coroutine_count++;
+    make_ready(handle);
+    return true;
+}
+
+void CoroutineScheduler::run()
+{
+    while (true) { run_once(); }
+}
+
+void CoroutineScheduler::run_once()
+{
+    // Done waits become ready in the order they were parked, the others keep their order
+    uint64_t now_us    = hal::micros();
+    uint8_t  remaining = 0;
+    for (uint8_t i = 0; i < wait_count; i++)
+    {
+        CoroutineWait& wait = *waits[i];
+        if (wait.is_polled && wait.poll()) { wait.is_done = true; }
+        else if (now_us < wait.deadline_us)
+        {
+            waits[remaining++] = &wait;
+            continue;
+        }
+
+        make_ready(wait.handle);
+    }
+    wait_count = remaining;
+
+    // Only those ready now, a coroutine that yields runs again in the next round after the waits were checked
+    uint8_t resumes = ready_count;
+    for (uint8_t i = 0; i < resumes; i++)
+    {
+        std::coroutine_handle<> handle = ready[ready_head];
+        ready_head                     = (ready_head + 1) % MAX_COROUTINES;
+        ready_count--;
+
+        totals.resumes++;
+        handle.resume();
+
+        if (finished)
+        {
+            finished.destroy();
+            finished = nullptr;
+            coroutine_count--;
+        }
+    }
+
+    // What ran may have sent to a queue another coroutine waits on, the waits are checked again before sleeping
+    publish();
+    if (resumes > 0) { return; }
+
+    uint64_t wake_us = UINT64_MAX;
+    now_us           = hal::micros();
+    for (uint8_t i = 0; i < wait_count; i++)
+    {
+        uint64_t deadline_us = waits[i]->deadline_us;
+        uint64_t poll_us     = now_us + poll_ms * 1'000ULL;
+        if (waits[i]->is_polled && poll_ms != NO_POLLING && poll_us < deadline_us) { deadline_us = poll_us; }
+        if (deadline_us < wake_us) { wake_us = deadline_us; }
+    }
+    if (wake_us <= now_us) { return; }
+
+    // Rounded up, waking before the deadline would only mean another round of sleeping
+    uint32_t timeout_ms = hal::WAIT_FOREVER;
+    if (wake_us != UINT64_MAX) { timeout_ms = static_cast<uint32_t>((wake_us - now_us + 999) / 1'000); }
+
+    uint8_t token = 0;
+    totals.wakeups++;
+    if (wake_queue != nullptr) { wake_queue->receive(&token, timeout_ms); }
+    else if (timeout_ms != hal::WAIT_FOREVER) { hal::delay_ms(timeout_ms); }
+}
+
+void CoroutineScheduler::notify()
+{
+    uint8_t token = 1;
+    if (wake_queue != nullptr) { wake_queue->send(&token, 0); }  // Full means a wake-up is pending already
+}
+
+CoroutineReceive CoroutineScheduler::receive(hal::Queue& queue, void* item, uint32_t timeout_ms)
+{
+    return CoroutineReceive(*this, queue, item, timeout_ms);
+}
+
+CoroutineAdcFrame CoroutineScheduler::adc_frame(uint16_t* dest, size_t capacity, uint32_t timeout_ms)
+{
+    return CoroutineAdcFrame(*this, dest, capacity, timeout_ms);
+}
+
+CoroutineReadable CoroutineScheduler::readable(int socket, uint32_t timeout_ms)
+{
+    return CoroutineReadable(*this, socket, timeout_ms);
+}
+
+CoroutineCondition CoroutineScheduler::until(CoroutineCondition::Condition condition,
+                                             void*                         context,
+                                             uint32_t                      timeout_ms)
+{
+    return CoroutineCondition(*this, condition, context, timeout_ms);
+}
+
+void CoroutineScheduler::make_ready(std::coroutine_handle<> handle)
+{
+    // Every spawned coroutine has one innermost coroutine, which is either ready or waiting, so this never overflows
+    ready[(ready_head + ready_count) % MAX_COROUTINES] = handle;
+    ready_count++;
+}
+
+void CoroutineScheduler::park(CoroutineWait& wait)
+{
+    waits[wait_count++] = &wait;
+}
+
+void CoroutineScheduler::publish()
+{
+    totals.coroutines            = coroutine_count;
+    totals.waiting               = wait_count;
+    totals.arena_slot_size       = static_cast<uint16_t>(frames.slot_size());
+    totals.arena_slots           = static_cast<uint8_t>(frames.slot_count());
+    totals.arena_slots_used      = static_cast<uint8_t>(frames.slots_used());
+    totals.arena_slots_max_used  = static_cast<uint8_t>(frames.slots_max_used());
+    totals.arena_largest_request = static_cast<uint16_t>(frames.largest_request());
+    published.publish(totals);
+}
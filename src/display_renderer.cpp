@@ -0,0 +1,402 @@
+/** -----------------------------------------------------------------------------------------------------
+ * @file display_renderer.cpp
+ *
+ * @brief Single owner of the display and its SPI bus, drawing widgets from a command queue between touch samples
+ * @version 0.1
+ * @date 2024-2025
+ *  ----------------------------------------------------------------------------------------------------- **/
+
+/** -----------------------------------------------------------------------------------------------------
+ * $ INCLUDES
+ *  ----------------------------------------------------------------------------------------------------- **/
+
+#include <string.h>
+
+#include "display_renderer.h"
+#include "metrics.h"
+
+/** -----------------------------------------------------------------------------------------------------
+ * $ GLOBAL VARIABLES
+ *  ----------------------------------------------------------------------------------------------------- **/
+
+static MetricHistogram frame_seconds_s("display_frame_duration_seconds", "Render pass that drew, transfers included");
+static MetricHistogram command_latency_s("display_command_latency_seconds", "From post() until the widget was drawn");
+static MetricCounter   commands_dropped_s("display_commands_dropped_total", "Commands lost to a full queue");
+
+/** -----------------------------------------------------------------------------------------------------
+ * $ FUNCTION DECLARATIONS
+ *  ----------------------------------------------------------------------------------------------------- **/
+
+DisplayRenderer::DisplayRenderer(hal::Display& display, const DisplayWidget* widgets, uint8_t count) :
+    display(display), widgets(widgets), count(count < MAX_WIDGETS ? count : MAX_WIDGETS)
+{
+}
+
+bool DisplayRenderer::begin(uint8_t touch_irq_pin, TouchCallback on_touch)
+{
+    if (commands == nullptr) { commands = hal::queue_create(QUEUE_DEPTH, sizeof(DisplayCommand)); }
+    if (touches == nullptr) { touches = hal::queue_create(TOUCH_DEPTH, sizeof(TouchEvent)); }
+    if (commands == nullptr || touches == nullptr) { return false; }
+
+    this->touch_irq_pin = touch_irq_pin;
+    this->on_touch      = on_touch;
+
+    touch_wake = {
+        .widget    = UINT8_MAX,
+        .flags     = DISPLAY_TOUCH_WAKE,
+        .color     = 0,
+        .posted_us = 0,
+        .text      = {},
+    };
+    arm_touch();
+
+    return true;
+}
+
+bool DisplayRenderer::post(uint8_t widget, const char* text, uint16_t color, uint8_t flags, uint32_t timeout_ms)
+{
+    DisplayCommand command = {
+        .widget    = widget,
+        .flags     = flags,
+        .color     = color,
+        .posted_us = static_cast<uint32_t>(hal::micros()),
+        .text      = {},
+    };
+    strncpy(command.text, text != nullptr ? text : "", sizeof(command.text) - 1);
+
+    if (commands == nullptr || !commands->send(&command, timeout_ms))
+    {
+        dropped.fetch_add(1, std::memory_order_relaxed);
+        commands_dropped_s.add();
+        return false;
+    }
+
+    return true;
+}
+
+void DisplayRenderer::run(uint8_t rotation, void (*on_first_frame)())
+{
+    display.begin();
+    display.setRotation(rotation);
+    for (hal::Sprite*& sprite : sprites) { sprite = hal::sprite_create(); }
+    last_touch_ms = hal::millis();
+
+    while (true)
+    {
+        uint32_t since_touch = hal::millis() - last_touch_ms;
+        if (!is_touch_awake) { render(hal::WAIT_FOREVER); }
+        else { render(since_touch < TOUCH_PERIOD_MS ? TOUCH_PERIOD_MS - since_touch : 0); }
+
+        if (on_first_frame != nullptr && totals.frames > 0)
+        {
+            on_first_frame();
+            on_first_frame = nullptr;
+        }
+    }
+}
+
+void DisplayRenderer::render(uint32_t wait_ms)
+{
+    DisplayCommand command;
+    if (commands != nullptr && commands->receive(&command, wait_ms))
+    {
+        // Take the whole backlog at once, only the newest command per widget is drawn
+        bool has_staged = false;
+        do
+        {
+            if ((command.flags & DISPLAY_TOUCH_WAKE) == 0)
+            {
+                stage(command);
+                has_staged = true;
+            }
+            else if (!is_touch_awake)
+            {
+                // Sample right away, the press debounce starts with the first read
+                is_touch_awake = true;
+                last_touch_ms  = hal::millis() - TOUCH_PERIOD_MS;
+            }
+        } while (commands->receive(&command, 0));
+
+        if (has_staged) { draw_staged(); }
+    }
+
+    if (is_touch_awake && hal::millis() - last_touch_ms >= TOUCH_PERIOD_MS) { sample_touch(); }
+
+    totals.dropped         = dropped.load(std::memory_order_relaxed);
+    totals.latency_mean_us = latency_count > 0 ? static_cast<uint32_t>(latency_total_us / latency_count) : 0;
+    totals.frame_mean_us   = totals.frames > 0 ? static_cast<uint32_t>(frame_total_us / totals.frames) : 0;
+    published.publish(totals);
+}
+
+bool DisplayRenderer::take_touch(TouchEvent& event, uint32_t timeout_ms)
+{
+    return touches != nullptr && touches->receive(&event, timeout_ms);
+}
+
+int8_t DisplayRenderer::hit_test(int32_t x, int32_t y) const
+{
+    // The table is constant, so this needs nothing from the render task
+    for (uint8_t i = 0; i < count; i++)
+    {
+        if (widgets[i].is_touchable && widgets[i].bounds.contains(x, y)) { return static_cast<int8_t>(i); }
+    }
+
+    return -1;
+}
+
+DisplayStats DisplayRenderer::stats() const
+{
+    DisplayStats result = {};
+    published.try_read(result);
+    result.dropped = dropped.load(std::memory_order_relaxed);
+    return result;
+}
+
+void DisplayRenderer::stage(const DisplayCommand& command)
+{
+    totals.commands++;
+    if (command.widget >= count) { return; }
+
+    if ((command.flags & DISPLAY_CLEAR_SCREEN) != 0)
+    {
+        // Everything on screen goes, persistent widgets come back with their last command
+        is_clear_pending = true;
+        for (uint8_t i = 0; i < count; i++)
+        {
+            if (!widgets[i].is_persistent) { is_shown[i] = is_dirty[i] = false; }
+            else if (is_shown[i] && !is_dirty[i])
+            {
+                is_dirty[i] = true;
+                order[i]    = sequence++;
+            }
+        }
+    }
+
+    uint8_t widget = command.widget;
+    if (is_posted[widget]) { totals.coalesced++; }
+
+    current[widget]   = command;
+    order[widget]     = sequence++;
+    is_shown[widget]  = true;
+    is_dirty[widget]  = true;
+    is_posted[widget] = true;
+}
+
+void DisplayRenderer::draw_staged()
+{
+    uint32_t start_us  = static_cast<uint32_t>(hal::micros());
+    bool     has_drawn = is_clear_pending;
+    display.startFrame();
+
+    if (is_clear_pending)
+    {
+        display.fillScreen(hal::COLOR_BLACK);
+        totals.pixels_pushed += static_cast<uint32_t>(display.width()) * static_cast<uint32_t>(display.height());
+        is_clear_pending = false;
+
+        // Text is diffed against an empty screen, custom widgets have nothing to diff and are drawn in full
+        for (uint8_t i = 0; i < count; i++)
+        {
+            drawn[i]    = {};
+            is_stale[i] = widgets[i].draw != nullptr;
+        }
+    }
+
+    while (true)
+    {
+        // At most MAX_WIDGETS are staged, a scan for the oldest beats sorting
+        uint8_t next = count;
+        for (uint8_t i = 0; i < count; i++)
+        {
+            if (is_dirty[i] && (next == count || order[i] < order[next])) { next = i; }
+        }
+        if (next == count) { break; }
+
+        is_dirty[next] = false;
+        if (widgets[next].draw == nullptr) { draw_text(next); }
+        else if (is_stale[next] || current[next].color != drawn[next].color
+                 || strcmp(current[next].text, drawn[next].text) != 0)
+        {
+            push_area(next, widgets[next].bounds, nullptr, 0);
+            drawn[next]    = current[next];
+            is_stale[next] = false;
+        }
+        has_drawn = true;
+
+        // Redraws after a screen clear were not waiting in the queue
+        if (is_posted[next])
+        {
+            uint32_t latency = static_cast<uint32_t>(hal::micros()) - current[next].posted_us;
+            latency_total_us += latency;
+            latency_count++;
+            if (latency > totals.latency_max_us) { totals.latency_max_us = latency; }
+            command_latency_s.observe_us(latency);
+            is_posted[next] = false;
+        }
+    }
+
+    display.endFrame();
+
+    if (has_drawn)
+    {
+        uint32_t frame_us = static_cast<uint32_t>(hal::micros()) - start_us;
+        frame_total_us += frame_us;
+        if (frame_us > totals.frame_max_us) { totals.frame_max_us = frame_us; }
+        frame_seconds_s.observe_us(frame_us);
+        totals.frames++;
+    }
+}
+
+/**
+ * @brief Redraw the spans of the text lines that differ from what is on screen
+ *
+ */
+void DisplayRenderer::draw_text(uint8_t widget)
+{
+    const DisplayWidget&  config = widgets[widget];
+    const DisplayCommand& next   = current[widget];
+    hal::Sprite*          meter  = sprites[0];
+    if (meter == nullptr || config.line_height <= 0) { return; }
+
+    meter->setTextFont(config.font);
+    meter->setTextSize(config.text_size);
+
+    bool        is_recolored = next.color != drawn[widget].color;
+    const char* new_text     = next.text;
+    const char* old_text     = drawn[widget].text;
+    for (int16_t y = 0; y + config.line_height <= config.bounds.h; y += config.line_height)
+    {
+        char   new_line[DISPLAY_TEXT_SIZE];
+        char   old_line[DISPLAY_TEXT_SIZE];
+        size_t new_length = strcspn(new_text, "\n");
+        size_t old_length = strcspn(old_text, "\n");
+        memcpy(new_line, new_text, new_length);
+        memcpy(old_line, old_text, old_length);
+        new_line[new_length] = '\0';
+        old_line[old_length] = '\0';
+        new_text += new_length + (new_text[new_length] == '\n' ? 1 : 0);
+        old_text += old_length + (old_text[old_length] == '\n' ? 1 : 0);
+
+        int32_t x0 = 0;
+        int32_t x1 = config.bounds.w;
+        if (!is_stale[widget])
+        {
+            if (!is_recolored && strcmp(new_line, old_line) == 0) { continue; }
+
+            // Characters before the first difference stay where they are, in the same color
+            size_t prefix = 0;
+            while (!is_recolored && prefix < new_length && new_line[prefix] == old_line[prefix]) { prefix++; }
+
+            int32_t new_width = meter->textWidth(new_line);
+            int32_t old_width = meter->textWidth(old_line);
+            char    saved     = new_line[prefix];
+            new_line[prefix]  = '\0';
+            x0                = meter->textWidth(new_line);
+            new_line[prefix]  = saved;
+            x1                = new_width > old_width ? new_width : old_width;
+            if (x1 > config.bounds.w) { x1 = config.bounds.w; }
+        }
+        if (x1 <= x0) { continue; }
+
+        DisplayRect area = {
+            .x = static_cast<int16_t>(config.bounds.x + x0),
+            .y = static_cast<int16_t>(config.bounds.y + y),
+            .w = static_cast<int16_t>(x1 - x0),
+            .h = config.line_height,
+        };
+        push_area(widget, area, new_line, area.y);
+    }
+
+    drawn[widget]    = next;
+    is_stale[widget] = false;
+}
+
+/**
+ * @brief Draw area of the screen into sprites, in bands of at most MAX_SPRITE_PIXELS, and push them
+ *
+ * A text line starting at screen row line_y is drawn when line is set, otherwise the draw function of the widget.
+ */
+void DisplayRenderer::push_area(uint8_t widget, const DisplayRect& area, const char* line, int16_t line_y)
+{
+    const DisplayWidget& config = widgets[widget];
+    int16_t band_height = static_cast<int16_t>(MAX_SPRITE_PIXELS / area.w > 0 ? MAX_SPRITE_PIXELS / area.w : 1);
+
+    for (int16_t y = area.y; y < area.y + area.h; y += band_height)
+    {
+        int16_t      height = area.y + area.h - y < band_height ? area.y + area.h - y : band_height;
+        hal::Sprite* sprite = sprites[next_sprite];
+        next_sprite         = (next_sprite + 1) % 2;
+        if (sprite == nullptr || !sprite->create(area.w, height))
+        {
+            log_w("Could not allocate a %dx%d sprite", area.w, height);
+            return;
+        }
+
+        sprite->fill(hal::COLOR_BLACK);
+        if (line != nullptr)
+        {
+            sprite->setTextFont(config.font);
+            sprite->setTextSize(config.text_size);
+            sprite->setTextColor(current[widget].color, hal::COLOR_BLACK);
+            sprite->setTextDatum(hal::DATUM_TOP_LEFT);
+            sprite->drawString(line, config.bounds.x - area.x, line_y - y);
+        }
+        else
+        {
+            DisplayRect bounds = {
+                .x = static_cast<int16_t>(config.bounds.x - area.x),
+                .y = static_cast<int16_t>(config.bounds.y - y),
+                .w = config.bounds.w,
+                .h = config.bounds.h,
+            };
+            config.draw(*sprite, bounds, current[widget]);
+        }
+
+        sprite->push(area.x, y);
+        totals.pixels_pushed += static_cast<uint32_t>(area.w) * static_cast<uint32_t>(height);
+    }
+
+    // Overlapping widgets lost what they drew there, their next update has nothing to diff against
+    for (uint8_t i = 0; i < count; i++)
+    {
+        if (i != widget && widgets[i].bounds.intersects(area)) { is_stale[i] = true; }
+    }
+}
+
+void DisplayRenderer::sample_touch()
+{
+    last_touch_ms = hal::millis();
+
+    uint16_t x          = 0;
+    uint16_t y          = 0;
+    bool     is_touched = display.getTouch(&x, &y);
+    totals.touch_samples++;
+
+    TouchEvent event;
+    if (gestures.update(is_touched, x, y, last_touch_ms, event))
+    {
+        // A touch task that falls behind loses events, never the render task its frame time
+        if (touches->send(&event, 0))
+        {
+            totals.touches++;
+            if (on_touch != nullptr) { on_touch(); }
+        }
+    }
+
+    if (!gestures.is_active())
+    {
+        is_touch_awake = false;
+        arm_touch();
+    }
+}
+
+/**
+ * @brief Wait for the next falling edge of the touch IRQ line
+ *
+ * The line may have gone low before the interrupt was armed again, that edge is lost and the press is picked up here.
+ */
+void DisplayRenderer::arm_touch()
+{
+    if (!hal::pin_interrupt_once(touch_irq_pin, commands, &touch_wake)) { log_w("Could not arm the touch interrupt"); }
+    else if (!hal::pin_read(touch_irq_pin)) { is_touch_awake = true; }
+}
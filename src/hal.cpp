@@ -0,0 +1,86 @@
+/** -----------------------------------------------------------------------------------------------------
+ * @file hal.cpp
+ *
+ * @brief Platform independent helpers of the hardware abstraction layer
+ * @version 0.1
+ * @date 2024-2025
+ *  ----------------------------------------------------------------------------------------------------- **/
+
+/** -----------------------------------------------------------------------------------------------------
+ * $ INCLUDES
+ *  ----------------------------------------------------------------------------------------------------- **/
+
+#include <stdio.h>
+#include <string.h>
+#include <dirent.h>
+#include <sys/stat.h>
+
+#include "hal.h"
+
+/** -----------------------------------------------------------------------------------------------------
+ * $ FUNCTION DECLARATIONS
+ *  ----------------------------------------------------------------------------------------------------- **/
+
+namespace hal
+{
+    void HttpServer::send(int code, const char* content_type, const char* content)
+    {
+        send(code, content_type, content, strlen(content));
+    }
+
+    // The data partition is reachable with stdio on both platforms (the VFS on the ESP32), only its root differs
+    FILE* fs_open(const char* path, const char* mode)
+    {
+        char full_path[128];
+        fs_path(path, full_path, sizeof(full_path));
+        return fopen(full_path, mode);
+    }
+
+    bool fs_remove(const char* path)
+    {
+        char full_path[128];
+        fs_path(path, full_path, sizeof(full_path));
+        return remove(full_path) == 0;
+    }
+
+    bool fs_mkdir(const char* path)
+    {
+        char        full_path[128];
+        struct stat info;
+        fs_path(path, full_path, sizeof(full_path));
+        return (stat(full_path, &info) == 0 && S_ISDIR(info.st_mode)) || mkdir(full_path, 0755) == 0;
+    }
+
+    bool fs_list(const char* path, FsListHandler handler, void* context)
+    {
+        char full_path[128];
+        fs_path(path, full_path, sizeof(full_path));
+
+        DIR* directory = opendir(full_path);
+        if (directory == nullptr) { return false; }
+
+        while (dirent* entry = readdir(directory))
+        {
+            if (entry->d_name[0] != '.') { handler(entry->d_name, context); }
+        }
+        closedir(directory);
+
+        return true;
+    }
+
+    void Console::println(const char* text)
+    {
+        print(text);
+        print("\n");
+    }
+
+    void Console::printf(const char* format, ...)
+    {
+        char    buffer[256];
+        va_list args;
+        va_start(args, format);
+        vsnprintf(buffer, sizeof(buffer), format, args);
+        va_end(args);
+        print(buffer);
+    }
+}  // namespace hal
@@ -0,0 +1,763 @@
+/** -----------------------------------------------------------------------------------------------------
+ * @file hal_esp32.cpp
+ *
+ * @brief Hardware abstraction layer for the ESP32 (Arduino, FreeRTOS, TFT_eSPI, RMT, WebServer)
+ * @version 0.1
+ * @date 2024-2025
+ *  ----------------------------------------------------------------------------------------------------- **/
+
+/** -----------------------------------------------------------------------------------------------------
+ * $ INCLUDES
+ *  ----------------------------------------------------------------------------------------------------- **/
+
+#include <atomic>
+
+#include <Arduino.h>
+#include <SPI.h>
+#include <WiFi.h>
+#include <WebServer.h>
+#include <WiFiManager.h>
+#include <LittleFS.h>
+#include <Preferences.h>
+#include <TFT_eSPI.h>
+#include <driver/rmt_tx.h>
+#include <esp_adc/adc_continuous.h>
+
+#include "hal.h"
+
+/** -----------------------------------------------------------------------------------------------------
+ * $ GLOBAL VARIABLES
+ *  ----------------------------------------------------------------------------------------------------- **/
+
+/**
+ * @brief TFT_eSPI object, providing the display functionality
+ *
+ */
+static TFT_eSPI tft_s = TFT_eSPI();
+
+/**
+ * @brief WiFiManager object, providing the WiFi connection functionality
+ *
+ */
+static WiFiManager wifi_manager_s;
+
+/**
+ * @brief WebServer object, providing the web server functionality
+ *
+ */
+static WebServer server_s(WEBSERVER_PORT);
+
+/**
+ * @brief Continuous ADC driver handle, set by adc_stream_begin()
+ *
+ */
+static adc_continuous_handle_t adc_stream_s = nullptr;
+
+/**
+ * @brief Queue and item of adc_stream_begin(), sent from the conversion-done interrupt
+ *
+ */
+struct AdcFrameInterrupt
+{
+    QueueHandle_t queue;
+    const void*   item;
+};
+
+static AdcFrameInterrupt adc_frame_interrupt_s = {};
+
+static hal::PortalHandler portal_handler_s = nullptr;
+
+/**
+ * @brief Access point of the last connection, also kept in NVS so the first attempt after a reboot skips the scan
+ *
+ */
+struct WifiCache
+{
+    uint8_t bssid[6];
+    int32_t channel;  // 0 while nothing is cached
+};
+
+static WifiCache wifi_cache_s      = {};
+static bool      is_wifi_started_s = false;  // Event handler registered and cache loaded
+static bool      is_sntp_started_s = false;
+
+static const char* const WIFI_CACHE_NAMESPACE = "wifi_cache";  // NVS
+
+/**
+ * @brief Interrupts of pin_interrupt_once(), indexed by GPIO number
+ *
+ */
+struct PinInterrupt
+{
+    QueueHandle_t     queue;
+    const void*       item;
+    std::atomic<bool> is_armed;
+    bool              is_attached;
+};
+
+constexpr static const uint8_t PIN_INTERRUPT_COUNT = 40;  // GPIO0 to GPIO39
+
+static PinInterrupt pin_interrupts_s[PIN_INTERRUPT_COUNT];
+
+/**
+ * @brief Tasks started with task_create(), FreeRTOS does not report the stack size it allocated
+ *
+ */
+struct CreatedTask
+{
+    TaskHandle_t handle;
+    uint32_t     stack_size;
+};
+
+constexpr static const uint8_t MAX_CREATED_TASKS = 16;
+constexpr static const uint8_t MAX_LISTED_TASKS  = 32;
+
+static CreatedTask          created_tasks_s[MAX_CREATED_TASKS];
+static std::atomic<uint8_t> created_task_count_s = 0;
+#if configUSE_TRACE_FACILITY
+static TaskStatus_t task_status_s[MAX_LISTED_TASKS];  // Too large for the stack of the caller
+#endif
+
+/**
+ * @brief VFS mount point of LittleFS, files are reachable with stdio below it
+ *
+ */
+static const char* const FS_BASE_PATH = "/littlefs";
+
+/** -----------------------------------------------------------------------------------------------------
+ * $ FUNCTION DECLARATIONS
+ *  ----------------------------------------------------------------------------------------------------- **/
+
+namespace hal
+{
+    class Esp32Mutex : public Mutex
+    {
+    public:
+        Esp32Mutex() : handle(xSemaphoreCreateMutex()) {}
+
+        bool take(uint32_t timeout_ms) override
+        {
+            return handle != NULL && xSemaphoreTake(handle, pdMS_TO_TICKS(timeout_ms)) == pdTRUE;
+        }
+        void give() override { xSemaphoreGive(handle); }
+
+    private:
+        SemaphoreHandle_t handle;
+    };
+
+    class Esp32Queue : public Queue
+    {
+    public:
+        Esp32Queue(size_t length, size_t item_size) : handle(xQueueCreate(length, item_size)) {}
+
+        bool send(const void* item, uint32_t timeout_ms) override
+        {
+            return handle != NULL && xQueueSend(handle, item, to_ticks(timeout_ms)) == pdTRUE;
+        }
+        bool receive(void* item, uint32_t timeout_ms) override
+        {
+            return handle != NULL && xQueueReceive(handle, item, to_ticks(timeout_ms)) == pdTRUE;
+        }
+
+        QueueHandle_t native_handle() const { return handle; }
+
+    private:
+        static TickType_t to_ticks(uint32_t timeout_ms)
+        {
+            return timeout_ms == WAIT_FOREVER ? portMAX_DELAY : pdMS_TO_TICKS(timeout_ms);
+        }
+
+        QueueHandle_t handle;
+    };
+
+    class Esp32Display : public Display
+    {
+    public:
+        void begin() override
+        {
+            tft_s.begin();
+            is_dma = tft_s.initDMA();
+            if (!is_dma) { log_w("TFT DMA unavailable, sprites are pushed by the CPU"); }
+        }
+        int16_t width() override { return tft_s.width(); }
+        int16_t height() override { return tft_s.height(); }
+        void    setRotation(uint8_t rotation) override { tft_s.setRotation(rotation); }
+        void    fillScreen(uint16_t color) override { tft_s.fillScreen(color); }
+        void    startFrame() override { tft_s.startWrite(); }
+        void    endFrame() override
+        {
+            tft_s.dmaWait();
+            tft_s.endWrite();
+        }
+        bool getTouch(uint16_t* x, uint16_t* y) override { return tft_s.getTouch(x, y); }
+
+        bool is_dma = false;
+    };
+
+    class Esp32Sprite : public Sprite
+    {
+    public:
+        Esp32Sprite() : sprite(&tft_s) { sprite.setColorDepth(16); }
+
+        bool create(int16_t w, int16_t h) override
+        {
+            if (pushing_s == this) { tft_s.dmaWait(); }  // The pixels may still be on their way to the display
+            if (sprite.created() && sprite.width() == w && sprite.height() == h) { return true; }
+
+            sprite.deleteSprite();
+            return sprite.createSprite(w, h) != nullptr;
+        }
+        void fill(uint16_t color) override { sprite.fillSprite(color); }
+        void fillRoundRect(int32_t x, int32_t y, int32_t w, int32_t h, int32_t r, uint16_t color) override
+        {
+            sprite.fillRoundRect(x, y, w, h, r, color);
+        }
+        void drawRoundRect(int32_t x, int32_t y, int32_t w, int32_t h, int32_t r, uint16_t color) override
+        {
+            sprite.drawRoundRect(x, y, w, h, r, color);
+        }
+        void    setTextFont(uint8_t font) override { sprite.setTextFont(font); }
+        void    setTextColor(uint16_t fg_color, uint16_t bg_color) override { sprite.setTextColor(fg_color, bg_color); }
+        void    setTextSize(uint8_t size) override { sprite.setTextSize(size); }
+        void    setTextDatum(uint8_t datum) override { sprite.setTextDatum(datum); }
+        int16_t textWidth(const char* text) override { return sprite.textWidth(text); }
+        void    drawString(const char* text, int32_t x, int32_t y) override { sprite.drawString(text, x, y); }
+        void    push(int16_t x, int16_t y) override
+        {
+            if (!sprite.created()) { return; }
+
+            // Sprite pixels are stored in the byte order of the display, DMA sends them as they are
+            if (static_cast<Esp32Display&>(display()).is_dma)
+            {
+                tft_s.pushImageDMA(x, y, sprite.width(), sprite.height(), static_cast<uint16_t*>(sprite.getPointer()));
+                pushing_s = this;
+            }
+            else { sprite.pushSprite(x, y); }
+        }
+
+    private:
+        static inline Esp32Sprite* pushing_s = nullptr;  // Owner of the last DMA transfer, pushImageDMA() queues one
+
+        TFT_eSprite sprite;
+    };
+
+    class Esp32StepGenerator : public StepGenerator
+    {
+    public:
+        bool begin(uint8_t step_pin, uint8_t direction_pin) override
+        {
+            this->direction_pin = direction_pin;
+            pinMode(direction_pin, OUTPUT);
+
+            rmt_tx_channel_config_t channel_config = {};
+            channel_config.gpio_num                = static_cast<gpio_num_t>(step_pin);
+            channel_config.clk_src                 = RMT_CLK_SRC_DEFAULT;
+            channel_config.resolution_hz           = STEP_TICK_HZ;
+            channel_config.mem_block_symbols       = 64;
+            channel_config.trans_queue_depth       = 2;  // The ramp and the looping cruise symbol
+
+            rmt_copy_encoder_config_t encoder_config = {};
+            return rmt_new_tx_channel(&channel_config, &channel) == ESP_OK
+                   && rmt_new_copy_encoder(&encoder_config, &encoder) == ESP_OK && rmt_enable(channel) == ESP_OK;
+        }
+        void setDirection(bool forward) override { digitalWrite(direction_pin, forward ? HIGH : LOW); }
+        bool run(const uint16_t* ramp, uint16_t from, uint16_t to, uint32_t interval, uint32_t wait) override
+        {
+            uint16_t count = from < to ? to - from : from - to;
+            if (channel == nullptr || count > MAX_RAMP_STEPS) { return false; }
+            if (interval != 0 && (interval < MIN_STEP_INTERVAL || interval > MAX_STEP_INTERVAL)) { return false; }
+
+            // Disabling drops the transactions in flight, so the symbol buffers can be rewritten
+            stop();
+
+            // A zero duration ends a transmission, a wait that short is dropped
+            size_t length = 0;
+            if (wait >= 2 && wait <= MAX_STEP_INTERVAL)
+            {
+                ramp_symbols[length]          = symbol(wait);
+                ramp_symbols[length++].level0 = 0;
+            }
+            for (uint16_t i = 0; i < count; i++)
+            {
+                ramp_symbols[length++] = symbol(from < to ? ramp[from + i] : ramp[from - 1 - i]);
+            }
+            cruise_symbol = symbol(interval);
+
+            // The driver starts the queued cruise loop as soon as the ramp has been emitted
+            rmt_transmit_config_t once       = {};
+            size_t                ramp_bytes = length * sizeof(rmt_symbol_word_t);
+            bool result = length == 0 || rmt_transmit(channel, encoder, ramp_symbols, ramp_bytes, &once) == ESP_OK;
+            if (result && interval != 0)
+            {
+                rmt_transmit_config_t loop = {};
+                loop.loop_count            = -1;
+                result = rmt_transmit(channel, encoder, &cruise_symbol, sizeof(cruise_symbol), &loop) == ESP_OK;
+            }
+
+            return result;
+        }
+        void stop() override
+        {
+            if (channel == nullptr) { return; }
+
+            rmt_disable(channel);
+            rmt_enable(channel);
+        }
+
+    private:
+        // One symbol per step, high for half the interval
+        static rmt_symbol_word_t symbol(uint32_t interval)
+        {
+            rmt_symbol_word_t result = {};
+            result.level0            = 1;
+            result.duration0         = interval / 2;
+            result.level1            = 0;
+            result.duration1         = interval - interval / 2;
+            return result;
+        }
+
+        uint8_t              direction_pin = 0;
+        rmt_channel_handle_t channel       = nullptr;
+        rmt_encoder_handle_t encoder       = nullptr;
+        rmt_symbol_word_t    ramp_symbols[MAX_RAMP_STEPS + 1];  // Wait and ramp, read by the driver while emitted
+        rmt_symbol_word_t    cruise_symbol = {};
+    };
+
+    class Esp32HttpServer : public HttpServer
+    {
+    public:
+        void on(const char* uri, HttpHandler handler) override { server_s.on(uri, handler); }
+        void collectHeaders(const char** names, size_t count) override { server_s.collectHeaders(names, count); }
+        void begin() override { server_s.begin(); }
+        void handleClient() override { server_s.handleClient(); }
+        bool header(const char* name, char* dest, size_t size) override
+        {
+            if (!server_s.hasHeader(name)) { return false; }
+
+            snprintf(dest, size, "%s", server_s.header(name).c_str());
+            return true;
+        }
+        bool arg(const char* name, char* dest, size_t size) override
+        {
+            if (!server_s.hasArg(name)) { return false; }
+
+            snprintf(dest, size, "%s", server_s.arg(name).c_str());
+            return true;
+        }
+        void sendHeader(const char* name, const char* value) override { server_s.sendHeader(name, value); }
+        void send(int code, const char* content_type, const char* content, size_t length) override
+        {
+            server_s.send_P(code, content_type, content, length);
+        }
+        bool sendFile(const char* content_type, const char* path) override
+        {
+            File file = LittleFS.open(path, "r");
+            if (!file) { return false; }
+
+            server_s.streamFile(file, content_type);
+            file.close();
+            return true;
+        }
+    };
+
+    class Esp32Console : public Console
+    {
+    public:
+        void begin(uint32_t baud_rate) override { Serial.begin(baud_rate); }
+        void print(const char* text) override { Serial.print(text); }
+    };
+
+    Display& display()
+    {
+        static Esp32Display display_s;
+        return display_s;
+    }
+
+    Sprite* sprite_create() { return new Esp32Sprite(); }
+
+    StepGenerator& step_generator()
+    {
+        static Esp32StepGenerator step_generator_s;
+        return step_generator_s;
+    }
+
+    HttpServer& http_server()
+    {
+        static Esp32HttpServer http_server_s;
+        return http_server_s;
+    }
+
+    Console& console()
+    {
+        static Esp32Console console_s;
+        return console_s;
+    }
+
+    void pin_input(uint8_t pin) { pinMode(pin, INPUT); }
+    void pin_output(uint8_t pin) { pinMode(pin, OUTPUT); }
+    void pin_write(uint8_t pin, bool high) { digitalWrite(pin, high ? HIGH : LOW); }
+    bool pin_read(uint8_t pin) { return digitalRead(pin) == HIGH; }
+
+    static void IRAM_ATTR pin_interrupt_isr(void* argument)
+    {
+        PinInterrupt* pin_interrupt = static_cast<PinInterrupt*>(argument);
+        if (!pin_interrupt->is_armed.exchange(false)) { return; }
+
+        BaseType_t is_woken = pdFALSE;
+        xQueueSendFromISR(pin_interrupt->queue, pin_interrupt->item, &is_woken);
+        portYIELD_FROM_ISR(is_woken);
+    }
+
+    bool pin_interrupt_once(uint8_t pin, Queue* queue, const void* item)
+    {
+        if (pin >= PIN_INTERRUPT_COUNT || queue == nullptr) { return false; }
+
+        // Set before arming, the interrupt only reads them once it sees is_armed
+        PinInterrupt& pin_interrupt = pin_interrupts_s[pin];
+        pin_interrupt.queue         = static_cast<Esp32Queue*>(queue)->native_handle();
+        pin_interrupt.item          = item;
+        pin_interrupt.is_armed.store(true);
+
+        if (!pin_interrupt.is_attached)
+        {
+            pinMode(pin, INPUT_PULLUP);
+            attachInterruptArg(pin, pin_interrupt_isr, &pin_interrupt, FALLING);
+            pin_interrupt.is_attached = true;
+        }
+
+        return true;
+    }
+
+    uint16_t adc_read(uint8_t pin) { return analogRead(pin); }
+
+    static bool IRAM_ATTR adc_frame_isr(adc_continuous_handle_t          handle,
+                                        const adc_continuous_evt_data_t* data,
+                                        void*                            argument)
+    {
+        AdcFrameInterrupt* frame_interrupt = static_cast<AdcFrameInterrupt*>(argument);
+
+        // The driver yields on true
+        BaseType_t is_woken = pdFALSE;
+        xQueueSendFromISR(frame_interrupt->queue, frame_interrupt->item, &is_woken);
+        return is_woken == pdTRUE;
+    }
+
+    bool adc_stream_begin(uint8_t     pin,
+                          uint32_t    sample_rate_hz,
+                          size_t      block_samples,
+                          Queue*      frame_queue,
+                          const void* item)
+    {
+        adc_unit_t    unit    = ADC_UNIT_1;
+        adc_channel_t channel = ADC_CHANNEL_0;
+        if (adc_stream_s != nullptr || adc_continuous_io_to_channel(pin, &unit, &channel) != ESP_OK
+            || unit != ADC_UNIT_1)
+        {
+            return false;
+        }
+
+        // Four frames of DMA pool, the reader has three frame times to pick one up before conversions are dropped
+        adc_continuous_handle_cfg_t handle_config = {};
+        handle_config.conv_frame_size             = block_samples * SOC_ADC_DIGI_RESULT_BYTES;
+        handle_config.max_store_buf_size          = handle_config.conv_frame_size * 4;
+
+        // Same attenuation as analogRead(), full scale is about 3.1 V
+        adc_digi_pattern_config_t pattern = {};
+        pattern.atten                     = ADC_ATTEN_DB_12;
+        pattern.channel                   = channel;
+        pattern.unit                      = unit;
+        pattern.bit_width                 = SOC_ADC_DIGI_MAX_BITWIDTH;
+
+        adc_continuous_config_t config = {};
+        config.pattern_num             = 1;
+        config.adc_pattern             = &pattern;
+        config.sample_freq_hz          = sample_rate_hz;
+        config.conv_mode               = ADC_CONV_SINGLE_UNIT_1;
+        config.format                  = ADC_DIGI_OUTPUT_FORMAT_TYPE1;
+
+        if (adc_continuous_new_handle(&handle_config, &adc_stream_s) != ESP_OK
+            || adc_continuous_config(adc_stream_s, &config) != ESP_OK)
+        {
+            return false;
+        }
+
+        // Callbacks can only be registered while the stream is stopped
+        if (frame_queue != nullptr)
+        {
+            adc_frame_interrupt_s.queue = static_cast<Esp32Queue*>(frame_queue)->native_handle();
+            adc_frame_interrupt_s.item  = item;
+
+            adc_continuous_evt_cbs_t callbacks = {};
+            callbacks.on_conv_done             = adc_frame_isr;
+            if (adc_continuous_register_event_callbacks(adc_stream_s, &callbacks, &adc_frame_interrupt_s) != ESP_OK)
+            {
+                return false;
+            }
+        }
+
+        return adc_continuous_start(adc_stream_s) == ESP_OK;
+    }
+
+    size_t adc_stream_read(uint16_t* dest, size_t capacity, uint32_t timeout_ms)
+    {
+        static_assert(SOC_ADC_DIGI_RESULT_BYTES == sizeof(uint16_t), "Type 1 results (ESP32) are decoded in place");
+
+        // The driver blocks on its frame pool, the task sleeps until the DMA has filled a frame
+        uint32_t length = 0;
+        if (adc_stream_s == nullptr
+            || adc_continuous_read(adc_stream_s,
+                                   reinterpret_cast<uint8_t*>(dest),
+                                   capacity * SOC_ADC_DIGI_RESULT_BYTES,
+                                   &length,
+                                   timeout_ms)
+                   != ESP_OK)
+        {
+            return 0;
+        }
+
+        size_t count = length / SOC_ADC_DIGI_RESULT_BYTES;
+        for (size_t i = 0; i < count; i++)
+        {
+            adc_digi_output_data_t result = {};
+            result.val                    = dest[i];
+            dest[i]                       = result.type1.data;
+        }
+
+        return count;
+    }
+
+    uint32_t millis() { return ::millis(); }
+    uint64_t micros() { return esp_timer_get_time(); }
+    void     delay_ms(uint32_t ms) { ::delay(ms); }
+
+    void delay_until_us(uint64_t wake_us)
+    {
+        int64_t remaining_us = static_cast<int64_t>(wake_us - esp_timer_get_time());
+        if (remaining_us <= 0) { return; }
+
+        // Whole ticks counted from the current one, which has partly passed already
+        constexpr int64_t TICK_US = portTICK_PERIOD_MS * 1'000;
+        vTaskDelay(static_cast<TickType_t>((remaining_us + TICK_US - 1) / TICK_US));
+    }
+    uint32_t cycle_count() { return ESP.getCycleCount(); }
+    uint32_t cycles_per_us() { return getCpuFrequencyMhz(); }
+
+    uint32_t unix_time()
+    {
+        // Anything before 2024 is the unsynchronised RTC counting from 1970
+        time_t now = time(nullptr);
+        return now > 1'704'067'200 ? static_cast<uint32_t>(now) : 0;
+    }
+
+    Mutex* mutex_create() { return new Esp32Mutex(); }
+
+    Queue* queue_create(size_t length, size_t item_size) { return new Esp32Queue(length, item_size); }
+
+    bool task_create(TaskFunction function,
+                     const char*  name,
+                     uint32_t     stack_size,
+                     void*        parameter,
+                     uint8_t      priority,
+                     int8_t       core)
+    {
+        TaskHandle_t handle = nullptr;
+        if (xTaskCreatePinnedToCore(function, name, stack_size, parameter, priority, &handle, core) != pdPASS)
+        {
+            return false;
+        }
+
+        uint8_t index = created_task_count_s.load(std::memory_order_relaxed);
+        if (index < MAX_CREATED_TASKS)
+        {
+            created_tasks_s[index] = {.handle = handle, .stack_size = stack_size};
+            created_task_count_s.store(index + 1, std::memory_order_release);
+        }
+
+        return true;
+    }
+
+    static uint32_t created_stack_size(TaskHandle_t handle)
+    {
+        uint8_t count = created_task_count_s.load(std::memory_order_acquire);
+        for (uint8_t i = 0; i < count; i++)
+        {
+            if (created_tasks_s[i].handle == handle) { return created_tasks_s[i].stack_size; }
+        }
+
+        return 0;
+    }
+
+    static TaskInfo to_task_info(TaskHandle_t handle, uint32_t run_time_us)
+    {
+        BaseType_t core = xTaskGetCoreID(handle);
+        TaskInfo   info = {
+            .name           = {},
+            .run_time_us    = run_time_us,
+            .stack_size     = created_stack_size(handle),
+            .stack_free_min = uxTaskGetStackHighWaterMark(handle),  // Bytes, the stack type of ESP-IDF is a byte
+            .priority       = static_cast<uint8_t>(uxTaskPriorityGet(handle)),
+            .core           = static_cast<int8_t>(core == tskNO_AFFINITY ? -1 : core),
+            .is_idle        = core != tskNO_AFFINITY && handle == xTaskGetIdleTaskHandleForCore(core),
+        };
+        strncpy(info.name, pcTaskGetName(handle), sizeof(info.name) - 1);
+
+        return info;
+    }
+
+    size_t task_list(TaskInfo* dest, size_t capacity)
+    {
+#if configUSE_TRACE_FACILITY
+        // ESP-IDF counts run time in esp_timer microseconds
+        UBaseType_t count = uxTaskGetSystemState(task_status_s, MAX_LISTED_TASKS, nullptr);
+        if (count > capacity) { count = capacity; }
+
+        for (UBaseType_t i = 0; i < count; i++)
+        {
+    #if configGENERATE_RUN_TIME_STATS
+            uint32_t run_time_us = static_cast<uint32_t>(task_status_s[i].ulRunTimeCounter);
+    #else
+            uint32_t run_time_us = 0;
+    #endif
+            dest[i] = to_task_info(task_status_s[i].xHandle, run_time_us);
+        }
+
+        return count;
+#else
+        // Without the trace facility only the own tasks are known, and none of their run time
+        size_t count = created_task_count_s.load(std::memory_order_acquire);
+        if (count > capacity) { count = capacity; }
+
+        for (size_t i = 0; i < count; i++) { dest[i] = to_task_info(created_tasks_s[i].handle, 0); }
+
+        return count;
+#endif
+    }
+
+    bool fs_mount() { return LittleFS.begin(true, FS_BASE_PATH); }
+
+    void fs_path(const char* path, char* dest, size_t size) { snprintf(dest, size, "%s%s", FS_BASE_PATH, path); }
+
+    bool wifi_begin(bool use_cached)
+    {
+        if (!is_wifi_started_s)
+        {
+            Preferences preferences;
+            if (preferences.begin(WIFI_CACHE_NAMESPACE, true))
+            {
+                if (preferences.getBytes("ap", &wifi_cache_s, sizeof(wifi_cache_s)) != sizeof(wifi_cache_s))
+                {
+                    wifi_cache_s = {};
+                }
+                preferences.end();
+            }
+
+            // Runs in the WiFi event task once the connection has an address
+            WiFi.onEvent(
+                [](arduino_event_id_t event, arduino_event_info_t info)
+                {
+                    if (!is_sntp_started_s)
+                    {
+                        configTime(0, 0, "pool.ntp.org");  // UTC, SNTP keeps the clock synchronised in the background
+                        is_sntp_started_s = true;
+                    }
+
+                    WifiCache current = {.bssid = {}, .channel = WiFi.channel()};
+                    memcpy(current.bssid, WiFi.BSSID(), sizeof(current.bssid));
+                    if (memcmp(&current, &wifi_cache_s, sizeof(current)) == 0) { return; }
+
+                    // Only written when the access point changed, NVS lives in flash
+                    wifi_cache_s = current;
+                    Preferences preferences;
+                    if (!preferences.begin(WIFI_CACHE_NAMESPACE, false)) { return; }
+                    preferences.putBytes("ap", &wifi_cache_s, sizeof(wifi_cache_s));
+                    preferences.end();
+                },
+                ARDUINO_EVENT_WIFI_STA_GOT_IP);
+
+            WiFi.mode(WIFI_STA);
+            WiFi.setAutoReconnect(false);  // The caller retries with its own backoff
+            is_wifi_started_s = true;
+        }
+
+        if (!wifi_manager_s.getWiFiIsSaved()) { return false; }
+
+        String ssid     = wifi_manager_s.getWiFiSSID(true);
+        String password = wifi_manager_s.getWiFiPass(true);
+        if (use_cached && wifi_cache_s.channel != 0)
+        {
+            WiFi.begin(ssid.c_str(), password.c_str(), wifi_cache_s.channel, wifi_cache_s.bssid);
+        }
+        else { WiFi.begin(ssid.c_str(), password.c_str()); }
+
+        return true;
+    }
+
+    void wifi_disconnect() { WiFi.disconnect(); }
+
+    bool wifi_portal_begin(const char* portal_ssid, uint16_t timeout_s, PortalHandler on_portal)
+    {
+        portal_handler_s = on_portal;
+
+        wifi_manager_s.setConfigPortalBlocking(false);
+        wifi_manager_s.setConfigPortalTimeout(timeout_s);
+        wifi_manager_s.setWiFiAutoReconnect(false);
+        wifi_manager_s.setAPCallback(
+            [](WiFiManager* manager)
+            {
+                if (portal_handler_s != nullptr)
+                {
+                    portal_handler_s(manager->getConfigPortalSSID().c_str(), WiFi.softAPIP().toString().c_str());
+                }
+            });
+
+        // Returns false at once in non-blocking mode, the portal stays open until process() closes it
+        wifi_manager_s.startConfigPortal(portal_ssid);
+        return wifi_manager_s.getConfigPortalActive();
+    }
+
+    bool wifi_portal_process()
+    {
+        wifi_manager_s.process();
+        return wifi_manager_s.getConfigPortalActive();
+    }
+
+    bool wifi_connected() { return WiFi.status() == WL_CONNECTED; }
+
+    bool wifi_failed()
+    {
+        wl_status_t status = WiFi.status();
+        return status == WL_NO_SSID_AVAIL || status == WL_CONNECT_FAILED || status == WL_CONNECTION_LOST;
+    }
+
+    void wifi_local_ip(char* dest, size_t size) { snprintf(dest, size, "%s", WiFi.localIP().toString().c_str()); }
+
+    void wifi_reset_settings() { wifi_manager_s.resetSettings(); }
+
+    void restart() { ESP.restart(); }
+
+    HeapInfo heap_info()
+    {
+        return {
+            .free_bytes         = ESP.getFreeHeap(),
+            .minimum_free_bytes = ESP.getMinFreeHeap(),
+            .largest_free_block = ESP.getMaxAllocHeap(),
+        };
+    }
+
+    void log(char level, const char* format, ...)
+    {
+        char    buffer[256];
+        va_list args;
+        va_start(args, format);
+        vsnprintf(buffer, sizeof(buffer), format, args);
+        va_end(args);
+
+        switch (level)
+        {
+            case 'E': log_e("%s", buffer); break;
+            case 'W': log_w("%s", buffer); break;
+            case 'I': log_i("%s", buffer); break;
+            default: log_d("%s", buffer); break;
+        }
+    }
+}  // namespace hal
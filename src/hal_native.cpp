@@ -0,0 +1,819 @@
+/** -----------------------------------------------------------------------------------------------------
+ * @file hal_native.cpp
+ *
+ * @brief Hardware abstraction layer for the host (env:native), backed by fakes and std::thread
+ * @version 0.1
+ * @date 2024-2025
+ *  ----------------------------------------------------------------------------------------------------- **/
+
+/** -----------------------------------------------------------------------------------------------------
+ * $ INCLUDES
+ *  ----------------------------------------------------------------------------------------------------- **/
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+
+#ifdef __GLIBC__
+    #include <malloc.h>
+#endif
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "hal.h"
+#include "hal_native.h"
+
+/** -----------------------------------------------------------------------------------------------------
+ * $ GLOBAL VARIABLES
+ *  ----------------------------------------------------------------------------------------------------- **/
+
+constexpr static const uint8_t  NATIVE_PIN_COUNT   = 64;
+constexpr static const uint16_t NATIVE_ADC_DEFAULT = 3500;
+
+// The data partition is the PlatformIO data directory, relative to the project directory the program runs in
+constexpr static const char* const NATIVE_FS_ROOT = "data";
+
+static const auto             boot_time_s = std::chrono::steady_clock::now();
+static std::atomic<uint16_t>  adc_values_s[NATIVE_PIN_COUNT];
+static std::atomic<bool>      pin_states_s[NATIVE_PIN_COUNT];
+static hal::native::AdcSource adc_source_s = nullptr;
+static std::atomic<bool>      is_wifi_connected_s = false;
+
+/**
+ * @brief Simulated pin_interrupt_once(), set_pin_input() plays the falling edge
+ *
+ */
+struct NativePinInterrupt
+{
+    hal::Queue* queue       = nullptr;
+    const void* item        = nullptr;
+    bool        is_armed    = false;
+    bool        is_attached = false;
+};
+
+static std::mutex         pin_interrupts_mutex_s;
+static NativePinInterrupt pin_interrupts_s[NATIVE_PIN_COUNT];
+
+/**
+ * @brief Threads started by task_create(), task_list() reports their CPU time
+ *
+ */
+struct NativeTask
+{
+    hal::TaskInfo info;
+    pthread_t     thread;
+};
+
+static std::mutex              tasks_mutex_s;
+static std::vector<NativeTask> tasks_s;
+
+/**
+ * @brief Simulated continuous ADC, frames of adc_read() codes released at the configured sample rate
+ *
+ * With a frame queue a thread plays the conversion-done interrupt and sends the item whenever a frame completes.
+ */
+static struct
+{
+    uint8_t                               pin            = 0;
+    uint32_t                              sample_rate_hz = 0;
+    size_t                                block_samples  = 0;
+    std::chrono::steady_clock::time_point next_frame;
+} adc_stream_s;
+
+/** -----------------------------------------------------------------------------------------------------
+ * $ FUNCTION DECLARATIONS
+ *  ----------------------------------------------------------------------------------------------------- **/
+
+namespace hal
+{
+    class NativeMutex : public Mutex
+    {
+    public:
+        bool take(uint32_t timeout_ms) override { return mutex.try_lock_for(std::chrono::milliseconds(timeout_ms)); }
+        void give() override { mutex.unlock(); }
+
+    private:
+        std::timed_mutex mutex;
+    };
+
+    class NativeQueue : public Queue
+    {
+    public:
+        NativeQueue(size_t length, size_t item_size) : storage(length * item_size), length(length), item_size(item_size)
+        {
+        }
+
+        bool send(const void* item, uint32_t timeout_ms) override
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            if (!wait(lock, timeout_ms, [this]() { return count < length; })) { return false; }
+
+            memcpy(&storage[((head + count) % length) * item_size], item, item_size);
+            count++;
+            changed.notify_all();
+            return true;
+        }
+        bool receive(void* item, uint32_t timeout_ms) override
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            if (!wait(lock, timeout_ms, [this]() { return count > 0; })) { return false; }
+
+            memcpy(item, &storage[head * item_size], item_size);
+            head = (head + 1) % length;
+            count--;
+            changed.notify_all();
+            return true;
+        }
+
+    private:
+        template<typename Ready>
+        bool wait(std::unique_lock<std::mutex>& lock, uint32_t timeout_ms, Ready ready)
+        {
+            if (timeout_ms == WAIT_FOREVER)
+            {
+                changed.wait(lock, ready);
+                return true;
+            }
+
+            // A poll, a timed wait would still sleep for the timer slack of the kernel
+            if (timeout_ms == 0) { return ready(); }
+
+            return changed.wait_for(lock, std::chrono::milliseconds(timeout_ms), ready);
+        }
+
+        std::mutex              mutex;
+        std::condition_variable changed;
+        std::vector<uint8_t>    storage;
+        size_t                  length;
+        size_t                  item_size;
+        size_t                  head  = 0;
+        size_t                  count = 0;
+    };
+
+    class NativeDisplay : public Display
+    {
+    public:
+        void    begin() override {}
+        int16_t width() override { return SCREEN_WIDTH; }
+        int16_t height() override { return SCREEN_HEIGHT; }
+        void    setRotation(uint8_t rotation) override {}
+        void    fillScreen(uint16_t color) override {}
+        void    startFrame() override {}
+        void    endFrame() override {}
+        bool    getTouch(uint16_t* x, uint16_t* y) override
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            *x = touch_x;
+            *y = touch_y;
+            touch_reads++;
+            return is_touched;
+        }
+
+        void set_touch(bool touched, uint16_t x, uint16_t y)
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            is_touched = touched;
+            touch_x    = x;
+            touch_y    = y;
+        }
+
+        uint32_t reads()
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            return touch_reads;
+        }
+
+        void print(const char* text)
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            text_buffer += text;
+        }
+
+        std::string take_text()
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            std::string                 result;
+            result.swap(text_buffer);
+            return result;
+        }
+
+    private:
+        std::mutex  mutex;
+        std::string text_buffer;
+        bool        is_touched  = false;
+        uint16_t    touch_x     = 0;
+        uint16_t    touch_y     = 0;
+        uint32_t    touch_reads = 0;
+    };
+
+    static NativeDisplay& native_display();
+
+    /**
+     * @brief Sprite without pixels, text drawn into it is recorded on the native display
+     *
+     * textWidth() assumes the 6x8 GLCD font (font 1) or an 8 px average for font 2.
+     */
+    class NativeSprite : public Sprite
+    {
+    public:
+        bool create(int16_t w, int16_t h) override { return w > 0 && h > 0; }
+        void fill(uint16_t color) override {}
+        void fillRoundRect(int32_t x, int32_t y, int32_t w, int32_t h, int32_t r, uint16_t color) override {}
+        void drawRoundRect(int32_t x, int32_t y, int32_t w, int32_t h, int32_t r, uint16_t color) override {}
+        void setTextFont(uint8_t font) override { text_font = font; }
+        void setTextColor(uint16_t fg_color, uint16_t bg_color) override {}
+        void setTextSize(uint8_t size) override { text_size = size; }
+        void setTextDatum(uint8_t datum) override {}
+        int16_t textWidth(const char* text) override
+        {
+            return static_cast<int16_t>(strlen(text) * (text_font == 2 ? 8 : 6) * text_size);
+        }
+        void drawString(const char* text, int32_t x, int32_t y) override
+        {
+            native_display().print(text);
+            native_display().print("\n");
+        }
+        void push(int16_t x, int16_t y) override {}
+
+    private:
+        uint8_t text_font = 1;
+        uint8_t text_size = 1;
+    };
+
+    /**
+     * @brief Simulated RMT channel, a thread emits the programmed pulse train on an absolute schedule
+     *
+     * Every step is recorded with its host timestamp, so the timing that the step engine commands can be inspected
+     * (see hal::native::step_timing()). Host scheduling adds the jitter a real peripheral does not have.
+     */
+    class NativeStepGenerator : public StepGenerator
+    {
+    public:
+        bool begin(uint8_t step_pin, uint8_t direction_pin) override
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            this->direction_pin = direction_pin;
+            if (!is_started)
+            {
+                std::thread([this]() { generate(); }).detach();
+                is_started = true;
+            }
+
+            return true;
+        }
+        void setDirection(bool forward) override { pin_write(direction_pin, forward); }
+        bool run(const uint16_t* ramp, uint16_t from, uint16_t to, uint32_t interval, uint32_t wait) override
+        {
+            uint16_t count = from < to ? to - from : from - to;
+            if (count > MAX_RAMP_STEPS) { return false; }
+            if (interval != 0 && (interval < MIN_STEP_INTERVAL || interval > MAX_STEP_INTERVAL)) { return false; }
+
+            std::vector<uint32_t> sequence;
+            for (uint16_t i = 0; i < count; i++)
+            {
+                sequence.push_back(from < to ? ramp[from + i] : ramp[from - 1 - i]);
+            }
+
+            program(sequence, interval, wait);
+            return true;
+        }
+        void stop() override { program({}, 0, 0); }
+
+        native::StepTiming timing()
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+
+            native::StepTiming result = {};
+            result.steps              = steps;
+            result.interval           = interval;
+            result.full_speed_us      = full_speed_us;
+
+            double   sum_interval = 0.0;
+            double   sum_squares  = 0.0;
+            uint32_t count        = 0;
+            size_t   recorded     = steps < RECORD_COUNT ? steps : RECORD_COUNT;
+            for (size_t i = 1; i < recorded; i++)
+            {
+                const StepRecord& current  = records[(steps - recorded + i) % RECORD_COUNT];
+                const StepRecord& previous = records[(steps - recorded + i - 1) % RECORD_COUNT];
+                if (current.run != previous.run) { continue; }
+
+                uint32_t measured  = static_cast<uint32_t>(current.time_us - previous.time_us);
+                double   deviation = static_cast<double>(measured) - previous.interval;
+                double   magnitude = deviation < 0.0 ? -deviation : deviation;
+
+                result.min_interval_us = count == 0 || measured < result.min_interval_us ? measured
+                                                                                         : result.min_interval_us;
+                result.max_interval_us = measured > result.max_interval_us ? measured : result.max_interval_us;
+                result.jitter_max_us   = magnitude > result.jitter_max_us ? magnitude : result.jitter_max_us;
+                sum_interval += measured;
+                sum_squares += deviation * deviation;
+                count++;
+            }
+
+            if (count > 0)
+            {
+                result.mean_interval_us = sum_interval / count;
+                result.jitter_rms_us    = sqrt(sum_squares / count);
+            }
+
+            return result;
+        }
+
+        std::vector<uint64_t> timestamps()
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+
+            std::vector<uint64_t> result;
+            size_t                recorded = steps < RECORD_COUNT ? steps : RECORD_COUNT;
+            for (size_t i = 0; i < recorded; i++)
+            {
+                result.push_back(records[(steps - recorded + i) % RECORD_COUNT].time_us);
+            }
+            return result;
+        }
+
+        void reset()
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            steps = 0;
+        }
+
+    private:
+        constexpr static const size_t RECORD_COUNT = 4'096;
+
+        struct StepRecord
+        {
+            uint64_t time_us;
+            uint32_t interval;  // Programmed time to the next step
+            uint32_t run;       // Steps of different run() calls are not compared
+        };
+
+        void program(const std::vector<uint32_t>& ramp, uint32_t interval, uint32_t wait)
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            ramp_steps     = ramp;
+            ramp_index     = 0;
+            this->interval = interval;
+            run_start_us   = micros();
+            full_speed_us  = 0;
+            next_step      = std::chrono::steady_clock::now() + std::chrono::microseconds(wait);
+            run_count++;
+            changed.notify_one();
+        }
+
+        void generate()
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            while (true)
+            {
+                uint32_t run = run_count;
+                if (ramp_index == ramp_steps.size() && interval == 0)
+                {
+                    changed.wait(lock, [&]() { return run_count != run; });
+                    continue;
+                }
+
+                // Absolute deadlines, a late wake-up does not shift the following steps
+                if (changed.wait_until(lock, next_step, [&]() { return run_count != run; })) { continue; }
+
+                uint64_t now_us    = micros();
+                bool     is_ramp   = ramp_index < ramp_steps.size();
+                uint32_t step_time = is_ramp ? ramp_steps[ramp_index++] : interval;
+                if (!is_ramp && full_speed_us == 0) { full_speed_us = now_us - run_start_us; }
+
+                records[steps % RECORD_COUNT] = {.time_us = now_us, .interval = step_time, .run = run};
+                steps++;
+                next_step += std::chrono::microseconds(step_time);
+            }
+        }
+
+        std::mutex                            mutex;
+        std::condition_variable               changed;
+        bool                                  is_started    = false;
+        uint8_t                               direction_pin = 0;
+        std::vector<uint32_t>                 ramp_steps;
+        size_t                                ramp_index    = 0;
+        uint32_t                              interval      = 0;  // Repeated after the ramp, 0 stops
+        uint32_t                              run_count     = 0;
+        uint64_t                              run_start_us  = 0;
+        uint64_t                              full_speed_us = 0;
+        std::chrono::steady_clock::time_point next_step;
+        StepRecord                            records[RECORD_COUNT] = {};
+        uint32_t                              steps                 = 0;
+    };
+
+    class NativeHttpServer : public HttpServer
+    {
+    public:
+        void on(const char* uri, HttpHandler handler) override { handlers[uri] = handler; }
+        void collectHeaders(const char** names, size_t count) override {}
+        void begin() override {}
+        void handleClient() override {}
+        bool header(const char* name, char* dest, size_t size) override
+        {
+            if (request_headers == nullptr) { return false; }
+
+            auto value = request_headers->find(name);
+            if (value == request_headers->end()) { return false; }
+
+            snprintf(dest, size, "%s", value->second.c_str());
+            return true;
+        }
+        bool arg(const char* name, char* dest, size_t size) override
+        {
+            auto value = request_args.find(name);
+            if (value == request_args.end()) { return false; }
+
+            snprintf(dest, size, "%s", value->second.c_str());
+            return true;
+        }
+        void sendHeader(const char* name, const char* value) override { pending_headers[name] = value; }
+        void send(int code, const char* content_type, const char* content, size_t length) override
+        {
+            if (response != nullptr)
+            {
+                response->code         = code;
+                response->content_type = content_type;
+                response->content.assign(content, length);
+                response->headers      = pending_headers;
+            }
+            pending_headers.clear();
+        }
+
+        bool sendFile(const char* content_type, const char* path) override
+        {
+            FILE* file = fs_open(path, "rb");
+            if (file == nullptr) { return false; }
+
+            std::string content;
+            char        chunk[512];
+            size_t      length = 0;
+            while ((length = fread(chunk, 1, sizeof(chunk), file)) > 0) { content.append(chunk, length); }
+            fclose(file);
+
+            size_t path_length = strlen(path);
+            if (path_length > 3 && strcmp(path + path_length - 3, ".gz") == 0)
+            {
+                pending_headers["Content-Encoding"] = "gzip";
+            }
+
+            send(200, content_type, content.data(), content.size());
+            return true;
+        }
+
+        bool request(const char* uri, native::HttpResponse& dest, const native::HttpHeaders& headers)
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+
+            // "path?name=value&..." like a request target, values are not percent-decoded
+            const char* query = strchr(uri, '?');
+            auto        handler = handlers.find(query != nullptr ? std::string(uri, query - uri) : std::string(uri));
+            if (handler == handlers.end()) { return false; }
+
+            request_args.clear();
+            for (const char* parameter = query; parameter != nullptr && *parameter != '\0';)
+            {
+                const char* end  = strchr(++parameter, '&');
+                std::string pair = end != nullptr ? std::string(parameter, end - parameter) : std::string(parameter);
+                size_t      equals = pair.find('=');
+                request_args[pair.substr(0, equals)] = equals != std::string::npos ? pair.substr(equals + 1) : "";
+                parameter = end;
+            }
+
+            response        = &dest;
+            request_headers = &headers;
+            handler->second();
+            response        = nullptr;
+            request_headers = nullptr;
+
+            return true;
+        }
+
+    private:
+        std::mutex                         mutex;
+        std::map<std::string, HttpHandler> handlers;
+        native::HttpHeaders                pending_headers;
+        native::HttpHeaders                request_args;
+        native::HttpResponse*              response        = nullptr;
+        const native::HttpHeaders*         request_headers = nullptr;
+    };
+
+    class NativeConsole : public Console
+    {
+    public:
+        void begin(uint32_t baud_rate) override {}
+        void print(const char* text) override { fputs(text, stdout); }
+    };
+
+    static NativeDisplay& native_display()
+    {
+        static NativeDisplay display_s;
+        return display_s;
+    }
+
+    static NativeStepGenerator& native_step_generator()
+    {
+        // Never destroyed, the generator thread outlives static destruction at exit()
+        static NativeStepGenerator* step_generator_s = new NativeStepGenerator();
+        return *step_generator_s;
+    }
+
+    static NativeHttpServer& native_http_server()
+    {
+        static NativeHttpServer http_server_s;
+        return http_server_s;
+    }
+
+    Display&       display() { return native_display(); }
+    Sprite*        sprite_create() { return new NativeSprite(); }
+    StepGenerator& step_generator() { return native_step_generator(); }
+    HttpServer&    http_server() { return native_http_server(); }
+
+    Console& console()
+    {
+        static NativeConsole console_s;
+        return console_s;
+    }
+
+    void pin_input(uint8_t pin) {}
+    void pin_output(uint8_t pin) {}
+    void pin_write(uint8_t pin, bool high) { pin_states_s[pin % NATIVE_PIN_COUNT] = high; }
+    bool pin_read(uint8_t pin) { return pin_states_s[pin % NATIVE_PIN_COUNT]; }
+
+    bool pin_interrupt_once(uint8_t pin, Queue* queue, const void* item)
+    {
+        if (queue == nullptr) { return false; }
+
+        std::lock_guard<std::mutex> lock(pin_interrupts_mutex_s);
+        NativePinInterrupt&         pin_interrupt = pin_interrupts_s[pin % NATIVE_PIN_COUNT];
+        if (!pin_interrupt.is_attached)
+        {
+            pin_states_s[pin % NATIVE_PIN_COUNT] = true;  // Pull-up
+            pin_interrupt.is_attached            = true;
+        }
+        pin_interrupt.queue    = queue;
+        pin_interrupt.item     = item;
+        pin_interrupt.is_armed = true;
+        return true;
+    }
+
+    uint16_t adc_read(uint8_t pin)
+    {
+        if (adc_source_s != nullptr) { return adc_source_s(pin); }
+
+        uint16_t value = adc_values_s[pin % NATIVE_PIN_COUNT];
+        return value != 0 ? value : NATIVE_ADC_DEFAULT;
+    }
+
+    static void adc_frame_interrupt(Queue*                                frame_queue,
+                                    const void*                           item,
+                                    std::chrono::steady_clock::time_point frame_end,
+                                    std::chrono::microseconds             frame_time)
+    {
+        while (true)
+        {
+            frame_end += frame_time;
+            std::this_thread::sleep_until(frame_end);
+            frame_queue->send(item, 0);
+        }
+    }
+
+    bool adc_stream_begin(uint8_t     pin,
+                          uint32_t    sample_rate_hz,
+                          size_t      block_samples,
+                          Queue*      frame_queue,
+                          const void* item)
+    {
+        if (adc_stream_s.sample_rate_hz != 0 || sample_rate_hz == 0 || block_samples == 0) { return false; }
+
+        adc_stream_s.pin            = pin;
+        adc_stream_s.sample_rate_hz = sample_rate_hz;
+        adc_stream_s.block_samples  = block_samples;
+        adc_stream_s.next_frame     = std::chrono::steady_clock::now();
+
+        if (frame_queue != nullptr)
+        {
+            auto frame_time = std::chrono::microseconds(block_samples * 1'000'000ULL / sample_rate_hz);
+            std::thread(adc_frame_interrupt, frame_queue, item, adc_stream_s.next_frame, frame_time).detach();
+        }
+        return true;
+    }
+
+    size_t adc_stream_read(uint16_t* dest, size_t capacity, uint32_t timeout_ms)
+    {
+        if (adc_stream_s.sample_rate_hz == 0) { return 0; }
+
+        // A frame is complete once its last conversion would have finished
+        size_t count      = capacity < adc_stream_s.block_samples ? capacity : adc_stream_s.block_samples;
+        auto   frame_time = std::chrono::microseconds(count * 1'000'000ULL / adc_stream_s.sample_rate_hz);
+        auto   frame_end  = adc_stream_s.next_frame + frame_time;
+        auto   timeout_at = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms);
+        if (frame_end > timeout_at)
+        {
+            std::this_thread::sleep_until(timeout_at);
+            return 0;
+        }
+
+        std::this_thread::sleep_until(frame_end);
+        adc_stream_s.next_frame = frame_end;
+        for (size_t i = 0; i < count; i++) { dest[i] = adc_read(adc_stream_s.pin); }
+        return count;
+    }
+
+    uint32_t millis() { return static_cast<uint32_t>(micros() / 1'000); }
+
+    uint64_t micros()
+    {
+        return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - boot_time_s)
+            .count();
+    }
+
+    void delay_ms(uint32_t ms) { std::this_thread::sleep_for(std::chrono::milliseconds(ms)); }
+
+    void delay_until_us(uint64_t wake_us)
+    {
+        std::this_thread::sleep_until(boot_time_s + std::chrono::microseconds(wake_us));
+    }
+
+    // Nanoseconds stand in for cycles, the host has no fixed clock rate
+    uint32_t cycle_count()
+    {
+        return static_cast<uint32_t>(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - boot_time_s)
+                .count());
+    }
+
+    uint32_t cycles_per_us() { return 1'000; }
+
+    uint32_t unix_time() { return static_cast<uint32_t>(time(nullptr)); }
+
+    Mutex* mutex_create() { return new NativeMutex(); }
+
+    Queue* queue_create(size_t length, size_t item_size) { return new NativeQueue(length, item_size); }
+
+    bool task_create(TaskFunction function,
+                     const char*  name,
+                     uint32_t     stack_size,
+                     void*        parameter,
+                     uint8_t      priority,
+                     int8_t       core)
+    {
+        std::thread thread(function, parameter);
+        NativeTask  task = {.info = {}, .thread = thread.native_handle()};
+        strncpy(task.info.name, name, sizeof(task.info.name) - 1);
+        task.info.stack_size = stack_size;
+        task.info.priority   = priority;
+        task.info.core       = core;
+        thread.detach();
+
+        std::lock_guard<std::mutex> lock(tasks_mutex_s);
+        tasks_s.push_back(task);
+        return true;
+    }
+
+    size_t task_list(TaskInfo* dest, size_t capacity)
+    {
+        // Tasks never return, so the threads are still there; the host has no stack high-water mark
+        std::lock_guard<std::mutex> lock(tasks_mutex_s);
+        size_t                      count = 0;
+        for (; count < tasks_s.size() && count < capacity; count++)
+        {
+            dest[count] = tasks_s[count].info;
+
+            clockid_t clock;
+            timespec  cpu_time;
+            if (pthread_getcpuclockid(tasks_s[count].thread, &clock) == 0 && clock_gettime(clock, &cpu_time) == 0)
+            {
+                dest[count].run_time_us =
+                    static_cast<uint32_t>(cpu_time.tv_sec * 1'000'000ULL + cpu_time.tv_nsec / 1'000);
+            }
+        }
+
+        return count;
+    }
+
+    bool fs_mount() { return fs_mkdir(""); }
+
+    void fs_path(const char* path, char* dest, size_t size) { snprintf(dest, size, "%s%s", NATIVE_FS_ROOT, path); }
+
+    // The host is always online, a connection is up as soon as it is started
+    bool wifi_begin(bool use_cached)
+    {
+        is_wifi_connected_s = true;
+        return true;
+    }
+
+    void wifi_disconnect() { is_wifi_connected_s = false; }
+
+    bool wifi_portal_begin(const char* portal_ssid, uint16_t timeout_s, PortalHandler on_portal) { return false; }
+
+    bool wifi_portal_process() { return false; }
+
+    bool wifi_connected() { return is_wifi_connected_s; }
+
+    bool wifi_failed() { return false; }
+
+    void wifi_local_ip(char* dest, size_t size) { snprintf(dest, size, "%s", "127.0.0.1"); }
+
+    void wifi_reset_settings() {}
+
+    void restart() { exit(0); }
+
+    HeapInfo heap_info()
+    {
+#ifdef __GLIBC__
+        // Free memory inside the malloc arena, the process can always grow it so there is no real minimum
+        struct mallinfo2 info = mallinfo2();
+        return {.free_bytes = info.fordblks, .minimum_free_bytes = info.fordblks, .largest_free_block = info.fordblks};
+#else
+        return {.free_bytes = 0, .minimum_free_bytes = 0, .largest_free_block = 0};
+#endif
+    }
+
+    void log(char level, const char* format, ...)
+    {
+        va_list args;
+        va_start(args, format);
+        fprintf(stderr, "[%c] ", level);
+        vfprintf(stderr, format, args);
+        fputc('\n', stderr);
+        va_end(args);
+    }
+
+    namespace native
+    {
+        void set_adc_source(AdcSource source) { adc_source_s = source; }
+
+        void set_adc_value(uint8_t pin, uint16_t value) { adc_values_s[pin % NATIVE_PIN_COUNT] = value; }
+
+        bool pin_state(uint8_t pin) { return pin_states_s[pin % NATIVE_PIN_COUNT]; }
+
+        void set_pin_input(uint8_t pin, bool high)
+        {
+            std::lock_guard<std::mutex> lock(pin_interrupts_mutex_s);
+            NativePinInterrupt&         pin_interrupt = pin_interrupts_s[pin % NATIVE_PIN_COUNT];
+            bool                        was_high      = pin_states_s[pin % NATIVE_PIN_COUNT].exchange(high);
+            if (was_high && !high && pin_interrupt.is_armed)
+            {
+                pin_interrupt.is_armed = false;
+                pin_interrupt.queue->send(pin_interrupt.item, 0);
+            }
+        }
+
+        void set_touch(bool touched, uint16_t x, uint16_t y) { native_display().set_touch(touched, x, y); }
+
+        uint32_t touch_reads() { return native_display().reads(); }
+
+        StepTiming step_timing() { return native_step_generator().timing(); }
+
+        std::vector<uint64_t> step_timestamps() { return native_step_generator().timestamps(); }
+
+        void step_timing_reset() { native_step_generator().reset(); }
+
+        bool http_request(const char* uri, HttpResponse& response, const HttpHeaders& request_headers)
+        {
+            return native_http_server().request(uri, response, request_headers);
+        }
+
+        std::string display_take_text() { return native_display().take_text(); }
+    }  // namespace native
+}  // namespace hal
+
+/** -----------------------------------------------------------------------------------------------------
+ * $$ HOST ENTRY POINT
+ *  ----------------------------------------------------------------------------------------------------- **/
+
+void setup();
+void loop();
+
+#ifndef PIO_UNIT_TESTING
+/**
+ * @brief Runs setup() and loop() like the Arduino core does, optionally for a limited time
+ *
+ * Usage: program [run_seconds]
+ */
+int main(int argc, char** argv)
+{
+    uint32_t run_seconds = argc > 1 ? static_cast<uint32_t>(strtoul(argv[1], nullptr, 10)) : 0;
+
+    setup();
+    while (run_seconds == 0 || hal::millis() < run_seconds * 1'000)
+    {
+        loop();
+        hal::delay_ms(1);
+    }
+
+    return 0;
+}
+#endif
@@ -16,14 +16,33 @@
  * $ INCLUDES
  *  ----------------------------------------------------------------------------------------------------- **/
 
-#include <Arduino.h>
-#include <SPI.h>
-#include <LittleFS.h>
-#include <WiFi.h>
-#include <WebServer.h>
-#include <WiFiManager.h>
-#include <TFT_eSPI.h>
-#include <AccelStepper.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <atomic>
+#include <string>
+
+#include "hal.h"
+#include "adc_decimator.h"
+#include "async_http_server.h"
+#include "coroutine_runtime.h"
+#include "display_renderer.h"
+#include "hampel_filter.h"
+#include "metrics.h"
+#include "periodic_executor.h"
+#include "pump_control.h"
+#include "rolling_stats.h"
+#include "sample_codec.h"
+#include "sample_log.h"
+#include "seqlock.h"
+#include "step_engine.h"
+#include "step_ramp.h"
+#include "task_profiler.h"
+#include "text_buffer.h"
+#include "trend_estimator.h"
+#include "turbidity_table.h"
 
 /** ----------------------------------------------------------------------------------------------------- 
  * $ GLOBAL VARIABLES
@@ -48,11 +67,69 @@ constexpr static const uint8_t SCREEN_ROTATION = 2;
 constexpr static const uint8_t TFT_FONT_SIZE            = TFT_FONT_STYLE == 2 ? 16 : 8;
 constexpr static const uint8_t TFT_FONT_SIZE_MULTIPLIER = TFT_FONT_STYLE == 2 ? 2 : 3;
 constexpr static const float   MOTOR_STEPS_PER_SECOND = (MOTOR_RPM * (MOTOR_STEPS_PER_REV * MOTOR_MICROSTEPS)) / 60.0F;
-static String                  WEBSERVER_IP_ADDRESS_TEXT = "";
-static uint8_t                 led_state                 = LOW;
-static bool                    pump_state                = PUMP_STATE_DEFAULT;
-static bool                    is_clean                  = false;
-static bool                    manual_keep_pump_on       = false;
+static std::string             WEBSERVER_IP_ADDRESS_TEXT = "";
+static bool                    led_state                 = false;
+
+// Ramp of the pump motor in steps/s and steps/s^2, MOTOR_ACCELERATION is in rpm/s
+constexpr static const float MOTOR_MICROSTEPS_PER_REV = MOTOR_STEPS_PER_REV * MOTOR_MICROSTEPS;
+constexpr static const float MOTOR_START_STEP_RATE    = (MOTOR_START_RPM * MOTOR_MICROSTEPS_PER_REV) / 60.0F;
+constexpr static const float MOTOR_STEP_ACCELERATION  = (MOTOR_ACCELERATION * MOTOR_MICROSTEPS_PER_REV) / 60.0F;
+
+// From leaving sleep until the driver takes steps, the step engine holds the first step back this long
+constexpr static const uint32_t MOTOR_WAKE_US = 1'000;
+
+// Continuous ADC: DMA frames of TURBIDITY_BLOCK_SAMPLES codes, decimated to TURBIDITY_OUTPUT_RATE_HZ samples
+constexpr static const uint32_t TURBIDITY_DECIMATION = TURBIDITY_SAMPLE_RATE_HZ / TURBIDITY_OUTPUT_RATE_HZ;
+
+static_assert(TURBIDITY_SAMPLE_RATE_HZ % TURBIDITY_OUTPUT_RATE_HZ == 0, "Output rate must divide the ADC rate");
+static_assert(TURBIDITY_DECIMATION <= AdcDecimator::MAX_DECIMATION, "Decimation too large for the 32-bit window sum");
+
+constexpr static const char* TURBIDITY_CALIBRATION_PATH = "/turbidity.cal";  // "<volts> <NTU>" per line, optional
+
+// Clean decision of the trend estimator, see TrendEstimator
+constexpr static const TrendEstimator::Config TURBIDITY_TREND = {
+    .threshold      = TURBIDITY_VOLTAGE_THRESHOLD,
+    .hysteresis     = TURBIDITY_HYSTERESIS,
+    .lead_s         = TURBIDITY_TREND_LEAD_S,
+    .confidence     = 2.0F,
+    .measurement_sd = 0.01F,
+    .slope_drift    = 0.002F,
+};
+
+// Pump decisions, see PumpController. The sampler delivers TURBIDITY_OUTPUT_RATE_HZ samples per second.
+constexpr static const PumpController::Config PUMP_CONTROL = {
+    .use_sensor        = USE_TURBIDITY_SENSOR,
+    .sample_timeout_ms = 5'000,
+    .invalid_limit     = 10,
+};
+constexpr static const uint8_t  PUMP_QUEUE_DEPTH     = 16;
+constexpr static const uint32_t PUMP_TICK_MS         = 500;
+constexpr static const uint32_t PUMP_POST_TIMEOUT_MS = 20;
+
+// With COROUTINE_TASKS sampling, touch and pump control share control_task, a post waiting for room in the display
+// queue would hold up all three. They post without waiting, the renderer draws the newest text per widget
+constexpr static const uint32_t CONTROL_DISPLAY_TIMEOUT_MS = COROUTINE_TASKS ? 0 : DisplayRenderer::POST_TIMEOUT_MS;
+
+// With COROUTINE_TASKS, frames of the sampling, touch and pump coroutines. largest_request in /system/tasks is the
+// biggest one
+constexpr static const size_t COROUTINE_SLOT_SIZE = 256;
+constexpr static const size_t COROUTINE_SLOTS     = 3;
+
+// Periods of the housekeeping jobs, see PeriodicExecutor
+constexpr static const uint32_t TASK_PROFILE_PERIOD_US = 5'000'000;   // CPU shares are averaged over this window
+constexpr static const uint32_t TASK_PROFILE_LOG_US    = 60'000'000;  // PROFILE log record
+constexpr static const uint32_t DEBUG_STATS_PERIOD_US  = 5'000'000;   // PUMP, DISPLAY and JOB lines with SERIAL_DEBUG
+
+// Network bring-up in network_task, nothing else waits for it
+constexpr static const char*    WIFI_PORTAL_SSID      = "ESP32_ConfigPortal";
+constexpr static const uint16_t WIFI_PORTAL_TIMEOUT_S = 180;     // Without a client, then the stored network is retried
+constexpr static const uint32_t WIFI_BACKOFF_MIN_MS   = 1'000;   // Between failed attempts, doubled after each one
+constexpr static const uint32_t WIFI_BACKOFF_MAX_MS   = 60'000;
+constexpr static const uint32_t WIFI_POLL_MS          = 100;
+constexpr static const uint32_t WIFI_RESET_DELAY_MS   = 2'000;   // From /wifi/reset to the restart, the page gets out
+
+constexpr static const uint16_t HISTORY_MAX_SAMPLES      = 512;    // Per JSON /turbidity/history response
+constexpr static const uint16_t HISTORY_MAX_BINARY_BYTES = 4'096;  // Encoded samples per binary response
 
 struct DataStats
 {
@@ -62,57 +139,217 @@ struct DataStats
 
 struct DataHistory
 {
-    float     history[TURBIDITY_HISTORY_SIZE] = {0.0F};
-    DataStats current                         = {0.0F};
-    DataStats previous                        = {-1.0F};
-    bool      is_rising                       = false;
-    bool      is_falling                      = false;
+    DataStats current    = {0.0F};
+    DataStats previous   = {-1.0F};
+    bool      is_rising  = false;
+    bool      is_falling = false;
 };
 
+/**
+ * @brief Sampler state, only accessed by get_turbidity_data on get_data_task
+ * 
+ */
 struct TurbidityData
 {
     DataHistory ntu;
     DataHistory voltage;
-    uint16_t    index = 0;
-    // bool        is_text_data_json;
-    String text_data      = "";
-    String text_data_json = "";
+    // Raw ADC codes of the last TURBIDITY_HISTORY_SIZE samples, invalid voltages and outliers are kept but not counted
+    RollingStats<uint16_t, TURBIDITY_HISTORY_SIZE> history;
+    HampelFilter<TURBIDITY_FILTER_WINDOW>          outliers{TURBIDITY_FILTER_SIGMAS};
+    TrendEstimator                                 trend{TURBIDITY_TREND};
+    uint32_t                                       sample_count   = 0;
+    uint32_t                                       last_sample_ms = 0;
+};
+
+/**
+ * @brief Fixed-size copy of the latest sample, published lock-free to the display, web server and pump logic
+ * 
+ */
+struct TurbiditySnapshot
+{
+    uint32_t  sample_count;
+    uint32_t  timestamp_ms;
+    uint16_t  analog_value;
+    DataStats ntu;
+    DataStats voltage;
+    float     slope;
+    bool      is_rising;
+    bool      is_falling;
+    bool      is_clean;
+};
+
+/**
+ * @brief Stack buffer for one telemetry text (JSON document or the TFT rows)
+ * 
+ */
+using TelemetryText = TextBuffer<128>;
+
+static TurbidityData              turbidity_data_s;
+static Seqlock<TurbiditySnapshot> turbidity_snapshot_s;
+static Seqlock<PumpStatus>        pump_status_s;
+
+/**
+ * @brief Events for pump_control_task, the only task that decides on or actuates the pump
+ * 
+ */
+static hal::Queue* pump_events_s         = nullptr;
+static bool        is_pump_state_shown_s = true;  // false while the display still shows an older state
+
+/**
+ * @brief Exported on /metrics, with METRICS_ENABLED false they are empty and every call compiles to nothing
+ * 
+ */
+static MetricHistogram sample_seconds_s("turbidity_sample_duration_seconds", "Processing of one turbidity sample");
+static MetricCounter   samples_s("turbidity_samples_total", "Turbidity samples processed");
+static MetricCounter   samples_invalid_s("turbidity_samples_invalid_total", "Samples out of range or outliers");
+static MetricCounter   adc_timeouts_s("adc_frame_timeouts_total", "Waits for an ADC DMA frame that timed out");
+static MetricHistogram pump_event_seconds_s("pump_event_duration_seconds", "Handling of one pump event");
+static MetricHistogram pump_latency_s("pump_command_latency_seconds", "From posting START or STOP to the motor");
+static MetricCounter   pump_dropped_s("pump_events_dropped_total", "Pump events lost to a full queue");
+static MetricGauge     pump_state_s("pump_state", "0 idle, 1 pumping, 2 manual hold, 3 fault");
+static MetricHistogram http_asset_s("http_handler_duration_seconds", "Time in the handler", "handler", "asset");
+static MetricHistogram http_data_s("http_handler_duration_seconds", "Time in the handler", "handler", "data");
+static MetricHistogram http_history_s("http_handler_duration_seconds", "Time in the handler", "handler", "history");
+static MetricHistogram http_pump_s("http_handler_duration_seconds", "Time in the handler", "handler", "pump");
+static MetricGauge     http_connections_s("http_connections_open", "Open HTTP connections, event streams included");
+static MetricGauge     heap_free_s("heap_free_bytes", "Free heap");
+static MetricGauge     heap_minimum_free_s("heap_minimum_free_bytes", "Lowest free heap since boot");
+static MetricGauge     heap_largest_block_s("heap_largest_free_block_bytes", "Largest allocation that would succeed");
+
+/**
+ * @brief Startup milestones, in the order they are normally reached: everything up to BOOT_SETUP runs without network
+ * 
+ */
+enum BootPhase : uint8_t
+{
+    BOOT_DISPLAY,    // display_task pushed its first frame
+    BOOT_CONTROL,    // Motor, pump control and touch ready
+    BOOT_STORAGE,    // Data partition, calibration and sample log
+    BOOT_SENSING,    // ADC stream (or single reads) running
+    BOOT_SETUP,      // setup() returned
+    BOOT_WIFI,       // First connection
+    BOOT_WEBSERVER,  // Serving HTTP
+    BOOT_CLOCK,      // SNTP synchronised, samples are logged from here on
+    BOOT_PHASE_COUNT,
+};
+
+constexpr static const char* const BOOT_PHASE_NAMES[BOOT_PHASE_COUNT] = {
+    "display", "control", "storage", "sensing", "setup", "wifi", "webserver", "clock",
+};
+
+static std::atomic<uint32_t> boot_phase_ms_s[BOOT_PHASE_COUNT] = {};  // 0 until reached
+static MetricGauge           boot_phase_s[BOOT_PHASE_COUNT]    = {
+    {"boot_phase_milliseconds", "Time from boot until the phase was reached", "phase", "display"},
+    {"boot_phase_milliseconds", "Time from boot until the phase was reached", "phase", "control"},
+    {"boot_phase_milliseconds", "Time from boot until the phase was reached", "phase", "storage"},
+    {"boot_phase_milliseconds", "Time from boot until the phase was reached", "phase", "sensing"},
+    {"boot_phase_milliseconds", "Time from boot until the phase was reached", "phase", "setup"},
+    {"boot_phase_milliseconds", "Time from boot until the phase was reached", "phase", "wifi"},
+    {"boot_phase_milliseconds", "Time from boot until the phase was reached", "phase", "webserver"},
+    {"boot_phase_milliseconds", "Time from boot until the phase was reached", "phase", "clock"},
+};
+
+#if METRICS_ENABLED
+/**
+ * @brief Sampled by periodic_task, served by /system/tasks and logged every TASK_PROFILE_LOG_US
+ * 
+ */
+static TaskProfiler task_profiler_s;
+#endif
+
+/**
+ * @brief Fixed-rate jobs: profiling and periodic logs on periodic_task, single ADC reads where the sampling runs
+ * 
+ */
+static PeriodicExecutor housekeeping_s;
+static PeriodicExecutor sampler_s;
+
+#if COROUTINE_TASKS
+/**
+ * @brief Sampling, touch and pump control as coroutines on control_task, one stack instead of three
+ * 
+ * Pump events, touch events and ADC frames all notify the scheduler, so it sleeps until one comes instead of polling.
+ */
+alignas(max_align_t) static uint8_t coroutine_frames_s[COROUTINE_SLOTS * (COROUTINE_SLOT_SIZE + alignof(max_align_t))];
+static CoroutineArena     coroutine_arena_s(coroutine_frames_s, sizeof(coroutine_frames_s), COROUTINE_SLOT_SIZE);
+static CoroutineScheduler control_scheduler_s(coroutine_arena_s, CoroutineScheduler::NO_POLLING);
+#endif
+
+/**
+ * @brief Persistent sample history on the data partition, served by /turbidity/history
+ * 
+ */
+static SampleLog sample_log_s("/log");
+static bool      is_data_mounted_s = false;  // Set by setup() before webserver_task exists
+
+/**
+ * @brief Gzipped web interface on the data partition, built from web/ by scripts/gzip_web.py
+ * 
+ * The page itself revalidates on every load, the assets it references are cached for an hour.
+ */
+struct WebAsset
+{
+    const char* uri;
+    const char* path;
+    const char* content_type;
+    const char* cache_control;
+    char        etag[12];
 };
 
-static TurbidityData turbidity_data_s = {.text_data = "", .text_data_json = ""};
+static WebAsset web_assets_s[] = {
+    {"/", "/www/index.html.gz", "text/html", "no-cache", ""},
+    {"/app.css", "/www/app.css.gz", "text/css", "max-age=3600", ""},
+    {"/app.js", "/www/app.js.gz", "application/javascript", "max-age=3600", ""},
+    {"/logo.svg", "/www/logo.svg.gz", "image/svg+xml", "max-age=3600", ""},
+};
 
 /**
- * @brief AccelStepper object, providing the motor control functionality
+ * @brief Start/stop ramp of the pump motor, MOTOR_START_RPM to MOTOR_RPM at MOTOR_ACCELERATION rpm/s
  * 
  */
-AccelStepper stepper(AccelStepper::DRIVER, MOTOR_STEP_PIN, MOTOR_DIRECTION_PIN);
+constexpr static const uint16_t MOTOR_RAMP_STEPS =
+    step_ramp_length(MOTOR_START_STEP_RATE, MOTOR_STEPS_PER_SECOND, MOTOR_STEP_ACCELERATION);
+constexpr static const StepRampTable<MOTOR_RAMP_STEPS> motor_ramp_s =
+    make_step_ramp<MOTOR_RAMP_STEPS>(MOTOR_START_STEP_RATE, MOTOR_STEPS_PER_SECOND, MOTOR_STEP_ACCELERATION);
+
+static_assert(MOTOR_RAMP_STEPS <= hal::StepGenerator::MAX_RAMP_STEPS, "Ramp too long, raise MOTOR_ACCELERATION");
+static_assert(MOTOR_START_RPM > 0, "The ramp table cannot start from standstill");
 
 /**
- * @brief TFT_eSPI object, providing the display functionality
+ * @brief Step engine, drives the pump motor with the hardware step generator
  * 
  */
-TFT_eSPI tft = TFT_eSPI();
+static StepEngine step_engine_s(hal::step_generator(), motor_ramp_s.ramp());
 
 /**
- * @brief WiFiManager object, providing the WiFi connection functionality
+ * @brief Set by run_motor(false) until settle_motor() puts the driver to sleep, only pump_control_task uses it
  * 
  */
-WiFiManager wifiManager;
+static bool is_motor_stopping_s = false;
 
 /**
- * @brief WebServer object, providing the web server functionality
+ * @brief HttpServer object, providing the web server functionality
  * 
  */
-WebServer server(WEBSERVER_PORT);
+#if WEBSERVER_ASYNC
+static AsyncHttpServer async_server_s(WEBSERVER_PORT);
+hal::HttpServer&       server = async_server_s;
+#else
+hal::HttpServer& server = hal::http_server();
+#endif
 
-TaskHandle_t      get_data_task_handle          = NULL;
-TaskHandle_t      motor_task_handle             = NULL;
-TaskHandle_t      tft_touch_task_handle         = NULL;
-TaskHandle_t      webserver_task_handle         = NULL;
-SemaphoreHandle_t semaphore_pump_state          = NULL;
-SemaphoreHandle_t semaphore_manual_keep_pump_on = NULL;
-SemaphoreHandle_t semaphore_is_clean            = NULL;
-SemaphoreHandle_t semaphore_turbidity_data      = NULL;
+/**
+ * @brief Set by /wifi/reset, only webserver_task reads and writes them
+ * 
+ */
+static bool     is_wifi_reset_pending_s = false;
+static uint32_t wifi_reset_at_ms_s      = 0;
+
+/**
+ * @brief Console object, providing the serial output
+ * 
+ */
+hal::Console& console = hal::console();
 
 /** ----------------------------------------------------------------------------------------------------- 
  * $ FUNCTION DECLARATIONS
@@ -131,11 +368,13 @@ constexpr const float to_voltage(uint16_t analog_value)
 constexpr const float to_ntu_raw(float voltage)
 {
 #if TURBIDITY_SENSOR_3V3
-    return (voltage < (TURBIDITY_SENSOR_INPUT_VOLTAGE / 2.0F) ? 3000.0F
-                                                              : (-2572.2F * sq(voltage) + 8700.5F * voltage - 4352.9F));
+    return (voltage < (TURBIDITY_SENSOR_INPUT_VOLTAGE / 2.0F)
+                ? 3000.0F
+                : (-2572.2F * (voltage * voltage) + 8700.5F * voltage - 4352.9F));
 #else
-    return (voltage < (TURBIDITY_SENSOR_INPUT_VOLTAGE / 2.0F) ? 3000.0F
-                                                              : (-1120.4F * sq(voltage) + 5742.3F * voltage - 4352.9F));
+    return (voltage < (TURBIDITY_SENSOR_INPUT_VOLTAGE / 2.0F)
+                ? 3000.0F
+                : (-1120.4F * (voltage * voltage) + 5742.3F * voltage - 4352.9F));
 #endif
 }
 
@@ -144,690 +383,1438 @@ constexpr const float to_ntu(float voltage)
     return (to_ntu_raw(voltage) < 0.0F) ? (0.0F) : (to_ntu_raw(voltage) > 3000.0F) ? (3000.0F) : to_ntu_raw(voltage);
 }
 
-template<typename T>
-bool semaphore_get(T& dest, T& src, SemaphoreHandle_t& semaphore_handle, const char* semaphore_name = "semaphore")
+/**
+ * @brief to_voltage() and to_ntu() for every ADC code, evaluated by the compiler and placed in flash
+ *
+ * The formulas stay the reference for the table and for the scale sent with the binary history.
+ */
+constexpr static const TurbidityEntries turbidity_entries_s = make_turbidity_entries(to_voltage, to_ntu);
+
+static TurbidityTable turbidity_table_s(turbidity_entries_s);
+
+bool is_valid_voltage(float voltage)
 {
-    if (semaphore_handle != NULL)
-    {
-        if (xSemaphoreTake(semaphore_handle, 2) == pdTRUE)
-        {
-            dest = src;
-            xSemaphoreGive(semaphore_handle);
+    float voltage_rounded = roundf(voltage * 1000.0F) / 1000.0F;
+    return voltage_rounded > 0.0F && voltage_rounded <= TURBIDITY_SENSOR_INPUT_VOLTAGE;
+}
 
-            return true;
-        }
-        else { log_w("Could not take %s", semaphore_name); }
-    }
-    else { log_w("%s is NULL", semaphore_name); }
+bool get_turbidity_snapshot(TurbiditySnapshot& dest)
+{
+    if (turbidity_snapshot_s.try_read(dest)) { return true; }
 
+    log_w("turbidity_snapshot_s not available");
     return false;
 }
 
-template<typename T>
-bool semaphore_set(T&                 dest,
-                   T                  value,
-                   SemaphoreHandle_t& semaphore_handle,
-                   const char*        semaphore_name = "semaphore",
-                   uint32_t           timeout        = 100)
+bool get_pump_status(PumpStatus& dest)
 {
-    if (semaphore_handle != NULL)
-    {
-        if (xSemaphoreTake(semaphore_handle, static_cast<TickType_t>(timeout / portTICK_PERIOD_MS)) == pdTRUE)
-        {
-            dest = value;
-            xSemaphoreGive(semaphore_handle);
+    if (pump_status_s.try_read(dest)) { return true; }
 
-            return true;
-        }
-        else { log_w("Could not take %s", semaphore_name); }
+    log_w("pump_status_s not available");
+    return false;
+}
+
+/**
+ * @brief Queue an event for pump_control_task, the sampler passes timeout_ms 0 and never waits
+ *
+ * With COROUTINE_TASKS the pump coroutine only checks the queue when its scheduler wakes, so the scheduler is
+ * notified.
+ */
+bool post_pump_event(PumpEventType   type,
+                     PumpEventSource source,
+                     bool            is_valid   = false,
+                     bool            is_clean   = false,
+                     uint32_t        timeout_ms = PUMP_POST_TIMEOUT_MS)
+{
+    PumpEvent event = {
+        .type      = type,
+        .source    = source,
+        .is_valid  = is_valid,
+        .is_clean  = is_clean,
+        .posted_us = static_cast<uint32_t>(hal::micros()),
+    };
+    if (pump_events_s != nullptr && pump_events_s->send(&event, timeout_ms))
+    {
+#if COROUTINE_TASKS
+        control_scheduler_s.notify();
+#endif
+        return true;
     }
-    else { log_w("%s is NULL", semaphore_name); }
 
+    pump_dropped_s.add();
+    log_w("Pump event %u dropped, the queue is full", type);
     return false;
 }
 
-bool get_semaphore_turbidity_data(TurbidityData& dest)
+constexpr const uint16_t to_tft_y(uint8_t row, uint8_t fonst_size_multiplier = TFT_FONT_SIZE_MULTIPLIER)
 {
-    return semaphore_get(dest, turbidity_data_s, semaphore_turbidity_data, "semaphore_turbidity_data");
+    return row * TFT_FONT_SIZE * fonst_size_multiplier;
 }
-bool set_semaphore_turbidity_data(TurbidityData state)
+
+/** -----------------------------------------------------------------------------------------------------
+ * $$ DISPLAY WIDGETS
+ *  ----------------------------------------------------------------------------------------------------- **/
+
+// Drawn only by display_task, every other task posts through display_renderer_s
+enum DisplayWidgetId : uint8_t
 {
-    return semaphore_set(turbidity_data_s, state, semaphore_turbidity_data, "semaphore_turbidity_data", 100);
-}
+    WIDGET_STATUS,      // Rows 0-2, WiFi and web server state
+    WIDGET_PORTAL,      // Rows 2-6, WiFi configuration portal while it is open
+    WIDGET_TURBIDITY,   // Rows 4-6
+    WIDGET_PUMP_LABEL,  // Row 7
+    WIDGET_PUMP_STATE,  // Row 8
+    WIDGET_BUTTON_ON,   // Touch buttons, the text is the label and the color the background
+    WIDGET_BUTTON_OFF,
+};
 
-bool get_semaphore_is_clean_state(bool& dest)
+constexpr const DisplayRect to_tft_rows(uint8_t row, uint8_t rows)
 {
-    return semaphore_get(dest, is_clean, semaphore_is_clean, "semaphore_is_clean");
+    return {
+        .x = 0,
+        .y = static_cast<int16_t>(to_tft_y(row)),
+        .w = SCREEN_WIDTH,
+        .h = static_cast<int16_t>(to_tft_y(rows)),
+    };
 }
-bool set_semaphore_is_clean_state(bool state)
+
+void draw_button(hal::Sprite& sprite, const DisplayRect& area, const DisplayCommand& command)
 {
-    return semaphore_set(is_clean, state, semaphore_is_clean, "semaphore_is_clean", 50);
+    sprite.fillRoundRect(area.x, area.y, area.w, area.h, 8, command.color);
+    sprite.drawRoundRect(area.x, area.y, area.w, area.h, 8, hal::COLOR_BLACK);
+    sprite.setTextFont(TFT_FONT_STYLE);
+    sprite.setTextColor(hal::COLOR_BLACK, command.color);
+    sprite.setTextSize(2);
+    sprite.setTextDatum(hal::DATUM_MIDDLE_CENTER);
+    sprite.drawString(command.text, area.x + area.w / 2, area.y + area.h / 2);
 }
 
-bool get_semaphore_manual_keep_pump_on_state(bool& dest)
+constexpr const DisplayWidget tft_text_widget(const DisplayRect& bounds, bool is_persistent = true)
 {
-    return semaphore_get(dest, manual_keep_pump_on, semaphore_manual_keep_pump_on, "semaphore_manual_keep_pump_on");
+    return {
+        .bounds        = bounds,
+        .draw          = nullptr,
+        .font          = TFT_FONT_STYLE,
+        .text_size     = TFT_FONT_SIZE_MULTIPLIER,
+        .line_height   = static_cast<int16_t>(to_tft_y(1)),
+        .is_persistent = is_persistent,
+        .is_touchable  = false,
+    };
 }
-bool set_semaphore_manual_keep_pump_on_state(bool state)
+
+constexpr const DisplayWidget tft_button_widget(const DisplayRect& bounds)
 {
-    return semaphore_set(manual_keep_pump_on,
-                         state,
-                         semaphore_manual_keep_pump_on,
-                         "semaphore_manual_keep_pump_on",
-                         50);
+    return {
+        .bounds        = bounds,
+        .draw          = draw_button,
+        .font          = 0,
+        .text_size     = 0,
+        .line_height   = 0,
+        .is_persistent = true,
+        .is_touchable  = true,
+    };
 }
 
-bool get_semaphore_pump_state(bool& dest)
+// Indexed by DisplayWidgetId, also the touch areas of the buttons
+static const DisplayWidget display_widgets_s[] = {
+    tft_text_widget(to_tft_rows(0, 3)),
+    tft_text_widget(to_tft_rows(2, 5), false),
+    tft_text_widget(to_tft_rows(4, 3)),
+    tft_text_widget(to_tft_rows(7, 1)),
+    tft_text_widget(to_tft_rows(8, 1)),
+    tft_button_widget({.x = 20, .y = 220, .w = 180, .h = 80}),
+    tft_button_widget({.x = 280, .y = 220, .w = 180, .h = 80}),
+};
+
+static DisplayRenderer display_renderer_s(hal::display(),
+                                          display_widgets_s,
+                                          sizeof(display_widgets_s) / sizeof(display_widgets_s[0]));
+
+/**
+ * @brief Show a status message, clear_screen wipes everything else first (persistent widgets are redrawn)
+ *
+ */
+void display_status(const char* text, uint16_t color = hal::COLOR_WHITE, bool clear_screen = false)
 {
-    return semaphore_get(dest, pump_state, semaphore_pump_state, "semaphore_pump_state");
+    display_renderer_s.post(WIDGET_STATUS, text, color, clear_screen ? DISPLAY_CLEAR_SCREEN : 0);
 }
-bool set_semaphore_pump_state(bool state)
+
+/**
+ * @brief Show the pump state
+ *
+ * @return false if the display queue stayed full for timeout_ms
+ */
+bool display_pump_state(PumpState state, uint32_t timeout_ms = DisplayRenderer::POST_TIMEOUT_MS)
 {
-    return semaphore_set(pump_state, state, semaphore_pump_state, "semaphore_pump_state", 50);
+    switch (state)
+    {
+        case PumpState::IDLE: return display_renderer_s.post(WIDGET_PUMP_STATE, "OFF", hal::COLOR_RED, 0, timeout_ms);
+        case PumpState::PUMPING:
+            return display_renderer_s.post(WIDGET_PUMP_STATE, "ON", hal::COLOR_GREEN, 0, timeout_ms);
+        case PumpState::MANUAL_HOLD:
+            return display_renderer_s.post(WIDGET_PUMP_STATE, "ON (HOLD)", hal::COLOR_GREEN, 0, timeout_ms);
+        case PumpState::FAULT:
+            return display_renderer_s.post(WIDGET_PUMP_STATE, "FAULT", hal::COLOR_ORANGE, 0, timeout_ms);
+    }
+
+    return true;
 }
 
-constexpr const uint16_t to_tft_y(uint8_t row, uint8_t fonst_size_multiplier = TFT_FONT_SIZE_MULTIPLIER)
+// Function: Change LED State
+void changeLedState(bool state)
 {
-    return row * TFT_FONT_SIZE * fonst_size_multiplier;
+    if (led_state != state)
+    {
+        hal::pin_write(LED_PIN, state);
+        led_state = state;
+    }
 }
 
-void tft_clear_row(uint8_t  row,
-                   uint8_t  font_size_height = TFT_FONT_SIZE * TFT_FONT_SIZE_MULTIPLIER,
-                   uint16_t color            = TFT_BLACK)
+/**
+ * @brief Wake and start the motor or ramp it down, only pump_control_task calls it
+ *
+ * A stop leaves the driver enabled for the deceleration ramp, settle_motor() puts it to sleep once the ramp is over.
+ *
+ * @return false if the step engine refused to start
+ */
+bool run_motor(bool run)
 {
-    tft.fillRect(0, to_tft_y(row), tft.width(), font_size_height, color);
+    if (run)
+    {
+        console.println("MOTOR START");
+        is_motor_stopping_s = false;
+
+        // Change motor to normal mode
+        hal::pin_write(MOTOR_SLEEP_PIN, true);
+        hal::pin_write(MOTOR_RESET_PIN, true);
+        hal::pin_write(MOTOR_ENABLE_PIN, false);
+
+        return step_engine_s.start(MOTOR_STEPS_PER_SECOND, MOTOR_WAKE_US);
+    }
+
+    console.println("MOTOR STOP");
+    step_engine_s.stop();
+    is_motor_stopping_s = true;
+
+    return true;
 }
 
-void tft_text_setup(bool     clear_screen = false,
-                    uint8_t  row          = 0,
-                    uint16_t fg_color     = TFT_WHITE,
-                    uint16_t bg_color     = TFT_BLACK,
-                    uint8_t  font_style   = TFT_FONT_STYLE,
-                    uint8_t  font_size    = TFT_FONT_SIZE_MULTIPLIER)
+/**
+ * @brief Put the motor driver to sleep now, also in the middle of a stop ramp
+ *
+ */
+void sleep_motor_driver()
 {
-    if (clear_screen) { tft.fillScreen(TFT_BLACK); }
-    tft.setRotation(SCREEN_ROTATION);
-    tft.setCursor(0, to_tft_y(row));
-    tft.setTextFont(font_style);
-    tft.setTextColor(fg_color, bg_color);
-    tft.setTextSize(font_size);
+    is_motor_stopping_s = false;
+
+    // Change motor to sleep mode
+    hal::pin_write(MOTOR_SLEEP_PIN, false);
+    hal::pin_write(MOTOR_RESET_PIN, false);
+    hal::pin_write(MOTOR_ENABLE_PIN, true);
 }
 
-void display_pump_state(uint8_t row = 7)
+/**
+ * @brief Put the driver to sleep once the stop ramp of run_motor(false) has played out
+ *
+ * @return the longest the caller may wait for an event, wait_ms or less while the motor is ramping down
+ */
+uint32_t settle_motor(uint32_t wait_ms)
 {
-    tft_text_setup(false, row, TFT_ORANGE, TFT_BLACK);
-    tft.printf("Pump State:\n");
-    tft_clear_row(row + 1);
+    if (!is_motor_stopping_s) { return wait_ms; }
 
-    bool pump_state_local;
-    if (get_semaphore_pump_state(pump_state_local))
+    uint32_t remaining_us = step_engine_s.time_to_standstill_us();
+    if (remaining_us == 0)
     {
-        tft_text_setup(false, row + 1, pump_state_local ? TFT_GREEN : TFT_RED);
-        tft.printf("%s", pump_state_local ? "ON" : "OFF");
+        sleep_motor_driver();
+        return wait_ms;
     }
-    else { log_w("get_semaphore_pump_state failed!"); }
+
+    uint32_t remaining_ms = (remaining_us + 999) / 1'000;
+    return remaining_ms < wait_ms ? remaining_ms : wait_ms;
 }
 
-// Function: Change LED State
-void changeLedState(uint8_t state)
+void format_turbidity_json(const TurbiditySnapshot& snapshot, TelemetryText& dest)
 {
-    if (led_state != state)
-    {
-        digitalWrite(LED_PIN, state);
-        led_state = state;
-    }
+    dest.clear();
+    dest.append("{\"turbidity\": ")
+        .append(snapshot.ntu.value, 2)
+        .append(", \"voltage\": ")
+        .append(snapshot.voltage.value, 2)
+        .append(", \"avg_voltage\": ")
+        .append(snapshot.voltage.avg, 2)
+        .append('}');
 }
 
-// Function: Change Pump State
-void changePumpState(bool state)
+void format_turbidity_text(const TurbiditySnapshot& snapshot, TelemetryText& dest)
 {
-    bool pump_state_local;
-    if (get_semaphore_pump_state(pump_state_local))
+    dest.clear();
+    dest.append("AVG Volt.: ")
+        .append(snapshot.voltage.avg, 2)
+        .append(" V\n")
+        .append("Voltage: ")
+        .append(snapshot.voltage.value, 2)
+        .append(" V\n")
+        .append("Is Clean?: ")
+        .append(snapshot.is_clean ? "YES" : "NO");
+}
+
+bool get_turbidity_data(uint16_t curr_sensor_value, bool serial_print = false, bool tft_print = true)
+{
+    // Only get_data_task updates the history, readers use turbidity_snapshot_s and the pump its events
+    TurbidityData& turbidity_data = turbidity_data_s;
+    MetricTimer    timer(sample_seconds_s);
+
+    float voltage_local = turbidity_table_s.voltage(curr_sensor_value);
+    float ntu_local     = turbidity_table_s.ntu(curr_sensor_value);
+
+    turbidity_data.ntu.current.value     = ntu_local;
+    turbidity_data.voltage.current.value = voltage_local;
+    // A bubble or spike stays out of the mean and the trend, so it cannot flip is_clean and cycle the pump
+    bool is_valid = is_valid_voltage(voltage_local) && !turbidity_data.outliers.push(curr_sensor_value);
+    turbidity_data.history.push(curr_sensor_value, is_valid);
+    turbidity_data.sample_count++;
+    samples_s.add();
+    if (!is_valid) { samples_invalid_s.add(); }
+
+    uint32_t now_ms               = hal::millis();
+    uint32_t elapsed_ms           = turbidity_data.sample_count > 1 ? now_ms - turbidity_data.last_sample_ms : 0;
+    turbidity_data.last_sample_ms = now_ms;
+    turbidity_data.trend.update(voltage_local, is_valid, elapsed_ms / 1000.0F);
+
+    float mean_code                    = turbidity_data.history.mean();
+    turbidity_data.voltage.current.avg = mean_code * to_voltage(1);
+    turbidity_data.ntu.current.avg     = turbidity_table_s.ntu(static_cast<uint16_t>(lroundf(mean_code)));
+
+    bool new_data = fabsf(turbidity_data.voltage.current.avg - turbidity_data.voltage.previous.avg) > 0.0F;
+
+    // Rising and falling only once the slope (V/s) is significant, the decision predicts the threshold crossing
+    turbidity_data.voltage.is_rising  = turbidity_data.trend.is_rising();
+    turbidity_data.voltage.is_falling = turbidity_data.trend.is_falling();
+
+    bool local_clean_state = turbidity_data.trend.is_clean();
+
+    TurbiditySnapshot snapshot = {
+        .sample_count = turbidity_data.sample_count,
+        .timestamp_ms = now_ms,
+        .analog_value = curr_sensor_value,
+        .ntu          = turbidity_data.ntu.current,
+        .voltage      = turbidity_data.voltage.current,
+        .slope        = turbidity_data.trend.slope(),
+        .is_rising    = turbidity_data.voltage.is_rising,
+        .is_falling   = turbidity_data.voltage.is_falling,
+        .is_clean     = local_clean_state,
+    };
+    turbidity_snapshot_s.publish(snapshot);
+#if WEBSERVER_ASYNC
+    async_server_s.notify();
+#endif
+
+    // Samples are only logged once the clock is synchronised, their timestamps have to survive a reboot
+    uint32_t unix_time = hal::unix_time();
+    if (unix_time != 0)
     {
-        if (pump_state_local != state)
-        {
-            if (set_semaphore_pump_state(state))
-            {
-                // changeLedState(state ? HIGH : LOW);
-                display_pump_state(7);
-
-                if (state)
-                {
-                    Serial.println("MOTOR START");
-
-#if USE_TURBIDITY_SENSOR
-                    bool local_manual_keep_pump_on, local_is_clean;
-                    if (get_semaphore_manual_keep_pump_on_state(local_manual_keep_pump_on)
-                        && get_semaphore_is_clean_state(local_is_clean))
-                    {
-                        if (!local_manual_keep_pump_on && local_is_clean)
-                        {
-                            if (!set_semaphore_manual_keep_pump_on_state(true))
-                            {
-                                log_w("set_semaphore_manual_keep_pump_on_state failed!");
-                            }
-                        }
-                    }
-                    else { log_w("get_semaphore_manual_keep_pump_on_state or get_semaphore_is_clean_state failed!"); }
+        uint8_t flags = (is_valid ? SAMPLE_FLAG_VALID : 0) | (local_clean_state ? SAMPLE_FLAG_CLEAN : 0);
+        sample_log_s.append({.timestamp = unix_time, .analog_value = curr_sensor_value, .flags = flags, .reserved = 0});
+    }
+
+    if (tft_print && new_data) { turbidity_data.voltage.previous = turbidity_data.voltage.current; }
+
+#if SERIAL_DEBUG && SERIAL_DEBUG_HISTORY
+    console.printf("HISTORY =>\n{\n");
+    for (uint16_t i = 0; i < turbidity_data.history.size(); i++)
+    {
+        uint16_t history_code = turbidity_data.history.at(i);
+        console.printf("  [%u] => [ NTU: %f NTU, Voltage: %f V, Valid: %s ]\n",
+                       i,
+                       turbidity_table_s.ntu(history_code),
+                       turbidity_table_s.voltage(history_code),
+                       turbidity_data.history.is_valid(i) ? "YES" : "NO");
+    }
+    console.printf("}\n");
 #endif
 
-                    // Change motor to normal mode
-                    digitalWrite(MOTOR_SLEEP_PIN, HIGH);
-                    digitalWrite(MOTOR_RESET_PIN, HIGH);
-                    digitalWrite(MOTOR_ENABLE_PIN, LOW);
-                    delay(1);
-
-                    stepper.setSpeed(MOTOR_STEPS_PER_SECOND);
-                    stepper.runSpeed();
-                }
-                else
-                {
-                    Serial.println("MOTOR STOP");
-
-#if USE_TURBIDITY_SENSOR
-                    bool local_manual_keep_pump_on, local_is_clean;
-                    if (get_semaphore_manual_keep_pump_on_state(local_manual_keep_pump_on)
-                        && get_semaphore_is_clean_state(local_is_clean))
-                    {
-                        if (local_manual_keep_pump_on || !local_is_clean)
-                        {
-                            set_semaphore_manual_keep_pump_on_state(false);
-                        }
-                    }
-                    else { log_w("get_semaphore_manual_keep_pump_on_state or get_semaphore_is_clean_state failed!"); }
+    // The sampler never waits for the pump, a full queue loses this sample and the next one follows
+    post_pump_event(PUMP_EVENT_SAMPLE, PUMP_SOURCE_SAMPLER, is_valid, local_clean_state, 0);
+
+#if SERIAL_DEBUG
+    console.printf("CURRENT => [ NTU: %f NTU, Voltage: %f V, AnalogRead: %u, Slope: %f V/s, IsRising: %s ]\n",
+                   snapshot.ntu.value,
+                   snapshot.voltage.value,
+                   snapshot.analog_value,
+                   snapshot.slope,
+                   snapshot.is_rising ? "YES" : "NO");
+
+    console.printf("AVERAGE => [ NTU: %f NTU, Voltage: %f V, IsRising: %s, Is Clean: %s ]\n",
+                   snapshot.ntu.avg,
+                   snapshot.voltage.avg,
+                   snapshot.is_rising ? "YES" : "NO",
+                   snapshot.is_clean ? "YES" : "NO");
 #endif
 
-                    stepper.setSpeed(0);
-                    stepper.stop();
+    if (!new_data) { return false; }
+    else if (tft_print && new_data)
+    {
+        TelemetryText text_data;
+        format_turbidity_text(snapshot, text_data);
 
-                    // Change motor to sleep mode
-                    digitalWrite(MOTOR_SLEEP_PIN, LOW);
-                    digitalWrite(MOTOR_RESET_PIN, LOW);
-                    digitalWrite(MOTOR_ENABLE_PIN, HIGH);
-                    delay(1);
-                }
-            }
-            else { log_w("set_semaphore_pump_state failed!"); }
-        }
+        display_renderer_s.post(WIDGET_TURBIDITY, text_data.c_str(), hal::COLOR_WHITE, 0, CONTROL_DISPLAY_TIMEOUT_MS);
+
+        if (serial_print) { console.println(text_data.c_str()); }
     }
-    else { log_w("get_semaphore_pump_state failed!"); }
+
+    return true;
 }
 
-bool get_turbidity_data(bool serial_print = false, bool tft_print = true, uint8_t row = 4)
+/**
+ * @brief 32-bit FNV-1a hash, pass the previous result as hash to continue over the next chunk
+ * 
+ */
+uint32_t fnv1a(const char* content, size_t length, uint32_t hash = 2166136261U)
 {
-    TurbidityData local_turbidity_data;
-    if (!get_semaphore_turbidity_data(local_turbidity_data)) { return false; }
-
-    uint16_t idx_local         = local_turbidity_data.index;
-    uint16_t curr_sensor_value = analogRead(TURBIDITY_PIN);
-    float    voltage_local     = to_voltage(curr_sensor_value);
-    float    ntu_local         = to_ntu(voltage_local);
+    for (size_t i = 0; i < length; i++) { hash = (hash ^ static_cast<uint8_t>(content[i])) * 16777619U; }
+    return hash;
+}
 
-    local_turbidity_data.ntu.current.value          = ntu_local;
-    local_turbidity_data.ntu.history[idx_local]     = ntu_local;
-    local_turbidity_data.voltage.current.value      = voltage_local;
-    local_turbidity_data.voltage.history[idx_local] = voltage_local;
+/**
+ * @brief Strong ETag of a response body (its FNV-1a hash), stays valid across reboots since it only depends on content
+ * 
+ */
+void format_etag(uint32_t hash, char* dest, size_t size)
+{
+    snprintf(dest, size, "\"%08lx\"", static_cast<unsigned long>(hash));
+}
 
-    float    _sum   = 0.0F;
-    uint16_t _count = 0;
-    for (uint16_t i = 0; i < TURBIDITY_HISTORY_SIZE; i++)
+/**
+ * @brief Hash every web asset once at boot, an asset without ETag is missing from the data partition
+ * 
+ */
+void load_web_assets()
+{
+    for (WebAsset& asset : web_assets_s)
     {
-        float _voltage         = local_turbidity_data.voltage.history[i];
-        float _voltage_rounded = roundf(_voltage * 1000.0F) / 1000.0F;
-        if (_voltage_rounded > 0.0F && _voltage_rounded <= TURBIDITY_SENSOR_INPUT_VOLTAGE)
+        asset.etag[0] = '\0';
+
+        FILE* file = hal::fs_open(asset.path, "rb");
+        if (file == NULL)
         {
-            _sum += _voltage;
-            _count++;
+            log_w("Web asset %s missing, upload the filesystem image", asset.path);
+            continue;
         }
-    }
 
-    local_turbidity_data.voltage.current.avg = _count > 0 ? _sum / static_cast<float>(_count) : 0.0F;
-    local_turbidity_data.ntu.current.avg     = to_ntu(local_turbidity_data.voltage.current.avg);
+        uint32_t hash = 2166136261U;
+        char     chunk[256];
+        size_t   length = 0;
+        while ((length = fread(chunk, 1, sizeof(chunk), file)) > 0) { hash = fnv1a(chunk, length, hash); }
+        fclose(file);
 
-    bool new_data = abs(local_turbidity_data.voltage.current.avg - local_turbidity_data.voltage.previous.avg) > 0.0F;
+        format_etag(hash, asset.etag, sizeof(asset.etag));
+    }
+}
+
+// Function: Static web asset, streamed gzipped from the data partition and revalidated with its ETag
+void send_web_asset(const WebAsset& asset)
+{
+    if (asset.etag[0] == '\0')
+    {
+        server.send(503, "text/plain", "Web interface not installed, upload the filesystem image");
+        return;
+    }
 
-    float    lin_regr_sum_x        = 0.0F;
-    float    lin_regr_sum_y        = 0.0F;
-    float    lin_regr_sum_xy       = 0.0F;
-    float    lin_regr_sum_x_square = 0.0F;
-    float    lin_regr_coeff        = 0.0F;
-    uint16_t lin_regr_count        = 0;
+    char if_none_match[64];
+    server.sendHeader("ETag", asset.etag);
+    server.sendHeader("Cache-Control", asset.cache_control);
 
-    for (uint16_t i = 0; i < TURBIDITY_HISTORY_SIZE; i++)
+    if (server.header("If-None-Match", if_none_match, sizeof(if_none_match))
+        && strcmp(if_none_match, asset.etag) == 0)
     {
-        if (local_turbidity_data.voltage.history[i] > 0.0F)
-        {
-            lin_regr_sum_y += local_turbidity_data.voltage.history[i];
-            lin_regr_sum_x += i;
-            lin_regr_sum_xy += i * local_turbidity_data.voltage.history[i];
-            lin_regr_sum_x_square += sq(i);
-            lin_regr_count += 1;
-        }
+        server.send(304, asset.content_type, "", 0);
     }
+    else if (!server.sendFile(asset.content_type, asset.path))
+    {
+        server.send(500, "text/plain", "Could not read web asset");
+    }
+}
 
-    if (lin_regr_count > 1)
+template<size_t INDEX>
+void handleWebAsset()
+{
+    send_web_asset(web_assets_s[INDEX]);
+}
+
+/**
+ * @brief Queue a pump command and redirect back to the (cached) main page
+ *
+ */
+void send_pump_command(PumpEventType type)
+{
+    if (!post_pump_event(type, PUMP_SOURCE_HTTP))
     {
-        float n                    = static_cast<float>(lin_regr_count);
-        float lin_regr_numerator   = (n * lin_regr_sum_xy) - (lin_regr_sum_x * lin_regr_sum_y);
-        float lin_regr_denominator = (n * lin_regr_sum_x_square) - (lin_regr_sum_x * lin_regr_sum_x);
-        lin_regr_coeff             = lin_regr_denominator != 0.0F ? lin_regr_numerator / lin_regr_denominator : 0.0F;
+        server.send(503, "text/plain", "Pump control busy");
+        return;
+    }
+
+    server.sendHeader("Location", "/");
+    server.send(303, "text/plain", "", 0);
+}
+
+// Function: Webserver Pump On
+void handlePumpOn()
+{
+    send_pump_command(PUMP_EVENT_START);
+}
+
+// Function: Webserver Pump Off
+void handlePumpOff()
+{
+    send_pump_command(PUMP_EVENT_STOP);
+}
+
+#if WEBSERVER_ASYNC
+// Function: Realtime Turbidity Data event (JSON on a single line), pushed to /turbidity/stream subscribers
+size_t format_turbidity_event(char* dest, size_t size)
+{
+    TurbiditySnapshot local_snapshot;
+    if (!get_turbidity_snapshot(local_snapshot)) { return 0; }
 
-        local_turbidity_data.voltage.is_rising  = lin_regr_coeff > 0.0F;
-        local_turbidity_data.voltage.is_falling = lin_regr_coeff < 0.0F;
+    TelemetryText json;
+    format_turbidity_json(local_snapshot, json);
+
+    return snprintf(dest, size, "%s", json.c_str());
+}
+#endif
+
+// Function: Realtime Turbidity Data (JSON), served from the last published snapshot without sampling the ADC
+void handleTurbidityData()
+{
+    TurbiditySnapshot local_snapshot;
+    if (!get_turbidity_snapshot(local_snapshot))
+    {
+        server.send(503, "application/json", "{}");
+        return;
     }
 
-    bool is_clean_flag         = !local_turbidity_data.voltage.is_falling;
-    local_turbidity_data.index = (idx_local + 1) % TURBIDITY_HISTORY_SIZE;
-    bool local_clean_state = (local_turbidity_data.voltage.current.avg > TURBIDITY_VOLTAGE_THRESHOLD) && is_clean_flag;
+    TelemetryText json;
+    format_turbidity_json(local_snapshot, json);
+
+    char etag[12];
+    char if_none_match[64];
+    format_etag(fnv1a(json.c_str(), json.size()), etag, sizeof(etag));
 
-    if (!set_semaphore_is_clean_state(local_clean_state)) { log_w("set_semaphore_is_clean_state failed!"); }
+    server.sendHeader("ETag", etag);
+    server.sendHeader("Cache-Control", "no-cache");
 
-#if USE_TURBIDITY_SENSOR
-    if (!local_clean_state)
+    if (server.header("If-None-Match", if_none_match, sizeof(if_none_match)) && strcmp(if_none_match, etag) == 0)
     {
-        if (!set_semaphore_manual_keep_pump_on_state(false)) { log_w("set_semaphore_is_clean_state failed!"); }
+        server.send(304, "application/json", "", 0);
     }
-#endif
+    else { server.send(200, "application/json", json.c_str(), json.size()); }
+}
+
+struct HistoryResponse
+{
+    std::string json;
+    uint16_t    count;
+    uint32_t    next;  // Timestamp to continue from when the response is full, 0 if complete
+};
+
+bool append_history_sample(const SampleRecord& record, void* context)
+{
+    HistoryResponse& response = *static_cast<HistoryResponse*>(context);
+    if (response.count == HISTORY_MAX_SAMPLES)
+    {
+        response.next = record.timestamp;
+        return false;
+    }
+
+    float         voltage = turbidity_table_s.voltage(record.analog_value);
+    TelemetryText row;
+    row.append(response.count > 0 ? ",[" : "[")
+        .append(record.timestamp)
+        .append(',')
+        .append(voltage, 2)
+        .append(',')
+        .append(turbidity_table_s.ntu(record.analog_value), 2)
+        .append((record.flags & SAMPLE_FLAG_CLEAN) != 0 ? ",true]" : ",false]");
+
+    response.json.append(row.c_str(), row.size());
+    response.count++;
+    return true;
+}
 
-#if USE_TURBIDITY_SENSOR
-    bool local_manual_keep_pump_on;
-    if (get_semaphore_manual_keep_pump_on_state(local_manual_keep_pump_on))
+/**
+ * @brief Header of the binary /turbidity/history response (little-endian), followed by one SampleEncoder block
+ * 
+ */
+struct HistoryBinaryHeader
+{
+    char     magic[4];        // "TSH1"
+    uint32_t next;            // Timestamp to continue from when the response is full, 0 if complete
+    uint16_t count;           // Records in the block
+    uint16_t length;          // Bytes of the block
+    float    volts_per_code;  // voltage = analog_value * volts_per_code
+};
+
+struct HistoryBinaryResponse
+{
+    SampleEncoder encoder;
+    uint32_t      next;
+};
+
+bool encode_history_sample(const SampleRecord& record, void* context)
+{
+    HistoryBinaryResponse& response = *static_cast<HistoryBinaryResponse*>(context);
+    if (!response.encoder.append(record))
     {
-        if (local_clean_state && !local_manual_keep_pump_on) { changePumpState(false); }
+        response.next = record.timestamp;
+        return false;
     }
+
+    return true;
+}
+
+void send_history_binary(uint32_t from, uint32_t to)
+{
+    std::string body(sizeof(HistoryBinaryHeader) + HISTORY_MAX_BINARY_BYTES, '\0');
+    uint8_t*    block = reinterpret_cast<uint8_t*>(body.data()) + sizeof(HistoryBinaryHeader);
+
+    HistoryBinaryResponse response = {.encoder = SampleEncoder(block, HISTORY_MAX_BINARY_BYTES), .next = 0};
+    sample_log_s.query(from, to, encode_history_sample, &response);
+
+    HistoryBinaryHeader header = {
+        .magic          = {'T', 'S', 'H', '1'},
+        .next           = response.next,
+        .count          = response.encoder.count(),
+        .length         = static_cast<uint16_t>(response.encoder.size()),
+        .volts_per_code = to_voltage(1),
+    };
+    memcpy(body.data(), &header, sizeof(header));
+    body.resize(sizeof(header) + header.length);
+
+    server.sendHeader("Cache-Control", "no-cache");
+    server.send(200, "application/octet-stream", body.data(), body.size());
+}
+
+void send_history_json(uint32_t from, uint32_t to)
+{
+    HistoryResponse response = {.json = "", .count = 0, .next = 0};
+    response.json.reserve(64 + HISTORY_MAX_SAMPLES / 4 * 32);
+    response.json.append("{\"fields\": [\"timestamp\", \"voltage\", \"turbidity\", \"is_clean\"], \"samples\": [");
+
+    sample_log_s.query(from, to, append_history_sample, &response);
+
+    TelemetryText tail;
+    tail.append("], \"next\": ");
+    if (response.next != 0) { tail.append(response.next); }
+    else { tail.append("null"); }
+    tail.append('}');
+    response.json.append(tail.c_str(), tail.size());
+
+    server.sendHeader("Cache-Control", "no-cache");
+    server.send(200, "application/json", response.json.c_str(), response.json.size());
+}
+
+// Function: Logged samples with from <= timestamp <= to (Unix seconds, default the last hour), JSON or format=binary
+void handleTurbidityHistory()
+{
+    char     value[16];
+    uint32_t now  = hal::unix_time();
+    uint32_t from = now > 3'600 ? now - 3'600 : 0;
+    uint32_t to   = UINT32_MAX;
+    if (server.arg("from", value, sizeof(value))) { from = strtoul(value, nullptr, 10); }
+    if (server.arg("to", value, sizeof(value))) { to = strtoul(value, nullptr, 10); }
+
+    if (server.arg("format", value, sizeof(value)) && strcmp(value, "binary") == 0) { send_history_binary(from, to); }
+    else { send_history_json(from, to); }
+}
+
+#if METRICS_ENABLED
+// Function: Counters, gauges and latency histograms in the Prometheus text format
+void handleMetrics()
+{
+    hal::HeapInfo heap = hal::heap_info();
+    heap_free_s.set(static_cast<int32_t>(heap.free_bytes));
+    heap_minimum_free_s.set(static_cast<int32_t>(heap.minimum_free_bytes));
+    heap_largest_block_s.set(static_cast<int32_t>(heap.largest_free_block));
+#if WEBSERVER_ASYNC
+    http_connections_s.set(async_server_s.open_connections());
 #endif
 
-    String is_clean_str                 = local_clean_state ? "YES" : "NO";
-    local_turbidity_data.text_data_json = "{\"turbidity\": " + String(local_turbidity_data.ntu.current.value, 2)
-                                          + ", \"voltage\": " + String(local_turbidity_data.voltage.current.value, 2)
-                                          + ", \"avg_voltage\": " + String(local_turbidity_data.voltage.current.avg, 2)
-                                          + "}";
-    local_turbidity_data.text_data = "AVG Volt.: " + String(local_turbidity_data.voltage.current.avg, 2) + " V" + "\n"
-                                     + "Voltage: " + String(local_turbidity_data.voltage.current.value, 2) + " V" + "\n"
-                                     + "Is Clean?: " + is_clean_str;
+    std::string text;
+    text.reserve(12'288);
+    Metric::format_all(text);
 
-#if SERIAL_DEBUG
-    Serial.printf("CURRENT => [ NTU: %f NTU, Voltage: %f V, AnalogRead: %u, Coeff: %f, IsRising: %s ]\n",
-                  ntu_local,
-                  voltage_local,
-                  curr_sensor_value,
-                  lin_regr_coeff,
-                  local_turbidity_data.voltage.is_rising ? "YES" : "NO");
-
-    Serial.printf("AVERAGE => [ NTU: %f NTU, Voltage: %f V, IsRising: %s, Is Clean: %s ]\n",
-                  local_turbidity_data.ntu.current.avg,
-                  local_turbidity_data.voltage.current.avg,
-                  local_turbidity_data.voltage.is_rising ? "YES" : "NO",
-                  local_clean_state ? "YES" : "NO");
-
-    #if SERIAL_DEBUG_HISTORY
-    Serial.printf("HISTORY =>\n{\n");
-    for (uint16_t i = 0; i < TURBIDITY_HISTORY_SIZE; i++)
-    {
-        Serial.printf("  [%u] => [ NTU: %f NTU, Voltage: %f V ]\n",
-                      i,
-                      local_turbidity_data.ntu.history[i],
-                      local_turbidity_data.voltage.history[i]);
-    }
-    Serial.printf("}\n");
-    #endif
+    server.sendHeader("Cache-Control", "no-cache");
+    server.send(200, "text/plain; version=0.0.4", text.c_str(), text.size());
+}
 #endif
 
-    if (!new_data) { return false; }
-    else if (tft_print && new_data)
+#if METRICS_ENABLED
+/**
+ * @brief Append a CPU share in percent, or unknown when the scheduler keeps no run-time statistics
+ *
+ */
+TelemetryText& append_load_percent(TelemetryText& text, uint16_t permille, const char* unknown)
+{
+    if (permille == TaskLoad::UNKNOWN_PERMILLE) { return text.append(unknown); }
+    return text.append(permille / 10.0F, 1);
+}
+
+void format_task_profile_json(const TaskProfile& profile, std::string& dest)
+{
+    TelemetryText text;
+    text.append("{\"timestamp_ms\": ")
+        .append(profile.timestamp_ms)
+        .append(", \"window_ms\": ")
+        .append(profile.window_ms)
+        .append(", \"heap\": {\"free\": ")
+        .append(profile.heap_free)
+        .append(", \"minimum_free\": ")
+        .append(profile.heap_minimum_free);
+    dest.append(text.c_str(), text.size());
+
+    text.clear();
+    text.append(", \"largest_free_block\": ").append(profile.heap_largest_block).append("}, \"cores\": [");
+    for (uint8_t core = 0; core < TaskProfile::CORES; core++)
     {
-        local_turbidity_data.voltage.previous = local_turbidity_data.voltage.current;
-        tft_text_setup(false, row);
-        for (uint8_t i = 0; i < 3; i++) { tft_clear_row(row + i); }
-        tft.println(local_turbidity_data.text_data.c_str());
-
-        if (serial_print) { Serial.println(local_turbidity_data.text_data.c_str()); }
-    }
-
-    bool result = set_semaphore_turbidity_data(local_turbidity_data);
-
-    return result;
-}
-
-// Function: HTML-header with CSS and JavaScript for real-time updates
-String getHtmlHeader()
-{
-    return "<!DOCTYPE html>\
-            <html>\
-                <head>\
-                <title>ESP32 Webinterface</title>\
-                    <style>\
-                        body { font-family: Arial, sans-serif; text-align: center; margin: 0; padding: 0; background-color: #f4f4f9; }\
-                        h1 { color: #333; }\
-                        p { color: #666; font-size: 18px; }\
-                        .container { max-width: 600px; margin: auto; padding: 20px; }\
-                        button { padding: 10px 20px; font-size: 16px; color: #fff; background-color: #007BFF; border: none; border-radius: 5px; cursor: pointer; }\
-                        button:hover { background-color: #0056b3; }\
-                        .link { text-decoration: none; }\
-                        .card { margin: 20px auto; padding: 15px; border-radius: 8px; background: #fff; box-shadow: 0 4px 8px rgba(0,0,0,0.2); }\
-                        .banner { width: 100%; display: flex; justify-content: center; align-items: center; background-color: #fff; padding: 10px 0; }\
-                        .svg-container { max-width: 600px; width: 100%; }\
-                        .data-section { margin-top: 20px; padding: 15px; background-color: #ffffff; border-radius: 8px; box-shadow: 0 4px 8px rgba(0,0,0,0.2); }\
-                        .data-item { margin: 10px 0; font-size: 18px; }\
-                    </style>\
-                    <script>\
-                        function updateTurbidity() {\
-                        fetch('/turbidity/data')\
-                            .then(response => response.json())\
-                            .then(data => {\
-                            document.getElementById('turbidity').innerText = data.turbidity + ' NTU';\
-                            document.getElementById('avg_turbidity').innerText = data.avg_turbidity + ' NTU';\
-                            document.getElementById('voltage').innerText = data.voltage + ' V';\
-                            document.getElementById('avg_voltage').innerText = data.avg_voltage + ' V';\
-                            })\
-                            .catch(error => {\
-                            console.error('Fout bij ophalen van turbidity data:', error);\
-                            });\
-                        }\
-                        setInterval(updateTurbidity, 1000);\
-                    </script>\
-                </head>\
-                <body>\
-                    <div class='banner'>\
-                        <div class='svg-container'>\
-                            <svg viewBox='0 0 1080 100' preserveAspectRatio='xMidYMid slice' xmlns='http://www.w3.org/2000/svg' width='100%' height='100'>\
-                                <rect style='fill:#ffffff;stroke:none;' width='1080' height='100' />\
-                                <g transform='scale(0.5) translate(450, -90)' style='stroke:none;'>\
-                                    <path style='fill:#01bf63;stroke:none;' d='m 251.81923,282.83088 c 0,0 -105.37212,1.47718 0.006,-147.22529 105.3786,148.70295 0.006,147.22577 0.006,147.22577' />\
-                                    <path style='fill:#ffffff;stroke:none;' d='m 210.39692,266.4831 c 0,0 56.52674,5.58289 93.74598,-28.14706 37.21925,-33.72994 0.46524,-37.21924 0.46524,-37.21924 0,0 -44.89571,56.99197 -103.51603,42.80213 -58.62031,-14.18984 9.30481,22.56417 9.30481,22.56417 z' />\
-                                    <path style='fill:#d8d4d5;stroke:none;' d='m 185.46511,214.04958 c 0,0 -35.50385,51.25721 23.74761,54.07871 0,0 51.25721,2.35125 100.63342,-40.44147 0,0 58.45213,-54.88295 -16.27049,-64.19344 0,0 37.26464,12.18139 6.98072,49.79206 0,0 -23.44561,28.57434 -63.01009,37.61067 0,0 -68.50547,16.67025 -52.08117,-36.84653 z' />\
-                                    <path style='fill:#ffffff;stroke:none;' d='m 217.44432,204.23819 c 0,0 -10.03344,24.84472 -5.25562,41.88564 l 2.22966,0.31852 c 0,0 -0.47779,-16.40388 3.02596,-42.20416 z' />\
-                                </g>\
-                                <text style='font-size:36px;font-family:Futura;font-weight:bold;fill:#241c1c;' x='400' y='60'>\
-                                    <tspan style='fill:#605b56;'>Pure</tspan>\
-                                    <tspan style='fill:#01bf63;'>FIo</tspan>\
-                                </text>\
-                                <text style='font-size:12px;font-family:Futura;font-weight:bold;fill:#605b56;' x='410' y='85'>RESIN FILTERS</text>\
-                            </svg>\
-                        </div>\
-                    </div>\
-                </body>\
-            </html>";
-}
-
-// Function: HTML-footer
-String getHtmlFooter() { return "</div></body></html>"; }
-
-// Function: Main Page
-void handleRoot()
-{
-    String html = getHtmlHeader();
-    html +=
-        "<h1>ESP32 Webinterface</h1>\
-            <p>Control the Pump state or check the turbidity values:</p>\
-            <div class='card'>\
-                <h2>Pump Settings</h2>\
-                <p><a href='/pump/on' class='link'><button>Pump ON</button></a></p>\
-                <p><a href='/pump/off' class='link'><button>Pump OFF</button></a></p>\
-            </div>\
-            <div class='card'>\
-                <h2>Realtime Turbidity Data</h2>\
-                <p><strong>Turbidity:</strong> <span id='turbidity'>Laden...</span></p>\
-                <p><strong>Average Turbidity:</strong> <span id='avg_turbidity'>Laden...</span></p>\
-                <p><strong>Voltage:</strong> <span id='voltage'>Laden...</span></p>\
-                <p><strong>Average Voltage:</strong> <span id='avg_voltage'>Laden...</span></p>\
-            </div>\
-            <div class='card'>\
-                <h2>Wi-Fi Settings</h2>\
-                <p><a href='/wifi/reset' class='link'><button>Reset Wi-Fi Settings</button></a></p>\
-            </div>";
-    html += getHtmlFooter();
-    server.send(200, "text/html", html);
-}
-
-// Function: Webserver LED On
-void handlePumpOn()
+        append_load_percent(text.append(core > 0 ? ", " : ""), profile.core_busy_permille[core], "-1");
+    }
+    text.append("], \"tasks\": [");
+    dest.append(text.c_str(), text.size());
+
+    for (uint8_t i = 0; i < profile.task_count; i++)
+    {
+        const TaskLoad& task = profile.tasks[i];
+
+        text.clear();
+        text.append(i > 0 ? ", {\"name\": \"" : "{\"name\": \"")
+            .append(task.name)
+            .append("\", \"core\": ")
+            .append(static_cast<int32_t>(task.core))
+            .append(", \"priority\": ")
+            .append(static_cast<uint32_t>(task.priority))
+            .append(", \"cpu_percent\": ");
+        append_load_percent(text, task.cpu_permille, "-1");
+        dest.append(text.c_str(), text.size());
+
+        text.clear();
+        text.append(", \"stack_size\": ")
+            .append(task.stack_size)
+            .append(", \"stack_free_min\": ")
+            .append(task.stack_free_min)
+            .append('}');
+        dest.append(text.c_str(), text.size());
+    }
+    dest.append("]");
+}
+
+void format_job_stats_json(const char* executor, const ExecutorStats& stats, std::string& dest)
 {
-    changePumpState(true);
-    handleRoot();
+    for (uint8_t i = 0; i < stats.job_count; i++)
+    {
+        const JobStats& job = stats.jobs[i];
+
+        TelemetryText text;
+        text.append(dest.back() == '[' ? "{\"executor\": \"" : ", {\"executor\": \"")
+            .append(executor)
+            .append("\", \"name\": \"")
+            .append(job.name)
+            .append("\", \"period_us\": ")
+            .append(job.period_us)
+            .append(", \"runs\": ")
+            .append(job.runs);
+        dest.append(text.c_str(), text.size());
+
+        text.clear();
+        text.append(", \"deadline_misses\": ")
+            .append(job.deadline_misses)
+            .append(", \"overruns\": ")
+            .append(job.overruns)
+            .append(", \"jitter_max_us\": ")
+            .append(job.jitter_max_us)
+            .append(", \"jitter_mean_us\": ")
+            .append(job.jitter_mean_us);
+        dest.append(text.c_str(), text.size());
+
+        text.clear();
+        text.append(", \"duration_max_us\": ")
+            .append(job.duration_max_us)
+            .append(", \"duration_mean_us\": ")
+            .append(job.duration_mean_us)
+            .append('}');
+        dest.append(text.c_str(), text.size());
+    }
 }
 
-// Function: Webserver LED Off
-void handlePumpOff()
+#if COROUTINE_TASKS
+void format_coroutine_stats_json(const CoroutineStats& stats, std::string& dest)
 {
-    changePumpState(false);
-    handleRoot();
+    TelemetryText text;
+    text.append(", \"coroutines\": {\"running\": ")
+        .append(static_cast<uint32_t>(stats.coroutines))
+        .append(", \"waiting\": ")
+        .append(static_cast<uint32_t>(stats.waiting))
+        .append(", \"resumes\": ")
+        .append(stats.resumes)
+        .append(", \"wakeups\": ")
+        .append(stats.wakeups);
+    dest.append(text.c_str(), text.size());
+
+    text.clear();
+    text.append(", \"slot_size\": ")
+        .append(static_cast<uint32_t>(stats.arena_slot_size))
+        .append(", \"slots\": ")
+        .append(static_cast<uint32_t>(stats.arena_slots))
+        .append(", \"slots_used\": ")
+        .append(static_cast<uint32_t>(stats.arena_slots_used))
+        .append(", \"slots_max_used\": ")
+        .append(static_cast<uint32_t>(stats.arena_slots_max_used))
+        .append(", \"largest_request\": ")
+        .append(static_cast<uint32_t>(stats.arena_largest_request))
+        .append('}');
+    dest.append(text.c_str(), text.size());
 }
+#endif
 
-// Function: Realtime Turbidity Data (JSON)
-void handleTurbidityData()
+/**
+ * @brief One line with the core load, the heap and per task its CPU share and free stack (of its size if known)
+ * 
+ */
+void log_task_profile(const TaskProfile& profile)
 {
-    if (get_turbidity_data(false, false, 4))
+    std::string   line = "PROFILE cpu";
+    TelemetryText text;
+    for (uint8_t core = 0; core < TaskProfile::CORES; core++)
     {
-        TurbidityData local_turbidity_data;
-        if (get_semaphore_turbidity_data(local_turbidity_data))
-        {
-            server.send(200, "application/json", local_turbidity_data.text_data_json);
-        }
-        else { handleRoot(); }
+        append_load_percent(text.append(core > 0 ? "/" : " "), profile.core_busy_permille[core], "?").append('%');
+    }
+    text.append(" heap ")
+        .append(profile.heap_free)
+        .append(" min ")
+        .append(profile.heap_minimum_free)
+        .append(" block ")
+        .append(profile.heap_largest_block);
+    line.append(text.c_str(), text.size());
+
+    for (uint8_t i = 0; i < profile.task_count; i++)
+    {
+        const TaskLoad& task = profile.tasks[i];
+
+        text.clear();
+        append_load_percent(text.append(" | ").append(task.name).append(' '), task.cpu_permille, "?").append("% ");
+        text.append(task.stack_free_min);
+        if (task.stack_size > 0) { text.append('/').append(task.stack_size); }
+        line.append(text.c_str(), text.size());
     }
+
+    console.println(line.c_str());
+}
+
+// Function: CPU share per task and core, stack high-water marks and heap of the last profiler window, and the
+// timing of the periodic jobs (JSON)
+void handleTaskProfile()
+{
+    // Only the web server task calls it, too large for its stack
+    static TaskProfile   profile;
+    static ExecutorStats job_stats;
+    if (!task_profiler_s.profile(profile))
+    {
+        server.send(503, "application/json", "{}");
+        return;
+    }
+
+    std::string json;
+    json.reserve(512 + (profile.task_count + 2 * ExecutorStats::MAX_JOBS) * 160);
+    format_task_profile_json(profile, json);
+
+    json.append(", \"jobs\": [");
+    if (housekeeping_s.stats(job_stats)) { format_job_stats_json("housekeeping", job_stats, json); }
+    if (sampler_s.stats(job_stats)) { format_job_stats_json("sampler", job_stats, json); }
+
+    json.append("], \"boot_ms\": {");
+    for (uint8_t i = 0; i < BOOT_PHASE_COUNT; i++)
+    {
+        TelemetryText text;
+        text.append(i > 0 ? ", \"" : "\"")
+            .append(BOOT_PHASE_NAMES[i])
+            .append("\": ")
+            .append(boot_phase_ms_s[i].load(std::memory_order_relaxed));
+        json.append(text.c_str(), text.size());
+    }
+    json.append("}");
+
+#if COROUTINE_TASKS
+    CoroutineStats coroutines;
+    if (control_scheduler_s.stats(coroutines)) { format_coroutine_stats_json(coroutines, json); }
+#endif
+    json.append("}");
+
+    server.sendHeader("Cache-Control", "no-cache");
+    server.send(200, "application/json", json.c_str(), json.size());
+}
+#endif
+
+/**
+ * @brief handler timed into histogram, both are fixed at compile time so a plain function pointer can be registered
+ *
+ */
+template<hal::HttpHandler HANDLER, MetricHistogram& HISTOGRAM>
+void timed_handler()
+{
+    MetricTimer timer(HISTOGRAM);
+    HANDLER();
 }
 
 void handleWiFiReset()
 {
+    // The page is only written after the handler returns, webserver_task resets once it had time to get out
     server.send(200, "text/html", "<h1>Wi-Fi Reset</h1><p>Wi-Fi settings are being reset...</p>");
-    delay(2'000);
-    wifiManager.resetSettings();
-    ESP.restart();
+    is_wifi_reset_pending_s = true;
+    wifi_reset_at_ms_s      = hal::millis() + WIFI_RESET_DELAY_MS;
 }
 
-void configModeCallback(WiFiManager* myWiFiManager)
+void configModeCallback(const char* portal_ssid, const char* portal_ip)
 {
-    Serial.println("Config mode!");
-    tft_text_setup(false, 2, TFT_YELLOW, TFT_BLACK);
-    tft.printf("Name:\n%s\n\nIP-address:\n%s\n",
-               myWiFiManager->getConfigPortalSSID().c_str(),
-               WiFi.softAPIP().toString().c_str());
-    Serial.printf("Name: %s\nIP-address: %s\n",
-                  myWiFiManager->getConfigPortalSSID().c_str(),
-                  WiFi.softAPIP().toString().c_str());
+    console.println("Config mode!");
+    char text[DISPLAY_TEXT_SIZE];
+    snprintf(text, sizeof(text), "Name:\n%s\n\nIP-address:\n%s", portal_ssid, portal_ip);
+    display_renderer_s.post(WIDGET_PORTAL, text, hal::COLOR_YELLOW);
+    console.printf("Name: %s\nIP-address: %s\n", portal_ssid, portal_ip);
 }
 
-void display_button(const char* text,
-                    uint16_t    x,
-                    uint16_t    y,
-                    uint16_t    w,
-                    uint16_t    h,
-                    uint16_t    bg_color,
-                    uint16_t    fg_color = TFT_WHITE)
+void update_buttons(uint16_t touch_x, uint16_t touch_y)
 {
-    tft.fillRoundRect(x, y, w, h, 8, bg_color);
-    tft.drawRoundRect(x, y, w, h, 8, TFT_BLACK);
-    tft.setTextColor(fg_color);
-    tft.setTextSize(2);
-    tft.setTextDatum(MC_DATUM);
-    tft.drawString(text, x + w / 2, y + h / 2);
+    int8_t widget = display_renderer_s.hit_test(touch_x, touch_y);
+    if (widget != WIDGET_BUTTON_ON && widget != WIDGET_BUTTON_OFF) { return; }
+
+    // As a coroutine on control_task, waiting for room would only hold up the pump coroutine that makes it
+    PumpEventType type       = widget == WIDGET_BUTTON_ON ? PUMP_EVENT_START : PUMP_EVENT_STOP;
+    uint32_t      timeout_ms = COROUTINE_TASKS ? 0 : PUMP_POST_TIMEOUT_MS;
+    post_pump_event(type, PUMP_SOURCE_TOUCH, false, false, timeout_ms);
 }
 
-bool is_button_pressed(uint16_t touch_x, uint16_t touch_y, uint16_t x, uint16_t y, uint16_t w, uint16_t h)
+/**
+ * @brief Record the time phase was reached, only the first time (a reconnect is not a boot milestone)
+ *
+ */
+void mark_boot_phase(BootPhase phase)
 {
-    uint16_t x1 = x;
-    uint16_t y1 = y;
-    uint16_t x2 = x + w;
-    uint16_t y2 = y + h;
+    uint32_t now_ms   = hal::millis();
+    uint32_t expected = 0;
+    if (!boot_phase_ms_s[phase].compare_exchange_strong(expected, now_ms > 0 ? now_ms : 1)) { return; }
 
-    return touch_x >= x1 && touch_x <= x2 && touch_y >= y1 && touch_y <= y2;
+    boot_phase_s[phase].set(static_cast<int32_t>(now_ms));
+    console.printf("BOOT %s at %lu ms\n", BOOT_PHASE_NAMES[phase], static_cast<unsigned long>(now_ms));
 }
 
-void update_buttons(uint16_t touch_x, uint16_t touch_y)
+void init_motor()
+{
+    console.println("PUMP INIT");
+
+    hal::pin_output(MOTOR_MS1_PIN);     // Microstep1 pin as output
+    hal::pin_output(MOTOR_MS2_PIN);     // Microstep2 pin as output
+    hal::pin_output(MOTOR_MS3_PIN);     // Microstep3 pin as output
+    hal::pin_output(MOTOR_SLEEP_PIN);   // Sleep pin as output
+    hal::pin_output(MOTOR_RESET_PIN);   // Reset pin as output
+    hal::pin_output(MOTOR_ENABLE_PIN);  // Enable pin as output
+
+    hal::pin_write(MOTOR_MS1_PIN, false);  // Set microstep1 pin to low
+    hal::pin_write(MOTOR_MS2_PIN, false);  // Set microstep2 pin to low
+    hal::pin_write(MOTOR_MS3_PIN, false);  // Set microstep3 pin to low
+
+    hal::pin_write(MOTOR_SLEEP_PIN, PUMP_STATE_DEFAULT);    // Set motor to normal or sleep mode
+    hal::pin_write(MOTOR_RESET_PIN, PUMP_STATE_DEFAULT);    // Set motor to normal or sleep mode
+    hal::pin_write(MOTOR_ENABLE_PIN, !PUMP_STATE_DEFAULT);  // Set motor to normal or sleep mode
+
+    step_engine_s.begin(MOTOR_STEP_PIN, MOTOR_DIRECTION_PIN, PUMP_DIRECTION_INVERTED);
+    console.printf("PUMP RAMP %u steps, %lu ms to full flow\n",
+                   MOTOR_RAMP_STEPS,
+                   static_cast<unsigned long>(motor_ramp_s.duration() / 1'000));
+
+    // pump_control_task starts in the default state, it only actuates on a change
+    console.println("PUMP START");
+    if (PUMP_STATE_DEFAULT) { step_engine_s.start(MOTOR_STEPS_PER_SECOND, MOTOR_WAKE_US); }
+}
+
+void webserver_task(void* parameter)
 {
-    bool button_on_pressed  = is_button_pressed(touch_x, touch_y, 20, 220, 180, 80);
-    bool button_off_pressed = is_button_pressed(touch_x, touch_y, 280, 220, 180, 80);
+    if (is_data_mounted_s) { load_web_assets(); }
+
+    server.on(web_assets_s[0].uri, timed_handler<handleWebAsset<0>, http_asset_s>);
+    server.on(web_assets_s[1].uri, timed_handler<handleWebAsset<1>, http_asset_s>);
+    server.on(web_assets_s[2].uri, timed_handler<handleWebAsset<2>, http_asset_s>);
+    server.on(web_assets_s[3].uri, timed_handler<handleWebAsset<3>, http_asset_s>);
+    static_assert(sizeof(web_assets_s) / sizeof(web_assets_s[0]) == 4, "Register every web asset");
+    server.on("/turbidity/data", timed_handler<handleTurbidityData, http_data_s>);  // Realtime data endpoint
+    server.on("/turbidity/history", timed_handler<handleTurbidityHistory, http_history_s>);
+#if WEBSERVER_ASYNC
+    async_server_s.on_event_stream("/turbidity/stream", format_turbidity_event);  // Realtime data push (SSE)
+#endif
+    server.on("/pump/on", timed_handler<handlePumpOn, http_pump_s>);
+    server.on("/pump/off", timed_handler<handlePumpOff, http_pump_s>);
+    server.on("/wifi/reset", handleWiFiReset);
+#if METRICS_ENABLED
+    server.on("/metrics", handleMetrics);
+    server.on("/system/tasks", handleTaskProfile);
+#endif
+
+    const char* collected_headers[] = {"If-None-Match"};
+    server.collectHeaders(collected_headers, 1);
 
-    bool pump_state_local;
-    if (get_semaphore_pump_state(pump_state_local))
+    server.begin();
+    // Replaces the first status line, the address stays below it
+    display_status(("Webserver started.\n" + WEBSERVER_IP_ADDRESS_TEXT).c_str(), hal::COLOR_GREEN);
+    console.println("Webserver started.");
+    mark_boot_phase(BOOT_WEBSERVER);
+
+    console.println("Entering Webserver Task loop");
+    while (true)
     {
-        bool result = (button_on_pressed && !button_off_pressed)   ? true
-                      : (button_off_pressed && !button_on_pressed) ? false
-                                                                   : pump_state_local;
+        if (hal::wifi_connected())
+        {
+            // Process incoming HTTP requests
+            server.handleClient();
+#if !WEBSERVER_ASYNC
+            hal::delay_ms(100);
+#endif
+        }
+        else { hal::delay_ms(WIFI_POLL_MS); }  // network_task reconnects
 
-        log_i("NEW pump state: %s", result ? "ON" : "OFF");
-        changePumpState(result);
+        if (is_wifi_reset_pending_s && static_cast<int32_t>(hal::millis() - wifi_reset_at_ms_s) >= 0)
+        {
+            sample_log_s.flush();
+            hal::wifi_reset_settings();
+            hal::restart();
+        }
     }
-    else { log_w("get_semaphore_pump_state failed!"); }
 }
 
-void init_motor()
+void on_wifi_connected()
 {
-    Serial.println("PUMP INIT");
+    char local_ip[16];
+    hal::wifi_local_ip(local_ip, sizeof(local_ip));
 
-    pinMode(MOTOR_MS1_PIN, OUTPUT);     // Microstep1 pin as output
-    pinMode(MOTOR_MS2_PIN, OUTPUT);     // Microstep2 pin as output
-    pinMode(MOTOR_MS3_PIN, OUTPUT);     // Microstep3 pin as output
-    pinMode(MOTOR_SLEEP_PIN, OUTPUT);   // Sleep pin as output
-    pinMode(MOTOR_RESET_PIN, OUTPUT);   // Reset pin as output
-    pinMode(MOTOR_ENABLE_PIN, OUTPUT);  // Enable pin as output
+    WEBSERVER_IP_ADDRESS_TEXT = std::string("Webserver IP-address:\n") + local_ip;
+    display_status(("WiFi connected!\n" + WEBSERVER_IP_ADDRESS_TEXT).c_str(), hal::COLOR_GREEN, true);
+    console.printf("%s\n%s\n", "WiFi connected!", WEBSERVER_IP_ADDRESS_TEXT.c_str());
+}
 
-    digitalWrite(MOTOR_MS1_PIN, LOW);  // Set microstep1 pin to low
-    digitalWrite(MOTOR_MS2_PIN, LOW);  // Set microstep2 pin to low
-    digitalWrite(MOTOR_MS3_PIN, LOW);  // Set microstep3 pin to low
+/**
+ * @brief Wait for the attempt started by hal::wifi_begin(), false once it failed or timeout_ms passed
+ *
+ */
+bool wait_for_wifi(uint32_t timeout_ms)
+{
+    uint32_t start_ms = hal::millis();
+    while (!hal::wifi_connected())
+    {
+        if (hal::wifi_failed() || hal::millis() - start_ms >= timeout_ms) { return false; }
+        hal::delay_ms(WIFI_POLL_MS);
+    }
 
-    digitalWrite(MOTOR_SLEEP_PIN, PUMP_STATE_DEFAULT ? HIGH : LOW);   // Set motor to normal or sleep mode
-    digitalWrite(MOTOR_RESET_PIN, PUMP_STATE_DEFAULT ? HIGH : LOW);   // Set motor to normal or sleep mode
-    digitalWrite(MOTOR_ENABLE_PIN, PUMP_STATE_DEFAULT ? LOW : HIGH);  // Set motor to normal or sleep mode
+    return true;
+}
 
-    stepper.setPinsInverted(PUMP_DIRECTION_INVERTED, false, false);
-    stepper.setMaxSpeed(static_cast<float>(MOTOR_RPM * MOTOR_STEPS_PER_REV * MOTOR_MICROSTEPS));
+/**
+ * @brief Serve the configuration portal until it closes: after credentials were saved (and joined) or its timeout
+ *
+ */
+void run_wifi_portal()
+{
+    console.println("Starting WiFi Manager!");
+    if (!hal::wifi_portal_begin(WIFI_PORTAL_SSID, WIFI_PORTAL_TIMEOUT_S, configModeCallback))
+    {
+        log_w("Could not open the WiFi configuration portal");
+        return;
+    }
 
-    Serial.println("PUMP START");
-    changePumpState(PUMP_STATE_DEFAULT);
+    while (hal::wifi_portal_process()) { hal::delay_ms(WIFI_POLL_MS / 2); }
 }
 
-void motor_task(void* parameter)
+/**
+ * @brief Brings the network up and keeps it up, without holding up any other task
+ *
+ * The first attempt after boot or a drop rejoins the cached access point, a failure there falls back to a scan at
+ * once. Failed scans are retried with a backoff that doubles up to WIFI_BACKOFF_MAX_MS, the configuration portal
+ * opens once per outage after WIFI_CONNECT_RETRIES of them, and right away while no network is stored. The first
+ * connection starts webserver_task.
+ */
+void network_task(void* parameter)
 {
-    init_motor();
+    console.println("Entering Network Task loop");
 
-    Serial.println("Entering Motor Task loop");
+    bool     is_connected        = false;
+    bool     is_webserver_active = false;
+    bool     use_cached          = true;
+    uint8_t  failures            = 0;
+    uint32_t backoff_ms          = WIFI_BACKOFF_MIN_MS;
     while (true)
     {
-        bool pump_state_local;
-        if (get_semaphore_pump_state(pump_state_local))
+        if (hal::wifi_connected())
+        {
+            if (!is_connected)
+            {
+                is_connected = true;
+                use_cached   = true;
+                failures     = 0;
+                backoff_ms   = WIFI_BACKOFF_MIN_MS;
+                on_wifi_connected();
+                mark_boot_phase(BOOT_WIFI);
+            }
+            if (!is_webserver_active)
+            {
+                is_webserver_active = hal::task_create(webserver_task, "webserver_task", 4096, NULL, 1, 0);
+            }
+            if (hal::unix_time() != 0) { mark_boot_phase(BOOT_CLOCK); }
+
+            hal::delay_ms(2 * WIFI_POLL_MS);
+            continue;
+        }
+
+        if (is_connected)
         {
-            if (pump_state_local) { stepper.runSpeed(); }
+            is_connected = false;
+            display_status("WiFi disconnected!", hal::COLOR_RED, true);
+            console.println("WiFi disconnected!");
         }
-        else { log_w("get_semaphore_pump_state failed!"); }
 
-        vTaskDelay(1 / portTICK_PERIOD_MS);
+        display_status("Connecting to WiFi...", hal::COLOR_WHITE);
+        bool has_credentials = hal::wifi_begin(use_cached);
+        if (has_credentials && wait_for_wifi(WIFI_CONNECT_TIMEOUT * 1'000)) { continue; }
+        hal::wifi_disconnect();
+
+        // The access point may have moved to another channel, or the network to another access point
+        if (has_credentials && use_cached)
+        {
+            use_cached = false;
+            continue;
+        }
+
+        if (has_credentials)
+        {
+            display_status("Failed to connect to WiFi!", hal::COLOR_RED);
+            console.println("Failed to connect to WiFi!");
+        }
+
+        failures++;
+        if (!has_credentials || failures == WIFI_CONNECT_RETRIES)
+        {
+            run_wifi_portal();
+            if (hal::wifi_connected()) { continue; }
+        }
+
+        console.printf("WiFi retry in %lu ms\n", static_cast<unsigned long>(backoff_ms));
+        hal::delay_ms(backoff_ms);
+        backoff_ms = backoff_ms < WIFI_BACKOFF_MAX_MS / 2 ? 2 * backoff_ms : WIFI_BACKOFF_MAX_MS;
     }
 }
 
-void init_wifi()
+void handle_touch_event(const TouchEvent& event)
 {
-    tft_text_setup(true);
-    tft.println("Starting WiFi Manager!");
-    Serial.println("Starting WiFi Manager!");
+    uint16_t touch_x = SCREEN_INVERTED ? SCREEN_WIDTH - event.x : event.x;
+    uint16_t touch_y = SCREEN_INVERTED ? SCREEN_HEIGHT - event.y : event.y;
 
-    // Connect to WiFi
-    wifiManager.setConnectTimeout(WIFI_CONNECT_TIMEOUT);
-    wifiManager.setConnectRetries(WIFI_CONNECT_RETRIES);
-    wifiManager.setAPCallback(configModeCallback);
+    // A long press on a button is still a press of that button, swipes have no meaning here yet
+    if (event.type == TOUCH_TAP || event.type == TOUCH_LONG_PRESS) { update_buttons(touch_x, touch_y); }
+    else { log_i("Swipe of %d, %d px (raw) ignored", event.dx, event.dy); }
+}
 
-    if (wifiManager.autoConnect("ESP32_ConfigPortal"))
-    {
-        wifiManager.setWiFiAutoReconnect(false);
+#if COROUTINE_TASKS
+bool take_touch_event(void* event)
+{
+    return display_renderer_s.take_touch(*static_cast<TouchEvent*>(event), 0);
+}
 
-        tft_text_setup(true, 0, TFT_GREEN, TFT_BLACK);
-        WEBSERVER_IP_ADDRESS_TEXT = "Webserver IP-address:\n" + WiFi.localIP().toString();
-        tft.printf("%s\n%s", "WiFi connected!", WEBSERVER_IP_ADDRESS_TEXT.c_str());
-        Serial.printf("%s\n%s", "WiFi connected!", WEBSERVER_IP_ADDRESS_TEXT.c_str());
+void notify_touch_event() { control_scheduler_s.notify(); }
+
+Coroutine touch_coroutine(CoroutineScheduler& scheduler)
+{
+    console.println("Entering TFT Touch coroutine");
+    while (true)
+    {
+        // The render task calls notify_touch_event() for each event
+        TouchEvent event;
+        if (co_await scheduler.until(take_touch_event, &event)) { handle_touch_event(event); }
     }
-    else
+}
+#else
+void tft_touch_task(void* parameter)
+{
+    console.println("Entering TFT Touch Task loop");
+    while (true)
     {
-        tft_text_setup(true, 0, TFT_RED, TFT_BLACK);
-        tft.printf("Failed to connect to WiFi!");
-        Serial.println("Failed to connect to WiFi!");
+        // display_task reads the touch controller only while a press is in progress, one event per press
+        TouchEvent event;
+        if (display_renderer_s.take_touch(event, hal::WAIT_FOREVER)) { handle_touch_event(event); }
     }
 }
+#endif
 
-void wifi_task(void* parameter)
+/**
+ * @brief Handle one event, actuate the motor on a change and publish the new state
+ *
+ */
+void handle_pump_event(PumpController& controller, PumpStatus& status, const PumpEvent& event)
 {
-    Serial.println("Entering WiFi Task loop");
-    while (true)
+    MetricTimer timer(pump_event_seconds_s);
+    PumpState before = controller.state();
+    PumpState after  = controller.handle(event, hal::millis());
+
+    bool is_pumping = PumpController::is_pumping_state(after);
+    if (is_pumping != PumpController::is_pumping_state(before) && !run_motor(is_pumping))
     {
-        if (WiFi.status() != WL_CONNECTED)
-        {
-            tft_text_setup(true, 0, TFT_RED, TFT_BLACK);
-            tft.println("WiFi disconnected!");
-            Serial.println("WiFi disconnected!");
+        // The motor stays off, a refused start is a fault like a lost sensor
+        PumpEvent fault = {
+            .type      = PUMP_EVENT_MOTOR_FAULT,
+            .source    = PUMP_SOURCE_CONTROL,
+            .is_valid  = false,
+            .is_clean  = false,
+            .posted_us = event.posted_us,
+        };
+        after = controller.handle(fault, hal::millis());
+
+        // A fault cuts the driver at once instead of waiting for the stop ramp
+        run_motor(false);
+        sleep_motor_driver();
+    }
 
-            init_wifi();
-            delay(5'000);
-        }
-        else { delay(200); }
+    status.events++;
+    if (event.type == PUMP_EVENT_START || event.type == PUMP_EVENT_STOP)
+    {
+        uint32_t latency = static_cast<uint32_t>(hal::micros()) - event.posted_us;
+        status.latency_mean_us =
+            static_cast<uint32_t>((static_cast<uint64_t>(status.latency_mean_us) * status.commands + latency)
+                                  / (status.commands + 1));
+        if (latency > status.latency_max_us) { status.latency_max_us = latency; }
+        pump_latency_s.observe_us(latency);
+        status.commands++;
+    }
+    status.state    = after;
+    status.is_clean = controller.is_clean();
+    pump_status_s.publish(status);
+    pump_state_s.set(static_cast<int32_t>(after));
+
+    if (after != before)
+    {
+        console.printf("PUMP %s -> %s\n", PumpController::state_name(before), PumpController::state_name(after));
+    }
+
+    // A state the full display queue refused goes out again with the next event, a tick at the latest
+    if (after != before || !is_pump_state_shown_s)
+    {
+        is_pump_state_shown_s = display_pump_state(after, CONTROL_DISPLAY_TIMEOUT_MS);
     }
 }
 
-void webserver_task(void* parameter)
+/**
+ * @brief Tick the controller once next_tick_ms has passed, ticks keep their period however many events arrive
+ *
+ * @return milliseconds until the next tick, the longest the caller may wait for an event
+ */
+uint32_t tick_pump(PumpController& controller, PumpStatus& status, uint32_t& next_tick_ms)
 {
-    server.on("/", handleRoot);
-    server.on("/turbidity/data", handleTurbidityData);  // Realtime data endpoint
-    server.on("/pump/on", handlePumpOn);
-    server.on("/pump/off", handlePumpOff);
-    server.on("/wifi/reset", handleWiFiReset);
+    if (static_cast<int32_t>(hal::millis() - next_tick_ms) >= 0)
+    {
+        next_tick_ms += PUMP_TICK_MS;
+
+        PumpEvent tick = {
+            .type      = PUMP_EVENT_TICK,
+            .source    = PUMP_SOURCE_TIMER,
+            .is_valid  = false,
+            .is_clean  = false,
+            .posted_us = static_cast<uint32_t>(hal::micros()),
+        };
+        handle_pump_event(controller, status, tick);
+    }
 
-    server.begin();
-    tft_text_setup(false, 0, TFT_GREEN, TFT_BLACK);
-    tft.println("Webserver started.");
-    Serial.println("Webserver started.");
+    int32_t until_tick = static_cast<int32_t>(next_tick_ms - hal::millis());
+    return until_tick > 0 ? until_tick : 0;
+}
 
-    Serial.println("Entering Webserver Task loop");
+#if COROUTINE_TASKS
+Coroutine pump_control_coroutine(CoroutineScheduler& scheduler)
+{
+    PumpController controller(PUMP_CONTROL, PUMP_STATE_DEFAULT);
+    PumpStatus     status       = {.state = controller.state()};
+    uint32_t       next_tick_ms = hal::millis() + PUMP_TICK_MS;
+    pump_status_s.publish(status);
+
+    console.println("Entering Pump Control coroutine");
     while (true)
     {
-        if (WiFi.status() == WL_CONNECTED)
+        PumpEvent event;
+        uint32_t  wait_ms = settle_motor(tick_pump(controller, status, next_tick_ms));
+        if (co_await scheduler.receive(*pump_events_s, &event, wait_ms))
         {
-            // Process incoming HTTP requests
-            server.handleClient();
-            delay(100);
+            handle_pump_event(controller, status, event);
         }
-        else
-        {
-            tft_text_setup(true, 0, TFT_RED, TFT_BLACK);
-            tft.println("WiFi disconnected!");
-            Serial.println("WiFi disconnected!");
+    }
+}
+#else
+void pump_control_task(void* parameter)
+{
+    PumpController controller(PUMP_CONTROL, PUMP_STATE_DEFAULT);
+    PumpStatus     status       = {.state = controller.state()};
+    uint32_t       next_tick_ms = hal::millis() + PUMP_TICK_MS;
+    pump_status_s.publish(status);
 
-            init_wifi();
-            delay(5'000);
+    console.println("Entering Pump Control Task loop");
+    while (true)
+    {
+        PumpEvent event;
+        if (pump_events_s->receive(&event, settle_motor(tick_pump(controller, status, next_tick_ms))))
+        {
+            handle_pump_event(controller, status, event);
         }
     }
 }
+#endif
 
-void tft_touch_task(void* parameter)
+#if METRICS_ENABLED
+void profile_job(void* context)
 {
-    Serial.println("Entering TFT Touch Task loop");
-    while (true)
+    task_profiler_s.sample();
+}
+
+void profile_log_job(void* context)
+{
+    static TaskProfile profile;  // Too large for the task stack
+    if (task_profiler_s.profile(profile)) { log_task_profile(profile); }
+}
+#endif
+
+#if SERIAL_DEBUG
+void log_job_stats(const char* executor, const PeriodicExecutor& executor_stats)
+{
+    ExecutorStats stats;
+    if (!executor_stats.stats(stats)) { return; }
+
+    for (uint8_t i = 0; i < stats.job_count; i++)
     {
-        uint16_t        raw_touch_x, raw_touch_y;
-        static uint16_t prev_x, prev_y;
+        const JobStats& job = stats.jobs[i];
+        console.printf("JOB => [ %s/%s: Runs: %lu, Misses: %lu, Overruns: %lu, Jitter: %lu us (max %lu us) ]\n",
+                       executor,
+                       job.name,
+                       static_cast<unsigned long>(job.runs),
+                       static_cast<unsigned long>(job.deadline_misses),
+                       static_cast<unsigned long>(job.overruns),
+                       static_cast<unsigned long>(job.jitter_mean_us),
+                       static_cast<unsigned long>(job.jitter_max_us));
+    }
+}
 
-        if (tft.getTouch(&raw_touch_x, &raw_touch_y))
-        {
-            uint16_t touch_x = SCREEN_INVERTED ? SCREEN_WIDTH - raw_touch_x : raw_touch_x;
-            uint16_t touch_y = SCREEN_INVERTED ? SCREEN_HEIGHT - raw_touch_y : raw_touch_y;
-            prev_x           = touch_x;
-            prev_y           = touch_y;
+void debug_stats_job(void* context)
+{
+    PumpStatus pump_status;
+    if (get_pump_status(pump_status))
+    {
+        console.printf("PUMP => [ State: %s, Commands: %lu, Latency: %lu us (max %lu us) ]\n",
+                       PumpController::state_name(pump_status.state),
+                       static_cast<unsigned long>(pump_status.commands),
+                       static_cast<unsigned long>(pump_status.latency_mean_us),
+                       static_cast<unsigned long>(pump_status.latency_max_us));
+    }
 
-            update_buttons(prev_x, prev_y);
-            display_pump_state(7);
-        }
+    DisplayStats display_stats    = display_renderer_s.stats();
+    uint64_t     pixels_per_frame = display_stats.frames > 0 ? display_stats.pixels_pushed / display_stats.frames : 0;
+    console.printf("DISPLAY => [ Frames: %lu, Pixels/Frame: %lu, Frame: %lu us (max %lu us) ]\n",
+                   static_cast<unsigned long>(display_stats.frames),
+                   static_cast<unsigned long>(pixels_per_frame),
+                   static_cast<unsigned long>(display_stats.frame_mean_us),
+                   static_cast<unsigned long>(display_stats.frame_max_us));
+
+    log_job_stats("housekeeping", housekeeping_s);
+    log_job_stats("sampler", sampler_s);
+}
+#endif
+
+void periodic_task(void* parameter)
+{
+    console.println("Entering Periodic Task loop");
+    housekeeping_s.run();
+}
 
-        delay(20);
+void sample_job(void* context)
+{
+    get_turbidity_data(hal::adc_read(TURBIDITY_PIN), false, true);  // Print turbidity data
+}
+
+void display_task(void* parameter)
+{
+    console.println("Entering Display Task loop");
+    display_renderer_s.run(SCREEN_ROTATION, []() { mark_boot_phase(BOOT_DISPLAY); });
+}
+
+void process_adc_frame(AdcDecimator& decimator, const uint16_t* block, size_t count)
+{
+    // The decimator completes a sample every TURBIDITY_DECIMATION codes
+    uint16_t outputs[4];
+    if (count == 0) { adc_timeouts_s.add(); }
+    size_t produced = decimator.push(block, count, outputs, sizeof(outputs) / sizeof(outputs[0]));
+    for (size_t i = 0; i < produced; i++)
+    {
+        get_turbidity_data(AdcDecimator::to_code(outputs[i]), false, true);  // Print turbidity data
     }
 }
 
+#if COROUTINE_TASKS
+void control_task(void* parameter)
+{
+    console.println("Entering Control Task loop");
+    control_scheduler_s.run();
+}
+
+Coroutine sampling_coroutine(CoroutineScheduler& scheduler)
+{
+    static uint16_t      block[TURBIDITY_BLOCK_SAMPLES];  // One DMA frame, too large for the arena
+    static const uint8_t frame_token = 1;                 // Sent to the wake queue by the conversion-done interrupt
+    AdcDecimator         decimator(TURBIDITY_DECIMATION);
+
+    console.println("Entering Get Data coroutine");
+    if (!hal::adc_stream_begin(TURBIDITY_PIN,
+                               TURBIDITY_SAMPLE_RATE_HZ,
+                               TURBIDITY_BLOCK_SAMPLES,
+                               scheduler.notify_queue(),
+                               &frame_token))
+    {
+        // The executor keeps the grid and the jitter accounting, between releases the other coroutines run
+        log_w("Continuous ADC unavailable, falling back to single reads");
+        sampler_s.add("sample", sample_job, nullptr, 1'000'000 / TURBIDITY_OUTPUT_RATE_HZ);
+        mark_boot_phase(BOOT_SENSING);
+        while (true) { co_await scheduler.sleep_until_us(sampler_s.poll()); }
+    }
+    mark_boot_phase(BOOT_SENSING);
+
+    while (true)
+    {
+        size_t count = co_await scheduler.adc_frame(block, TURBIDITY_BLOCK_SAMPLES, 1'000);
+        process_adc_frame(decimator, block, count);
+    }
+}
+#else
 void get_data_task(void* parameter)
 {
-    Serial.println("Entering Get Data Task loop");
+    static uint16_t block[TURBIDITY_BLOCK_SAMPLES];  // One DMA frame, too large for the task stack
+    AdcDecimator    decimator(TURBIDITY_DECIMATION);
+
+    // Without the DMA stream (e.g. a pin on ADC2) the sensor is read once per output period
+    console.println("Entering Get Data Task loop");
+    if (!hal::adc_stream_begin(TURBIDITY_PIN, TURBIDITY_SAMPLE_RATE_HZ, TURBIDITY_BLOCK_SAMPLES))
+    {
+        // Released on a fixed grid, so processing time does not stretch the sample period
+        log_w("Continuous ADC unavailable, falling back to single reads");
+        sampler_s.add("sample", sample_job, nullptr, 1'000'000 / TURBIDITY_OUTPUT_RATE_HZ);
+        mark_boot_phase(BOOT_SENSING);
+        sampler_s.run();
+    }
+    mark_boot_phase(BOOT_SENSING);
+
     while (true)
     {
-        get_turbidity_data(false, true, 4);  // Print turbidity data
-        delay(1'000);
+        // Wakes once per frame
+        size_t count = hal::adc_stream_read(block, TURBIDITY_BLOCK_SAMPLES, 1'000);
+        process_adc_frame(decimator, block, count);
     }
 }
+#endif
 
 /** ----------------------------------------------------------------------------------------------------- 
  * $$ ARDUINO SETUP
@@ -835,42 +1822,89 @@ void get_data_task(void* parameter)
 
 void setup()
 {
-    Serial.begin(115200);
-    Serial.println("Starting ESP!");
+    console.begin(115200);
+    console.println("Starting ESP!");
 
-    semaphore_pump_state = xSemaphoreCreateMutex();
-    Serial.println("Created semaphore_pump_state!");
-    semaphore_manual_keep_pump_on = xSemaphoreCreateMutex();
-    Serial.println("Created semaphore_manual_keep_pump_on!");
-    semaphore_is_clean = xSemaphoreCreateMutex();
-    Serial.println("Created semaphore_is_clean!");
-    semaphore_turbidity_data = xSemaphoreCreateMutex();
-    Serial.println("Created semaphore_turbidity_data!");
+    pump_events_s = hal::queue_create(PUMP_QUEUE_DEPTH, sizeof(PumpEvent));
+    console.println("Created pump_events_s!");
 
-    tft.begin();
-    Serial.println("TFT Begin!");
+    // display_task owns the display from here on, everything else posts to it
+#if COROUTINE_TASKS
+    bool is_display_ready = display_renderer_s.begin(TOUCH_IRQ_PIN, notify_touch_event);
+#else
+    bool is_display_ready = display_renderer_s.begin(TOUCH_IRQ_PIN);
+#endif
+    if (!is_display_ready) { log_w("Could not create the display queues"); }
+    hal::task_create(display_task, "display_task", 4096, NULL, 2, 0);
+    display_status("TFT Setup Done!", hal::COLOR_WHITE, true);
+    console.println("TFT Setup Done!");
 
-    tft_text_setup(true);
-    tft.println("TFT Setup Done!");
-    Serial.println("TFT Setup Done!");
+    display_renderer_s.post(WIDGET_PUMP_LABEL, "Pump State:", hal::COLOR_ORANGE);
+    display_pump_state(PUMP_STATE_DEFAULT ? PumpState::PUMPING : PumpState::IDLE);
+    display_renderer_s.post(WIDGET_BUTTON_ON, "ON", hal::COLOR_GREEN);
+    display_renderer_s.post(WIDGET_BUTTON_OFF, "OFF", hal::COLOR_RED);
 
     // Pin configuration
-    pinMode(TURBIDITY_PIN, INPUT);
-    pinMode(LED_PIN, OUTPUT);
-    digitalWrite(LED_PIN, LOW);  // Make sure the LED is off on startup
-    led_state = LOW;
-
-    init_wifi();
-
-    get_turbidity_data(false, true, 4);  // Print turbidity data (only on TFT display)
-    display_pump_state(7);
-    display_button("ON", 20, 220, 180, 80, TFT_GREEN, TFT_BLACK);
-    display_button("OFF", 280, 220, 180, 80, TFT_RED, TFT_BLACK);
-
-    xTaskCreatePinnedToCore(webserver_task, "webserver_task", 4096, NULL, 1, &webserver_task_handle, 0);
-    xTaskCreatePinnedToCore(tft_touch_task, "tft_touch_task", 4096, NULL, 3, &tft_touch_task_handle, 0);
-    xTaskCreatePinnedToCore(get_data_task, "get_data_task", 4096, NULL, 4, &get_data_task_handle, 0);
-    xTaskCreatePinnedToCore(motor_task, "motor_task", 4096, NULL, 2, &motor_task_handle, 1);  // Main App core
+    hal::pin_input(TURBIDITY_PIN);
+    hal::pin_output(LED_PIN);
+    hal::pin_write(LED_PIN, false);  // Make sure the LED is off on startup
+    led_state = false;
+
+    init_motor();  // The pulse train is hardware-timed, the motor needs no task
+#if !COROUTINE_TASKS
+    hal::task_create(pump_control_task, "pump_control_task", 4096, NULL, 5, 0);
+    hal::task_create(tft_touch_task, "tft_touch_task", 4096, NULL, 3, 0);
+    mark_boot_phase(BOOT_CONTROL);
+#endif
+
+    // Before sampling starts: the calibration applies to the first sample on, the log takes them once time is known
+    is_data_mounted_s = hal::fs_mount();
+    if (is_data_mounted_s)
+    {
+        sample_log_s.begin();
+
+        // Optional per-device curve, converted samples use it from the first one on
+        if (turbidity_table_s.load_calibration(TURBIDITY_CALIBRATION_PATH))
+        {
+            console.printf("TURBIDITY CALIBRATION %u points\n", turbidity_table_s.calibration_points());
+        }
+    }
+    else { log_w("Could not mount the data partition"); }
+    mark_boot_phase(BOOT_STORAGE);
+
+#if COROUTINE_TASKS
+    // The arena belongs to control_task once it runs, so all three are spawned before it starts. Only one of them
+    // runs at a time, the stack is that of the task with the deepest calls before
+    if (!control_scheduler_s.begin()) { log_w("Could not create the control wake queue"); }
+    if (!control_scheduler_s.spawn(pump_control_coroutine(control_scheduler_s))
+        || !control_scheduler_s.spawn(touch_coroutine(control_scheduler_s))
+        || !control_scheduler_s.spawn(sampling_coroutine(control_scheduler_s)))
+    {
+        log_w("Could not spawn the control coroutines");
+    }
+    hal::task_create(control_task, "control_task", 4096, NULL, 5, 0);
+    mark_boot_phase(BOOT_CONTROL);
+#else
+    hal::task_create(get_data_task, "get_data_task", 4096, NULL, 4, 0);
+#endif
+
+    // Connecting can take from a second to the whole portal timeout, the tasks above run meanwhile. The portal needs
+    // the larger stack
+    hal::task_create(network_task, "network_task", 8192, NULL, 1, 0);
+
+#if METRICS_ENABLED
+    task_profiler_s.sample();
+    housekeeping_s.add("profile", profile_job, nullptr, TASK_PROFILE_PERIOD_US, 0, TASK_PROFILE_PERIOD_US);
+    housekeeping_s.add("profile_log", profile_log_job, nullptr, TASK_PROFILE_LOG_US, 0, TASK_PROFILE_LOG_US);
+#endif
+#if SERIAL_DEBUG
+    housekeeping_s.add("debug_stats", debug_stats_job, nullptr, DEBUG_STATS_PERIOD_US);
+#endif
+#if METRICS_ENABLED || SERIAL_DEBUG
+    // Away from the control tasks on core 0, the profile includes its own share
+    hal::task_create(periodic_task, "periodic_task", 4096, NULL, 1, 1);
+#endif
+    mark_boot_phase(BOOT_SETUP);
 }
 
 /** ----------------------------------------------------------------------------------------------------- 
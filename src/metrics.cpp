@@ -0,0 +1,151 @@
+/** -----------------------------------------------------------------------------------------------------
+ * @file metrics.cpp
+ *
+ * @brief Counters, gauges and fixed-bucket latency histograms on the cycle counter, exported as Prometheus text
+ * @version 0.1
+ * @date 2024-2025
+ *  ----------------------------------------------------------------------------------------------------- **/
+
+/** -----------------------------------------------------------------------------------------------------
+ * $ INCLUDES
+ *  ----------------------------------------------------------------------------------------------------- **/
+
+#include <string.h>
+
+#include "metrics.h"
+#include "text_buffer.h"
+
+#if METRICS_ENABLED
+
+/** -----------------------------------------------------------------------------------------------------
+ * $ GLOBAL VARIABLES
+ *  ----------------------------------------------------------------------------------------------------- **/
+
+// Constant-initialised, so they are valid before the first metric of any file is constructed
+static Metric* metrics_head_s = nullptr;
+static Metric* metrics_tail_s = nullptr;
+
+using MetricLine = TextBuffer<24>;  // One number or bucket bound
+
+/** -----------------------------------------------------------------------------------------------------
+ * $ FUNCTION DECLARATIONS
+ *  ----------------------------------------------------------------------------------------------------- **/
+
+/**
+ * @brief Append whole microseconds as seconds with six exact decimals, a float would round large sums
+ *
+ */
+static void append_seconds(MetricLine& line, uint32_t us)
+{
+    char     fraction[7];
+    uint32_t remainder = us % 1'000'000;
+    for (int8_t i = 5; i >= 0; i--)
+    {
+        fraction[i] = static_cast<char>('0' + remainder % 10);
+        remainder /= 10;
+    }
+    fraction[6] = '\0';
+
+    line.append(us / 1'000'000).append('.').append(fraction);
+}
+
+Metric::Metric(const char* type, const char* name, const char* help, const char* label, const char* label_value) :
+    type(type), name(name), help(help), label(label), label_value(label_value)
+{
+    // Kept in declaration order, so metrics that share a name stay next to each other
+    if (metrics_tail_s == nullptr) { metrics_head_s = this; }
+    else { metrics_tail_s->next = this; }
+    metrics_tail_s = this;
+}
+
+void Metric::format_all(std::string& dest)
+{
+    const char* previous_name = nullptr;
+    for (const Metric* metric = metrics_head_s; metric != nullptr; metric = metric->next)
+    {
+        if (previous_name == nullptr || strcmp(previous_name, metric->name) != 0)
+        {
+            dest.append("# HELP ").append(metric->name).append(" ").append(metric->help).append("\n");
+            dest.append("# TYPE ").append(metric->name).append(" ").append(metric->type).append("\n");
+            previous_name = metric->name;
+        }
+
+        metric->format(dest);
+    }
+}
+
+void Metric::append_series(std::string& dest, const char* suffix, const char* le) const
+{
+    dest.append(name).append(suffix);
+
+    bool has_label = label != nullptr && label_value != nullptr;
+    if (has_label || le != nullptr)
+    {
+        dest.append("{");
+        if (has_label) { dest.append(label).append("=\"").append(label_value).append("\""); }
+        if (has_label && le != nullptr) { dest.append(","); }
+        if (le != nullptr) { dest.append("le=\"").append(le).append("\""); }
+        dest.append("}");
+    }
+    dest.append(" ");
+}
+
+void MetricCounter::format(std::string& dest) const
+{
+    MetricLine line;
+    line.append(value.load(std::memory_order_relaxed)).append('\n');
+
+    append_series(dest, "");
+    dest.append(line.c_str(), line.size());
+}
+
+void MetricGauge::format(std::string& dest) const
+{
+    MetricLine line;
+    line.append(value.load(std::memory_order_relaxed)).append('\n');
+
+    append_series(dest, "");
+    dest.append(line.c_str(), line.size());
+}
+
+void MetricHistogram::observe_us(uint32_t duration_us)
+{
+    uint8_t bucket = 0;
+    while (bucket < METRIC_BUCKET_COUNT && duration_us > METRIC_BUCKETS_US[bucket]) { bucket++; }
+
+    buckets[bucket].fetch_add(1, std::memory_order_relaxed);
+    sum_us.fetch_add(duration_us, std::memory_order_relaxed);
+}
+
+void MetricHistogram::format(std::string& dest) const
+{
+    // Prometheus buckets are cumulative, the count is the +Inf bucket
+    uint32_t   cumulative = 0;
+    MetricLine line;
+    for (uint8_t i = 0; i <= METRIC_BUCKET_COUNT; i++)
+    {
+        cumulative += buckets[i].load(std::memory_order_relaxed);
+
+        MetricLine le;
+        if (i < METRIC_BUCKET_COUNT) { append_seconds(le, METRIC_BUCKETS_US[i]); }
+        else { le.append("+Inf"); }
+
+        append_series(dest, "_bucket", le.c_str());
+        line.clear();
+        line.append(cumulative).append('\n');
+        dest.append(line.c_str(), line.size());
+    }
+
+    append_series(dest, "_sum");
+    line.clear();
+    append_seconds(line, sum_us.load(std::memory_order_relaxed));
+    line.append('\n');
+    dest.append(line.c_str(), line.size());
+
+    append_series(dest, "_count");
+    line.clear();
+    line.append(cumulative).append('\n');
+    dest.append(line.c_str(), line.size());
+}
+
+#endif
@@ -0,0 +1,123 @@
+/** -----------------------------------------------------------------------------------------------------
+ * @file periodic_executor.cpp
+ *
+ * @brief Fixed-rate jobs on absolute release times, with jitter, deadline miss and overrun accounting per job
+ * @version 0.1
+ * @date 2024-2025
+ *  ----------------------------------------------------------------------------------------------------- **/
+
+/** -----------------------------------------------------------------------------------------------------
+ * $ INCLUDES
+ *  ----------------------------------------------------------------------------------------------------- **/
+
+#include "periodic_executor.h"
+
+/** -----------------------------------------------------------------------------------------------------
+ * $ FUNCTION DECLARATIONS
+ *  ----------------------------------------------------------------------------------------------------- **/
+
+PeriodicExecutor::PeriodicExecutor(Clock clock, Sleep sleep) : clock(clock), sleep(sleep) {}
+
+bool PeriodicExecutor::add(const char* name,
+                           PeriodicJob job,
+                           void*       context,
+                           uint32_t    period_us,
+                           uint32_t    deadline_us,
+                           uint32_t    offset_us)
+{
+    if (totals.job_count == ExecutorStats::MAX_JOBS || period_us == 0) { return false; }
+
+    uint8_t index = totals.job_count;
+
+    jobs[index] = {
+        .function          = job,
+        .context           = context,
+        .deadline_us       = deadline_us > 0 ? deadline_us : period_us,
+        .offset_us         = offset_us,
+        .release_us        = is_started ? clock() + offset_us : 0,
+        .jitter_total_us   = 0,
+        .duration_total_us = 0,
+    };
+    totals.jobs[index] = {.name = name, .period_us = period_us};
+    totals.job_count++;
+
+    return true;
+}
+
+uint64_t PeriodicExecutor::poll()
+{
+    uint64_t now_us = clock();
+    if (!is_started)
+    {
+        for (uint8_t i = 0; i < totals.job_count; i++) { jobs[i].release_us = now_us + jobs[i].offset_us; }
+        is_started = true;
+    }
+
+    // Every job runs at most once per poll(), a job that always takes longer than its period cannot keep poll() from
+    // returning and publishing, it is released again right away and its overruns show in the stats
+    uint32_t has_run = 0;
+    while (true)
+    {
+        // At most MAX_JOBS, a scan for the earliest deadline beats a priority queue
+        uint8_t next = totals.job_count;
+        for (uint8_t i = 0; i < totals.job_count; i++)
+        {
+            if (jobs[i].release_us > now_us || (has_run & (1U << i)) != 0) { continue; }
+            if (next == totals.job_count
+                || jobs[i].release_us + jobs[i].deadline_us < jobs[next].release_us + jobs[next].deadline_us)
+            {
+                next = i;
+            }
+        }
+        if (next == totals.job_count) { break; }
+
+        execute(next, now_us);
+        has_run |= 1U << next;
+        now_us = clock();
+    }
+
+    published.publish(totals);
+
+    uint64_t next_release_us = UINT64_MAX;
+    for (uint8_t i = 0; i < totals.job_count; i++)
+    {
+        if (jobs[i].release_us < next_release_us) { next_release_us = jobs[i].release_us; }
+    }
+
+    return next_release_us;
+}
+
+void PeriodicExecutor::run()
+{
+    while (true) { sleep(poll()); }
+}
+
+void PeriodicExecutor::execute(uint8_t index, uint64_t start_us)
+{
+    Job&      job   = jobs[index];
+    JobStats& stats = totals.jobs[index];
+
+    job.function(job.context);
+
+    uint64_t end_us   = clock();
+    uint32_t jitter   = static_cast<uint32_t>(start_us - job.release_us);
+    uint32_t duration = static_cast<uint32_t>(end_us - start_us);
+
+    if (end_us > job.release_us + job.deadline_us) { stats.deadline_misses++; }
+    stats.runs++;
+    job.jitter_total_us += jitter;
+    job.duration_total_us += duration;
+    stats.jitter_mean_us   = static_cast<uint32_t>(job.jitter_total_us / stats.runs);
+    stats.duration_mean_us = static_cast<uint32_t>(job.duration_total_us / stats.runs);
+    if (jitter > stats.jitter_max_us) { stats.jitter_max_us = jitter; }
+    if (duration > stats.duration_max_us) { stats.duration_max_us = duration; }
+
+    // The next release follows the previous one, releases a whole period or more in the past are skipped
+    job.release_us += stats.period_us;
+    if (end_us >= job.release_us + stats.period_us)
+    {
+        uint64_t missed = (end_us - job.release_us) / stats.period_us;
+        job.release_us += missed * stats.period_us;
+        stats.overruns += static_cast<uint32_t>(missed);
+    }
+}
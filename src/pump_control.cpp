@@ -0,0 +1,88 @@
+/** -----------------------------------------------------------------------------------------------------
+ * @file pump_control.cpp
+ *
+ * @brief Pump state machine driven by events from touch, HTTP, the sampler and the control task timer
+ * @version 0.1
+ * @date 2024-2025
+ *  ----------------------------------------------------------------------------------------------------- **/
+
+/** -----------------------------------------------------------------------------------------------------
+ * $ INCLUDES
+ *  ----------------------------------------------------------------------------------------------------- **/
+
+#include "pump_control.h"
+
+/** -----------------------------------------------------------------------------------------------------
+ * $ FUNCTION DECLARATIONS
+ *  ----------------------------------------------------------------------------------------------------- **/
+
+PumpController::PumpController(const Config& config, bool is_pumping) :
+    config(config), current(is_pumping ? PumpState::PUMPING : PumpState::IDLE)
+{
+}
+
+PumpState PumpController::handle(const PumpEvent& event, uint32_t now_ms)
+{
+    switch (event.type)
+    {
+        case PUMP_EVENT_START:
+            if (current == PumpState::IDLE)
+            {
+                current = config.use_sensor && clean ? PumpState::MANUAL_HOLD : PumpState::PUMPING;
+            }
+            break;
+
+        case PUMP_EVENT_STOP:
+            if (current != PumpState::FAULT) { current = PumpState::IDLE; }
+            break;
+
+        case PUMP_EVENT_SAMPLE:
+            if (!config.use_sensor) { break; }
+
+            has_sample     = true;
+            last_sample_ms = now_ms;
+            if (!event.is_valid)
+            {
+                if (invalid_count < config.invalid_limit) { invalid_count++; }
+                if (invalid_count >= config.invalid_limit) { current = PumpState::FAULT; }
+                break;
+            }
+
+            invalid_count = 0;
+            clean         = event.is_clean;
+            if (current == PumpState::FAULT) { current = PumpState::IDLE; }
+            else if (current == PumpState::PUMPING && clean) { current = PumpState::IDLE; }
+            else if (current == PumpState::MANUAL_HOLD && !clean) { current = PumpState::PUMPING; }
+            break;
+
+        case PUMP_EVENT_TICK:
+            // Before the first sample the sampler may not be running yet
+            if (config.use_sensor && has_sample && now_ms - last_sample_ms > config.sample_timeout_ms)
+            {
+                current = PumpState::FAULT;
+            }
+            break;
+
+        case PUMP_EVENT_MOTOR_FAULT: current = PumpState::FAULT; break;
+    }
+
+    return current;
+}
+
+bool PumpController::is_pumping_state(PumpState state)
+{
+    return state == PumpState::PUMPING || state == PumpState::MANUAL_HOLD;
+}
+
+const char* PumpController::state_name(PumpState state)
+{
+    switch (state)
+    {
+        case PumpState::IDLE: return "idle";
+        case PumpState::PUMPING: return "pumping";
+        case PumpState::MANUAL_HOLD: return "manual-hold";
+        case PumpState::FAULT: return "fault";
+    }
+
+    return "unknown";
+}
@@ -0,0 +1,229 @@
+/** -----------------------------------------------------------------------------------------------------
+ * @file sample_codec.cpp
+ *
+ * @brief Lossless bit-packed encoding of turbidity sample blocks (delta-of-delta timestamps, ADC code deltas)
+ * @version 0.1
+ * @date 2024-2025
+ *  ----------------------------------------------------------------------------------------------------- **/
+
+/** -----------------------------------------------------------------------------------------------------
+ * $ INCLUDES
+ *  ----------------------------------------------------------------------------------------------------- **/
+
+#include "sample_codec.h"
+
+/** -----------------------------------------------------------------------------------------------------
+ * $ FUNCTION DECLARATIONS
+ *  ----------------------------------------------------------------------------------------------------- **/
+
+static uint32_t zigzag_encode(int32_t value)
+{
+    return (static_cast<uint32_t>(value) << 1) ^ static_cast<uint32_t>(value >> 31);
+}
+
+static int32_t zigzag_decode(uint32_t value)
+{
+    return static_cast<int32_t>(value >> 1) ^ -static_cast<int32_t>(value & 1U);
+}
+
+SampleEncoder::SampleEncoder(uint8_t* dest, size_t capacity) : dest(dest), capacity(capacity) {}
+
+bool SampleEncoder::append(const SampleRecord& record)
+{
+    if (records == UINT16_MAX) { return false; }
+
+    if (records == 0)
+    {
+        if (capacity < 7) { return false; }
+
+        write(record.timestamp, 32);
+        write(record.analog_value, 16);
+        write(record.flags, 8);
+    }
+    else
+    {
+        uint32_t delta          = record.timestamp - previous_timestamp;
+        uint32_t delta_of_delta = zigzag_encode(static_cast<int32_t>(delta - previous_delta));
+        uint32_t value_delta    = zigzag_encode(static_cast<int32_t>(record.analog_value) - previous_value);
+        bool     flags_changed  = record.flags != previous_flags;
+
+        uint8_t timestamp_bits = delta_of_delta == 0 ? 1 : delta_of_delta < 128 ? 9 : delta_of_delta < 65'536 ? 19 : 35;
+        uint8_t value_bits     = value_delta == 0 ? 1 : value_delta < 8 ? 5 : value_delta < 64 ? 9 : 19;
+        if (bit_count + timestamp_bits + value_bits + (flags_changed ? 9 : 1) > capacity * 8) { return false; }
+
+        switch (timestamp_bits)
+        {
+            case 1: write(0b0, 1); break;
+            case 9: write((0b10 << 7) | delta_of_delta, 9); break;
+            case 19: write((0b110 << 16) | delta_of_delta, 19); break;
+            default:
+                write(0b111, 3);
+                write(delta, 32);
+                break;
+        }
+
+        switch (value_bits)
+        {
+            case 1: write(0b0, 1); break;
+            case 5: write((0b10 << 3) | value_delta, 5); break;
+            case 9: write((0b110 << 6) | value_delta, 9); break;
+            default: write((0b111 << 16) | record.analog_value, 19); break;
+        }
+
+        if (flags_changed) { write((0b1 << 8) | record.flags, 9); }
+        else { write(0b0, 1); }
+
+        previous_delta = delta;
+    }
+
+    previous_timestamp = record.timestamp;
+    previous_value     = record.analog_value;
+    previous_flags     = record.flags;
+    records++;
+
+    return true;
+}
+
+void SampleEncoder::reset()
+{
+    bit_count          = 0;
+    records            = 0;
+    previous_timestamp = 0;
+    previous_delta     = 0;
+    previous_value     = 0;
+    previous_flags     = 0;
+}
+
+void SampleEncoder::write(uint32_t value, uint8_t bits)
+{
+    while (bits > 0)
+    {
+        uint8_t used  = bit_count % 8;
+        uint8_t taken = 8 - used < bits ? 8 - used : bits;
+        uint8_t chunk = static_cast<uint8_t>((value >> (bits - taken)) & ((1U << taken) - 1U));
+
+        // Bytes are assigned when they are started, the buffer does not have to be cleared
+        if (used == 0) { dest[bit_count / 8] = 0; }
+        dest[bit_count / 8] |= static_cast<uint8_t>(chunk << (8 - used - taken));
+
+        bit_count += taken;
+        bits -= taken;
+    }
+}
+
+SampleDecoder::SampleDecoder(const uint8_t* source, size_t size, uint16_t count) :
+    source(source),
+    bit_size(size * 8),
+    remaining(count)
+{
+}
+
+bool SampleDecoder::next(SampleRecord& dest)
+{
+    if (remaining == 0) { return false; }
+
+    uint32_t timestamp = 0;
+    uint32_t value     = 0;
+    uint32_t flags     = previous_flags;
+    uint8_t  prefix    = 0;
+
+    if (records == 0)
+    {
+        if (!read(32, timestamp) || !read(16, value) || !read(8, flags)) { return false; }
+    }
+    else
+    {
+        uint32_t delta = previous_delta;
+        uint32_t field = 0;
+
+        if (!read_prefix(prefix)) { return false; }
+        switch (prefix)
+        {
+            case 0: break;
+            case 1:
+                if (!read(7, field)) { return false; }
+                delta += zigzag_decode(field);
+                break;
+            case 2:
+                if (!read(16, field)) { return false; }
+                delta += zigzag_decode(field);
+                break;
+            default:
+                if (!read(32, delta)) { return false; }
+                break;
+        }
+        timestamp      = previous_timestamp + delta;
+        previous_delta = delta;
+
+        value = previous_value;
+        if (!read_prefix(prefix)) { return false; }
+        switch (prefix)
+        {
+            case 0: break;
+            case 1:
+                if (!read(3, field)) { return false; }
+                value += zigzag_decode(field);
+                break;
+            case 2:
+                if (!read(6, field)) { return false; }
+                value += zigzag_decode(field);
+                break;
+            default:
+                if (!read(16, value)) { return false; }
+                break;
+        }
+
+        if (!read(1, field)) { return false; }
+        if (field != 0 && !read(8, flags)) { return false; }
+    }
+
+    dest = {
+        .timestamp    = timestamp,
+        .analog_value = static_cast<uint16_t>(value),
+        .flags        = static_cast<uint8_t>(flags),
+        .reserved     = 0,
+    };
+
+    previous_timestamp = dest.timestamp;
+    previous_value     = dest.analog_value;
+    previous_flags     = dest.flags;
+    records++;
+    remaining--;
+
+    return true;
+}
+
+bool SampleDecoder::read(uint8_t bits, uint32_t& dest)
+{
+    if (bit_offset + bits > bit_size) { return false; }
+
+    dest = 0;
+    while (bits > 0)
+    {
+        uint8_t used  = bit_offset % 8;
+        uint8_t taken = 8 - used < bits ? 8 - used : bits;
+        uint8_t chunk = static_cast<uint8_t>(source[bit_offset / 8] >> (8 - used - taken)) & ((1U << taken) - 1U);
+
+        dest = (dest << taken) | chunk;
+        bit_offset += taken;
+        bits -= taken;
+    }
+
+    return true;
+}
+
+/**
+ * @brief Read a '0' / '10' / '110' / '111' prefix as 0..3
+ *
+ */
+bool SampleDecoder::read_prefix(uint8_t& dest)
+{
+    uint32_t bit = 0;
+    for (dest = 0; dest < 3; dest++)
+    {
+        if (!read(1, bit)) { return false; }
+        if (bit == 0) { break; }
+    }
+
+    return true;
+}
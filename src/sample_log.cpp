@@ -0,0 +1,303 @@
+/** -----------------------------------------------------------------------------------------------------
+ * @file sample_log.cpp
+ *
+ * @brief Persistent append-only log of turbidity samples on the data partition, split into rotating segments
+ * @version 0.1
+ * @date 2024-2025
+ *  ----------------------------------------------------------------------------------------------------- **/
+
+/** -----------------------------------------------------------------------------------------------------
+ * $ INCLUDES
+ *  ----------------------------------------------------------------------------------------------------- **/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "sample_log.h"
+
+/** -----------------------------------------------------------------------------------------------------
+ * $ FUNCTION DECLARATIONS
+ *  ----------------------------------------------------------------------------------------------------- **/
+
+static uint32_t crc32(const void* data, size_t length)
+{
+    const uint8_t* bytes = static_cast<const uint8_t*>(data);
+    uint32_t       crc   = 0xFFFFFFFFU;
+
+    for (size_t i = 0; i < length; i++)
+    {
+        crc ^= bytes[i];
+        for (uint8_t bit = 0; bit < 8; bit++) { crc = (crc >> 1) ^ (0xEDB88320U & (0U - (crc & 1U))); }
+    }
+
+    return ~crc;
+}
+
+static long file_size(FILE* file)
+{
+    return fseek(file, 0, SEEK_END) == 0 ? ftell(file) : -1;
+}
+
+SampleLog::SampleLog(const char* directory) : directory(directory) {}
+
+bool SampleLog::begin()
+{
+    if (mutex == nullptr) { mutex = hal::mutex_create(); }
+    if (!hal::fs_mkdir(directory))
+    {
+        log_w("SampleLog could not create %s", directory);
+        return false;
+    }
+
+    segment_count = 0;
+    hal::fs_list(
+        directory,
+        [](const char* name, void* context)
+        {
+            char*         end = nullptr;
+            unsigned long id  = strtoul(name, &end, 10);
+            if (end != name && strcmp(end, ".seg") == 0) { static_cast<SampleLog*>(context)->add_segment(id); }
+        },
+        this);
+
+    // Read the first page header of every segment for the time index, drop segments without a valid page
+    uint8_t kept = 0;
+    char    path[48];
+    for (uint8_t i = 0; i < segment_count; i++)
+    {
+        Segment segment = segments[i];
+        segment_path(segment.id, path, sizeof(path));
+
+        FILE* file = hal::fs_open(path, "rb");
+        long  size = file != nullptr ? file_size(file) : -1;
+        if (size >= PAGE_SIZE && read_page(file, 0, true))
+        {
+            segment.first_timestamp = scratch.header.first_timestamp;
+            segment.pages           = static_cast<uint16_t>(size / PAGE_SIZE);
+            segment.is_sealed       = size % PAGE_SIZE != 0 || segment.pages >= SEGMENT_PAGES;
+            segments[kept++]        = segment;
+
+            // The newest record continues the clamp of append()
+            SampleRecord record = {};
+            if (i == segment_count - 1 && read_page(file, segment.pages - 1, false))
+            {
+                SampleDecoder decoder(scratch.payload, scratch.header.length, scratch.header.count);
+                while (decoder.next(record)) { last_timestamp = record.timestamp; }
+            }
+        }
+        else
+        {
+            log_w("SampleLog dropping invalid segment %s", path);
+            hal::fs_remove(path);
+        }
+
+        if (file != nullptr) { fclose(file); }
+    }
+    segment_count = kept;
+
+    return true;
+}
+
+bool SampleLog::append(const SampleRecord& record)
+{
+    if (mutex == nullptr || !mutex->take(100)) { return false; }
+
+    SampleRecord clamped = record;
+    if (clamped.timestamp < last_timestamp) { clamped.timestamp = last_timestamp; }
+    last_timestamp = clamped.timestamp;
+
+    bool result = true;
+    if (!encoder.append(clamped))
+    {
+        // Page full, an empty page always has room for a record
+        result = write_pending();
+        encoder.append(clamped);
+    }
+
+    if (encoder.count() == 1) { pending.header.first_timestamp = clamped.timestamp; }
+    pending.header.count  = encoder.count();
+    pending.header.length = static_cast<uint16_t>(encoder.size());
+    counters.samples_appended++;
+
+    // Write as soon as the next record might not fit, so a full page does not wait for the next sample
+    if (encoder.remaining() < SampleEncoder::MAX_RECORD_BYTES) { result = write_pending() && result; }
+
+    mutex->give();
+    return result;
+}
+
+bool SampleLog::flush()
+{
+    if (mutex == nullptr || !mutex->take(1'000)) { return false; }
+
+    bool result = write_pending();
+
+    mutex->give();
+    return result;
+}
+
+bool SampleLog::write_pending()
+{
+    if (pending.header.count == 0) { return true; }
+
+    if (segment_count == 0 || segments[segment_count - 1].is_sealed)
+    {
+        add_segment(segment_count > 0 ? segments[segment_count - 1].id + 1 : 1);
+        segments[segment_count - 1].first_timestamp = pending.header.first_timestamp;
+    }
+
+    Segment& segment     = segments[segment_count - 1];
+    pending.header.magic = PAGE_MAGIC;
+    pending.header.crc   = crc32(pending.payload, pending.header.length);
+
+    char path[48];
+    segment_path(segment.id, path, sizeof(path));
+
+    // Closing the file commits the page (LittleFS is copy-on-write), a torn write is caught by the CRC
+    FILE* file   = hal::fs_open(path, "ab");
+    bool  result = file != nullptr && fwrite(&pending, PAGE_SIZE, 1, file) == 1;
+    if (file != nullptr) { result = fclose(file) == 0 && result; }
+
+    if (result)
+    {
+        segment.pages++;
+        segment.is_sealed = segment.pages >= SEGMENT_PAGES;
+        counters.pages_written++;
+        counters.bytes_written += PAGE_SIZE;
+    }
+    else
+    {
+        // The file may end in a partial page now, continue in a new segment
+        log_w("SampleLog could not write %s", path);
+        segment.is_sealed = true;
+    }
+
+    memset(&pending, 0, sizeof(pending));
+    encoder.reset();
+    return result;
+}
+
+size_t SampleLog::query(uint32_t from, uint32_t to, Visitor visitor, void* context)
+{
+    size_t count = 0;
+    if (mutex == nullptr || from > to || !mutex->take(1'000)) { return count; }
+
+    // Segments before the last one that starts at or before from end before from
+    uint8_t first = 0;
+    for (uint8_t i = 0; i < segment_count; i++)
+    {
+        if (segments[i].first_timestamp <= from) { first = i; }
+    }
+
+    bool is_done = false;
+    char path[48];
+    for (uint8_t i = first; i < segment_count && !is_done && segments[i].first_timestamp <= to; i++)
+    {
+        segment_path(segments[i].id, path, sizeof(path));
+        FILE* file = hal::fs_open(path, "rb");
+        if (file == nullptr) { continue; }
+
+        // Last page that starts at or before from, unreadable headers are treated as later pages
+        uint16_t low  = 0;
+        uint16_t high = segments[i].pages;
+        while (high - low > 1)
+        {
+            uint16_t middle = low + (high - low) / 2;
+            if (read_page(file, middle, true) && scratch.header.first_timestamp <= from) { low = middle; }
+            else { high = middle; }
+        }
+
+        for (uint16_t page = low; page < segments[i].pages && !is_done; page++)
+        {
+            if (!read_page(file, page, false)) { continue; }
+
+            is_done = scratch.header.first_timestamp > to || !visit_page(scratch, from, to, visitor, context, count);
+        }
+
+        fclose(file);
+    }
+
+    if (!is_done) { visit_page(pending, from, to, visitor, context, count); }
+
+    mutex->give();
+    return count;
+}
+
+SampleLogStats SampleLog::stats()
+{
+    SampleLogStats result = {};
+    if (mutex == nullptr || !mutex->take(100)) { return result; }
+
+    result          = counters;
+    result.segments = segment_count;
+
+    mutex->give();
+    return result;
+}
+
+bool SampleLog::read_page(FILE* file, uint16_t page, bool header_only)
+{
+    size_t length = header_only ? sizeof(PageHeader) : PAGE_SIZE;
+    if (fseek(file, static_cast<long>(page) * PAGE_SIZE, SEEK_SET) != 0 || fread(&scratch, length, 1, file) != 1)
+    {
+        return false;
+    }
+
+    if (scratch.header.magic != PAGE_MAGIC || scratch.header.length > sizeof(scratch.payload)) { return false; }
+
+    return header_only || crc32(scratch.payload, scratch.header.length) == scratch.header.crc;
+}
+
+bool SampleLog::visit_page(const Page& page,
+                           uint32_t    from,
+                           uint32_t    to,
+                           Visitor     visitor,
+                           void*       context,
+                           size_t&     count)
+{
+    SampleDecoder decoder(page.payload, page.header.length, page.header.count);
+    SampleRecord  record = {};
+    while (decoder.next(record))
+    {
+        if (record.timestamp < from) { continue; }
+        if (record.timestamp > to || !visitor(record, context)) { return false; }
+
+        count++;
+    }
+
+    return true;
+}
+
+void SampleLog::segment_path(uint32_t id, char* dest, size_t size) const
+{
+    snprintf(dest, size, "%s/%08lu.seg", directory, static_cast<unsigned long>(id));
+}
+
+void SampleLog::add_segment(uint32_t id)
+{
+    if (segment_count == MAX_SEGMENTS)
+    {
+        // Rotation: the oldest segment makes room (also when SAMPLE_LOG_MAX_SEGMENTS was lowered)
+        char     path[48];
+        uint32_t oldest = segments[0].id < id ? segments[0].id : id;
+        segment_path(oldest, path, sizeof(path));
+        hal::fs_remove(path);
+
+        if (oldest == id) { return; }
+
+        segment_count--;
+        memmove(segments, segments + 1, segment_count * sizeof(Segment));
+    }
+
+    // Insert sorted by id, new segments always go to the end
+    uint8_t i = segment_count;
+    while (i > 0 && segments[i - 1].id > id)
+    {
+        segments[i] = segments[i - 1];
+        i--;
+    }
+
+    segments[i] = {.id = id, .first_timestamp = 0, .pages = 0, .is_sealed = false};
+    segment_count++;
+}
@@ -0,0 +1,151 @@
+/** -----------------------------------------------------------------------------------------------------
+ * @file step_engine.cpp
+ *
+ * @brief Start/stop control of the hardware step pulse train through a lock-free command word
+ * @version 0.1
+ * @date 2024-2025
+ *  ----------------------------------------------------------------------------------------------------- **/
+
+/** -----------------------------------------------------------------------------------------------------
+ * $ INCLUDES
+ *  ----------------------------------------------------------------------------------------------------- **/
+
+#include "step_engine.h"
+
+/** -----------------------------------------------------------------------------------------------------
+ * $ FUNCTION DECLARATIONS
+ *  ----------------------------------------------------------------------------------------------------- **/
+
+static_assert(hal::StepGenerator::STEP_TICK_HZ == 1'000'000, "StepEngine tracks ramp positions with hal::micros()");
+
+StepEngine::StepEngine(hal::StepGenerator& generator, const StepRamp& ramp) : generator(generator), ramp(ramp) {}
+
+bool StepEngine::begin(uint8_t step_pin, uint8_t direction_pin, bool direction_inverted)
+{
+    if (!generator.begin(step_pin, direction_pin))
+    {
+        log_w("StepEngine could not claim the step generator");
+        return false;
+    }
+
+    generator.setDirection(!direction_inverted);
+    return true;
+}
+
+bool StepEngine::start(float steps_per_second, uint32_t wake_us)
+{
+    constexpr float tick_hz  = static_cast<float>(hal::StepGenerator::STEP_TICK_HZ);
+    float           interval = steps_per_second > 0.0F ? tick_hz / steps_per_second + 0.5F : 0.0F;
+    if (interval < hal::StepGenerator::MIN_STEP_INTERVAL || interval > hal::StepGenerator::MAX_STEP_INTERVAL)
+    {
+        log_w("StepEngine cannot run at %.2f steps/s", static_cast<double>(steps_per_second));
+        return false;
+    }
+
+    wake_delay_us.store(wake_us, std::memory_order_relaxed);
+    command.store(RUN_BIT | static_cast<uint32_t>(interval), std::memory_order_seq_cst);
+    apply();
+    return true;
+}
+
+void StepEngine::stop()
+{
+    command.store(0, std::memory_order_seq_cst);
+    apply();
+}
+
+void StepEngine::apply()
+{
+    // Whoever holds the flag applies the newest command, a caller that finds it taken leaves its word to the holder.
+    // The store of the word, test_and_set(), clear() and the re-check below are sequentially consistent: either the
+    // caller's test_and_set() sees the flag cleared or the holder's re-check sees the caller's word, never neither
+    while (!applying.test_and_set(std::memory_order_seq_cst))
+    {
+        uint32_t wanted = command.load(std::memory_order_acquire);
+        if (wanted != applied)
+        {
+            uint64_t now_us   = hal::micros();
+            uint32_t wait     = 0;
+            uint16_t position = ramp_position(now_us, wait);
+            uint32_t interval = wanted & INTERVAL_MASK;
+            uint16_t target   = (wanted & RUN_BIT) != 0 ? ramp.position_of(interval) : 0;
+
+            // From standstill the generator holds the first step back instead of the caller sleeping
+            if ((wanted & RUN_BIT) != 0 && (applied & RUN_BIT) == 0 && position == 0)
+            {
+                uint32_t wake_us = wake_delay_us.load(std::memory_order_relaxed);
+                if (wait < wake_us) { wait = wake_us; }
+            }
+
+            if ((wanted & RUN_BIT) == 0 && position == 0) { generator.stop(); }
+            else if (!generator.run(ramp.intervals, position, target, interval, wait))
+            {
+                log_w("StepEngine could not start the generator");
+            }
+
+            applied       = wanted;
+            ramp_from     = position;
+            ramp_to       = target;
+            ramp_start_us = now_us + wait;
+
+            if ((wanted & RUN_BIT) == 0)
+            {
+                uint64_t end_us = position == 0 ? now_us : ramp_start_us + ramp.elapsed[position];
+                standstill_us.store(static_cast<uint32_t>(end_us), std::memory_order_release);
+            }
+        }
+
+        applying.clear(std::memory_order_seq_cst);
+
+        // A command stored while the flag was held would otherwise be left unapplied
+        if (command.load(std::memory_order_seq_cst) == wanted) { break; }
+    }
+}
+
+uint32_t StepEngine::time_to_standstill_us() const
+{
+    if (is_running()) { return UINT32_MAX; }
+
+    int32_t remaining = static_cast<int32_t>(standstill_us.load(std::memory_order_acquire)
+                                             - static_cast<uint32_t>(hal::micros()));
+    return remaining > 0 ? static_cast<uint32_t>(remaining) : 0;
+}
+
+/**
+ * @brief Ramp position once the step in progress is complete, wait receives the ticks until then
+ *
+ */
+uint16_t StepEngine::ramp_position(uint64_t now_us, uint32_t& wait) const
+{
+    if (now_us < ramp_start_us) { now_us = ramp_start_us; }  // Still in the wait of the last command
+
+    uint64_t elapsed   = now_us - ramp_start_us;
+    uint32_t ramp_time = ramp_from == ramp_to  ? 0
+                         : ramp_from < ramp_to ? ramp.elapsed[ramp_to] - ramp.elapsed[ramp_from]
+                                               : ramp.elapsed[ramp_from] - ramp.elapsed[ramp_to];
+    uint32_t cruise    = applied & INTERVAL_MASK;
+
+    wait = 0;
+    if (elapsed < ramp_time)
+    {
+        // Steps of the ramp end at the table's elapsed times, counted from where the stretch started
+        uint16_t position = ramp_from;
+        uint32_t step_end = 0;
+        do
+        {
+            position = ramp_from < ramp_to ? position + 1 : position - 1;
+            step_end = ramp_from < ramp_to ? ramp.elapsed[position] - ramp.elapsed[ramp_from]
+                                           : ramp.elapsed[ramp_from] - ramp.elapsed[position];
+        } while (step_end <= elapsed);
+
+        wait = static_cast<uint32_t>(step_end - elapsed);
+        return position;
+    }
+
+    if ((applied & RUN_BIT) != 0 && cruise != 0)
+    {
+        wait = cruise - static_cast<uint32_t>((elapsed - ramp_time) % cruise);
+    }
+
+    return ramp_to;
+}
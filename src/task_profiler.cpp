@@ -0,0 +1,105 @@
+/** -----------------------------------------------------------------------------------------------------
+ * @file task_profiler.cpp
+ *
+ * @brief Per-task CPU share, stack high-water marks and heap, sampled periodically and published lock-free
+ * @version 0.1
+ * @date 2024-2025
+ *  ----------------------------------------------------------------------------------------------------- **/
+
+/** -----------------------------------------------------------------------------------------------------
+ * $ INCLUDES
+ *  ----------------------------------------------------------------------------------------------------- **/
+
+#include <string.h>
+
+#include "task_profiler.h"
+
+/** -----------------------------------------------------------------------------------------------------
+ * $ FUNCTION DECLARATIONS
+ *  ----------------------------------------------------------------------------------------------------- **/
+
+void TaskProfiler::sample()
+{
+    uint64_t now_us    = hal::micros();
+    uint64_t window_us = previous_us != 0 ? now_us - previous_us : 0;
+    size_t   count     = hal::task_list(tasks, TaskProfile::MAX_TASKS);
+
+    uint32_t idle_permille[TaskProfile::CORES]   = {};
+    uint32_t pinned_permille[TaskProfile::CORES] = {};
+    bool     has_idle[TaskProfile::CORES]        = {};
+    bool     has_run_time                        = false;
+
+    for (size_t i = 0; i < count; i++) { has_run_time = has_run_time || tasks[i].run_time_us != 0; }
+
+    current.timestamp_ms = static_cast<uint32_t>(now_us / 1'000);
+    current.window_ms    = static_cast<uint32_t>(window_us / 1'000);
+    current.task_count   = static_cast<uint8_t>(count);
+
+    for (size_t i = 0; i < count; i++)
+    {
+        const hal::TaskInfo& task     = tasks[i];
+        uint32_t             previous = 0;
+        uint32_t             permille = has_run_time ? 0 : TaskLoad::UNKNOWN_PERMILLE;
+        if (has_run_time && window_us > 0 && previous_run_time(task.name, previous))
+        {
+            // The run time counter wraps, the difference stays correct within a window
+            uint64_t run_us = static_cast<uint32_t>(task.run_time_us - previous);
+            permille        = static_cast<uint32_t>(run_us * 1'000 / window_us);
+            if (permille > 1'000) { permille = 1'000; }
+        }
+
+        TaskLoad& load = current.tasks[i];
+        memcpy(load.name, task.name, sizeof(load.name));
+        load.cpu_permille   = static_cast<uint16_t>(permille);
+        load.stack_size     = task.stack_size;
+        load.stack_free_min = task.stack_free_min;
+        load.priority       = task.priority;
+        load.core           = task.core;
+
+        if (task.core >= 0 && task.core < TaskProfile::CORES)
+        {
+            if (task.is_idle)
+            {
+                idle_permille[task.core] = permille;
+                has_idle[task.core]      = true;
+            }
+            else { pinned_permille[task.core] += permille; }
+        }
+    }
+
+    for (uint8_t core = 0; core < TaskProfile::CORES; core++)
+    {
+        uint32_t busy = has_idle[core] ? 1'000 - idle_permille[core] : pinned_permille[core];
+        current.core_busy_permille[core] =
+            has_run_time ? static_cast<uint16_t>(busy < 1'000 ? busy : 1'000) : TaskLoad::UNKNOWN_PERMILLE;
+    }
+
+    hal::HeapInfo heap         = hal::heap_info();
+    current.heap_free          = static_cast<uint32_t>(heap.free_bytes);
+    current.heap_minimum_free  = static_cast<uint32_t>(heap.minimum_free_bytes);
+    current.heap_largest_block = static_cast<uint32_t>(heap.largest_free_block);
+
+    published.publish(current);
+
+    for (size_t i = 0; i < count; i++)
+    {
+        memcpy(previous[i].name, tasks[i].name, sizeof(previous[i].name));
+        previous[i].run_time_us = tasks[i].run_time_us;
+    }
+    previous_count = static_cast<uint8_t>(count);
+    previous_us    = now_us;
+}
+
+bool TaskProfiler::previous_run_time(const char* name, uint32_t& run_time_us) const
+{
+    for (uint8_t i = 0; i < previous_count; i++)
+    {
+        if (strncmp(previous[i].name, name, sizeof(previous[i].name)) == 0)
+        {
+            run_time_us = previous[i].run_time_us;
+            return true;
+        }
+    }
+
+    return false;
+}
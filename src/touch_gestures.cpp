@@ -0,0 +1,92 @@
+/** -----------------------------------------------------------------------------------------------------
+ * @file touch_gestures.cpp
+ *
+ * @brief Debounced touch samples to one tap, long press or swipe event per press
+ * @version 0.1
+ * @date 2024-2025
+ *  ----------------------------------------------------------------------------------------------------- **/
+
+/** -----------------------------------------------------------------------------------------------------
+ * $ INCLUDES
+ *  ----------------------------------------------------------------------------------------------------- **/
+
+#include <stdlib.h>
+
+#include "touch_gestures.h"
+
+/** -----------------------------------------------------------------------------------------------------
+ * $ FUNCTION DECLARATIONS
+ *  ----------------------------------------------------------------------------------------------------- **/
+
+TouchGestures::TouchGestures(const Config& config) : config(config) {}
+
+bool TouchGestures::update(bool is_touched, uint16_t x, uint16_t y, uint32_t now_ms, TouchEvent& event)
+{
+    switch (state)
+    {
+        case State::IDLE:
+            if (is_touched)
+            {
+                state      = State::PRESSING;
+                is_swiping = false;
+                is_lifting = false;
+                start_x    = x;
+                start_y    = y;
+                last_x     = x;
+                last_y     = y;
+                start_ms   = now_ms;
+            }
+            return false;
+
+        case State::PRESSING:
+            if (!is_touched) { state = State::IDLE; }
+            else if (now_ms - start_ms >= config.press_ms) { state = State::PRESSED; }
+            return false;
+
+        case State::PRESSED:
+        case State::HELD:
+            break;
+    }
+
+    event = {
+        .type        = TOUCH_TAP,
+        .x           = start_x,
+        .y           = start_y,
+        .dx          = static_cast<int16_t>(last_x - start_x),
+        .dy          = static_cast<int16_t>(last_y - start_y),
+        .duration_ms = now_ms - start_ms,
+    };
+
+    if (is_touched)
+    {
+        is_lifting = false;
+        last_x     = x;
+        last_y     = y;
+        event.dx   = static_cast<int16_t>(last_x - start_x);
+        event.dy   = static_cast<int16_t>(last_y - start_y);
+        if (abs(event.dx) >= config.swipe_px || abs(event.dy) >= config.swipe_px) { is_swiping = true; }
+
+        if (state == State::PRESSED && !is_swiping && event.duration_ms >= config.long_press_ms)
+        {
+            state      = State::HELD;
+            event.type = TOUCH_LONG_PRESS;
+            return true;
+        }
+
+        return false;
+    }
+
+    if (!is_lifting)
+    {
+        is_lifting = true;
+        lifted_ms  = now_ms;
+    }
+    if (now_ms - lifted_ms < config.release_ms) { return false; }
+
+    // Released, a long press already had its event
+    bool was_held     = state == State::HELD;
+    state             = State::IDLE;
+    event.type        = is_swiping ? TOUCH_SWIPE : TOUCH_TAP;
+    event.duration_ms = lifted_ms - start_ms;
+    return !was_held;
+}
@@ -0,0 +1,90 @@
+/** -----------------------------------------------------------------------------------------------------
+ * @file trend_estimator.cpp
+ *
+ * @brief Kalman level-and-slope tracking of the sensor voltage with a predictive, hysteretic clean decision
+ * @version 0.1
+ * @date 2024-2025
+ *  ----------------------------------------------------------------------------------------------------- **/
+
+/** -----------------------------------------------------------------------------------------------------
+ * $ INCLUDES
+ *  ----------------------------------------------------------------------------------------------------- **/
+
+#include <math.h>
+
+#include "trend_estimator.h"
+
+/** -----------------------------------------------------------------------------------------------------
+ * $ FUNCTION DECLARATIONS
+ *  ----------------------------------------------------------------------------------------------------- **/
+
+constexpr static const float TREND_INITIAL_SLOPE_SD = 1.0F;  // V/s, nothing is known about the slope at the start
+
+TrendEstimator::TrendEstimator(const Config& config) : config(config) {}
+
+void TrendEstimator::update(float voltage, bool valid, float dt_s)
+{
+    if (!has_level)
+    {
+        if (!valid) { return; }
+
+        float variance = config.measurement_sd * config.measurement_sd;
+        state_level    = voltage;
+        state_slope    = 0.0F;
+        p00            = variance;
+        p01            = 0.0F;
+        p11            = TREND_INITIAL_SLOPE_SD * TREND_INITIAL_SLOPE_SD;
+        has_level      = true;
+    }
+    else
+    {
+        // Predict: the level moves at the slope, the slope drifts as white-noise acceleration
+        float dt    = dt_s > 0.0F ? dt_s : 0.0F;
+        float drift = config.slope_drift * config.slope_drift;
+        state_level += state_slope * dt;
+        p00 += dt * (2.0F * p01 + dt * p11) + drift * dt * dt * dt / 3.0F;
+        p01 += dt * p11 + drift * dt * dt / 2.0F;
+        p11 += drift * dt;
+
+        if (valid)
+        {
+            // Correct with the measured level
+            float innovation = voltage - state_level;
+            float variance   = p00 + config.measurement_sd * config.measurement_sd;
+            float gain_level = p00 / variance;
+            float gain_slope = p01 / variance;
+
+            state_level += gain_level * innovation;
+            state_slope += gain_slope * innovation;
+            p11 -= gain_slope * p01;
+            p01 -= gain_slope * p00;
+            p00 -= gain_level * p00;
+        }
+    }
+
+    float sd    = 0.0F;
+    float ahead = predicted(config.lead_s, sd);
+    if (!clean) { clean = ahead - config.confidence * sd > config.threshold; }
+    else { clean = ahead + config.confidence * sd >= config.threshold - config.hysteresis; }
+}
+
+bool TrendEstimator::is_rising() const
+{
+    return has_level && state_slope > config.confidence * sqrtf(p11);
+}
+
+bool TrendEstimator::is_falling() const
+{
+    return has_level && state_slope < -config.confidence * sqrtf(p11);
+}
+
+/**
+ * @brief Level expected horizon_s seconds from now, sd receives its standard deviation
+ *
+ */
+float TrendEstimator::predicted(float horizon_s, float& sd) const
+{
+    float variance = p00 + horizon_s * (2.0F * p01 + horizon_s * p11);
+    sd             = sqrtf(variance > 0.0F ? variance : 0.0F);
+    return state_level + state_slope * horizon_s;
+}
@@ -0,0 +1,90 @@
+/** -----------------------------------------------------------------------------------------------------
+ * @file turbidity_table.cpp
+ *
+ * @brief Fixed-point lookup table from 12-bit ADC code to sensor voltage and NTU, with per-device calibration
+ * @version 0.1
+ * @date 2024-2025
+ *  ----------------------------------------------------------------------------------------------------- **/
+
+/** -----------------------------------------------------------------------------------------------------
+ * $ INCLUDES
+ *  ----------------------------------------------------------------------------------------------------- **/
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "hal.h"
+#include "turbidity_table.h"
+
+/** -----------------------------------------------------------------------------------------------------
+ * $ FUNCTION DECLARATIONS
+ *  ----------------------------------------------------------------------------------------------------- **/
+
+TurbidityTable::TurbidityTable(const TurbidityEntries& defaults) : entries(defaults.entries) {}
+
+bool TurbidityTable::load_calibration(const char* path)
+{
+    FILE* file = hal::fs_open(path, "r");
+    if (file == nullptr) { return false; }
+
+    Point   loaded[MAX_POINTS];
+    uint8_t count   = 0;
+    bool    is_good = true;
+    char    line[64];
+    while (is_good && fgets(line, sizeof(line), file) != nullptr)
+    {
+        char* cursor = line;
+        while (*cursor == ' ' || *cursor == '\t') { cursor++; }
+        if (*cursor == '#' || *cursor == '\r' || *cursor == '\n' || *cursor == '\0') { continue; }
+
+        char* end     = nullptr;
+        float voltage = strtof(cursor, &end);
+        char* ntu_end = nullptr;
+        float ntu     = end != cursor ? strtof(end, &ntu_end) : 0.0F;
+
+        is_good = end != cursor && ntu_end != end && count < MAX_POINTS && ntu >= 0.0F
+                  && (count == 0 || voltage > loaded[count - 1].voltage);
+        if (is_good) { loaded[count++] = {.voltage = voltage, .ntu = ntu}; }
+    }
+    fclose(file);
+
+    if (!is_good || count < 2)
+    {
+        log_w("TurbidityTable ignoring invalid calibration %s", path);
+        return false;
+    }
+
+    if (calibrated == nullptr) { calibrated = new TurbidityEntry[TURBIDITY_ADC_CODES]; }
+
+    // The voltage column is the same for every curve, it is copied from the current table
+    for (uint8_t i = 0; i < count; i++) { points[i] = loaded[i]; }
+    point_count = count;
+    for (uint16_t code = 0; code < TURBIDITY_ADC_CODES; code++)
+    {
+        uint16_t voltage = entries[code].voltage;
+        calibrated[code] = {
+            .voltage = voltage,
+            .ntu     = turbidity_fixed(interpolate(voltage * TURBIDITY_VOLTAGE_UNIT), TURBIDITY_NTU_UNIT),
+        };
+    }
+    entries = calibrated;
+
+    return true;
+}
+
+float TurbidityTable::interpolate(float voltage) const
+{
+    if (voltage <= points[0].voltage) { return points[0].ntu; }
+
+    for (uint8_t i = 1; i < point_count; i++)
+    {
+        if (voltage <= points[i].voltage)
+        {
+            const Point& low  = points[i - 1];
+            const Point& high = points[i];
+            return low.ntu + (high.ntu - low.ntu) * (voltage - low.voltage) / (high.voltage - low.voltage);
+        }
+    }
+
+    return points[point_count - 1].ntu;
+}
@@ -0,0 +1,236 @@
+/** -----------------------------------------------------------------------------------------------------
+ * @file test_main.cpp
+ *
+ * @brief AdcDecimator on synthetic ADC blocks: effective resolution (ENOB), mains rejection and cost per output
+ * @version 0.1
+ * @date 2024-2025
+ *  ----------------------------------------------------------------------------------------------------- **/
+
+/** -----------------------------------------------------------------------------------------------------
+ * $ INCLUDES
+ *  ----------------------------------------------------------------------------------------------------- **/
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include <chrono>
+#include <random>
+#include <vector>
+
+#include <unity.h>
+
+#include "adc_decimator.h"
+#include "hal_native.h"
+
+/** -----------------------------------------------------------------------------------------------------
+ * $ GLOBAL VARIABLES
+ *  ----------------------------------------------------------------------------------------------------- **/
+
+constexpr static const double   NOISE_LSB     = 3.0;      // RMS noise of the sensor and the ESP32 ADC
+constexpr static const double   LEVEL         = 2'000.37;  // Input between two codes
+constexpr static const uint32_t SAMPLE_RATE   = TURBIDITY_SAMPLE_RATE_HZ;
+constexpr static const size_t   BLOCK_SAMPLES = TURBIDITY_BLOCK_SAMPLES;
+constexpr static const uint32_t DECIMATION    = SAMPLE_RATE / TURBIDITY_OUTPUT_RATE_HZ;  // As on the board
+constexpr static const size_t   OUTPUTS       = 200;
+
+static std::mt19937                     random_s(1);
+static std::normal_distribution<double> noise_s(0.0, NOISE_LSB);
+static double                           mains_lsb_s = 0.0;  // Amplitude of the 50 Hz interference
+static uint64_t                         sample_s    = 0;    // Codes generated so far
+
+/** -----------------------------------------------------------------------------------------------------
+ * $ FUNCTION DECLARATIONS
+ *  ----------------------------------------------------------------------------------------------------- **/
+
+void setUp()
+{
+    random_s.seed(1);
+    mains_lsb_s = 0.0;
+    sample_s    = 0;
+}
+
+void tearDown() {}
+
+/**
+ * @brief Next code of the synthetic input: LEVEL, white noise and mains, rounded and clipped like the converter
+ *
+ */
+uint16_t next_code()
+{
+    double time  = static_cast<double>(sample_s++) / SAMPLE_RATE;
+    double value = LEVEL + noise_s(random_s) + mains_lsb_s * sin(2.0 * M_PI * 50.0 * time);
+    long   code  = lround(value);
+    return static_cast<uint16_t>(code < 0 ? 0 : code > 4'095 ? 4'095 : code);
+}
+
+uint16_t adc_source(uint8_t pin) { return next_code(); }
+
+/**
+ * @brief ENOB on the 12-bit scale from the RMS error, a full-scale ideal converter has LSB / sqrt(12)
+ *
+ */
+double effective_bits(double rms_error_lsb) { return log2(4'096.0 / (rms_error_lsb * sqrt(12.0))); }
+
+struct Measurement
+{
+    double enob;
+    double ns_per_output;
+};
+
+/**
+ * @brief Decimate synthetic blocks until OUTPUTS outputs are complete
+ *
+ */
+Measurement measure(uint32_t decimation, size_t outputs_wanted = OUTPUTS)
+{
+    AdcDecimator             decimator(decimation);
+    std::vector<uint16_t>    block(BLOCK_SAMPLES);
+    uint16_t                 outputs[64];
+    double                   squares      = 0.0;
+    size_t                   outputs_done = 0;
+    std::chrono::nanoseconds spent(0);
+
+    while (outputs_done < outputs_wanted)
+    {
+        for (uint16_t& code : block) { code = next_code(); }
+
+        auto   start    = std::chrono::steady_clock::now();
+        size_t produced = decimator.push(block.data(), block.size(), outputs, 64);
+        spent += std::chrono::steady_clock::now() - start;
+
+        for (size_t i = 0; i < produced && outputs_done < outputs_wanted; i++, outputs_done++)
+        {
+            double error = static_cast<double>(outputs[i]) / (1U << AdcDecimator::FRACTION_BITS) - LEVEL;
+            squares += error * error;
+        }
+    }
+
+    return {.enob          = effective_bits(sqrt(squares / outputs_done)),
+            .ns_per_output = static_cast<double>(spent.count()) / outputs_done};
+}
+
+void test_enob_grows_with_decimation()
+{
+    // One raw code per output, what a single analogRead() gives
+    double single = measure(1, 100'000).enob;
+
+    for (uint32_t decimation : {16U, 256U, 4'096U, DECIMATION})
+    {
+        Measurement result = measure(decimation);
+
+        char message[120];
+        snprintf(message,
+                 sizeof(message),
+                 "decimation %5u: ENOB %.2f (single read %.2f), %.0f ns per output, %.2f ns per code",
+                 decimation,
+                 result.enob,
+                 single,
+                 result.ns_per_output,
+                 result.ns_per_output / decimation);
+        TEST_MESSAGE(message);
+
+        // Half a bit per doubling of the decimation, until the FRACTION_BITS of the output limit it
+        double expected = single + 0.5 * log2(decimation);
+        double limit    = 12.0 + AdcDecimator::FRACTION_BITS - 1.0;
+        TEST_ASSERT_TRUE(result.enob > (expected < limit ? expected : limit) - 0.5);
+    }
+}
+
+void test_mains_interference_cancels()
+{
+    // 50 Hz of 40 LSB on the cable, whole periods per window at the 1 Hz and 10 Hz output rates
+    for (uint32_t decimation : {SAMPLE_RATE, SAMPLE_RATE / 10})
+    {
+        setUp();
+        double quiet = measure(decimation, 20).enob;
+
+        setUp();
+        mains_lsb_s  = 40.0;
+        double mains = measure(decimation, 20).enob;
+
+        char message[80];
+        snprintf(message, sizeof(message), "decimation %5u: ENOB %.2f quiet, %.2f mains", decimation, quiet, mains);
+        TEST_MESSAGE(message);
+        TEST_ASSERT_TRUE(mains > quiet - 0.5);
+    }
+}
+
+void test_blocks_may_end_anywhere()
+{
+    std::vector<uint16_t> codes(10'007);
+    for (uint16_t& code : codes) { code = next_code(); }
+
+    // One push against pushes of odd sizes, windows span block boundaries
+    AdcDecimator whole(100);
+    uint16_t     expected[128];
+    size_t       expected_count = whole.push(codes.data(), codes.size(), expected, 128);
+    TEST_ASSERT_EQUAL_UINT32(100, expected_count);
+
+    for (size_t block : {1U, 7U, 99U, 100U, 101U, 1'000U})
+    {
+        AdcDecimator split(100);
+        uint16_t     outputs[128];
+        size_t       count = 0;
+        for (size_t offset = 0; offset < codes.size(); offset += block)
+        {
+            size_t length = offset + block < codes.size() ? block : codes.size() - offset;
+            count += split.push(codes.data() + offset, length, outputs + count, 128 - count);
+        }
+
+        TEST_ASSERT_EQUAL_UINT32(expected_count, count);
+        TEST_ASSERT_EQUAL_UINT16_ARRAY(expected, outputs, count);
+    }
+
+    // Outputs beyond capacity are dropped, not written
+    AdcDecimator small(100);
+    uint16_t     outputs[4] = {};
+    TEST_ASSERT_EQUAL_UINT32(2, small.push(codes.data(), 1'000, outputs, 2));
+    TEST_ASSERT_EQUAL_UINT16(0, outputs[2]);
+    TEST_ASSERT_EQUAL_UINT16(AdcDecimator::to_code(expected[0]), AdcDecimator::to_code(outputs[0]));
+}
+
+void test_stream_pipeline()
+{
+    // The simulated DMA stream at 200 kHz, 100 outputs/s, a frame per 5 ms
+    constexpr uint32_t rate       = 200'000;
+    constexpr uint32_t decimation = 2'000;
+
+    hal::native::set_adc_source(adc_source);
+    TEST_ASSERT_TRUE(hal::adc_stream_begin(TURBIDITY_PIN, rate, BLOCK_SAMPLES));
+
+    AdcDecimator decimator(decimation);
+    uint16_t     block[BLOCK_SAMPLES];
+    uint16_t     outputs[4];
+    size_t       outputs_done = 0;
+    double       squares      = 0.0;
+    while (outputs_done < 20)
+    {
+        size_t count    = hal::adc_stream_read(block, BLOCK_SAMPLES, 1'000);
+        size_t produced = decimator.push(block, count, outputs, 4);
+        TEST_ASSERT_EQUAL_UINT32(BLOCK_SAMPLES, count);
+
+        for (size_t i = 0; i < produced; i++, outputs_done++)
+        {
+            double error = static_cast<double>(outputs[i]) / (1U << AdcDecimator::FRACTION_BITS) - LEVEL;
+            squares += error * error;
+        }
+    }
+    hal::native::set_adc_source(nullptr);
+
+    double enob = effective_bits(sqrt(squares / outputs_done));
+    char   message[80];
+    snprintf(message, sizeof(message), "stream at %u Hz, decimation %u: ENOB %.2f", rate, decimation, enob);
+    TEST_MESSAGE(message);
+    TEST_ASSERT_TRUE(enob > effective_bits(NOISE_LSB) + 0.5 * log2(decimation) - 0.7);
+}
+
+int main(int argc, char** argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_enob_grows_with_decimation);
+    RUN_TEST(test_mains_interference_cancels);
+    RUN_TEST(test_blocks_may_end_anywhere);
+    RUN_TEST(test_stream_pipeline);
+    return UNITY_END();
+}
@@ -0,0 +1,278 @@
+/** -----------------------------------------------------------------------------------------------------
+ * @file test_main.cpp
+ *
+ * @brief AsyncHttpServer over loopback: requests/s and p99 latency with 1, 8 and 32 keep-alive clients, errors
+ * @version 0.1
+ * @date 2024-2025
+ *  ----------------------------------------------------------------------------------------------------- **/
+
+/** -----------------------------------------------------------------------------------------------------
+ * $ INCLUDES
+ *  ----------------------------------------------------------------------------------------------------- **/
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <unity.h>
+
+#include "async_http_server.h"
+
+/** -----------------------------------------------------------------------------------------------------
+ * $ GLOBAL VARIABLES
+ *  ----------------------------------------------------------------------------------------------------- **/
+
+constexpr static const uint16_t PORT                = 18'080;
+constexpr static const uint32_t REQUESTS_PER_CLIENT = 200;
+
+static AsyncHttpServer   server_s(PORT, 50);
+static std::atomic<bool> is_running_s = true;
+
+/** -----------------------------------------------------------------------------------------------------
+ * $ FUNCTION DECLARATIONS
+ *  ----------------------------------------------------------------------------------------------------- **/
+
+void handle_data()
+{
+    const char* body = "{\"turbidity\": 12.34, \"voltage\": 2.81, \"avg_voltage\": 2.80}";
+    server_s.send(200, "application/json", body, strlen(body));
+}
+
+int connect_client()
+{
+    int client = socket(AF_INET, SOCK_STREAM, 0);
+    int enable = 1;
+    setsockopt(client, IPPROTO_TCP, TCP_NODELAY, &enable, sizeof(enable));
+
+    sockaddr_in address     = {};
+    address.sin_family      = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    address.sin_port        = htons(PORT);
+    if (connect(client, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0)
+    {
+        close(client);
+        return -1;
+    }
+
+    timeval timeout = {.tv_sec = 10, .tv_usec = 0};
+    setsockopt(client, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    return client;
+}
+
+bool send_all(int client, const char* request)
+{
+    size_t length = strlen(request);
+    return send(client, request, length, MSG_NOSIGNAL) == static_cast<ssize_t>(length);
+}
+
+/**
+ * @brief Read one response (head and Content-Length body)
+ *
+ * @return status code, 0 if the connection closed or timed out first
+ */
+int read_response(int client, std::string& body, bool* is_closing = nullptr)
+{
+    std::string data;
+    char        buffer[1'024];
+    size_t      head_end = std::string::npos;
+    while (head_end == std::string::npos)
+    {
+        ssize_t received = recv(client, buffer, sizeof(buffer), 0);
+        if (received <= 0) { return 0; }
+        data.append(buffer, received);
+        head_end = data.find("\r\n\r\n");
+    }
+
+    size_t length_at = data.find("Content-Length: ");
+    size_t length    = length_at != std::string::npos ? strtoul(data.c_str() + length_at + 16, nullptr, 10) : 0;
+    while (data.size() < head_end + 4 + length)
+    {
+        ssize_t received = recv(client, buffer, sizeof(buffer), 0);
+        if (received <= 0) { return 0; }
+        data.append(buffer, received);
+    }
+
+    body = data.substr(head_end + 4, length);
+    if (is_closing != nullptr) { *is_closing = data.find("Connection: close") < head_end; }
+    return atoi(data.c_str() + 9);
+}
+
+/**
+ * @brief True once the server closed the connection (recv() returns 0)
+ *
+ */
+bool is_closed_by_server(int client)
+{
+    char buffer[64];
+    return recv(client, buffer, sizeof(buffer), 0) == 0;
+}
+
+void setUp() {}
+void tearDown() {}
+
+void run_load(uint8_t clients)
+{
+    std::vector<std::vector<uint32_t>> latencies(clients);
+    std::atomic<uint32_t>              failures = 0;
+    std::vector<std::thread>           threads;
+
+    auto start = std::chrono::steady_clock::now();
+    for (uint8_t c = 0; c < clients; c++)
+    {
+        threads.emplace_back(
+            [&, c]()
+            {
+                // One keep-alive connection per client, its first request also waits for a free connection slot
+                auto request_start = std::chrono::steady_clock::now();
+                int  client        = connect_client();
+                for (uint32_t i = 0; i < REQUESTS_PER_CLIENT && client >= 0; i++)
+                {
+                    std::string body;
+                    if (!send_all(client, "GET /turbidity/data HTTP/1.1\r\nHost: test\r\n\r\n")
+                        || read_response(client, body) != 200)
+                    {
+                        failures++;
+                        break;
+                    }
+
+                    auto request_end = std::chrono::steady_clock::now();
+                    latencies[c].push_back(static_cast<uint32_t>(
+                        std::chrono::duration_cast<std::chrono::microseconds>(request_end - request_start).count()));
+                    request_start = request_end;
+                }
+                if (client < 0) { failures++; }
+                else { close(client); }
+            });
+    }
+    for (std::thread& thread : threads) { thread.join(); }
+    auto end = std::chrono::steady_clock::now();
+
+    std::vector<uint32_t> all;
+    for (const std::vector<uint32_t>& client_latencies : latencies)
+    {
+        all.insert(all.end(), client_latencies.begin(), client_latencies.end());
+    }
+    std::sort(all.begin(), all.end());
+
+    double   seconds = std::chrono::duration<double>(end - start).count();
+    uint32_t p50     = all.empty() ? 0 : all[all.size() / 2];
+    uint32_t p99     = all.empty() ? 0 : all[all.size() * 99 / 100];
+
+    char message[160];
+    snprintf(message,
+             sizeof(message),
+             "%2u clients: %u requests, %.0f requests/s, p50 %u us, p99 %u us, max %u us",
+             clients,
+             static_cast<unsigned>(all.size()),
+             all.size() / seconds,
+             p50,
+             p99,
+             all.empty() ? 0 : all.back());
+    TEST_MESSAGE(message);
+
+    TEST_ASSERT_EQUAL_UINT32(0, failures.load());
+    TEST_ASSERT_EQUAL_UINT32(clients * REQUESTS_PER_CLIENT, all.size());
+}
+
+void test_load_1_client()
+{
+    run_load(1);
+}
+
+void test_load_8_clients()
+{
+    run_load(8);
+}
+
+void test_load_32_clients()
+{
+    // More clients than WEBSERVER_MAX_CONNECTIONS: the rest wait in the listen backlog until a client is done
+    run_load(32);
+}
+
+void test_slow_client_does_not_stall_others()
+{
+    int slow = connect_client();
+    TEST_ASSERT_TRUE(send_all(slow, "GET /turbidity/da"));  // And nothing more for now
+
+    auto        start  = std::chrono::steady_clock::now();
+    int         client = connect_client();
+    std::string body;
+    TEST_ASSERT_TRUE(send_all(client, "GET /turbidity/data HTTP/1.1\r\n\r\n"));
+    TEST_ASSERT_EQUAL_INT(200, read_response(client, body));
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    TEST_ASSERT_LESS_THAN(100, std::chrono::duration_cast<std::chrono::milliseconds>(elapsed).count());
+
+    // The slow one is answered once its request is complete
+    TEST_ASSERT_TRUE(send_all(slow, "ta HTTP/1.1\r\n\r\n"));
+    TEST_ASSERT_EQUAL_INT(200, read_response(slow, body));
+    close(client);
+    close(slow);
+}
+
+void test_bad_request_after_answered_request_gets_400()
+{
+    int         client = connect_client();
+    std::string body;
+    bool        is_closing = false;
+    TEST_ASSERT_TRUE(send_all(client, "GET /turbidity/data HTTP/1.1\r\n\r\n"));
+    TEST_ASSERT_EQUAL_INT(200, read_response(client, body));
+
+    // The server still remembers the answered request above, the error has to be written anyway
+    TEST_ASSERT_TRUE(send_all(client, "garbage\r\n\r\n"));
+    TEST_ASSERT_EQUAL_INT(400, read_response(client, body, &is_closing));
+    TEST_ASSERT_TRUE(is_closing);
+    TEST_ASSERT_TRUE(is_closed_by_server(client));
+    close(client);
+}
+
+void test_huge_content_length_gets_413()
+{
+    int         client = connect_client();
+    std::string body;
+    bool        is_closing = false;
+
+    // Would wrap head + body length to a small number on a 32-bit size_t
+    TEST_ASSERT_TRUE(send_all(client, "GET /turbidity/data HTTP/1.1\r\nContent-Length: 4294967295\r\n\r\n"));
+    TEST_ASSERT_EQUAL_INT(413, read_response(client, body, &is_closing));
+    TEST_ASSERT_TRUE(is_closing);
+    TEST_ASSERT_TRUE(is_closed_by_server(client));
+    close(client);
+}
+
+int main(int argc, char** argv)
+{
+    server_s.on("/turbidity/data", handle_data);
+    server_s.begin();
+    std::thread server_thread(
+        []()
+        {
+            while (is_running_s.load()) { server_s.handleClient(); }
+        });
+
+    UNITY_BEGIN();
+    RUN_TEST(test_bad_request_after_answered_request_gets_400);
+    RUN_TEST(test_huge_content_length_gets_413);
+    RUN_TEST(test_slow_client_does_not_stall_others);
+    RUN_TEST(test_load_1_client);
+    RUN_TEST(test_load_8_clients);
+    RUN_TEST(test_load_32_clients);
+    int failures = UNITY_END();
+
+    is_running_s.store(false);
+    server_thread.join();
+    return failures;
+}
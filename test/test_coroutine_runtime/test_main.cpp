@@ -0,0 +1,297 @@
+/** -----------------------------------------------------------------------------------------------------
+ * @file test_main.cpp
+ *
+ * @brief Coroutines on one task against one task per loop: reserved RAM, frame sizes, switch cost and idle wakeups
+ * @version 0.1
+ * @date 2024-2025
+ *  ----------------------------------------------------------------------------------------------------- **/
+
+/** -----------------------------------------------------------------------------------------------------
+ * $ INCLUDES
+ *  ----------------------------------------------------------------------------------------------------- **/
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include <atomic>
+#include <thread>
+
+#include <unity.h>
+
+#include "coroutine_runtime.h"
+#include "hal.h"
+
+/** -----------------------------------------------------------------------------------------------------
+ * $ GLOBAL VARIABLES
+ *  ----------------------------------------------------------------------------------------------------- **/
+
+// The layouts of main.cpp: get_data_task, tft_touch_task and pump_control_task, or control_task and the arena
+constexpr static const uint32_t TASK_STACK_SIZE     = 4'096;
+constexpr static const uint8_t  REPLACED_TASKS      = 3;
+constexpr static const size_t   COROUTINE_SLOT_SIZE = 256;
+constexpr static const size_t   COROUTINE_SLOTS     = 3;
+constexpr static const size_t   ARENA_SIZE          = COROUTINE_SLOTS * (COROUTINE_SLOT_SIZE + alignof(max_align_t));
+
+constexpr static const uint32_t SWITCHES  = 200'000;
+constexpr static const uint32_t HANDOFFS  = 20'000;
+constexpr static const size_t   WIDE_SLOT = 1'024;  // Room to measure frames larger than a slot
+
+// ADC frames of 50 ms as in the firmware, and a touch event posted by another thread in between
+constexpr static const uint8_t  ADC_PIN             = 36;
+constexpr static const uint32_t ADC_RATE_HZ         = 20'000;
+constexpr static const size_t   ADC_BLOCK           = 1'000;
+constexpr static const uint8_t  FRAMES              = 6;
+constexpr static const uint32_t TOUCH_AFTER_MS      = 120;
+constexpr static const uint32_t MAX_WAKE_LATENCY_US = 20'000;
+
+alignas(max_align_t) static uint8_t frames_s[ARENA_SIZE];
+static CoroutineArena               arena_s(frames_s, sizeof(frames_s), COROUTINE_SLOT_SIZE);
+static CoroutineScheduler           scheduler_s(arena_s);
+
+#if COROUTINE_TASKS
+alignas(max_align_t) static uint8_t wide_frames_s[4 * (WIDE_SLOT + alignof(max_align_t))];
+#endif
+
+alignas(max_align_t) static uint8_t quiet_frames_s[2 * (COROUTINE_SLOT_SIZE + alignof(max_align_t))];
+static CoroutineArena               quiet_arena_s(quiet_frames_s, sizeof(quiet_frames_s), COROUTINE_SLOT_SIZE);
+static CoroutineScheduler           quiet_scheduler_s(quiet_arena_s, CoroutineScheduler::NO_POLLING);
+
+static hal::Queue* ping_s = nullptr;
+static hal::Queue* pong_s = nullptr;
+
+static uint16_t              adc_block_s[ADC_BLOCK];
+static uint8_t               frames_taken_s = 0;
+static std::atomic<bool>     is_touched_s   = false;
+static std::atomic<uint64_t> touched_us_s   = 0;
+static uint64_t              woken_us_s     = 0;
+
+/** -----------------------------------------------------------------------------------------------------
+ * $ FUNCTION DECLARATIONS
+ *  ----------------------------------------------------------------------------------------------------- **/
+
+#if COROUTINE_TASKS
+// main.cpp, the loops that replace the three tasks
+Coroutine sampling_coroutine(CoroutineScheduler& scheduler);
+Coroutine touch_coroutine(CoroutineScheduler& scheduler);
+Coroutine pump_control_coroutine(CoroutineScheduler& scheduler);
+#endif
+
+void setUp() {}
+void tearDown() {}
+
+/**
+ * @brief Resume until every coroutine has returned
+ *
+ * @return microseconds it took
+ */
+uint64_t run_to_completion(CoroutineScheduler& scheduler, CoroutineArena& arena)
+{
+    uint64_t start_us = hal::micros();
+    while (arena.slots_used() > 0) { scheduler.run_once(); }
+    return hal::micros() - start_us;
+}
+
+Coroutine spinner(CoroutineScheduler& scheduler)
+{
+    for (uint32_t i = 0; i < SWITCHES / 2; i++) { co_await scheduler.yield(); }
+}
+
+Coroutine ping(CoroutineScheduler& scheduler)
+{
+    uint32_t value = 0;
+    for (uint32_t i = 0; i < HANDOFFS / 2; i++)
+    {
+        ping_s->send(&value, 0);
+        co_await scheduler.receive(*pong_s, &value);
+    }
+}
+
+Coroutine pong(CoroutineScheduler& scheduler)
+{
+    uint32_t value = 0;
+    for (uint32_t i = 0; i < HANDOFFS / 2; i++)
+    {
+        co_await scheduler.receive(*ping_s, &value);
+        pong_s->send(&value, 0);
+    }
+}
+
+Coroutine frame_reader(CoroutineScheduler& scheduler)
+{
+    for (uint8_t i = 0; i < FRAMES; i++)
+    {
+        if (co_await scheduler.adc_frame(adc_block_s, ADC_BLOCK, 1'000) > 0) { frames_taken_s++; }
+    }
+}
+
+bool take_touch(void* context) { return is_touched_s.exchange(false); }
+
+Coroutine touch_reader(CoroutineScheduler& scheduler)
+{
+    // Not if (co_await ...): GCC 12 gets the handle of a coroutine without other locals 8 bytes off its frame
+    bool is_touched = co_await scheduler.until(take_touch, nullptr, 1'000);
+    if (is_touched) { woken_us_s = hal::micros(); }
+}
+
+#if COROUTINE_TASKS
+/**
+ * @brief Frame size of a coroutine, created and destroyed without being resumed
+ *
+ */
+size_t frame_size(Coroutine (*make)(CoroutineScheduler& scheduler))
+{
+    CoroutineArena     wide(wide_frames_s, sizeof(wide_frames_s), WIDE_SLOT);
+    CoroutineScheduler scheduler(wide);
+    {
+        Coroutine coroutine = make(scheduler);
+        TEST_ASSERT_TRUE(static_cast<bool>(coroutine));
+    }
+    TEST_ASSERT_EQUAL_UINT32(0, wide.slots_used());
+    return wide.largest_request();
+}
+
+void test_firmware_frames_fit_the_arena_slots()
+{
+    size_t sampling = frame_size(sampling_coroutine);
+    size_t touch    = frame_size(touch_coroutine);
+    size_t pump     = frame_size(pump_control_coroutine);
+
+    char message[100];
+    snprintf(message,
+             sizeof(message),
+             "frames: sampling %u, touch %u, pump control %u bytes, slots of %u",
+             static_cast<uint32_t>(sampling),
+             static_cast<uint32_t>(touch),
+             static_cast<uint32_t>(pump),
+             static_cast<uint32_t>(COROUTINE_SLOT_SIZE));
+    TEST_MESSAGE(message);
+
+    TEST_ASSERT_LESS_OR_EQUAL_UINT32(COROUTINE_SLOT_SIZE, sampling);
+    TEST_ASSERT_LESS_OR_EQUAL_UINT32(COROUTINE_SLOT_SIZE, touch);
+    TEST_ASSERT_LESS_OR_EQUAL_UINT32(COROUTINE_SLOT_SIZE, pump);
+}
+#endif
+
+void test_reserved_ram_against_the_task_layout()
+{
+    // Stacks are reserved whole whatever a task uses, the coroutine layout keeps one stack and adds the arena
+    uint32_t tasks      = REPLACED_TASKS * TASK_STACK_SIZE;
+    uint32_t coroutines = TASK_STACK_SIZE + sizeof(frames_s) + sizeof(CoroutineArena) + sizeof(CoroutineScheduler);
+
+    char message[120];
+    snprintf(message,
+             sizeof(message),
+             "reserved: %u tasks %u bytes, one task and coroutines %u bytes, %u bytes saved (TCBs not counted)",
+             REPLACED_TASKS,
+             tasks,
+             coroutines,
+             tasks - coroutines);
+    TEST_MESSAGE(message);
+
+    TEST_ASSERT_LESS_THAN_UINT32(tasks - TASK_STACK_SIZE, coroutines);
+}
+
+void test_switch_cost_against_tasks()
+{
+    TEST_ASSERT_TRUE(scheduler_s.spawn(spinner(scheduler_s)));
+    TEST_ASSERT_TRUE(scheduler_s.spawn(spinner(scheduler_s)));
+    uint64_t yield_us = run_to_completion(scheduler_s, arena_s);
+
+    // One value back and forth through two queues, between two coroutines and between two tasks
+    ping_s = hal::queue_create(1, sizeof(uint32_t));
+    pong_s = hal::queue_create(1, sizeof(uint32_t));
+    TEST_ASSERT_TRUE(scheduler_s.spawn(ping(scheduler_s)));
+    TEST_ASSERT_TRUE(scheduler_s.spawn(pong(scheduler_s)));
+    uint64_t coroutine_us = run_to_completion(scheduler_s, arena_s);
+
+    uint64_t    start_us = hal::micros();
+    std::thread task([]() {
+        uint32_t value = 0;
+        for (uint32_t i = 0; i < HANDOFFS / 2; i++)
+        {
+            ping_s->send(&value, hal::WAIT_FOREVER);
+            pong_s->receive(&value, hal::WAIT_FOREVER);
+        }
+    });
+    uint32_t value = 0;
+    for (uint32_t i = 0; i < HANDOFFS / 2; i++)
+    {
+        ping_s->receive(&value, hal::WAIT_FOREVER);
+        pong_s->send(&value, hal::WAIT_FOREVER);
+    }
+    task.join();
+    uint64_t task_us = hal::micros() - start_us;
+
+    double yield_ns     = yield_us * 1'000.0 / SWITCHES;
+    double coroutine_ns = coroutine_us * 1'000.0 / HANDOFFS;
+    double task_ns      = task_us * 1'000.0 / HANDOFFS;
+
+    char message[140];
+    snprintf(message,
+             sizeof(message),
+             "coroutine yield %.0f ns per switch, queue handoff %.0f ns between coroutines, %.0f ns between tasks",
+             yield_ns,
+             coroutine_ns,
+             task_ns);
+    TEST_MESSAGE(message);
+
+    CoroutineStats stats;
+    TEST_ASSERT_TRUE(scheduler_s.stats(stats));
+    TEST_ASSERT_EQUAL_UINT8(0, stats.coroutines);
+    TEST_ASSERT_GREATER_OR_EQUAL_UINT32(SWITCHES + HANDOFFS, stats.resumes);
+    TEST_ASSERT_TRUE(coroutine_ns < task_ns);
+}
+
+void test_notified_waits_sleep_until_their_event()
+{
+    // The stream sends to the wake queue per frame, the touch producer calls notify() like the render task does
+    static const uint8_t frame_token = 1;
+    TEST_ASSERT_TRUE(quiet_scheduler_s.begin());
+    TEST_ASSERT_TRUE(
+        hal::adc_stream_begin(ADC_PIN, ADC_RATE_HZ, ADC_BLOCK, quiet_scheduler_s.notify_queue(), &frame_token));
+    TEST_ASSERT_TRUE(quiet_scheduler_s.spawn(frame_reader(quiet_scheduler_s)));
+    TEST_ASSERT_TRUE(quiet_scheduler_s.spawn(touch_reader(quiet_scheduler_s)));
+
+    std::thread producer([]() {
+        hal::delay_ms(TOUCH_AFTER_MS);
+        touched_us_s = hal::micros();
+        is_touched_s = true;
+        quiet_scheduler_s.notify();
+    });
+    uint64_t elapsed_us = run_to_completion(quiet_scheduler_s, quiet_arena_s);
+    producer.join();
+
+    CoroutineStats stats;
+    TEST_ASSERT_TRUE(quiet_scheduler_s.stats(stats));
+
+    // Polling every 10 ms would have woken about elapsed_us / 10'000 times
+    uint32_t latency_us = static_cast<uint32_t>(woken_us_s - touched_us_s);
+    char     message[120];
+    snprintf(message,
+             sizeof(message),
+             "%u wakeups in %u ms for %u frames and one touch, touch seen after %u us",
+             stats.wakeups,
+             static_cast<uint32_t>(elapsed_us / 1'000),
+             frames_taken_s,
+             latency_us);
+    TEST_MESSAGE(message);
+
+    TEST_ASSERT_EQUAL_UINT8(FRAMES, frames_taken_s);
+    TEST_ASSERT_TRUE(woken_us_s != 0);
+    TEST_ASSERT_LESS_THAN_UINT32(MAX_WAKE_LATENCY_US, latency_us);
+    TEST_ASSERT_LESS_OR_EQUAL_UINT32(FRAMES + 3, stats.wakeups);
+}
+
+int main(int argc, char** argv)
+{
+    scheduler_s.begin();
+
+    UNITY_BEGIN();
+#if COROUTINE_TASKS
+    RUN_TEST(test_firmware_frames_fit_the_arena_slots);
+#endif
+    RUN_TEST(test_reserved_ram_against_the_task_layout);
+    RUN_TEST(test_switch_cost_against_tasks);
+    RUN_TEST(test_notified_waits_sleep_until_their_event);
+    return UNITY_END();
+}
@@ -0,0 +1,316 @@
+/** -----------------------------------------------------------------------------------------------------
+ * @file test_main.cpp
+ *
+ * @brief DisplayRenderer on the fake display: draw order, coalescing, partial text redraws and queue latency
+ * @version 0.1
+ * @date 2024-2025
+ *  ----------------------------------------------------------------------------------------------------- **/
+
+/** -----------------------------------------------------------------------------------------------------
+ * $ INCLUDES
+ *  ----------------------------------------------------------------------------------------------------- **/
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <unity.h>
+
+#include "display_renderer.h"
+#include "hal_native.h"
+
+/** -----------------------------------------------------------------------------------------------------
+ * $ GLOBAL VARIABLES
+ *  ----------------------------------------------------------------------------------------------------- **/
+
+
+enum TestWidget : uint8_t
+{
+    WIDGET_GATE,  // Blocks the render task while the test queues a backlog
+    WIDGET_A,
+    WIDGET_B,
+    WIDGET_C,
+    WIDGET_TEXT,
+    WIDGET_BANNER,  // Persistent, comes back after a screen clear
+};
+
+/**
+ * @brief Draw calls of the custom widgets, in the order the render task made them
+ *
+ */
+static std::mutex               draws_mutex_s;
+static std::vector<std::string> draws_s;
+
+static std::mutex              gate_mutex_s;
+static std::condition_variable gate_changed_s;
+static bool                    is_gate_closed_s = false;
+static bool                    is_gate_held_s   = false;  // The render task waits in the gate widget
+
+static std::atomic<uint32_t> first_frames_s(0);  // Calls of the on_first_frame callback of run()
+
+/** -----------------------------------------------------------------------------------------------------
+ * $ FUNCTION DECLARATIONS
+ *  ----------------------------------------------------------------------------------------------------- **/
+
+void record_draw(hal::Sprite& sprite, const DisplayRect& area, const DisplayCommand& command)
+{
+    std::lock_guard<std::mutex> lock(draws_mutex_s);
+    draws_s.push_back(command.text);
+}
+
+void gate_draw(hal::Sprite& sprite, const DisplayRect& area, const DisplayCommand& command)
+{
+    std::unique_lock<std::mutex> lock(gate_mutex_s);
+    is_gate_held_s = true;
+    gate_changed_s.notify_all();
+    gate_changed_s.wait(lock, []() { return !is_gate_closed_s; });
+    is_gate_held_s = false;
+}
+
+static const DisplayWidget widgets_s[] = {
+    {{0, 0, 40, 20}, gate_draw, 0, 0, 0, false, false},
+    {{0, 20, 40, 20}, record_draw, 0, 0, 0, false, false},
+    {{40, 20, 40, 20}, record_draw, 0, 0, 0, false, false},
+    {{80, 20, 40, 20}, record_draw, 0, 0, 0, false, true},
+    {{0, 40, 240, 32}, nullptr, 1, 2, 16, false, false},
+    {{0, 80, 240, 20}, record_draw, 0, 0, 0, true, false},
+};
+
+static DisplayRenderer renderer_s(hal::display(), widgets_s, sizeof(widgets_s) / sizeof(widgets_s[0]));
+
+std::vector<std::string> take_draws()
+{
+    std::lock_guard<std::mutex> lock(draws_mutex_s);
+    std::vector<std::string>    result;
+    result.swap(draws_s);
+    return result;
+}
+
+/**
+ * @brief Wait until the render task has taken commands commands in total and finished the pass
+ *
+ */
+void wait_for_commands(uint32_t commands)
+{
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(2);
+    while (renderer_s.stats().commands < commands && std::chrono::steady_clock::now() < deadline)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    TEST_ASSERT_LESS_OR_EQUAL_UINT32(renderer_s.stats().commands, commands);
+}
+
+/**
+ * @brief Block the render task in the gate widget, commands posted meanwhile wait in the queue as one backlog
+ *
+ */
+void close_gate(const char* text)
+{
+    std::unique_lock<std::mutex> lock(gate_mutex_s);
+    is_gate_closed_s = true;
+    lock.unlock();
+
+    renderer_s.post(WIDGET_GATE, text);
+
+    lock.lock();
+    TEST_ASSERT_TRUE(gate_changed_s.wait_for(lock, std::chrono::seconds(2), []() { return is_gate_held_s; }));
+}
+
+void open_gate()
+{
+    std::lock_guard<std::mutex> lock(gate_mutex_s);
+    is_gate_closed_s = false;
+    gate_changed_s.notify_all();
+}
+
+void setUp()
+{
+    take_draws();
+    hal::native::display_take_text();
+}
+
+void tearDown() { open_gate(); }
+
+void test_first_frame_is_reported_once()
+{
+    // Nothing posted yet, nothing pushed
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    TEST_ASSERT_EQUAL_UINT32(0, first_frames_s.load());
+
+    for (uint8_t i = 0; i < 3; i++)
+    {
+        uint32_t commands = renderer_s.stats().commands + 1;
+        renderer_s.post(WIDGET_A, i % 2 == 0 ? "first" : "second");
+        wait_for_commands(commands);
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        TEST_ASSERT_EQUAL_UINT32(1, first_frames_s.load());
+    }
+}
+
+void test_backlog_is_coalesced_and_drawn_in_post_order()
+{
+    DisplayStats before = renderer_s.stats();
+    close_gate("gate 1");
+
+    // A burst while the render task is busy, A three times
+    renderer_s.post(WIDGET_A, "A1");
+    renderer_s.post(WIDGET_B, "B1");
+    renderer_s.post(WIDGET_A, "A2");
+    renderer_s.post(WIDGET_C, "C1");
+    renderer_s.post(WIDGET_A, "A3");
+    open_gate();
+    wait_for_commands(before.commands + 6);
+
+    // One draw per widget with its newest text, in the order of the newest commands
+    std::vector<std::string> draws = take_draws();
+    TEST_ASSERT_EQUAL_UINT32(3, draws.size());
+    TEST_ASSERT_EQUAL_STRING("B1", draws[0].c_str());
+    TEST_ASSERT_EQUAL_STRING("C1", draws[1].c_str());
+    TEST_ASSERT_EQUAL_STRING("A3", draws[2].c_str());
+    TEST_ASSERT_EQUAL_UINT32(before.coalesced + 2, renderer_s.stats().coalesced);
+}
+
+void test_unchanged_widget_is_not_redrawn()
+{
+    DisplayStats before = renderer_s.stats();
+    renderer_s.post(WIDGET_B, "B2");
+    wait_for_commands(before.commands + 1);
+    renderer_s.post(WIDGET_B, "B2");
+    wait_for_commands(before.commands + 2);
+    renderer_s.post(WIDGET_B, "B2", hal::COLOR_RED);
+    wait_for_commands(before.commands + 3);
+
+    // The same text again costs nothing, a new color is a change
+    std::vector<std::string> draws = take_draws();
+    TEST_ASSERT_EQUAL_UINT32(2, draws.size());
+}
+
+void test_text_lines_redraw_only_what_changed()
+{
+    DisplayStats before = renderer_s.stats();
+    renderer_s.post(WIDGET_TEXT, "AVG Volt.: 2.81 V\nVoltage: 2.80 V");
+    wait_for_commands(before.commands + 1);
+    TEST_ASSERT_EQUAL_STRING("AVG Volt.: 2.81 V\nVoltage: 2.80 V\n", hal::native::display_take_text().c_str());
+
+    renderer_s.post(WIDGET_TEXT, "AVG Volt.: 2.81 V\nVoltage: 2.90 V");
+    wait_for_commands(before.commands + 2);
+    TEST_ASSERT_EQUAL_STRING("Voltage: 2.90 V\n", hal::native::display_take_text().c_str());
+
+    // Only the changed span of the line went to the display, not the widget
+    DisplayStats after = renderer_s.stats();
+    uint64_t     pixels = after.pixels_pushed - before.pixels_pushed;
+    uint64_t     widget = static_cast<uint64_t>(widgets_s[WIDGET_TEXT].bounds.w) * widgets_s[WIDGET_TEXT].bounds.h;
+    TEST_ASSERT_TRUE(pixels < widget * 2);
+}
+
+void test_clear_screen_restores_persistent_widgets_first()
+{
+    DisplayStats before = renderer_s.stats();
+    renderer_s.post(WIDGET_BANNER, "banner");
+    renderer_s.post(WIDGET_C, "C2");
+    wait_for_commands(before.commands + 2);
+    take_draws();
+
+    // The clear wipes C, the banner is drawn again before the widget that cleared
+    renderer_s.post(WIDGET_A, "A4", hal::COLOR_WHITE, DISPLAY_CLEAR_SCREEN);
+    wait_for_commands(before.commands + 3);
+
+    std::vector<std::string> draws = take_draws();
+    TEST_ASSERT_EQUAL_UINT32(2, draws.size());
+    TEST_ASSERT_EQUAL_STRING("banner", draws[0].c_str());
+    TEST_ASSERT_EQUAL_STRING("A4", draws[1].c_str());
+}
+
+void test_hit_test_finds_touchable_widgets()
+{
+    TEST_ASSERT_EQUAL_INT8(WIDGET_C, renderer_s.hit_test(90, 25));
+    TEST_ASSERT_EQUAL_INT8(-1, renderer_s.hit_test(10, 25));  // A is not touchable
+    TEST_ASSERT_EQUAL_INT8(-1, renderer_s.hit_test(300, 300));
+}
+
+void test_queue_latency()
+{
+    // Single updates: the render task sleeps on the queue and wakes for each one
+    DisplayStats before = renderer_s.stats();
+    char         text[16];
+    for (uint32_t i = 0; i < 200; i++)
+    {
+        snprintf(text, sizeof(text), "B%u", i);
+        renderer_s.post(WIDGET_B, text);
+        wait_for_commands(before.commands + i + 1);
+    }
+    DisplayStats single = renderer_s.stats();
+
+    // Two tasks posting as fast as they can, e.g. the sampler and the pump task
+    std::thread sampler([]() {
+        char line[16];
+        for (uint32_t i = 0; i < 5'000; i++)
+        {
+            snprintf(line, sizeof(line), "A%u", i);
+            renderer_s.post(WIDGET_A, line);
+        }
+    });
+    std::thread pump([]() {
+        char line[16];
+        for (uint32_t i = 0; i < 5'000; i++)
+        {
+            snprintf(line, sizeof(line), "C%u", i);
+            renderer_s.post(WIDGET_C, line);
+        }
+    });
+    sampler.join();
+    pump.join();
+    wait_for_commands(single.commands + 10'000 - (renderer_s.stats().dropped - single.dropped));
+    DisplayStats burst = renderer_s.stats();
+
+    char message[200];
+    snprintf(message,
+             sizeof(message),
+             "single updates: latency mean %u us, max %u us; burst of 10000 from two tasks: %u frames, %u coalesced, "
+             "%u dropped, latency max %u us",
+             single.latency_mean_us,
+             single.latency_max_us,
+             burst.frames - single.frames,
+             burst.coalesced - single.coalesced,
+             burst.dropped - single.dropped,
+             burst.latency_max_us);
+    TEST_MESSAGE(message);
+
+    // Nothing lost and the newest text of each widget is on screen
+    TEST_ASSERT_EQUAL_UINT32(single.dropped, burst.dropped);
+    TEST_ASSERT_TRUE(burst.frames - single.frames < 10'000);
+    std::vector<std::string> draws = take_draws();
+    TEST_ASSERT_TRUE(draws.size() >= 2);
+    bool has_last_a = false;
+    bool has_last_c = false;
+    for (const std::string& draw : draws)
+    {
+        has_last_a = has_last_a || draw == "A4999";
+        has_last_c = has_last_c || draw == "C4999";
+    }
+    TEST_ASSERT_TRUE(has_last_a && has_last_c);
+}
+
+int main(int argc, char** argv)
+{
+    hal::native::set_pin_input(TOUCH_IRQ_PIN, true);  // Nobody touches the panel
+    renderer_s.begin(TOUCH_IRQ_PIN);
+    std::thread([]() { renderer_s.run(0, []() { first_frames_s++; }); }).detach();
+
+    UNITY_BEGIN();
+    RUN_TEST(test_first_frame_is_reported_once);
+    RUN_TEST(test_backlog_is_coalesced_and_drawn_in_post_order);
+    RUN_TEST(test_unchanged_widget_is_not_redrawn);
+    RUN_TEST(test_text_lines_redraw_only_what_changed);
+    RUN_TEST(test_clear_screen_restores_persistent_widgets_first);
+    RUN_TEST(test_hit_test_finds_touchable_widgets);
+    RUN_TEST(test_queue_latency);
+    return UNITY_END();
+}
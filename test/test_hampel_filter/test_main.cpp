@@ -0,0 +1,328 @@
+/** -----------------------------------------------------------------------------------------------------
+ * @file test_main.cpp
+ *
+ * @brief HampelFilter: agreement with a sorting reference, spike injection against pump toggles, cost per sample
+ * @version 0.1
+ * @date 2024-2025
+ *  ----------------------------------------------------------------------------------------------------- **/
+
+/** -----------------------------------------------------------------------------------------------------
+ * $ INCLUDES
+ *  ----------------------------------------------------------------------------------------------------- **/
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <vector>
+
+#include <unity.h>
+
+#include "hampel_filter.h"
+#include "pump_control.h"
+#include "trend_estimator.h"
+
+/** -----------------------------------------------------------------------------------------------------
+ * $ GLOBAL VARIABLES
+ *  ----------------------------------------------------------------------------------------------------- **/
+
+constexpr static const float VOLTS_PER_CODE = 3.3F / 4'096.0F;
+constexpr static const float SAMPLE_PERIOD  = 1.0F / TURBIDITY_OUTPUT_RATE_HZ;
+
+// The clean decision and the pump rules of main.cpp
+constexpr static const TrendEstimator::Config TREND = {
+    .threshold      = TURBIDITY_VOLTAGE_THRESHOLD,
+    .hysteresis     = TURBIDITY_HYSTERESIS,
+    .lead_s         = TURBIDITY_TREND_LEAD_S,
+    .confidence     = 2.0F,
+    .measurement_sd = 0.01F,
+    .slope_drift    = 0.002F,
+};
+constexpr static const PumpController::Config PUMP = {
+    .use_sensor        = true,
+    .sample_timeout_ms = 5'000,
+    .invalid_limit     = 10,
+};
+
+// Water levels in ADC codes, about 2.42 V (dirty) and 2.98 V (clean) against the 2.73 V threshold
+constexpr static const uint16_t DIRTY_CODE = 3'000;
+constexpr static const uint16_t CLEAN_CODE = 3'700;
+
+/**
+ * @brief Pump state changes over a run of the sampling pipeline
+ *
+ */
+struct PumpRun
+{
+    uint32_t toggles;       // Motor on/off changes after the manual start
+    uint32_t changes;       // State changes, also between PUMPING and MANUAL_HOLD
+    uint32_t first_toggle;  // Sample of the first motor change, UINT32_MAX if none
+    uint32_t outliers;
+};
+
+/** -----------------------------------------------------------------------------------------------------
+ * $ FUNCTION DECLARATIONS
+ *  ----------------------------------------------------------------------------------------------------- **/
+
+void setUp() {}
+void tearDown() {}
+
+/**
+ * @brief Hampel test by sorting the window, the definition HampelFilter implements with a Fenwick tree
+ *
+ */
+bool reference_is_outlier(const std::vector<uint16_t>& window, uint16_t code, float sigmas)
+{
+    if (window.size() < 3) { return false; }
+
+    std::vector<uint16_t> sorted = window;
+    std::sort(sorted.begin(), sorted.end());
+    int32_t median = sorted[(sorted.size() + 1) / 2 - 1];
+
+    std::vector<int32_t> deviations;
+    for (uint16_t value : sorted) { deviations.push_back(abs(value - median)); }
+    std::sort(deviations.begin(), deviations.end());
+    int32_t mad = deviations[(deviations.size() + 1) / 2 - 1];
+
+    return fabsf(static_cast<float>(code - median)) > sigmas * 1.4826F * mad;
+}
+
+template <uint16_t N>
+void check_against_reference()
+{
+    static HampelFilter<N> filter(3.0F);
+    std::mt19937           random(N);
+    std::vector<uint16_t>  window;
+    uint32_t               mismatches = 0;
+
+    for (uint32_t i = 0; i < 50'000; i++)
+    {
+        uint16_t code = random() % 50 == 0 ? random() % 4'096 : 3'000 + random() % 7;
+        window.push_back(code);
+        if (window.size() > N) { window.erase(window.begin()); }
+
+        if (filter.push(code) != reference_is_outlier(window, code, 3.0F)) { mismatches++; }
+        TEST_ASSERT_EQUAL_UINT16(window.size(), filter.count());
+    }
+
+    TEST_ASSERT_EQUAL_UINT32(0, mismatches);
+}
+
+void test_matches_sorting_reference()
+{
+    check_against_reference<3>();
+    check_against_reference<TURBIDITY_FILTER_WINDOW>();
+    check_against_reference<31>();
+}
+
+/**
+ * @brief Feed codes through the path of get_turbidity_data into a PumpController, as pump_control_task would
+ *
+ * @param is_filtered false counts every in-range sample as valid, the mean-only pipeline before the filter
+ */
+PumpRun run_pump(const std::vector<uint16_t>& codes, bool is_pumping, bool is_filtered)
+{
+    HampelFilter<TURBIDITY_FILTER_WINDOW> outliers(TURBIDITY_FILTER_SIGMAS);
+    TrendEstimator                        trend(TREND);
+    PumpController                        controller(PUMP, false);
+    PumpRun                               run = {.toggles = 0, .changes = 0, .first_toggle = UINT32_MAX, .outliers = 0};
+
+    for (uint32_t i = 0; i < codes.size(); i++)
+    {
+        float voltage    = codes[i] * VOLTS_PER_CODE;
+        bool  is_outlier = outliers.push(codes[i]);
+        bool  is_valid   = voltage > 0.0F && !(is_filtered && is_outlier);
+        trend.update(voltage, is_valid, SAMPLE_PERIOD);
+        if (is_outlier) { run.outliers++; }
+
+        PumpEvent sample = {
+            .type      = PUMP_EVENT_SAMPLE,
+            .source    = PUMP_SOURCE_SAMPLER,
+            .is_valid  = is_valid,
+            .is_clean  = trend.is_clean(),
+            .posted_us = 0,
+        };
+        PumpState before = controller.state();
+        PumpState after  = controller.handle(sample, i * 1'000 / TURBIDITY_OUTPUT_RATE_HZ);
+
+        // The pump is switched on by hand once the sensor has settled, that start is not counted
+        if (i == 30 && is_pumping)
+        {
+            after  = controller.handle({.type = PUMP_EVENT_START, .source = PUMP_SOURCE_TOUCH}, 0);
+            before = after;
+        }
+
+        if (after != before) { run.changes++; }
+        if (PumpController::is_pumping_state(after) != PumpController::is_pumping_state(before))
+        {
+            if (run.toggles == 0) { run.first_toggle = i; }
+            run.toggles++;
+        }
+    }
+
+    return run;
+}
+
+/**
+ * @brief Steady level with sensor noise, bubbles (dips) and spikes to the rail
+ *
+ */
+std::vector<uint16_t> spiky_trace(uint16_t level, uint32_t seed, uint32_t samples)
+{
+    std::mt19937                    random(seed);
+    std::normal_distribution<float> noise(0.0F, 4.0F);
+    std::vector<uint16_t>           codes;
+
+    for (uint32_t i = 0; i < samples; i++)
+    {
+        int32_t code = static_cast<int32_t>(lroundf(level + noise(random)));
+        if (i > 40 && random() % 40 == 0) { code -= 400 + random() % 1'200; }  // Bubble
+        else if (i > 40 && random() % 97 == 0) { code = 4'095; }               // Spike to the rail
+        codes.push_back(static_cast<uint16_t>(code < 1 ? 1 : code > 4'095 ? 4'095 : code));
+    }
+
+    return codes;
+}
+
+void report(const char* name, const PumpRun& unfiltered, const PumpRun& filtered)
+{
+    char message[160];
+    snprintf(message,
+             sizeof(message),
+             "%s: pump toggles %u (state changes %u) mean only, %u (%u) with the Hampel filter, %u outliers",
+             name,
+             unfiltered.toggles,
+             unfiltered.changes,
+             filtered.toggles,
+             filtered.changes,
+             filtered.outliers);
+    TEST_MESSAGE(message);
+}
+
+void test_spikes_do_not_stop_the_pump_in_dirty_water()
+{
+    // Pumping dirty water, a spike towards clean must not end the cycle
+    PumpRun unfiltered = {};
+    PumpRun filtered   = {};
+    for (uint32_t seed = 0; seed < 10; seed++)
+    {
+        std::vector<uint16_t> codes = spiky_trace(DIRTY_CODE, seed, 2'000);
+        PumpRun               one   = run_pump(codes, true, false);
+        PumpRun               two   = run_pump(codes, true, true);
+        unfiltered.toggles += one.toggles;
+        unfiltered.changes += one.changes;
+        filtered.toggles += two.toggles;
+        filtered.changes += two.changes;
+        filtered.outliers += two.outliers;
+    }
+
+    report("dirty water", unfiltered, filtered);
+    TEST_ASSERT_EQUAL_UINT32(0, filtered.toggles);
+}
+
+void test_bubbles_do_not_restart_the_pump_in_clean_water()
+{
+    // Started by hand in clean water (MANUAL_HOLD), a bubble must not turn it into a cleaning cycle
+    PumpRun unfiltered = {};
+    PumpRun filtered   = {};
+    for (uint32_t seed = 0; seed < 10; seed++)
+    {
+        std::vector<uint16_t> codes = spiky_trace(CLEAN_CODE, seed, 2'000);
+        PumpRun               one   = run_pump(codes, true, false);
+        PumpRun               two   = run_pump(codes, true, true);
+        unfiltered.toggles += one.toggles;
+        unfiltered.changes += one.changes;
+        filtered.toggles += two.toggles;
+        filtered.changes += two.changes;
+        filtered.outliers += two.outliers;
+    }
+
+    report("clean water", unfiltered, filtered);
+    TEST_ASSERT_EQUAL_UINT32(0, filtered.toggles);
+    TEST_ASSERT_EQUAL_UINT32(0, filtered.changes);
+}
+
+void test_real_clearing_still_stops_the_pump()
+{
+    // The water clears over a minute, the filter follows a real change once it holds the window
+    std::vector<uint16_t> codes = spiky_trace(DIRTY_CODE, 3, 600);
+    for (uint32_t i = 300; i < codes.size(); i++)
+    {
+        float progress = (i - 300) / 60.0F;
+        codes[i] += static_cast<uint16_t>((CLEAN_CODE - DIRTY_CODE) * (progress < 1.0F ? progress : 1.0F));
+        if (codes[i] > 4'095) { codes[i] = 4'095; }
+    }
+
+    PumpRun unfiltered = run_pump(codes, true, false);
+    PumpRun filtered   = run_pump(codes, true, true);
+
+    char message[120];
+    snprintf(message,
+             sizeof(message),
+             "clearing from sample 300: pump stopped at sample %u mean only, %u with the Hampel filter",
+             unfiltered.first_toggle,
+             filtered.first_toggle);
+    TEST_MESSAGE(message);
+
+    // Stopped once, after the water cleared and the clearing held the filter window
+    TEST_ASSERT_EQUAL_UINT32(1, filtered.toggles);
+    TEST_ASSERT_TRUE(filtered.first_toggle > 300 && filtered.first_toggle < 360 + TURBIDITY_FILTER_WINDOW);
+}
+
+template <uint16_t N>
+double push_cost_ns()
+{
+    static HampelFilter<N> filter(3.0F);
+    std::mt19937           random(1);
+    std::vector<uint16_t>  codes(1 << 16);
+    for (uint16_t& code : codes) { code = 2'800 + random() % 400; }
+
+    double   best     = 1e9;
+    uint32_t outliers = 0;
+    for (uint8_t run = 0; run < 5; run++)
+    {
+        auto start = std::chrono::steady_clock::now();
+        for (uint16_t code : codes) { outliers += filter.push(code); }
+        double spent = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+        best         = spent < best ? spent : best;
+    }
+    TEST_ASSERT_TRUE(outliers < codes.size() * 5);
+
+    return best / codes.size();
+}
+
+void test_cost_per_sample_across_window_sizes()
+{
+    double costs[] = {push_cost_ns<9>(), push_cost_ns<31>(), push_cost_ns<127>(), push_cost_ns<511>(),
+                      push_cost_ns<2'047>()};
+
+    char message[160];
+    snprintf(message,
+             sizeof(message),
+             "ns per sample: N=9 %.1f, N=31 %.1f, N=127 %.1f, N=511 %.1f, N=2047 %.1f",
+             costs[0],
+             costs[1],
+             costs[2],
+             costs[3],
+             costs[4]);
+    TEST_MESSAGE(message);
+
+    // O(log 4096) whatever the window, far below the 50 us between codes of a 20 kHz stream
+    TEST_ASSERT_TRUE(costs[4] < costs[0] * 3.0 + 20.0);
+    TEST_ASSERT_TRUE(costs[4] < 5'000.0);
+}
+
+int main(int argc, char** argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_matches_sorting_reference);
+    RUN_TEST(test_spikes_do_not_stop_the_pump_in_dirty_water);
+    RUN_TEST(test_bubbles_do_not_restart_the_pump_in_clean_water);
+    RUN_TEST(test_real_clearing_still_stops_the_pump);
+    RUN_TEST(test_cost_per_sample_across_window_sizes);
+    return UNITY_END();
+}
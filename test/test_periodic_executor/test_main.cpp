@@ -0,0 +1,268 @@
+/** -----------------------------------------------------------------------------------------------------
+ * @file test_main.cpp
+ *
+ * @brief PeriodicExecutor on a simulated clock: release times, jitter, deadline misses and overruns
+ * @version 0.1
+ * @date 2024-2025
+ *  ----------------------------------------------------------------------------------------------------- **/
+
+/** -----------------------------------------------------------------------------------------------------
+ * $ INCLUDES
+ *  ----------------------------------------------------------------------------------------------------- **/
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <unity.h>
+
+#include "periodic_executor.h"
+
+/** -----------------------------------------------------------------------------------------------------
+ * $ GLOBAL VARIABLES
+ *  ----------------------------------------------------------------------------------------------------- **/
+
+constexpr static const uint8_t MAX_STARTS = 64;
+
+/**
+ * @brief A job that takes cost_us of simulated time and records when it started
+ *
+ */
+struct Work
+{
+    uint32_t cost_us;
+    uint32_t runs;
+    uint64_t starts[MAX_STARTS];
+};
+
+static uint64_t now_us_s       = 0;
+static uint64_t wake_late_us_s = 0;  // Every sleep wakes this late, like a busy core
+
+/** -----------------------------------------------------------------------------------------------------
+ * $ FUNCTION DECLARATIONS
+ *  ----------------------------------------------------------------------------------------------------- **/
+
+uint64_t sim_clock() { return now_us_s; }
+
+void sim_sleep(uint64_t wake_us)
+{
+    if (wake_us > now_us_s) { now_us_s = wake_us + wake_late_us_s; }
+}
+
+void work(void* context)
+{
+    Work& work = *static_cast<Work*>(context);
+    if (work.runs < MAX_STARTS) { work.starts[work.runs] = now_us_s; }
+    work.runs++;
+    now_us_s += work.cost_us;
+}
+
+/**
+ * @brief What PeriodicExecutor::run() does, for a fixed number of polls
+ *
+ */
+void run_polls(PeriodicExecutor& executor, uint32_t polls)
+{
+    for (uint32_t i = 0; i < polls; i++) { sim_sleep(executor.poll()); }
+}
+
+void setUp()
+{
+    now_us_s       = 1'000;
+    wake_late_us_s = 0;
+}
+
+void tearDown() {}
+
+void test_releases_do_not_drift()
+{
+    PeriodicExecutor executor(sim_clock, sim_sleep);
+    Work             sampler = {.cost_us = 100};
+    Work             logger  = {.cost_us = 300};
+    TEST_ASSERT_TRUE(executor.add("sampler", work, &sampler, 1'000));
+    TEST_ASSERT_TRUE(executor.add("logger", work, &logger, 5'000, 2'000));
+    run_polls(executor, 200);
+
+    // Every start stays within a job of its release, never later by the sum of the costs so far
+    for (uint32_t i = 1; i < MAX_STARTS; i++)
+    {
+        uint64_t release_us = 1'000 + i * 1'000ULL;
+        TEST_ASSERT_TRUE(sampler.starts[i] >= release_us);
+        TEST_ASSERT_LESS_OR_EQUAL_UINT32(300, static_cast<uint32_t>(sampler.starts[i] - release_us));
+    }
+    for (uint32_t i = 1; i < logger.runs && i < MAX_STARTS; i++)
+    {
+        TEST_ASSERT_LESS_OR_EQUAL_UINT32(100, static_cast<uint32_t>((logger.starts[i] - 1'000) % 5'000));
+    }
+
+    ExecutorStats stats = {};
+    TEST_ASSERT_TRUE(executor.stats(stats));
+    TEST_ASSERT_EQUAL_UINT8(2, stats.job_count);
+    TEST_ASSERT_EQUAL_STRING("sampler", stats.jobs[0].name);
+    TEST_ASSERT_EQUAL_UINT32(0, stats.jobs[0].overruns);
+    TEST_ASSERT_EQUAL_UINT32(0, stats.jobs[0].deadline_misses);
+    TEST_ASSERT_EQUAL_UINT32(0, stats.jobs[1].overruns);
+    TEST_ASSERT_EQUAL_UINT32(0, stats.jobs[1].deadline_misses);
+    TEST_ASSERT_EQUAL_UINT32(0, stats.jobs[0].jitter_max_us);    // Goes first, the logger ends before its next release
+    TEST_ASSERT_EQUAL_UINT32(100, stats.jobs[1].jitter_max_us);  // Waits for the sampler
+    TEST_ASSERT_EQUAL_UINT32(100, stats.jobs[0].duration_max_us);
+    TEST_ASSERT_EQUAL_UINT32(300, stats.jobs[1].duration_mean_us);
+
+    // The old "work, then delay(period)" loop over the same 64 periods
+    uint64_t start_us = now_us_s;
+    for (uint32_t i = 0; i < MAX_STARTS; i++) { now_us_s += sampler.cost_us + 1'000; }
+    uint32_t delay_loop_drift_us = static_cast<uint32_t>(now_us_s - start_us - MAX_STARTS * 1'000);
+
+    char message[100];
+    snprintf(message,
+             sizeof(message),
+             "after %u periods: executor %u us late, delay loop %u us",
+             MAX_STARTS,
+             static_cast<uint32_t>(sampler.starts[MAX_STARTS - 1] - (1'000 + (MAX_STARTS - 1) * 1'000ULL)),
+             delay_loop_drift_us);
+    TEST_MESSAGE(message);
+}
+
+void test_earliest_deadline_runs_first()
+{
+    // Both released together, the one with the tighter deadline goes first whatever the order of add()
+    PeriodicExecutor executor(sim_clock, sim_sleep);
+    Work             relaxed = {.cost_us = 50};
+    Work             urgent  = {.cost_us = 50};
+    executor.add("relaxed", work, &relaxed, 1'000);
+    executor.add("urgent", work, &urgent, 1'000, 200);
+    run_polls(executor, 10);
+
+    for (uint32_t i = 0; i < 10; i++) { TEST_ASSERT_TRUE(urgent.starts[i] < relaxed.starts[i]); }
+
+    // offset_us spreads jobs of the same period apart
+    PeriodicExecutor spread(sim_clock, sim_sleep);
+    Work             first  = {.cost_us = 50};
+    Work             second = {.cost_us = 50};
+    spread.add("first", work, &first, 1'000);
+    spread.add("second", work, &second, 1'000, 0, 500);
+    run_polls(spread, 10);
+
+    TEST_ASSERT_EQUAL_UINT32(500, static_cast<uint32_t>(second.starts[0] - first.starts[0]));
+    TEST_ASSERT_EQUAL_UINT32(500, static_cast<uint32_t>(second.starts[3] - first.starts[3]));
+}
+
+void test_late_wakeups_are_jitter_not_drift()
+{
+    wake_late_us_s = 700;
+
+    PeriodicExecutor executor(sim_clock, sim_sleep);
+    Work             sampler = {.cost_us = 50};
+    executor.add("sampler", work, &sampler, 1'000);
+    run_polls(executor, 100);
+
+    ExecutorStats stats = {};
+    TEST_ASSERT_TRUE(executor.stats(stats));
+    TEST_ASSERT_EQUAL_UINT32(0, stats.jobs[0].overruns);
+    TEST_ASSERT_EQUAL_UINT32(0, stats.jobs[0].deadline_misses);
+    TEST_ASSERT_EQUAL_UINT32(700, stats.jobs[0].jitter_max_us);
+    TEST_ASSERT_EQUAL_UINT32(1'000 + 63 * 1'000 + 700, static_cast<uint32_t>(sampler.starts[63]));
+}
+
+void test_long_run_misses_and_skips_keeping_the_phase()
+{
+    PeriodicExecutor executor(sim_clock, sim_sleep);
+    Work             sampler = {.cost_us = 100};
+    executor.add("sampler", work, &sampler, 1'000, 500);
+    run_polls(executor, 5);
+
+    // One run of 2.5 periods: it misses its deadline, the next release is one period behind and the one after
+    // that is skipped
+    sampler.cost_us = 2'500;
+    run_polls(executor, 1);
+    sampler.cost_us = 100;
+    run_polls(executor, 10);
+
+    ExecutorStats stats = {};
+    TEST_ASSERT_TRUE(executor.stats(stats));
+    TEST_ASSERT_EQUAL_UINT32(1, stats.jobs[0].overruns);
+    TEST_ASSERT_EQUAL_UINT32(2, stats.jobs[0].deadline_misses);
+    TEST_ASSERT_EQUAL_UINT32(16, stats.jobs[0].runs);
+    TEST_ASSERT_EQUAL_UINT32(2'500, stats.jobs[0].duration_max_us);
+
+    // Back on the original grid after the skip
+    uint64_t last_start = sampler.starts[sampler.runs - 1];
+    TEST_ASSERT_EQUAL_UINT32(0, static_cast<uint32_t>((last_start - 1'000) % 1'000));
+}
+
+void test_job_longer_than_its_period_does_not_starve_others()
+{
+    PeriodicExecutor executor(sim_clock, sim_sleep);
+    Work             slow = {.cost_us = 2'500};
+    Work             fast = {.cost_us = 10};
+    executor.add("slow", work, &slow, 1'000);
+    executor.add("fast", work, &fast, 1'000);
+    run_polls(executor, 20);
+
+    // poll() still returns and publishes, each job runs at most once per poll
+    ExecutorStats stats = {};
+    TEST_ASSERT_TRUE(executor.stats(stats));
+    TEST_ASSERT_GREATER_OR_EQUAL_UINT32(10, stats.jobs[1].runs);
+    TEST_ASSERT_GREATER_THAN_UINT32(0, stats.jobs[0].overruns);
+}
+
+void test_runs_are_deterministic()
+{
+    uint32_t results[2][4];
+    for (uint8_t k = 0; k < 2; k++)
+    {
+        now_us_s = 0;
+
+        PeriodicExecutor executor(sim_clock, sim_sleep);
+        Work             a = {.cost_us = 230};
+        Work             b = {.cost_us = 900};
+        Work             c = {.cost_us = 40};
+        executor.add("a", work, &a, 1'000);
+        executor.add("b", work, &b, 3'000, 1'500, 500);
+        executor.add("c", work, &c, 700);
+        run_polls(executor, 5'000);
+
+        ExecutorStats stats = {};
+        TEST_ASSERT_TRUE(executor.stats(stats));
+        results[k][0] = stats.jobs[0].jitter_max_us;
+        results[k][1] = stats.jobs[1].deadline_misses;
+        results[k][2] = stats.jobs[2].overruns;
+        results[k][3] = stats.jobs[2].runs;
+    }
+
+    TEST_ASSERT_EQUAL_UINT32_ARRAY(results[0], results[1], 4);
+    TEST_ASSERT_GREATER_THAN_UINT32(0, results[0][3]);
+}
+
+void test_add_rejects_zero_period_and_full_table()
+{
+    PeriodicExecutor executor(sim_clock, sim_sleep);
+    Work             job = {.cost_us = 1};
+    TEST_ASSERT_FALSE(executor.add("zero", work, &job, 0));
+    for (uint8_t i = 0; i < ExecutorStats::MAX_JOBS; i++) { TEST_ASSERT_TRUE(executor.add("job", work, &job, 100)); }
+    TEST_ASSERT_FALSE(executor.add("full", work, &job, 100));
+
+    // A job added after the first poll() is released from then on
+    PeriodicExecutor late(sim_clock, sim_sleep);
+    Work             early   = {.cost_us = 10};
+    Work             joining = {.cost_us = 10};
+    late.add("early", work, &early, 1'000);
+    run_polls(late, 3);
+    uint64_t added_us = now_us_s;
+    late.add("joining", work, &joining, 1'000, 0, 250);
+    run_polls(late, 4);
+    TEST_ASSERT_EQUAL_UINT32(static_cast<uint32_t>(added_us + 250), static_cast<uint32_t>(joining.starts[0]));
+}
+
+int main(int argc, char** argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_releases_do_not_drift);
+    RUN_TEST(test_earliest_deadline_runs_first);
+    RUN_TEST(test_late_wakeups_are_jitter_not_drift);
+    RUN_TEST(test_long_run_misses_and_skips_keeping_the_phase);
+    RUN_TEST(test_job_longer_than_its_period_does_not_starve_others);
+    RUN_TEST(test_runs_are_deterministic);
+    RUN_TEST(test_add_rejects_zero_period_and_full_table);
+    return UNITY_END();
+}
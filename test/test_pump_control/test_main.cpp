@@ -0,0 +1,317 @@
+/** -----------------------------------------------------------------------------------------------------
+ * @file test_main.cpp
+ *
+ * @brief Event replays through PumpController and command-to-actuation latency of the pump control loop
+ * @version 0.1
+ * @date 2024-2025
+ *  ----------------------------------------------------------------------------------------------------- **/
+
+/** -----------------------------------------------------------------------------------------------------
+ * $ INCLUDES
+ *  ----------------------------------------------------------------------------------------------------- **/
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+#include <unity.h>
+
+#include "hal.h"
+#include "hal_native.h"
+#include "pump_control.h"
+#include "seqlock.h"
+
+/** -----------------------------------------------------------------------------------------------------
+ * $ GLOBAL VARIABLES
+ *  ----------------------------------------------------------------------------------------------------- **/
+
+// The configuration of main.cpp
+constexpr static const PumpController::Config SENSOR_CONTROL = {
+    .use_sensor        = true,
+    .sample_timeout_ms = 5'000,
+    .invalid_limit     = 10,
+};
+constexpr static const PumpController::Config SENSORLESS_CONTROL = {
+    .use_sensor        = false,
+    .sample_timeout_ms = 5'000,
+    .invalid_limit     = 10,
+};
+
+constexpr static const uint8_t  QUEUE_DEPTH = 16;
+constexpr static const uint16_t COMMANDS    = 200;
+
+/**
+ * @brief One replayed event and the state the controller must be in afterwards
+ *
+ */
+struct ReplayStep
+{
+    uint32_t  at_ms;
+    uint8_t   type;
+    bool      is_valid;
+    bool      is_clean;
+    PumpState expected;
+};
+
+static hal::Queue*         events_s = nullptr;
+static Seqlock<PumpStatus> status_s;
+static std::atomic<bool>   is_running_s(false);
+
+/** -----------------------------------------------------------------------------------------------------
+ * $ FUNCTION DECLARATIONS
+ *  ----------------------------------------------------------------------------------------------------- **/
+
+// main.cpp, the body of pump_control_task
+void     handle_pump_event(PumpController& controller, PumpStatus& status, const PumpEvent& event);
+uint32_t tick_pump(PumpController& controller, PumpStatus& status, uint32_t& next_tick_ms);
+uint32_t settle_motor(uint32_t wait_ms);
+
+void setUp() {}
+void tearDown() {}
+
+PumpEvent make_event(uint8_t type, bool is_valid = false, bool is_clean = false)
+{
+    return {
+        .type      = type,
+        .source    = type == PUMP_EVENT_SAMPLE ? PUMP_SOURCE_SAMPLER : PUMP_SOURCE_HTTP,
+        .is_valid  = is_valid,
+        .is_clean  = is_clean,
+        .posted_us = static_cast<uint32_t>(hal::micros()),
+    };
+}
+
+template <size_t COUNT>
+void replay(PumpController& controller, const ReplayStep (&steps)[COUNT])
+{
+    for (size_t i = 0; i < COUNT; i++)
+    {
+        const ReplayStep& step  = steps[i];
+        PumpState         after = controller.handle(make_event(step.type, step.is_valid, step.is_clean), step.at_ms);
+
+        char message[40];
+        snprintf(message, sizeof(message), "step %u", static_cast<unsigned>(i));
+        TEST_ASSERT_EQUAL_STRING_MESSAGE(
+            PumpController::state_name(step.expected), PumpController::state_name(after), message);
+        TEST_ASSERT_TRUE(controller.is_pumping() == PumpController::is_pumping_state(step.expected));
+    }
+}
+
+void test_sensorless_follows_commands_only()
+{
+    PumpController       controller(SENSORLESS_CONTROL, false);
+    constexpr ReplayStep steps[] = {
+        {0, PUMP_EVENT_START, false, false, PumpState::PUMPING},
+        {1'000, PUMP_EVENT_SAMPLE, true, true, PumpState::PUMPING},
+        {2'000, PUMP_EVENT_SAMPLE, false, false, PumpState::PUMPING},
+        {60'000, PUMP_EVENT_TICK, false, false, PumpState::PUMPING},
+        {61'000, PUMP_EVENT_START, false, false, PumpState::PUMPING},
+        {62'000, PUMP_EVENT_STOP, false, false, PumpState::IDLE},
+        {63'000, PUMP_EVENT_STOP, false, false, PumpState::IDLE},
+    };
+    replay(controller, steps);
+}
+
+void test_pumping_stops_on_clean_water()
+{
+    PumpController       controller(SENSOR_CONTROL, false);
+    constexpr ReplayStep steps[] = {
+        {0, PUMP_EVENT_SAMPLE, true, false, PumpState::IDLE},
+        {500, PUMP_EVENT_START, false, false, PumpState::PUMPING},
+        {1'000, PUMP_EVENT_SAMPLE, true, false, PumpState::PUMPING},
+        {1'500, PUMP_EVENT_TICK, false, false, PumpState::PUMPING},
+        {2'000, PUMP_EVENT_SAMPLE, true, true, PumpState::IDLE},
+        {3'000, PUMP_EVENT_SAMPLE, true, false, PumpState::IDLE},
+        {3'500, PUMP_EVENT_START, false, false, PumpState::PUMPING},
+        {4'000, PUMP_EVENT_STOP, false, false, PumpState::IDLE},
+    };
+    replay(controller, steps);
+
+    // The boot default PUMP_STATE_DEFAULT true starts in PUMPING
+    PumpController pumping(SENSOR_CONTROL, true);
+    TEST_ASSERT_TRUE(pumping.is_pumping());
+}
+
+void test_manual_hold_lasts_until_dirty_then_clean()
+{
+    PumpController       controller(SENSOR_CONTROL, false);
+    constexpr ReplayStep steps[] = {
+        {0, PUMP_EVENT_SAMPLE, true, true, PumpState::IDLE},
+        {500, PUMP_EVENT_START, false, false, PumpState::MANUAL_HOLD},
+        {1'000, PUMP_EVENT_SAMPLE, true, true, PumpState::MANUAL_HOLD},
+        {2'000, PUMP_EVENT_SAMPLE, true, true, PumpState::MANUAL_HOLD},
+        {3'000, PUMP_EVENT_SAMPLE, true, false, PumpState::PUMPING},
+        {4'000, PUMP_EVENT_SAMPLE, true, true, PumpState::IDLE},
+        {4'500, PUMP_EVENT_START, false, false, PumpState::MANUAL_HOLD},
+        {5'000, PUMP_EVENT_STOP, false, false, PumpState::IDLE},
+    };
+    replay(controller, steps);
+}
+
+void test_invalid_samples_fault_until_a_valid_one()
+{
+    PumpController controller(SENSOR_CONTROL, false);
+    controller.handle(make_event(PUMP_EVENT_START), 0);
+
+    // One short of the limit, a valid sample in between resets the count
+    for (uint16_t i = 0; i + 1 < SENSOR_CONTROL.invalid_limit; i++)
+    {
+        TEST_ASSERT_TRUE(controller.handle(make_event(PUMP_EVENT_SAMPLE), i * 1'000) == PumpState::PUMPING);
+    }
+    controller.handle(make_event(PUMP_EVENT_SAMPLE, true, false), 10'000);
+    for (uint16_t i = 0; i + 1 < SENSOR_CONTROL.invalid_limit; i++)
+    {
+        TEST_ASSERT_TRUE(controller.handle(make_event(PUMP_EVENT_SAMPLE), 11'000 + i * 1'000) == PumpState::PUMPING);
+    }
+
+    constexpr ReplayStep steps[] = {
+        {20'000, PUMP_EVENT_SAMPLE, false, false, PumpState::FAULT},
+        {21'000, PUMP_EVENT_START, false, false, PumpState::FAULT},
+        {22'000, PUMP_EVENT_STOP, false, false, PumpState::FAULT},
+        {23'000, PUMP_EVENT_SAMPLE, false, false, PumpState::FAULT},
+        {24'000, PUMP_EVENT_SAMPLE, true, false, PumpState::IDLE},
+        {25'000, PUMP_EVENT_START, false, false, PumpState::PUMPING},
+    };
+    replay(controller, steps);
+}
+
+void test_lost_sampler_faults_after_the_timeout()
+{
+    PumpController controller(SENSOR_CONTROL, false);
+
+    // Before the first sample the sampler may still be starting up
+    constexpr ReplayStep boot[] = {
+        {0, PUMP_EVENT_START, false, false, PumpState::PUMPING},
+        {10'000, PUMP_EVENT_TICK, false, false, PumpState::PUMPING},
+        {60'000, PUMP_EVENT_TICK, false, false, PumpState::PUMPING},
+    };
+    replay(controller, boot);
+
+    constexpr ReplayStep lost[] = {
+        {61'000, PUMP_EVENT_SAMPLE, true, false, PumpState::PUMPING},
+        {66'000, PUMP_EVENT_TICK, false, false, PumpState::PUMPING},
+        {66'500, PUMP_EVENT_TICK, false, false, PumpState::FAULT},
+        {67'000, PUMP_EVENT_START, false, false, PumpState::FAULT},
+        {67'500, PUMP_EVENT_SAMPLE, true, false, PumpState::IDLE},
+        {68'000, PUMP_EVENT_TICK, false, false, PumpState::IDLE},
+    };
+    replay(controller, lost);
+
+    // millis() wraps after 49.7 days, the gap is computed modulo 2^32
+    PumpController wrapping(SENSOR_CONTROL, false);
+    wrapping.handle(make_event(PUMP_EVENT_SAMPLE, true, false), UINT32_MAX - 1'000);
+    TEST_ASSERT_TRUE(wrapping.handle(make_event(PUMP_EVENT_TICK), 2'000) == PumpState::IDLE);
+    TEST_ASSERT_TRUE(wrapping.handle(make_event(PUMP_EVENT_TICK), 5'000) == PumpState::FAULT);
+}
+
+void test_motor_fault_stops_the_pump()
+{
+    PumpController       controller(SENSOR_CONTROL, false);
+    constexpr ReplayStep steps[] = {
+        {0, PUMP_EVENT_START, false, false, PumpState::PUMPING},
+        {1, PUMP_EVENT_MOTOR_FAULT, false, false, PumpState::FAULT},
+        {500, PUMP_EVENT_START, false, false, PumpState::FAULT},
+        {1'000, PUMP_EVENT_SAMPLE, true, false, PumpState::IDLE},
+    };
+    replay(controller, steps);
+}
+
+/**
+ * @brief pump_control_task on its own queue, publishing its status for the test thread after every event
+ *
+ */
+void control_loop()
+{
+    PumpController controller(SENSOR_CONTROL, false);
+    PumpStatus     status       = {.state = controller.state()};
+    uint32_t       next_tick_ms = hal::millis() + 500;
+    status_s.publish(status);
+
+    while (is_running_s.load())
+    {
+        PumpEvent event;
+        if (events_s->receive(&event, settle_motor(tick_pump(controller, status, next_tick_ms))))
+        {
+            handle_pump_event(controller, status, event);
+            status_s.publish(status);
+        }
+    }
+}
+
+PumpStatus wait_for_commands(uint32_t commands)
+{
+    PumpStatus status = {};
+    for (uint16_t i = 0; i < 2'000; i++)
+    {
+        if (status_s.try_read(status) && status.commands >= commands) { break; }
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    return status;
+}
+
+void test_command_to_actuation_latency()
+{
+    events_s = hal::queue_create(QUEUE_DEPTH, sizeof(PumpEvent));
+    is_running_s.store(true);
+    std::thread control(control_loop);
+
+    // A command every 5 ms with the sampler posting a sample before each, the driver wakes on every START
+    uint32_t   posted      = 0;
+    uint32_t   wake_max_us = 0;
+    PumpStatus status      = {};
+    for (uint16_t i = 0; i < COMMANDS; i++)
+    {
+        PumpEvent sample = make_event(PUMP_EVENT_SAMPLE, true, false);
+        TEST_ASSERT_TRUE(events_s->send(&sample, 20));
+        posted++;
+
+        bool      is_start = i % 2 == 0;
+        PumpEvent command  = make_event(is_start ? PUMP_EVENT_START : PUMP_EVENT_STOP);
+        TEST_ASSERT_TRUE(events_s->send(&command, 20));
+        posted++;
+
+        if (is_start)
+        {
+            while (!hal::native::pin_state(MOTOR_SLEEP_PIN)) { std::this_thread::yield(); }
+            uint32_t wake_us = static_cast<uint32_t>(hal::micros()) - command.posted_us;
+            if (wake_us > wake_max_us) { wake_max_us = wake_us; }
+        }
+
+        status = wait_for_commands(i + 1);
+        TEST_ASSERT_TRUE(status.state == (is_start ? PumpState::PUMPING : PumpState::IDLE));
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    }
+
+    is_running_s.store(false);
+    control.join();
+
+    char message[140];
+    snprintf(message,
+             sizeof(message),
+             "%u commands: posted to motor commanded mean %u us, max %u us; posted to driver awake max %u us",
+             status.commands,
+             status.latency_mean_us,
+             status.latency_max_us,
+             wake_max_us);
+    TEST_MESSAGE(message);
+
+    TEST_ASSERT_EQUAL_UINT32(COMMANDS, status.commands);
+    TEST_ASSERT_GREATER_OR_EQUAL_UINT32(posted, status.events);  // Ticks come on top
+    TEST_ASSERT_LESS_OR_EQUAL_UINT32(5'000, status.latency_mean_us);
+    TEST_ASSERT_LESS_OR_EQUAL_UINT32(50'000, status.latency_max_us);
+}
+
+int main(int argc, char** argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_sensorless_follows_commands_only);
+    RUN_TEST(test_pumping_stops_on_clean_water);
+    RUN_TEST(test_manual_hold_lasts_until_dirty_then_clean);
+    RUN_TEST(test_invalid_samples_fault_until_a_valid_one);
+    RUN_TEST(test_lost_sampler_faults_after_the_timeout);
+    RUN_TEST(test_motor_fault_stops_the_pump);
+    RUN_TEST(test_command_to_actuation_latency);
+    return UNITY_END();
+}
@@ -0,0 +1,139 @@
+/** -----------------------------------------------------------------------------------------------------
+ * @file test_main.cpp
+ *
+ * @brief RollingStats against a full rescan of the window, and its cost per push from N = 10 to N = 10000
+ * @version 0.1
+ * @date 2024-2025
+ *  ----------------------------------------------------------------------------------------------------- **/
+
+/** -----------------------------------------------------------------------------------------------------
+ * $ INCLUDES
+ *  ----------------------------------------------------------------------------------------------------- **/
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <chrono>
+
+#include <unity.h>
+
+#include "rolling_stats.h"
+
+/** -----------------------------------------------------------------------------------------------------
+ * $ FUNCTION DECLARATIONS
+ *  ----------------------------------------------------------------------------------------------------- **/
+
+void setUp() {}
+void tearDown() {}
+
+/**
+ * @brief The two loops get_turbidity_data ran before RollingStats, over the window from oldest to newest
+ *
+ */
+template<typename T, uint16_t N>
+void rescan(const RollingStats<T, N>& stats, float& mean, float& slope)
+{
+    double count = 0, sum_x = 0, sum_y = 0, sum_xy = 0, sum_x_square = 0;
+    for (uint16_t i = 0; i < N; i++)
+    {
+        if (!stats.is_valid(i)) { continue; }
+        count++;
+        sum_x += i;
+        sum_y += stats.at(i);
+        sum_xy += static_cast<double>(i) * stats.at(i);
+        sum_x_square += static_cast<double>(i) * i;
+    }
+
+    double denominator = count * sum_x_square - sum_x * sum_x;
+    double numerator   = count * sum_xy - sum_x * sum_y;
+    mean               = count > 0 ? static_cast<float>(sum_y / count) : 0.0F;
+    slope              = count >= 2 && denominator != 0 ? static_cast<float>(numerator / denominator) : 0.0F;
+}
+
+void test_matches_rescan_with_invalid_samples()
+{
+    RollingStats<uint16_t, 64> stats;
+    srand(1);
+    for (uint32_t i = 0; i < 20'000; i++)
+    {
+        // A slow ramp with noise, one in eight samples out of range
+        uint16_t value = static_cast<uint16_t>((i / 4) % 4096 + rand() % 32);
+        stats.push(value, rand() % 8 != 0);
+
+        float mean, slope;
+        rescan(stats, mean, slope);
+        TEST_ASSERT_FLOAT_WITHIN(0.01F + mean * 1e-5F, mean, stats.mean());
+        TEST_ASSERT_FLOAT_WITHIN(0.001F + fabsf(slope) * 1e-4F, slope, stats.slope());
+    }
+}
+
+void test_empty_and_single_sample()
+{
+    RollingStats<uint16_t, 10> stats;
+    TEST_ASSERT_EQUAL_FLOAT(0.0F, stats.mean());
+    TEST_ASSERT_EQUAL_FLOAT(0.0F, stats.slope());
+
+    stats.push(100, true);
+    TEST_ASSERT_EQUAL_FLOAT(100.0F, stats.mean());
+    TEST_ASSERT_EQUAL_FLOAT(0.0F, stats.slope());  // Undefined with one sample
+
+    // Invalid samples age the valid one out like any other
+    for (uint8_t i = 0; i < 10; i++) { stats.push(4095, false); }
+    TEST_ASSERT_EQUAL(0, stats.count());
+    TEST_ASSERT_EQUAL_FLOAT(0.0F, stats.mean());
+}
+
+/**
+ * @brief Nanoseconds per push, the best of a few runs so a preempted run does not count
+ *
+ */
+template<uint16_t N>
+double push_cost_ns()
+{
+    constexpr static const uint32_t PUSHES = 1'000'000;
+
+    static RollingStats<uint16_t, N> stats;  // 30 KB at N = 10000
+    double                           best = 1e9;
+    for (uint8_t run = 0; run < 5; run++)
+    {
+        auto start = std::chrono::steady_clock::now();
+        for (uint32_t i = 0; i < PUSHES; i++) { stats.push(static_cast<uint16_t>(i & 0x0FFF), (i & 7) != 0); }
+        auto end = std::chrono::steady_clock::now();
+
+        double ns = std::chrono::duration<double, std::nano>(end - start).count() / PUSHES;
+        if (ns < best) { best = ns; }
+    }
+
+    // Keeps the pushes from being optimised away
+    TEST_ASSERT_TRUE(stats.mean() >= 0.0F);
+    return best;
+}
+
+void test_cost_per_push_is_flat()
+{
+    double costs[] = {push_cost_ns<10>(), push_cost_ns<100>(), push_cost_ns<1'000>(), push_cost_ns<10'000>()};
+
+    char message[128];
+    snprintf(message,
+             sizeof(message),
+             "ns per push: N=10 %.1f, N=100 %.1f, N=1000 %.1f, N=10000 %.1f",
+             costs[0],
+             costs[1],
+             costs[2],
+             costs[3]);
+    TEST_MESSAGE(message);
+
+    // A rescan would be 1000 times slower at N = 10000, a factor of 3 leaves room for cache effects and noise
+    TEST_ASSERT_TRUE(costs[3] < costs[0] * 3.0 + 5.0);
+}
+
+int main(int argc, char** argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_matches_rescan_with_invalid_samples);
+    RUN_TEST(test_empty_and_single_sample);
+    RUN_TEST(test_cost_per_push_is_flat);
+    return UNITY_END();
+}
@@ -0,0 +1,220 @@
+/** -----------------------------------------------------------------------------------------------------
+ * @file test_main.cpp
+ *
+ * @brief SampleEncoder and SampleDecoder: lossless round trips, bytes per sample and throughput on sensor traces
+ * @version 0.1
+ * @date 2024-2025
+ *  ----------------------------------------------------------------------------------------------------- **/
+
+/** -----------------------------------------------------------------------------------------------------
+ * $ INCLUDES
+ *  ----------------------------------------------------------------------------------------------------- **/
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <chrono>
+#include <random>
+#include <vector>
+
+#include <unity.h>
+
+#include "sample_codec.h"
+
+/** -----------------------------------------------------------------------------------------------------
+ * $ GLOBAL VARIABLES
+ *  ----------------------------------------------------------------------------------------------------- **/
+
+constexpr static const uint32_t TRACE_SAMPLES = 100'000;
+constexpr static const uint32_t START_TIME    = 1'735'689'600;
+
+/** -----------------------------------------------------------------------------------------------------
+ * $ FUNCTION DECLARATIONS
+ *  ----------------------------------------------------------------------------------------------------- **/
+
+void setUp() {}
+void tearDown() {}
+
+/**
+ * @brief Cleaning cycles at 1 Hz: the code rises from dirty to clean water, with sensor noise and the odd bubble
+ *
+ * A sample goes missing now and then (a late wake-up), which breaks the constant timestamp delta.
+ */
+std::vector<SampleRecord> cleaning_trace()
+{
+    std::mt19937                     random(42);
+    std::normal_distribution<float>  noise(0.0F, 3.0F);
+    std::vector<SampleRecord>        trace;
+    uint32_t                         timestamp = START_TIME;
+
+    for (uint32_t i = 0; i < TRACE_SAMPLES; i++)
+    {
+        float    cycle = static_cast<float>(i % 1'800);  // Half an hour per cycle
+        float    level = 3'400.0F - 1'200.0F * expf(-cycle / 120.0F) + noise(random);
+        uint16_t code  = static_cast<uint16_t>(level);
+        if (random() % 500 == 0) { code -= 600; }  // Bubble
+
+        uint8_t flags = SAMPLE_FLAG_VALID | (code > 3'380 ? SAMPLE_FLAG_CLEAN : 0);
+        timestamp += random() % 200 == 0 ? 2 : 1;
+        trace.push_back({.timestamp = timestamp, .analog_value = code, .flags = flags, .reserved = 0});
+    }
+
+    return trace;
+}
+
+/**
+ * @brief Uncorrelated codes and timestamps, the worst case of the codec
+ *
+ */
+std::vector<SampleRecord> random_trace()
+{
+    std::mt19937              random(7);
+    std::vector<SampleRecord> trace;
+    uint32_t                  timestamp = START_TIME;
+
+    for (uint32_t i = 0; i < TRACE_SAMPLES; i++)
+    {
+        timestamp += random() % 100'000;
+        uint16_t code  = static_cast<uint16_t>(random() % 4'096);
+        uint8_t  flags = static_cast<uint8_t>(random() % 4);
+        trace.push_back({.timestamp = timestamp, .analog_value = code, .flags = flags, .reserved = 0});
+    }
+
+    return trace;
+}
+
+/**
+ * @brief Encode trace into blocks of block_size bytes like the log pages, decode them and compare
+ *
+ * @return encoded bytes
+ */
+size_t round_trip(const std::vector<SampleRecord>& trace, size_t block_size, const char* name)
+{
+    struct Block
+    {
+        std::vector<uint8_t> bytes;
+        uint16_t             count;
+    };
+
+    std::vector<Block>   blocks;
+    std::vector<uint8_t> buffer(block_size);
+    SampleEncoder        encoder(buffer.data(), buffer.size());
+
+    auto encode_start = std::chrono::steady_clock::now();
+    for (const SampleRecord& record : trace)
+    {
+        if (!encoder.append(record))
+        {
+            blocks.push_back({std::vector<uint8_t>(buffer.begin(), buffer.begin() + encoder.size()), encoder.count()});
+            encoder.reset();
+            TEST_ASSERT_TRUE(encoder.append(record));
+        }
+    }
+    blocks.push_back({std::vector<uint8_t>(buffer.begin(), buffer.begin() + encoder.size()), encoder.count()});
+    auto encode_end = std::chrono::steady_clock::now();
+
+    size_t   encoded = 0;
+    uint32_t index   = 0;
+    auto     decode_start = std::chrono::steady_clock::now();
+    for (const Block& block : blocks)
+    {
+        SampleDecoder decoder(block.bytes.data(), block.bytes.size(), block.count);
+        SampleRecord  record;
+        while (decoder.next(record))
+        {
+            TEST_ASSERT_TRUE(index < trace.size());
+            TEST_ASSERT_EQUAL_UINT32(trace[index].timestamp, record.timestamp);
+            TEST_ASSERT_EQUAL_UINT16(trace[index].analog_value, record.analog_value);
+            TEST_ASSERT_EQUAL_UINT8(trace[index].flags, record.flags);
+            index++;
+        }
+        encoded += block.bytes.size();
+    }
+    auto decode_end = std::chrono::steady_clock::now();
+    TEST_ASSERT_EQUAL_UINT32(trace.size(), index);
+
+    double encode_s = std::chrono::duration<double>(encode_end - encode_start).count();
+    double decode_s = std::chrono::duration<double>(decode_end - decode_start).count();
+
+    char message[160];
+    snprintf(message,
+             sizeof(message),
+             "%s: %.2f bytes per sample (raw %u), encode %.1f M samples/s, decode %.1f M samples/s (with checks)",
+             name,
+             static_cast<double>(encoded) / trace.size(),
+             static_cast<unsigned>(sizeof(SampleRecord)),
+             trace.size() / encode_s / 1e6,
+             trace.size() / decode_s / 1e6);
+    TEST_MESSAGE(message);
+
+    return encoded;
+}
+
+void test_cleaning_trace_round_trip_and_size()
+{
+    std::vector<SampleRecord> trace   = cleaning_trace();
+    size_t                    encoded = round_trip(trace, 1'008, "cleaning trace");  // Payload of a 1 KiB log page
+
+    // About one byte per sample on a slowly varying signal, eight raw
+    TEST_ASSERT_TRUE(static_cast<double>(encoded) / trace.size() < 1.5);
+}
+
+void test_random_trace_round_trip()
+{
+    std::vector<SampleRecord> trace   = random_trace();
+    size_t                    encoded = round_trip(trace, 1'008, "random trace");
+
+    // Never worse than MAX_RECORD_BYTES per record
+    TEST_ASSERT_LESS_OR_EQUAL(trace.size() * SampleEncoder::MAX_RECORD_BYTES, encoded);
+}
+
+void test_extreme_values_round_trip()
+{
+    // Largest deltas in both directions, a timestamp that goes backwards and every flag bit
+    std::vector<SampleRecord> trace = {
+        {.timestamp = 0, .analog_value = 0, .flags = 0, .reserved = 0},
+        {.timestamp = UINT32_MAX, .analog_value = 4'095, .flags = 0xFF, .reserved = 0},
+        {.timestamp = 1, .analog_value = 0, .flags = 0, .reserved = 0},
+        {.timestamp = 1, .analog_value = UINT16_MAX, .flags = 0x80, .reserved = 0},
+        {.timestamp = 2, .analog_value = UINT16_MAX, .flags = 0x80, .reserved = 0},
+        {.timestamp = 0x80000000, .analog_value = 1, .flags = 1, .reserved = 0},
+    };
+    round_trip(trace, 64, "extreme values");
+}
+
+void test_full_block_rejects_without_writing()
+{
+    uint8_t       buffer[16];
+    SampleEncoder encoder(buffer, sizeof(buffer));
+
+    uint32_t appended = 0;
+    while (encoder.append({.timestamp = START_TIME + appended * 1'000, .analog_value = 0, .flags = 0, .reserved = 0}))
+    {
+        appended++;
+    }
+
+    // What was appended still decodes, the rejected record left no partial bits behind
+    SampleDecoder decoder(buffer, encoder.size(), encoder.count());
+    SampleRecord  record;
+    uint32_t      decoded = 0;
+    while (decoder.next(record)) { decoded++; }
+    TEST_ASSERT_EQUAL_UINT32(appended, decoded);
+
+    // A truncated block ends the decode instead of reading past it
+    SampleDecoder truncated(buffer, encoder.size() / 2, encoder.count());
+    decoded = 0;
+    while (truncated.next(record)) { decoded++; }
+    TEST_ASSERT_LESS_THAN(appended, decoded);
+}
+
+int main(int argc, char** argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_cleaning_trace_round_trip_and_size);
+    RUN_TEST(test_random_trace_round_trip);
+    RUN_TEST(test_extreme_values_round_trip);
+    RUN_TEST(test_full_block_rejects_without_writing);
+    return UNITY_END();
+}
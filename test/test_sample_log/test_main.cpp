@@ -0,0 +1,241 @@
+/** -----------------------------------------------------------------------------------------------------
+ * @file test_main.cpp
+ *
+ * @brief SampleLog on the host data partition: write amplification, rotation, range queries and torn pages
+ * @version 0.1
+ * @date 2024-2025
+ *  ----------------------------------------------------------------------------------------------------- **/
+
+/** -----------------------------------------------------------------------------------------------------
+ * $ INCLUDES
+ *  ----------------------------------------------------------------------------------------------------- **/
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <chrono>
+
+#include <unity.h>
+
+#include "hal.h"
+#include "sample_log.h"
+
+/** -----------------------------------------------------------------------------------------------------
+ * $ GLOBAL VARIABLES
+ *  ----------------------------------------------------------------------------------------------------- **/
+
+// Below data/log like the log of the firmware, which .gitignore keeps out of the repository
+constexpr static const char*    LOG_DIRECTORY = "/log/test";
+constexpr static const uint32_t START_TIME    = 1'735'689'600;  // 2025-01-01, one sample per second from here
+
+struct QueryResult
+{
+    uint32_t count;
+    uint32_t first;
+    uint32_t last;
+    bool     is_ordered;
+};
+
+/** -----------------------------------------------------------------------------------------------------
+ * $ FUNCTION DECLARATIONS
+ *  ----------------------------------------------------------------------------------------------------- **/
+
+void remove_segments()
+{
+    hal::fs_list(
+        LOG_DIRECTORY,
+        [](const char* name, void* context)
+        {
+            char path[64];
+            snprintf(path, sizeof(path), "%s/%s", LOG_DIRECTORY, name);
+            hal::fs_remove(path);
+        },
+        nullptr);
+}
+
+void setUp()
+{
+    TEST_ASSERT_TRUE(hal::fs_mount());
+    TEST_ASSERT_TRUE(hal::fs_mkdir("/log"));
+    TEST_ASSERT_TRUE(hal::fs_mkdir(LOG_DIRECTORY));
+    remove_segments();
+}
+
+void tearDown()
+{
+    remove_segments();
+}
+
+/**
+ * @brief A slowly varying sensor trace with noise of a few codes, like the 1 Hz samples of the firmware
+ *
+ */
+SampleRecord make_record(uint32_t second)
+{
+    uint16_t code  = static_cast<uint16_t>(3'000 + 400 * sinf(second / 600.0F) + (second * 7919 % 5) - 2);
+    uint8_t  flags = SAMPLE_FLAG_VALID | (code > 3'200 ? SAMPLE_FLAG_CLEAN : 0);
+    return {.timestamp = START_TIME + second, .analog_value = code, .flags = flags, .reserved = 0};
+}
+
+bool collect(const SampleRecord& record, void* context)
+{
+    QueryResult& result = *static_cast<QueryResult*>(context);
+    if (result.count == 0) { result.first = record.timestamp; }
+    else if (record.timestamp <= result.last) { result.is_ordered = false; }
+    result.last = record.timestamp;
+    result.count++;
+    return true;
+}
+
+QueryResult query(SampleLog& log, uint32_t from, uint32_t to, double* micros = nullptr)
+{
+    QueryResult result = {.count = 0, .first = 0, .last = 0, .is_ordered = true};
+    auto        start  = std::chrono::steady_clock::now();
+    log.query(from, to, collect, &result);
+    auto end = std::chrono::steady_clock::now();
+    if (micros != nullptr) { *micros = std::chrono::duration<double, std::micro>(end - start).count(); }
+    return result;
+}
+
+void test_write_amplification()
+{
+    constexpr static const uint32_t SAMPLES = 100'000;  // About 28 hours at 1 Hz
+
+    SampleLog log(LOG_DIRECTORY);
+    TEST_ASSERT_TRUE(log.begin());
+    for (uint32_t i = 0; i < SAMPLES; i++) { TEST_ASSERT_TRUE(log.append(make_record(i))); }
+
+    // Against appending every raw record to flash as it arrives
+    SampleLogStats stats            = log.stats();
+    double         bytes_per_sample = static_cast<double>(stats.bytes_written) / SAMPLES;
+    double         amplification    = static_cast<double>(stats.bytes_written) / (SAMPLES * sizeof(SampleRecord));
+
+    char message[160];
+    snprintf(message,
+             sizeof(message),
+             "%u samples: %u pages, %.2f bytes written per sample, %.2f of the raw records, 1 write per %u samples",
+             SAMPLES,
+             stats.pages_written,
+             bytes_per_sample,
+             amplification,
+             SAMPLES / (stats.pages_written > 0 ? stats.pages_written : 1));
+    TEST_MESSAGE(message);
+
+    TEST_ASSERT_EQUAL_UINT32(SAMPLES, stats.samples_appended);
+    TEST_ASSERT_TRUE(amplification < 0.5);                         // Compressed, whole pages included
+    TEST_ASSERT_GREATER_THAN(500, SAMPLES / stats.pages_written);  // Page writes instead of sample writes
+}
+
+void test_range_queries_read_only_the_range()
+{
+    constexpr static const uint32_t SAMPLES = 200'000;
+
+    SampleLog log(LOG_DIRECTORY);
+    TEST_ASSERT_TRUE(log.begin());
+    for (uint32_t i = 0; i < SAMPLES; i++) { log.append(make_record(i)); }
+
+    // One hour in the middle, once from the index in RAM and once from the partition after a restart
+    for (uint8_t pass = 0; pass < 2; pass++)
+    {
+        SampleLog reopened(LOG_DIRECTORY);
+        if (pass == 1)
+        {
+            log.flush();
+            TEST_ASSERT_TRUE(reopened.begin());
+        }
+        SampleLog& source = pass == 0 ? log : reopened;
+
+        double      hour_us = 0;
+        double      all_us  = 0;
+        QueryResult hour    = query(source, START_TIME + 120'000, START_TIME + 123'599, &hour_us);
+        QueryResult all     = query(source, START_TIME, START_TIME + SAMPLES, &all_us);
+
+        char message[160];
+        snprintf(message,
+                 sizeof(message),
+                 "%s: 1 hour of %u samples in %.0f us, all %u samples in %.0f us",
+                 pass == 0 ? "running" : "reopened",
+                 SAMPLES,
+                 hour_us,
+                 all.count,
+                 all_us);
+        TEST_MESSAGE(message);
+
+        TEST_ASSERT_EQUAL_UINT32(3'600, hour.count);
+        TEST_ASSERT_EQUAL_UINT32(START_TIME + 120'000, hour.first);
+        TEST_ASSERT_EQUAL_UINT32(START_TIME + 123'599, hour.last);
+        TEST_ASSERT_TRUE(hour.is_ordered);
+        TEST_ASSERT_EQUAL_UINT32(SAMPLES, all.count);
+        TEST_ASSERT_TRUE(all.is_ordered);
+
+        // The hour is found through the index, not by decoding everything before it
+        TEST_ASSERT_TRUE(hour_us < all_us / 5);
+    }
+}
+
+void test_oldest_segments_rotate_out()
+{
+    SampleLog log(LOG_DIRECTORY);
+    TEST_ASSERT_TRUE(log.begin());
+
+    // Until well past the capacity, which is about one record per payload byte
+    uint32_t capacity = SAMPLE_LOG_MAX_SEGMENTS * SAMPLE_LOG_SEGMENT_PAGES * SAMPLE_LOG_PAGE_SIZE;
+    uint32_t samples  = capacity * 2;
+    for (uint32_t i = 0; i < samples; i++) { log.append(make_record(i)); }
+
+    SampleLogStats stats = log.stats();
+    QueryResult    all   = query(log, START_TIME, START_TIME + samples);
+    TEST_ASSERT_LESS_OR_EQUAL(SAMPLE_LOG_MAX_SEGMENTS, stats.segments);
+    TEST_ASSERT_GREATER_THAN(START_TIME, all.first);  // The oldest ones are gone
+    TEST_ASSERT_EQUAL_UINT32(START_TIME + samples - 1, all.last);
+    TEST_ASSERT_EQUAL_UINT32(all.last - all.first + 1, all.count);
+}
+
+void test_torn_and_corrupt_pages_are_skipped()
+{
+    constexpr static const uint32_t SAMPLES = 20'000;
+
+    {
+        SampleLog log(LOG_DIRECTORY);
+        TEST_ASSERT_TRUE(log.begin());
+        for (uint32_t i = 0; i < SAMPLES; i++) { log.append(make_record(i)); }
+        log.flush();
+    }
+
+    // A bit flip in the second page and a power loss halfway through a page write at the end
+    char path[64];
+    snprintf(path, sizeof(path), "%s/%08u.seg", LOG_DIRECTORY, 1U);  // Only segment of 20000 samples
+    FILE* file = hal::fs_open(path, "r+b");
+    TEST_ASSERT_NOT_NULL(file);
+    fseek(file, SAMPLE_LOG_PAGE_SIZE + 100, SEEK_SET);
+    fputc(0x5A, file);
+    fseek(file, 0, SEEK_END);
+    uint8_t half_page[SAMPLE_LOG_PAGE_SIZE / 2] = {0x4C, 0x47, 0x47, 0x32};
+    fwrite(half_page, 1, sizeof(half_page), file);
+    fclose(file);
+
+    SampleLog log(LOG_DIRECTORY);
+    TEST_ASSERT_TRUE(log.begin());
+    QueryResult all = query(log, START_TIME, START_TIME + SAMPLES);
+
+    // One page of about a thousand records is lost, the rest is intact and appending continues after it
+    TEST_ASSERT_TRUE(all.is_ordered);
+    TEST_ASSERT_LESS_THAN(SAMPLES, all.count);
+    TEST_ASSERT_GREATER_THAN(SAMPLES - 2 * SAMPLE_LOG_PAGE_SIZE, all.count);
+    TEST_ASSERT_EQUAL_UINT32(START_TIME + SAMPLES - 1, all.last);
+
+    TEST_ASSERT_TRUE(log.append(make_record(SAMPLES)));
+    TEST_ASSERT_EQUAL_UINT32(START_TIME + SAMPLES, query(log, START_TIME, START_TIME + SAMPLES).last);
+}
+
+int main(int argc, char** argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_write_amplification);
+    RUN_TEST(test_range_queries_read_only_the_range);
+    RUN_TEST(test_oldest_segments_rotate_out);
+    RUN_TEST(test_torn_and_corrupt_pages_are_skipped);
+    return UNITY_END();
+}
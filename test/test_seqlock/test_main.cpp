@@ -0,0 +1,163 @@
+/** -----------------------------------------------------------------------------------------------------
+ * @file test_main.cpp
+ *
+ * @brief Seqlock under contention: one writer thread, several reader threads, no torn or stale snapshots
+ * @version 0.1
+ * @date 2024-2025
+ *  ----------------------------------------------------------------------------------------------------- **/
+
+/** -----------------------------------------------------------------------------------------------------
+ * $ INCLUDES
+ *  ----------------------------------------------------------------------------------------------------- **/
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+#include <unity.h>
+
+#include "seqlock.h"
+
+/** -----------------------------------------------------------------------------------------------------
+ * $ GLOBAL VARIABLES
+ *  ----------------------------------------------------------------------------------------------------- **/
+
+constexpr static const uint32_t PUBLISHES = 2'000'000;
+constexpr static const uint8_t  READERS   = 4;
+
+/**
+ * @brief Large enough that a copy takes many word loads, every field is derived from the version
+ *
+ */
+struct Snapshot
+{
+    uint32_t version;
+    float    voltage;
+    uint16_t codes[40];
+    uint32_t check;
+};
+
+struct ReaderResult
+{
+    uint32_t reads;
+    uint32_t misses;  // try_read() gave up, every attempt overlapped with a publish (back to back here, 1 Hz live)
+    uint32_t torn;
+    uint32_t backwards;
+};
+
+/** -----------------------------------------------------------------------------------------------------
+ * $ FUNCTION DECLARATIONS
+ *  ----------------------------------------------------------------------------------------------------- **/
+
+void setUp() {}
+void tearDown() {}
+
+Snapshot make_snapshot(uint32_t version)
+{
+    Snapshot snapshot = {.version = version, .voltage = version * 0.5F, .codes = {}, .check = ~version};
+    for (uint16_t& code : snapshot.codes) { code = static_cast<uint16_t>(version); }
+    return snapshot;
+}
+
+bool is_consistent(const Snapshot& snapshot)
+{
+    if (snapshot.check != ~snapshot.version || snapshot.voltage != snapshot.version * 0.5F) { return false; }
+    for (uint16_t code : snapshot.codes)
+    {
+        if (code != static_cast<uint16_t>(snapshot.version)) { return false; }
+    }
+    return true;
+}
+
+void test_nothing_published()
+{
+    Seqlock<Snapshot> seqlock;
+    Snapshot          snapshot;
+    TEST_ASSERT_FALSE(seqlock.try_read(snapshot));
+    TEST_ASSERT_EQUAL_UINT32(0, seqlock.version());
+
+    seqlock.publish(make_snapshot(7));
+    TEST_ASSERT_TRUE(seqlock.try_read(snapshot));
+    TEST_ASSERT_EQUAL_UINT32(7, snapshot.version);
+    TEST_ASSERT_EQUAL_UINT32(1, seqlock.version());
+}
+
+void test_readers_never_see_torn_or_older_snapshots()
+{
+    static Seqlock<Snapshot> seqlock;
+    std::atomic<bool>        is_writing = true;
+    ReaderResult             results[READERS] = {};
+
+    seqlock.publish(make_snapshot(0));
+
+    std::thread readers[READERS];
+    for (uint8_t r = 0; r < READERS; r++)
+    {
+        readers[r] = std::thread(
+            [&, r]()
+            {
+                ReaderResult& result = results[r];
+                uint32_t      last   = 0;
+                while (is_writing.load(std::memory_order_relaxed))
+                {
+                    Snapshot snapshot;
+                    if (!seqlock.try_read(snapshot))
+                    {
+                        result.misses++;
+                        continue;
+                    }
+
+                    result.reads++;
+                    if (!is_consistent(snapshot)) { result.torn++; }
+                    if (snapshot.version < last) { result.backwards++; }
+                    last = snapshot.version;
+                }
+            });
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    for (uint32_t version = 1; version <= PUBLISHES; version++) { seqlock.publish(make_snapshot(version)); }
+    auto end = std::chrono::steady_clock::now();
+    is_writing.store(false);
+    for (std::thread& reader : readers) { reader.join(); }
+
+    ReaderResult total = {};
+    for (const ReaderResult& result : results)
+    {
+        total.reads += result.reads;
+        total.misses += result.misses;
+        total.torn += result.torn;
+        total.backwards += result.backwards;
+    }
+
+    double seconds = std::chrono::duration<double>(end - start).count();
+    char   message[160];
+    snprintf(message,
+             sizeof(message),
+             "%u publishes at %.0f ns each, %u reads by %u readers, %u gave up",
+             PUBLISHES,
+             seconds * 1e9 / PUBLISHES,
+             total.reads,
+             READERS,
+             total.misses);
+    TEST_MESSAGE(message);
+
+    TEST_ASSERT_EQUAL_UINT32(0, total.torn);
+    TEST_ASSERT_EQUAL_UINT32(0, total.backwards);
+    TEST_ASSERT_GREATER_THAN_UINT32(0, total.reads);
+
+    Snapshot last;
+    TEST_ASSERT_TRUE(seqlock.try_read(last));
+    TEST_ASSERT_EQUAL_UINT32(PUBLISHES, last.version);
+}
+
+int main(int argc, char** argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_nothing_published);
+    RUN_TEST(test_readers_never_see_torn_or_older_snapshots);
+    return UNITY_END();
+}
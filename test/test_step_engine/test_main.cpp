@@ -0,0 +1,143 @@
+/** -----------------------------------------------------------------------------------------------------
+ * @file test_main.cpp
+ *
+ * @brief StepEngine on the simulated step generator: step rate and jitter at several speeds, concurrent commands
+ * @version 0.1
+ * @date 2024-2025
+ *  ----------------------------------------------------------------------------------------------------- **/
+
+/** -----------------------------------------------------------------------------------------------------
+ * $ INCLUDES
+ *  ----------------------------------------------------------------------------------------------------- **/
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include <chrono>
+#include <thread>
+
+#include <unity.h>
+
+#include "hal_native.h"
+#include "step_engine.h"
+
+/** -----------------------------------------------------------------------------------------------------
+ * $ GLOBAL VARIABLES
+ *  ----------------------------------------------------------------------------------------------------- **/
+
+constexpr static const uint8_t  STEP_PIN      = 33;
+constexpr static const uint8_t  DIRECTION_PIN = 32;
+constexpr static const uint32_t RUN_TIME_MS   = 400;
+
+// No ramp, the generator switches straight to the commanded interval
+static StepEngine step_engine_s(hal::step_generator(), StepRamp{});
+
+/** -----------------------------------------------------------------------------------------------------
+ * $ FUNCTION DECLARATIONS
+ *  ----------------------------------------------------------------------------------------------------- **/
+
+void setUp()
+{
+    step_engine_s.stop();
+    std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    hal::native::step_timing_reset();
+}
+
+void tearDown() { step_engine_s.stop(); }
+
+/**
+ * @brief Run at steps_per_second for RUN_TIME_MS, check the rate and report the jitter
+ *
+ */
+void check_rate(float steps_per_second)
+{
+    TEST_ASSERT_TRUE(step_engine_s.start(steps_per_second));
+    uint32_t interval = step_engine_s.step_interval();
+    std::this_thread::sleep_for(std::chrono::milliseconds(RUN_TIME_MS));
+    hal::native::StepTiming timing = hal::native::step_timing();
+
+    char message[200];
+    snprintf(message,
+             sizeof(message),
+             "%6.0f steps/s: %u steps, interval %u us, mean %.2f us, min %u us, max %u us, jitter rms %.2f us, "
+             "max %.1f us",
+             static_cast<double>(steps_per_second),
+             timing.steps,
+             interval,
+             timing.mean_interval_us,
+             timing.min_interval_us,
+             timing.max_interval_us,
+             timing.jitter_rms_us,
+             timing.jitter_max_us);
+    TEST_MESSAGE(message);
+
+    TEST_ASSERT_EQUAL_UINT32(interval, timing.interval);
+
+    // Deadlines are absolute, host jitter moves single steps but not the rate
+    double expected_steps = steps_per_second * RUN_TIME_MS / 1'000.0;
+    TEST_ASSERT_TRUE(timing.steps > expected_steps * 0.9 && timing.steps < expected_steps * 1.1 + 2.0);
+    if (timing.steps > 4'096) { return; }  // Mean over the recorded window only
+    TEST_ASSERT_TRUE(timing.mean_interval_us > interval * 0.98 && timing.mean_interval_us < interval * 1.02);
+}
+
+void test_rate_at_low_speed() { check_rate(150.0F); }
+
+void test_rate_at_default_speed() { check_rate(1'600.0F); }
+
+void test_rate_at_high_speed() { check_rate(4'800.0F); }
+
+void test_rate_at_fine_microstepping() { check_rate(16'000.0F); }
+
+void test_rejects_rates_out_of_range()
+{
+    TEST_ASSERT_FALSE(step_engine_s.start(10.0F));         // Interval above two RMT durations
+    TEST_ASSERT_FALSE(step_engine_s.start(1'000'000.0F));  // Below MIN_STEP_INTERVAL
+    TEST_ASSERT_FALSE(step_engine_s.is_running());
+}
+
+void test_stop_halts_the_pulse_train()
+{
+    step_engine_s.start(1'600.0F);
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    step_engine_s.stop();
+    std::this_thread::sleep_for(std::chrono::milliseconds(5));
+
+    uint32_t steps = hal::native::step_timing().steps;
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    TEST_ASSERT_EQUAL_UINT32(steps, hal::native::step_timing().steps);
+    TEST_ASSERT_EQUAL_UINT32(0, hal::native::step_timing().interval);
+}
+
+void test_concurrent_commands_end_in_last_state()
+{
+    // Two tasks command at once, the generator must follow the last command word whoever applied it
+    std::thread starter([]() {
+        for (uint32_t i = 0; i < 10'000; i++) { step_engine_s.start(100.0F + i % 50); }
+    });
+    std::thread stopper([]() {
+        for (uint32_t i = 0; i < 10'000; i++) { step_engine_s.stop(); }
+    });
+    starter.join();
+    stopper.join();
+
+    // No further command: a word left unapplied by the racing callers would show as a mismatch here
+    uint32_t expected = step_engine_s.is_running() ? step_engine_s.step_interval() : 0;
+    TEST_ASSERT_EQUAL_UINT32(expected, hal::native::step_timing().interval);
+
+    step_engine_s.stop();
+}
+
+int main(int argc, char** argv)
+{
+    step_engine_s.begin(STEP_PIN, DIRECTION_PIN, false);
+
+    UNITY_BEGIN();
+    RUN_TEST(test_rate_at_low_speed);
+    RUN_TEST(test_rate_at_default_speed);
+    RUN_TEST(test_rate_at_high_speed);
+    RUN_TEST(test_rate_at_fine_microstepping);
+    RUN_TEST(test_rejects_rates_out_of_range);
+    RUN_TEST(test_stop_halts_the_pulse_train);
+    RUN_TEST(test_concurrent_commands_end_in_last_state);
+    return UNITY_END();
+}
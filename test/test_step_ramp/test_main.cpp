@@ -0,0 +1,275 @@
+/** -----------------------------------------------------------------------------------------------------
+ * @file test_main.cpp
+ *
+ * @brief Ramp tables and their playback: profile, time to full flow, stop ramp and mid-ramp stop/start
+ * @version 0.1
+ * @date 2024-2025
+ *  ----------------------------------------------------------------------------------------------------- **/
+
+/** -----------------------------------------------------------------------------------------------------
+ * $ INCLUDES
+ *  ----------------------------------------------------------------------------------------------------- **/
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include <unity.h>
+
+#include "hal_native.h"
+#include "step_engine.h"
+#include "step_ramp.h"
+
+/** -----------------------------------------------------------------------------------------------------
+ * $ GLOBAL VARIABLES
+ *  ----------------------------------------------------------------------------------------------------- **/
+
+// The pump ramp of main.cpp, MOTOR_START_RPM to MOTOR_RPM at MOTOR_ACCELERATION rpm/s
+constexpr static const double   STEPS_PER_REV = MOTOR_STEPS_PER_REV * MOTOR_MICROSTEPS;
+constexpr static const double   START_RATE    = MOTOR_START_RPM * STEPS_PER_REV / 60.0;
+constexpr static const double   TARGET_RATE   = MOTOR_RPM * STEPS_PER_REV / 60.0;
+constexpr static const double   ACCELERATION  = MOTOR_ACCELERATION * STEPS_PER_REV / 60.0;
+constexpr static const uint16_t RAMP_STEPS    = step_ramp_length(START_RATE, TARGET_RATE, ACCELERATION);
+constexpr static const auto     ramp_table_s  = make_step_ramp<RAMP_STEPS>(START_RATE, TARGET_RATE, ACCELERATION);
+
+constexpr static const uint32_t SLACK_US     = 20'000;  // Host wake-ups, the RMT has none
+constexpr static const uint32_t TICK_WAIT_MS = 500;     // What pump_control_task passes between ticks
+constexpr static const uint32_t WAKE_US      = 1'000;   // MOTOR_WAKE_US of main.cpp
+
+static StepEngine step_engine_s(hal::step_generator(), ramp_table_s.ramp());
+
+/** -----------------------------------------------------------------------------------------------------
+ * $ FUNCTION DECLARATIONS
+ *  ----------------------------------------------------------------------------------------------------- **/
+
+// main.cpp, pump_control_task drives the driver pins through them
+bool     run_motor(bool run);
+void     sleep_motor_driver();
+uint32_t settle_motor(uint32_t wait_ms);
+
+void setUp() { hal::native::step_timing_reset(); }
+
+void tearDown()
+{
+    step_engine_s.stop();
+    std::this_thread::sleep_for(std::chrono::microseconds(ramp_table_s.duration() + SLACK_US));
+}
+
+void sleep_us(uint32_t microseconds) { std::this_thread::sleep_for(std::chrono::microseconds(microseconds)); }
+
+/**
+ * @brief Ramp time the engine plays for interval, the ramp ends at the first step as fast as the cruise
+ *
+ */
+uint32_t ramp_time_us(uint32_t interval) { return ramp_table_s.elapsed[ramp_table_s.ramp().position_of(interval)]; }
+
+/**
+ * @brief Check a table against the constant acceleration it was built for
+ *
+ */
+template <uint16_t COUNT>
+void check_profile(const StepRampTable<COUNT>& table, double start_sps, double target_sps, double acceleration)
+{
+    constexpr double tick_hz = hal::StepGenerator::STEP_TICK_HZ;
+
+    TEST_ASSERT_EQUAL_UINT32(0, table.elapsed[0]);
+    for (uint16_t n = 0; n < COUNT; n++)
+    {
+        // Speeds up monotonically and never passes the cruise speed
+        if (n > 0) { TEST_ASSERT_LESS_OR_EQUAL_UINT32(table.intervals[n - 1], table.intervals[n]); }
+        TEST_ASSERT_TRUE(table.intervals[n] + 0.5 >= tick_hz / target_sps);
+        TEST_ASSERT_EQUAL_UINT32(table.elapsed[n] + table.intervals[n], table.elapsed[n + 1]);
+
+        // Each step ends where constant acceleration puts it, rounding does not accumulate
+        double exact = (sqrt(start_sps * start_sps + 2.0 * acceleration * (n + 1)) - start_sps) / acceleration;
+        if (n + 1 < COUNT) { TEST_ASSERT_TRUE(fabs(table.elapsed[n + 1] - exact * tick_hz) <= (n + 1) * 0.5); }
+    }
+
+    // v = v0 + a t, the last step may be stretched to the cruise interval
+    double duration_us = (target_sps - start_sps) / acceleration * tick_hz;
+    TEST_ASSERT_TRUE(fabs(table.duration() - duration_us) < tick_hz / target_sps + 1.0);
+
+    char message[160];
+    snprintf(message,
+             sizeof(message),
+             "%.0f -> %.0f steps/s at %.0f steps/s^2: %u steps, first %u us, last %u us, %.1f ms to full speed",
+             start_sps,
+             target_sps,
+             acceleration,
+             COUNT,
+             table.intervals[0],
+             table.intervals[COUNT - 1],
+             table.duration() / 1'000.0);
+    TEST_MESSAGE(message);
+}
+
+void test_pump_ramp_profile() { check_profile(ramp_table_s, START_RATE, TARGET_RATE, ACCELERATION); }
+
+void test_microstepping_ramp_profiles()
+{
+    // 1/8 and 1/16 microstepping at the pump speeds, what a higher MOTOR_MICROSTEPS would build
+    constexpr uint16_t eighth_steps = step_ramp_length(200.0, 600.0, 1'200.0 * 8);
+    constexpr auto     eighth       = make_step_ramp<eighth_steps>(200.0, 600.0, 1'200.0 * 8);
+    check_profile(eighth, 200.0, 600.0, 1'200.0 * 8);
+
+    constexpr uint16_t sixteenth_steps = step_ramp_length(800.0, 2'400.0, 4'800.0 * 4);
+    constexpr auto     sixteenth       = make_step_ramp<sixteenth_steps>(800.0, 2'400.0, 4'800.0 * 4);
+    check_profile(sixteenth, 800.0, 2'400.0, 4'800.0 * 4);
+
+    TEST_ASSERT_EQUAL_UINT16(0, step_ramp_length(600.0, 600.0, 1'000.0));
+}
+
+void test_time_to_full_flow()
+{
+    TEST_ASSERT_TRUE(step_engine_s.start(TARGET_RATE));
+    sleep_us(ramp_table_s.duration() + SLACK_US * 2);
+
+    hal::native::StepTiming timing  = hal::native::step_timing();
+    uint32_t                ramp_us = ramp_time_us(step_engine_s.step_interval());
+    char                    message[160];
+    snprintf(message,
+             sizeof(message),
+             "full flow after %.1f ms (ramp %.1f ms), %u steps, ramp and cruise jitter rms %.1f us",
+             timing.full_speed_us / 1'000.0,
+             ramp_us / 1'000.0,
+             timing.steps,
+             timing.jitter_rms_us);
+    TEST_MESSAGE(message);
+
+    TEST_ASSERT_TRUE(timing.full_speed_us >= ramp_us);
+    TEST_ASSERT_TRUE(timing.full_speed_us < ramp_us + SLACK_US);
+    TEST_ASSERT_EQUAL_UINT32(step_engine_s.step_interval(), timing.interval);
+}
+
+void test_stop_plays_the_ramp_down()
+{
+    step_engine_s.start(TARGET_RATE);
+    sleep_us(ramp_table_s.duration() + SLACK_US);
+
+    uint32_t interval      = step_engine_s.step_interval();
+    uint32_t steps_at_stop = hal::native::step_timing().steps;
+    step_engine_s.stop();
+
+    // The ramp back to the start speed plus the cruise step in progress
+    uint32_t standstill_us = step_engine_s.time_to_standstill_us();
+    TEST_ASSERT_TRUE(standstill_us > ramp_time_us(interval));
+    TEST_ASSERT_TRUE(standstill_us <= ramp_time_us(interval) + interval);
+
+    sleep_us(standstill_us + SLACK_US);
+    TEST_ASSERT_EQUAL_UINT32(0, step_engine_s.time_to_standstill_us());
+
+    uint32_t steps_after = hal::native::step_timing().steps;
+    TEST_ASSERT_UINT32_WITHIN(1, ramp_table_s.ramp().position_of(interval), steps_after - steps_at_stop);
+    sleep_us(SLACK_US);
+    TEST_ASSERT_EQUAL_UINT32(steps_after, hal::native::step_timing().steps);
+}
+
+void test_mid_ramp_stop_and_restart()
+{
+    // Stop halfway up, the ramp down starts from where the motor is instead of the top
+    step_engine_s.start(TARGET_RATE);
+    sleep_us(ramp_table_s.duration() / 2);
+    step_engine_s.stop();
+
+    uint32_t standstill_us = step_engine_s.time_to_standstill_us();
+    TEST_ASSERT_TRUE(standstill_us > ramp_table_s.duration() / 4);
+    TEST_ASSERT_TRUE(standstill_us < ramp_table_s.duration() * 3 / 4);
+
+    // Restart halfway down, the ramp up continues from there and reaches full speed early
+    sleep_us(standstill_us / 2);
+    hal::native::step_timing_reset();
+    step_engine_s.start(TARGET_RATE);
+    TEST_ASSERT_EQUAL_UINT32(UINT32_MAX, step_engine_s.time_to_standstill_us());
+    sleep_us(ramp_table_s.duration() + SLACK_US);
+
+    hal::native::StepTiming timing  = hal::native::step_timing();
+    uint32_t                ramp_us = ramp_time_us(step_engine_s.step_interval());
+    char                    message[120];
+    snprintf(message,
+             sizeof(message),
+             "restart halfway down the stop ramp: full flow after %.1f ms (from standstill %.1f ms)",
+             timing.full_speed_us / 1'000.0,
+             ramp_us / 1'000.0);
+    TEST_MESSAGE(message);
+
+    // About a quarter of the ramp is still behind it
+    TEST_ASSERT_TRUE(timing.full_speed_us > 0);
+    TEST_ASSERT_TRUE(timing.full_speed_us < ramp_us - ramp_us / 8);
+}
+
+void test_driver_stays_enabled_until_standstill()
+{
+    TEST_ASSERT_TRUE(run_motor(true));
+    sleep_us(ramp_table_s.duration() + SLACK_US);
+    TEST_ASSERT_TRUE(hal::native::pin_state(MOTOR_SLEEP_PIN));
+
+    // The driver must still be awake for the deceleration pulses
+    run_motor(false);
+    uint32_t wait_ms = settle_motor(TICK_WAIT_MS);
+    TEST_ASSERT_TRUE(wait_ms > 0 && wait_ms <= (ramp_table_s.duration() + 999) / 1'000 + 1);
+    TEST_ASSERT_TRUE(hal::native::pin_state(MOTOR_SLEEP_PIN));
+    TEST_ASSERT_FALSE(hal::native::pin_state(MOTOR_ENABLE_PIN));
+
+    // Waiting as long as settle_motor() asks is enough
+    sleep_us(wait_ms * 1'000);
+    TEST_ASSERT_EQUAL_UINT32(TICK_WAIT_MS, settle_motor(TICK_WAIT_MS));
+    TEST_ASSERT_FALSE(hal::native::pin_state(MOTOR_SLEEP_PIN));
+    TEST_ASSERT_TRUE(hal::native::pin_state(MOTOR_ENABLE_PIN));
+}
+
+void test_driver_wake_up_delays_the_first_step_not_the_caller()
+{
+    uint64_t start_us = hal::micros();
+    TEST_ASSERT_TRUE(run_motor(true));
+    uint32_t call_us = static_cast<uint32_t>(hal::micros() - start_us);
+    TEST_ASSERT_TRUE(hal::native::pin_state(MOTOR_SLEEP_PIN));
+    sleep_us(20'000);
+
+    std::vector<uint64_t> steps      = hal::native::step_timestamps();
+    uint32_t              first_step = steps.empty() ? 0 : static_cast<uint32_t>(steps.front() - start_us);
+
+    char message[100];
+    snprintf(message, sizeof(message), "run_motor(true) returned after %u us, first step %u us", call_us, first_step);
+    TEST_MESSAGE(message);
+
+    // pump_control_task goes back to its queue at once, the generator waits for the driver
+    TEST_ASSERT_LESS_THAN_UINT32(WAKE_US / 2, call_us);
+    TEST_ASSERT_FALSE(steps.empty());
+    TEST_ASSERT_GREATER_OR_EQUAL_UINT32(WAKE_US, first_step);
+    TEST_ASSERT_LESS_THAN_UINT32(WAKE_US + ramp_table_s.intervals[0] + SLACK_US, first_step);
+
+    run_motor(false);
+    sleep_motor_driver();
+}
+
+void test_fault_cuts_the_driver_at_once()
+{
+    TEST_ASSERT_TRUE(run_motor(true));
+    sleep_us(ramp_table_s.duration() / 2);
+
+    run_motor(false);
+    sleep_motor_driver();
+    TEST_ASSERT_FALSE(hal::native::pin_state(MOTOR_SLEEP_PIN));
+    TEST_ASSERT_TRUE(hal::native::pin_state(MOTOR_ENABLE_PIN));
+    TEST_ASSERT_EQUAL_UINT32(TICK_WAIT_MS, settle_motor(TICK_WAIT_MS));
+}
+
+int main(int argc, char** argv)
+{
+    step_engine_s.begin(MOTOR_STEP_PIN, MOTOR_DIRECTION_PIN, false);
+
+    UNITY_BEGIN();
+    RUN_TEST(test_pump_ramp_profile);
+    RUN_TEST(test_microstepping_ramp_profiles);
+    RUN_TEST(test_time_to_full_flow);
+    RUN_TEST(test_stop_plays_the_ramp_down);
+    RUN_TEST(test_mid_ramp_stop_and_restart);
+    RUN_TEST(test_driver_stays_enabled_until_standstill);
+    RUN_TEST(test_driver_wake_up_delays_the_first_step_not_the_caller);
+    RUN_TEST(test_fault_cuts_the_driver_at_once);
+    return UNITY_END();
+}
@@ -0,0 +1,155 @@
+/** -----------------------------------------------------------------------------------------------------
+ * @file test_main.cpp
+ *
+ * @brief Heap allocations of the sampling path: get_turbidity_data and its JSON and TFT formatting must make none
+ * @version 0.1
+ * @date 2024-2025
+ *  ----------------------------------------------------------------------------------------------------- **/
+
+/** -----------------------------------------------------------------------------------------------------
+ * $ INCLUDES
+ *  ----------------------------------------------------------------------------------------------------- **/
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <atomic>
+#include <new>
+#include <string>
+
+#include <unity.h>
+
+#include "text_buffer.h"
+
+/** -----------------------------------------------------------------------------------------------------
+ * $ GLOBAL VARIABLES
+ *  ----------------------------------------------------------------------------------------------------- **/
+
+static std::atomic<uint32_t> allocations_s = 0;
+
+/** -----------------------------------------------------------------------------------------------------
+ * $ FUNCTION DECLARATIONS
+ *  ----------------------------------------------------------------------------------------------------- **/
+
+// Every allocation of the process goes through these, std::string and friends included
+void* operator new(size_t size)
+{
+    allocations_s.fetch_add(1, std::memory_order_relaxed);
+    void* memory = malloc(size > 0 ? size : 1);
+    if (memory == nullptr) { throw std::bad_alloc(); }
+    return memory;
+}
+
+void* operator new[](size_t size)
+{
+    return operator new(size);
+}
+
+void operator delete(void* memory) noexcept
+{
+    free(memory);
+}
+
+void operator delete[](void* memory) noexcept
+{
+    free(memory);
+}
+
+void operator delete(void* memory, size_t size) noexcept
+{
+    free(memory);
+}
+
+void operator delete[](void* memory, size_t size) noexcept
+{
+    free(memory);
+}
+
+#ifdef __GLIBC__
+// And C allocations, like the malloc inside an Arduino String on the board
+extern "C" void* __libc_malloc(size_t size);
+extern "C" void* __libc_calloc(size_t count, size_t size);
+extern "C" void* __libc_realloc(void* memory, size_t size);
+
+extern "C" void* malloc(size_t size)
+{
+    allocations_s.fetch_add(1, std::memory_order_relaxed);
+    return __libc_malloc(size);
+}
+
+extern "C" void* calloc(size_t count, size_t size)
+{
+    allocations_s.fetch_add(1, std::memory_order_relaxed);
+    return __libc_calloc(count, size);
+}
+
+extern "C" void* realloc(void* memory, size_t size)
+{
+    allocations_s.fetch_add(1, std::memory_order_relaxed);
+    return __libc_realloc(memory, size);
+}
+#endif
+
+// The sampling path in main.cpp. Without setup() there are no display and pump queues, each sample logs the drop
+bool get_turbidity_data(uint16_t curr_sensor_value, bool serial_print, bool tft_print);
+
+void setUp() {}
+void tearDown() {}
+
+void test_allocations_are_counted()
+{
+    uint32_t    before = allocations_s.load();
+    std::string text(64, 'x');
+    TEST_ASSERT_GREATER_THAN_UINT32(before, allocations_s.load());
+}
+
+void test_text_buffer_formats_in_place()
+{
+    TextBuffer<64> text;
+
+    uint32_t before = allocations_s.load();
+    text.append("{\"turbidity\": ").append(229.14F, 2).append(", \"voltage\": ").append(2.7349F, 2).append('}');
+    uint32_t after = allocations_s.load();
+
+    TEST_ASSERT_EQUAL_STRING("{\"turbidity\": 229.14, \"voltage\": 2.73}", text.c_str());
+    TEST_ASSERT_EQUAL_UINT32(0, after - before);
+}
+
+void test_text_buffer_truncates_instead_of_growing()
+{
+    TextBuffer<8> text;
+    text.append("0123456789").append(static_cast<uint32_t>(42));
+
+    TEST_ASSERT_EQUAL(7, text.size());
+    TEST_ASSERT_EQUAL_STRING("0123456", text.c_str());
+}
+
+void test_sampling_path_makes_no_allocations()
+{
+    // The first samples may set up statics, the count starts after them
+    for (uint16_t i = 0; i < 16; i++) { get_turbidity_data(static_cast<uint16_t>(3'000 + i), false, true); }
+
+    uint32_t before = allocations_s.load();
+    for (uint16_t i = 0; i < 200; i++)
+    {
+        // Alternating codes, so every sample changes the average and also formats the TFT rows
+        get_turbidity_data(static_cast<uint16_t>(i % 2 == 0 ? 3'100 : 3'400), false, true);
+    }
+    uint32_t after = allocations_s.load();
+
+    char message[64];
+    snprintf(message, sizeof(message), "%u allocations in 200 samples", after - before);
+    TEST_MESSAGE(message);
+    TEST_ASSERT_EQUAL_UINT32(0, after - before);
+}
+
+int main(int argc, char** argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_allocations_are_counted);
+    RUN_TEST(test_text_buffer_formats_in_place);
+    RUN_TEST(test_text_buffer_truncates_instead_of_growing);
+    RUN_TEST(test_sampling_path_makes_no_allocations);
+    return UNITY_END();
+}
@@ -0,0 +1,242 @@
+/** -----------------------------------------------------------------------------------------------------
+ * @file test_main.cpp
+ *
+ * @brief Scripted touch sequences: one event per press from TouchGestures and through the interrupt-driven renderer
+ * @version 0.1
+ * @date 2024-2025
+ *  ----------------------------------------------------------------------------------------------------- **/
+
+/** -----------------------------------------------------------------------------------------------------
+ * $ INCLUDES
+ *  ----------------------------------------------------------------------------------------------------- **/
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include <chrono>
+#include <initializer_list>
+#include <thread>
+#include <vector>
+
+#include <unity.h>
+
+#include "display_renderer.h"
+#include "hal_native.h"
+#include "touch_gestures.h"
+
+/** -----------------------------------------------------------------------------------------------------
+ * $ GLOBAL VARIABLES
+ *  ----------------------------------------------------------------------------------------------------- **/
+
+constexpr static const TouchGestures::Config GESTURES  = DisplayRenderer::TOUCH_GESTURES;
+constexpr static const uint32_t              PERIOD_MS = DisplayRenderer::TOUCH_PERIOD_MS;
+
+/**
+ * @brief One step of a script: the panel reads is_touched at x, y for duration_ms
+ *
+ */
+struct TouchStep
+{
+    uint32_t duration_ms;
+    bool     is_touched;
+    uint16_t x;
+    uint16_t y;
+};
+
+static const DisplayWidget widgets_s[] = {
+    {{0, 0, 120, 60}, nullptr, 1, 1, 8, false, true},
+};
+
+static DisplayRenderer renderer_s(hal::display(), widgets_s, 1);
+
+/** -----------------------------------------------------------------------------------------------------
+ * $ FUNCTION DECLARATIONS
+ *  ----------------------------------------------------------------------------------------------------- **/
+
+void setUp() {}
+void tearDown() {}
+
+/**
+ * @brief Sample the script every PERIOD_MS like the render task does, followed by a second without touch
+ *
+ */
+std::vector<TouchEvent> play(std::initializer_list<TouchStep> script)
+{
+    TouchGestures           gestures(GESTURES);
+    std::vector<TouchEvent> events;
+    uint32_t                now_ms  = 1'000;
+    uint32_t                step_ms = now_ms;
+
+    std::vector<TouchStep> steps(script);
+    steps.push_back({1'000, false, 0, 0});
+    for (const TouchStep& step : steps)
+    {
+        step_ms += step.duration_ms;
+        for (; now_ms < step_ms; now_ms += PERIOD_MS)
+        {
+            TouchEvent event;
+            if (gestures.update(step.is_touched, step.x, step.y, now_ms, event)) { events.push_back(event); }
+        }
+    }
+
+    TEST_ASSERT_FALSE(gestures.is_active());
+    return events;
+}
+
+void test_tap_is_one_event()
+{
+    std::vector<TouchEvent> events = play({{120, true, 50, 60}});
+    TEST_ASSERT_EQUAL_UINT32(1, events.size());
+    TEST_ASSERT_EQUAL_UINT8(TOUCH_TAP, events[0].type);
+    TEST_ASSERT_EQUAL_UINT16(50, events[0].x);
+    TEST_ASSERT_EQUAL_UINT16(60, events[0].y);
+    TEST_ASSERT_UINT32_WITHIN(PERIOD_MS, 120, events[0].duration_ms);
+}
+
+void test_bounces_are_no_press()
+{
+    // Contacts shorter than press_ms, one sample each
+    std::vector<TouchEvent> events =
+        play({{PERIOD_MS, true, 50, 60}, {100, false, 0, 0}, {PERIOD_MS, true, 50, 60}, {100, false, 0, 0}});
+    TEST_ASSERT_EQUAL_UINT32(0, events.size());
+}
+
+void test_dropouts_do_not_split_a_press()
+{
+    // The pressure drops out for a sample during a hold, shorter than release_ms
+    std::vector<TouchEvent> events = play({{100, true, 50, 60},
+                                           {PERIOD_MS, false, 0, 0},
+                                           {100, true, 52, 61},
+                                           {PERIOD_MS * 2, false, 0, 0},
+                                           {100, true, 51, 60}});
+    TEST_ASSERT_EQUAL_UINT32(1, events.size());
+    TEST_ASSERT_EQUAL_UINT8(TOUCH_TAP, events[0].type);
+}
+
+void test_long_press_is_one_event_while_held()
+{
+    std::vector<TouchEvent> events = play({{3'000, true, 50, 60}});
+    TEST_ASSERT_EQUAL_UINT32(1, events.size());
+    TEST_ASSERT_EQUAL_UINT8(TOUCH_LONG_PRESS, events[0].type);
+    TEST_ASSERT_UINT32_WITHIN(PERIOD_MS, GESTURES.long_press_ms, events[0].duration_ms);
+}
+
+void test_swipe_reports_direction()
+{
+    std::vector<TouchEvent> events =
+        play({{60, true, 100, 60}, {60, true, 130, 62}, {60, true, 160, 64}, {60, true, 190, 66}});
+    TEST_ASSERT_EQUAL_UINT32(1, events.size());
+    TEST_ASSERT_EQUAL_UINT8(TOUCH_SWIPE, events[0].type);
+    TEST_ASSERT_EQUAL_INT32(90, events[0].dx);
+    TEST_ASSERT_EQUAL_INT32(6, events[0].dy);
+
+    // A slow drag held past long_press_ms is still a swipe, not a long press
+    events = play({{500, true, 100, 60}, {500, true, 150, 60}, {500, true, 200, 60}});
+    TEST_ASSERT_EQUAL_UINT32(1, events.size());
+    TEST_ASSERT_EQUAL_UINT8(TOUCH_SWIPE, events[0].type);
+}
+
+void test_presses_in_a_row_are_one_event_each()
+{
+    std::vector<TouchEvent> events = play({{80, true, 10, 10},
+                                           {100, false, 0, 0},
+                                           {80, true, 20, 20},
+                                           {100, false, 0, 0},
+                                           {1'000, true, 30, 30},
+                                           {100, false, 0, 0},
+                                           {80, true, 40, 40}});
+    TEST_ASSERT_EQUAL_UINT32(4, events.size());
+    TEST_ASSERT_EQUAL_UINT8(TOUCH_TAP, events[0].type);
+    TEST_ASSERT_EQUAL_UINT8(TOUCH_TAP, events[1].type);
+    TEST_ASSERT_EQUAL_UINT8(TOUCH_LONG_PRESS, events[2].type);
+    TEST_ASSERT_EQUAL_UINT8(TOUCH_TAP, events[3].type);
+    TEST_ASSERT_EQUAL_UINT16(40, events[3].x);
+}
+
+/**
+ * @brief Press the fake panel: the IRQ line goes low with the touch and back high on release
+ *
+ */
+void press(uint16_t x, uint16_t y, uint32_t hold_ms)
+{
+    hal::native::set_touch(true, x, y);
+    hal::native::set_pin_input(TOUCH_IRQ_PIN, false);
+    std::this_thread::sleep_for(std::chrono::milliseconds(hold_ms));
+    hal::native::set_touch(false);
+    hal::native::set_pin_input(TOUCH_IRQ_PIN, true);
+}
+
+uint32_t take_events(TouchEvent* events, uint32_t capacity)
+{
+    uint32_t count = 0;
+    while (count < capacity && renderer_s.take_touch(events[count], 300)) { count++; }
+    return count;
+}
+
+void test_renderer_reads_the_panel_only_while_touched()
+{
+    // Idle: the render task sleeps on its queue, no SPI transaction reads the touch controller
+    uint32_t reads = hal::native::touch_reads();
+    std::this_thread::sleep_for(std::chrono::milliseconds(300));
+    TEST_ASSERT_EQUAL_UINT32(reads, hal::native::touch_reads());
+
+    press(50, 30, 150);
+    TouchEvent events[4];
+    TEST_ASSERT_EQUAL_UINT32(1, take_events(events, 4));
+    TEST_ASSERT_EQUAL_UINT8(TOUCH_TAP, events[0].type);
+    TEST_ASSERT_EQUAL_INT32(0, renderer_s.hit_test(events[0].x, events[0].y));
+
+    // Sampled while the press lasted and until the release was debounced, then idle again
+    uint32_t press_reads = hal::native::touch_reads() - reads;
+    std::this_thread::sleep_for(std::chrono::milliseconds(300));
+    uint32_t idle_reads = hal::native::touch_reads() - reads - press_reads;
+
+    char message[100];
+    snprintf(message, sizeof(message), "touch reads: %u for a 150 ms tap, %u in 300 ms idle", press_reads, idle_reads);
+    TEST_MESSAGE(message);
+    TEST_ASSERT_TRUE(press_reads <= (150 + GESTURES.release_ms) / PERIOD_MS + 3);
+    TEST_ASSERT_EQUAL_UINT32(0, idle_reads);
+}
+
+void test_renderer_delivers_one_event_per_press()
+{
+    TouchEvent events[8];
+
+    press(50, 30, 1'000);
+    TEST_ASSERT_EQUAL_UINT32(1, take_events(events, 8));
+    TEST_ASSERT_EQUAL_UINT8(TOUCH_LONG_PRESS, events[0].type);
+
+    for (uint8_t i = 0; i < 3; i++)
+    {
+        press(10 + i * 10, 30, 100);
+        std::this_thread::sleep_for(std::chrono::milliseconds(150));
+    }
+    TEST_ASSERT_EQUAL_UINT32(3, take_events(events, 8));
+    for (uint8_t i = 0; i < 3; i++)
+    {
+        TEST_ASSERT_EQUAL_UINT8(TOUCH_TAP, events[i].type);
+        TEST_ASSERT_EQUAL_UINT16(10 + i * 10, events[i].x);
+    }
+
+    // A bounce of a few milliseconds wakes the task but is no press
+    press(50, 30, 3);
+    TEST_ASSERT_EQUAL_UINT32(0, take_events(events, 8));
+}
+
+int main(int argc, char** argv)
+{
+    hal::native::set_pin_input(TOUCH_IRQ_PIN, true);
+    renderer_s.begin(TOUCH_IRQ_PIN);
+    std::thread([]() { renderer_s.run(0); }).detach();
+
+    UNITY_BEGIN();
+    RUN_TEST(test_tap_is_one_event);
+    RUN_TEST(test_bounces_are_no_press);
+    RUN_TEST(test_dropouts_do_not_split_a_press);
+    RUN_TEST(test_long_press_is_one_event_while_held);
+    RUN_TEST(test_swipe_reports_direction);
+    RUN_TEST(test_presses_in_a_row_are_one_event_each);
+    RUN_TEST(test_renderer_reads_the_panel_only_while_touched);
+    RUN_TEST(test_renderer_delivers_one_event_per_press);
+    return UNITY_END();
+}
@@ -0,0 +1,268 @@
+/** -----------------------------------------------------------------------------------------------------
+ * @file test_main.cpp
+ *
+ * @brief Replay of cleaning cycles: pump-on time and toggles of TrendEstimator against the mean and slope decision
+ * @version 0.1
+ * @date 2024-2025
+ *  ----------------------------------------------------------------------------------------------------- **/
+
+/** -----------------------------------------------------------------------------------------------------
+ * $ INCLUDES
+ *  ----------------------------------------------------------------------------------------------------- **/
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include <algorithm>
+#include <iterator>
+#include <random>
+#include <vector>
+
+#include <unity.h>
+
+#include "hampel_filter.h"
+#include "pump_control.h"
+#include "rolling_stats.h"
+#include "trend_estimator.h"
+
+/** -----------------------------------------------------------------------------------------------------
+ * $ GLOBAL VARIABLES
+ *  ----------------------------------------------------------------------------------------------------- **/
+
+constexpr static const float    VOLTS_PER_CODE = 3.3F / 4'096.0F;
+constexpr static const float    THRESHOLD      = TURBIDITY_VOLTAGE_THRESHOLD;
+constexpr static const uint32_t CYCLE_SAMPLES  = 900;  // 15 minutes at 1 Hz
+constexpr static const uint32_t SEEDS          = 40;
+
+// The clean decision and the pump rules of main.cpp
+constexpr static const TrendEstimator::Config TREND = {
+    .threshold      = TURBIDITY_VOLTAGE_THRESHOLD,
+    .hysteresis     = TURBIDITY_HYSTERESIS,
+    .lead_s         = TURBIDITY_TREND_LEAD_S,
+    .confidence     = 2.0F,
+    .measurement_sd = 0.01F,
+    .slope_drift    = 0.002F,
+};
+constexpr static const PumpController::Config PUMP = {
+    .use_sensor        = true,
+    .sample_timeout_ms = 5'000,
+    .invalid_limit     = 10,
+};
+
+/**
+ * @brief Cleaning cycle: the voltage rises from start_v towards end_v with time constant tau_s, noise and bubbles
+ *
+ * The shape of the recorded cycles, an exponential approach to the clean level. Synthetic, so the true threshold
+ * crossing is known.
+ */
+struct Cycle
+{
+    float start_v;
+    float end_v;
+    float tau_s;
+    float noise_v;
+};
+
+constexpr static const Cycle CYCLES[] = {
+    {1.8F, 2.95F, 40.0F, 0.005F},
+    {1.5F, 2.95F, 90.0F, 0.010F},
+    {2.2F, 2.90F, 20.0F, 0.005F},
+    {1.9F, 2.78F, 60.0F, 0.010F},
+    {2.0F, 2.76F, 120.0F, 0.015F},
+    {1.7F, 2.85F, 30.0F, 0.020F},
+};
+
+struct Replay
+{
+    float    stop_s;     // Pump-on time from the start, CYCLE_SAMPLES if it never stopped
+    uint32_t toggles;    // Changes of the clean decision, each one would switch a pump that follows it
+    float    deficit_v;  // How far below the threshold the true level was at the stop
+};
+
+/** -----------------------------------------------------------------------------------------------------
+ * $ FUNCTION DECLARATIONS
+ *  ----------------------------------------------------------------------------------------------------- **/
+
+void setUp() {}
+void tearDown() {}
+
+float true_level(const Cycle& cycle, float time_s)
+{
+    return cycle.end_v - (cycle.end_v - cycle.start_v) * expf(-time_s / cycle.tau_s);
+}
+
+/**
+ * @brief Seconds until the true level crosses the threshold
+ *
+ */
+float crossing_s(const Cycle& cycle)
+{
+    return -cycle.tau_s * logf((cycle.end_v - THRESHOLD) / (cycle.end_v - cycle.start_v));
+}
+
+/**
+ * @brief Replay one cycle through the Hampel filter, the decision and a PumpController started at sample 0
+ *
+ * @param is_trend TrendEstimator, otherwise the decision it replaced: mean over the history above the threshold
+ *                 and a least-squares slope that is not falling
+ */
+Replay replay(const Cycle& cycle, uint32_t seed, bool is_trend)
+{
+    std::mt19937                                   random(seed);
+    std::normal_distribution<float>                noise(0.0F, cycle.noise_v);
+    RollingStats<uint16_t, TURBIDITY_HISTORY_SIZE> history;
+    HampelFilter<TURBIDITY_FILTER_WINDOW>          outliers(TURBIDITY_FILTER_SIGMAS);
+    TrendEstimator                                 trend(TREND);
+    PumpController                                 controller(PUMP, false);
+
+    Replay result   = {.stop_s = CYCLE_SAMPLES, .toggles = 0, .deficit_v = 0.0F};
+    bool   was_clean = false;
+    for (uint32_t i = 0; i < CYCLE_SAMPLES; i++)
+    {
+        float   level = true_level(cycle, static_cast<float>(i));
+        int32_t code  = static_cast<int32_t>(lroundf((level + noise(random)) / VOLTS_PER_CODE));
+        if (i > 5 && random() % 40 == 0) { code -= 300 + random() % 900; }  // Bubble
+        code = std::clamp(code, 0, 4'095);
+
+        float voltage  = code * VOLTS_PER_CODE;
+        bool  is_valid = voltage > 0.0F && !outliers.push(static_cast<uint16_t>(code));
+        history.push(static_cast<uint16_t>(code), is_valid);
+        trend.update(voltage, is_valid, 1.0F);
+
+        bool is_falling = history.count() > 1 && history.slope() < 0.0F;
+        bool is_clean   = is_trend ? trend.is_clean() : history.mean() * VOLTS_PER_CODE > THRESHOLD && !is_falling;
+        if (is_clean != was_clean) { result.toggles++; }
+        was_clean = is_clean;
+
+        // Started by hand with the first sample, the first clean decision stops it
+        PumpEvent sample = {
+            .type      = PUMP_EVENT_SAMPLE,
+            .source    = PUMP_SOURCE_SAMPLER,
+            .is_valid  = is_valid,
+            .is_clean  = is_clean,
+            .posted_us = 0,
+        };
+        controller.handle(sample, i * 1'000);
+        if (i == 0) { controller.handle({.type = PUMP_EVENT_START, .source = PUMP_SOURCE_TOUCH}, 0); }
+        if (!controller.is_pumping() && result.stop_s == CYCLE_SAMPLES)
+        {
+            result.stop_s    = static_cast<float>(i);
+            result.deficit_v = THRESHOLD - level;
+        }
+    }
+
+    return result;
+}
+
+/**
+ * @brief Replay every cycle SEEDS times with both decisions, report and check the trend estimator
+ *
+ */
+void test_replay_cleaning_cycles()
+{
+    float    saved_s       = 0.0F;
+    uint32_t mean_toggles  = 0;
+    uint32_t trend_toggles = 0;
+
+    for (const Cycle& cycle : CYCLES)
+    {
+        std::vector<float> mean_delays;
+        std::vector<float> trend_delays;
+        float              worst_deficit_v = -1.0F;
+        for (uint32_t seed = 0; seed < SEEDS; seed++)
+        {
+            Replay mean  = replay(cycle, seed, false);
+            Replay trend = replay(cycle, seed, true);
+            mean_delays.push_back(mean.stop_s - crossing_s(cycle));
+            trend_delays.push_back(trend.stop_s - crossing_s(cycle));
+            mean_toggles += mean.toggles;
+            trend_toggles += trend.toggles;
+            saved_s += mean.stop_s - trend.stop_s;
+            worst_deficit_v = fmaxf(worst_deficit_v, trend.deficit_v);
+
+            // Clean once, never back to dirty while the water keeps clearing
+            TEST_ASSERT_EQUAL_UINT32(1, trend.toggles);
+        }
+
+        std::sort(mean_delays.begin(), mean_delays.end());
+        std::sort(trend_delays.begin(), trend_delays.end());
+        float mean_median  = mean_delays[SEEDS / 2];
+        float trend_median = trend_delays[SEEDS / 2];
+
+        char message[160];
+        snprintf(message,
+                 sizeof(message),
+                 "%.1f -> %.2f V, tau %3.0f s, noise %2.0f mV: stop %+5.1f s after the crossing, at worst %3.0f mV "
+                 "short (mean and slope %+5.1f s)",
+                 static_cast<double>(cycle.start_v),
+                 static_cast<double>(cycle.end_v),
+                 static_cast<double>(cycle.tau_s),
+                 static_cast<double>(cycle.noise_v * 1'000.0F),
+                 static_cast<double>(trend_median),
+                 static_cast<double>(worst_deficit_v * 1'000.0F),
+                 static_cast<double>(mean_median));
+        TEST_MESSAGE(message);
+
+        // An early stop stays within the hysteresis band and the noise the estimator is not tuned for
+        TEST_ASSERT_TRUE(worst_deficit_v < TURBIDITY_HYSTERESIS + cycle.noise_v);
+
+        // The lag of the mean dominates on fast cycles, slow ones wait until the crossing is certain
+        if (cycle.tau_s <= 40.0F) { TEST_ASSERT_TRUE(trend_median < mean_median); }
+    }
+
+    constexpr float replays = SEEDS * std::size(CYCLES);
+    char            message[120];
+    snprintf(message,
+             sizeof(message),
+             "per cycle: pump-on time saved %+.1f s, clean decision changes %.2f (mean and slope %.2f)",
+             static_cast<double>(saved_s / replays),
+             static_cast<double>(trend_toggles / replays),
+             static_cast<double>(mean_toggles / replays));
+    TEST_MESSAGE(message);
+}
+
+void test_noise_at_the_threshold_does_not_toggle()
+{
+    // Clean water right at the threshold: the clean decision may change once, not with every noisy sample
+    std::mt19937                    random(5);
+    std::normal_distribution<float> noise(0.0F, 0.01F);
+    TrendEstimator                  trend(TREND);
+    uint32_t                        changes   = 0;
+    bool                            was_clean = false;
+
+    for (uint32_t i = 0; i < 3'600; i++)
+    {
+        trend.update(THRESHOLD + noise(random), true, 1.0F);
+        if (trend.is_clean() != was_clean) { changes++; }
+        was_clean = trend.is_clean();
+    }
+
+    TEST_ASSERT_LESS_OR_EQUAL_UINT32(1, changes);
+}
+
+void test_slope_follows_a_ramp()
+{
+    // 10 mV/s, invalid samples only advance the prediction
+    TrendEstimator trend(TREND);
+    for (uint32_t i = 0; i < 100; i++) { trend.update(2.0F + 0.01F * i, i % 10 != 7, 1.0F); }
+
+    TEST_ASSERT_FLOAT_WITHIN(0.001F, 0.01F, trend.slope());
+    TEST_ASSERT_FLOAT_WITHIN(0.01F, 2.0F + 0.01F * 99, trend.level());
+    TEST_ASSERT_TRUE(trend.is_rising());
+    TEST_ASSERT_FALSE(trend.is_falling());
+
+    // The slope is per second, whatever the sample rate
+    TrendEstimator fast(TREND);
+    for (uint32_t i = 0; i < 1'000; i++) { fast.update(2.0F + 0.001F * i, true, 0.1F); }
+    TEST_ASSERT_FLOAT_WITHIN(0.001F, 0.01F, fast.slope());
+}
+
+int main(int argc, char** argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_replay_cleaning_cycles);
+    RUN_TEST(test_noise_at_the_threshold_does_not_toggle);
+    RUN_TEST(test_slope_follows_a_ramp);
+    return UNITY_END();
+}
@@ -0,0 +1,250 @@
+/** -----------------------------------------------------------------------------------------------------
+ * @file test_main.cpp
+ *
+ * @brief TurbidityTable against the float sensor formulas it replaces, and its per-device calibration
+ * @version 0.1
+ * @date 2024-2025
+ *  ----------------------------------------------------------------------------------------------------- **/
+
+/** -----------------------------------------------------------------------------------------------------
+ * $ INCLUDES
+ *  ----------------------------------------------------------------------------------------------------- **/
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include <chrono>
+
+#include <unity.h>
+
+#include "hal.h"
+#include "turbidity_table.h"
+
+/** -----------------------------------------------------------------------------------------------------
+ * $ GLOBAL VARIABLES
+ *  ----------------------------------------------------------------------------------------------------- **/
+
+// The stated bound: half an entry unit, plus the float rounding of unit * steps
+constexpr static const float VOLTAGE_BOUND = TURBIDITY_VOLTAGE_UNIT / 2.0F + 1e-6F;
+constexpr static const float NTU_BOUND     = TURBIDITY_NTU_UNIT / 2.0F + 1e-3F;
+
+// Below data/log, which .gitignore keeps out of the repository
+constexpr static const char* CALIBRATION_PATH = "/log/test_turbidity.cal";
+
+/**
+ * @brief Coefficients of to_ntu_raw() in main.cpp, for the 3.3 V and the 5 V sensor
+ *
+ */
+struct SensorFormulas
+{
+    float input_voltage;
+    float square;
+    float linear;
+    float offset;
+};
+
+constexpr static const SensorFormulas SENSOR_3V3 = {3.3F, -2'572.2F, 8'700.5F, 4'352.9F};
+constexpr static const SensorFormulas SENSOR_5V  = {5.0F, -1'120.4F, 5'742.3F, 4'352.9F};
+
+/** -----------------------------------------------------------------------------------------------------
+ * $ FUNCTION DECLARATIONS
+ *  ----------------------------------------------------------------------------------------------------- **/
+
+/**
+ * @brief to_voltage() and to_ntu() of main.cpp as they were before the table, the reference
+ *
+ */
+constexpr float formula_voltage(const SensorFormulas& sensor, uint16_t code)
+{
+    float voltage = static_cast<float>(code) * (sensor.input_voltage / 4096.0F);
+    return voltage < 0 ? 0 : voltage;
+}
+
+constexpr float formula_ntu(const SensorFormulas& sensor, float voltage)
+{
+    float ntu = voltage < (sensor.input_voltage / 2.0F)
+                    ? 3000.0F
+                    : (sensor.square * (voltage * voltage) + sensor.linear * voltage - sensor.offset);
+    return ntu < 0.0F ? 0.0F : ntu > 3000.0F ? 3000.0F : ntu;
+}
+
+constexpr static const TurbidityEntries entries_3v3_s =
+    make_turbidity_entries([](uint16_t code) { return formula_voltage(SENSOR_3V3, code); },
+                           [](float voltage) { return formula_ntu(SENSOR_3V3, voltage); });
+constexpr static const TurbidityEntries entries_5v_s =
+    make_turbidity_entries([](uint16_t code) { return formula_voltage(SENSOR_5V, code); },
+                           [](float voltage) { return formula_ntu(SENSOR_5V, voltage); });
+
+#if TURBIDITY_SENSOR_3V3
+constexpr static const SensorFormulas&   SENSOR    = SENSOR_3V3;
+constexpr static const TurbidityEntries& entries_s = entries_3v3_s;
+#else
+constexpr static const SensorFormulas&   SENSOR    = SENSOR_5V;
+constexpr static const TurbidityEntries& entries_s = entries_5v_s;
+#endif
+
+void setUp()
+{
+    TEST_ASSERT_TRUE(hal::fs_mount());
+    hal::fs_mkdir("/log");
+}
+
+void tearDown() { hal::fs_remove(CALIBRATION_PATH); }
+
+void write_calibration(const char* text)
+{
+    FILE* file = hal::fs_open(CALIBRATION_PATH, "w");
+    TEST_ASSERT_NOT_NULL(file);
+    fputs(text, file);
+    fclose(file);
+}
+
+/**
+ * @brief Largest deviation of the table from the formulas over all 4096 codes
+ *
+ */
+void check_against_formulas(const SensorFormulas& sensor, const TurbidityEntries& entries, const char* name)
+{
+    TurbidityTable table(entries);
+    float          voltage_error = 0.0F;
+    float          ntu_error     = 0.0F;
+    for (uint16_t code = 0; code < TURBIDITY_ADC_CODES; code++)
+    {
+        float voltage = formula_voltage(sensor, code);
+        voltage_error = fmaxf(voltage_error, fabsf(table.voltage(code) - voltage));
+        ntu_error     = fmaxf(ntu_error, fabsf(table.ntu(code) - formula_ntu(sensor, voltage)));
+    }
+
+    char message[120];
+    snprintf(message,
+             sizeof(message),
+             "%s sensor: max |dV| %.1f uV (bound %.1f uV), max |dNTU| %.4f (bound %.4f)",
+             name,
+             voltage_error * 1e6,
+             VOLTAGE_BOUND * 1e6,
+             ntu_error,
+             NTU_BOUND);
+    TEST_MESSAGE(message);
+
+    TEST_ASSERT_TRUE(voltage_error <= VOLTAGE_BOUND);
+    TEST_ASSERT_TRUE(ntu_error <= NTU_BOUND);
+}
+
+void test_table_matches_3v3_formulas() { check_against_formulas(SENSOR_3V3, entries_3v3_s, "3.3 V"); }
+
+void test_table_matches_5v_formulas() { check_against_formulas(SENSOR_5V, entries_5v_s, "5 V"); }
+
+void test_clean_decisions_agree()
+{
+    // A code flips its decision only if the threshold lies within the bound of its voltage, at most one code
+    TurbidityTable table(entries_s);
+    uint32_t       flipped = 0;
+    for (uint16_t code = 0; code < TURBIDITY_ADC_CODES; code++)
+    {
+        bool is_clean_formula = formula_voltage(SENSOR, code) >= TURBIDITY_VOLTAGE_THRESHOLD;
+        bool is_clean_table   = table.voltage(code) >= TURBIDITY_VOLTAGE_THRESHOLD;
+        if (is_clean_formula != is_clean_table) { flipped++; }
+    }
+
+    TEST_ASSERT_LESS_OR_EQUAL_UINT32(1, flipped);
+}
+
+void test_calibration_replaces_ntu()
+{
+    write_calibration("# voltage NTU\n2.0 1000\n\n2.5 300\n  3.0\t10\n");
+
+    TurbidityTable table(entries_s);
+    TEST_ASSERT_TRUE(table.load_calibration(CALIBRATION_PATH));
+    TEST_ASSERT_TRUE(table.is_calibrated());
+    TEST_ASSERT_EQUAL_UINT8(3, table.calibration_points());
+
+    for (uint16_t code = 0; code < TURBIDITY_ADC_CODES; code++)
+    {
+        // The voltage column stays, the NTU column follows the measured points
+        float voltage = formula_voltage(SENSOR, code);
+        TEST_ASSERT_TRUE(fabsf(table.voltage(code) - voltage) <= VOLTAGE_BOUND);
+
+        float expected = voltage <= 2.0F   ? 1'000.0F
+                         : voltage <= 2.5F ? 1'000.0F - 700.0F * (voltage - 2.0F) / 0.5F
+                         : voltage <= 3.0F ? 300.0F - 290.0F * (voltage - 2.5F) / 0.5F
+                                           : 10.0F;
+        TEST_ASSERT_TRUE(fabsf(table.ntu(code) - expected) <= NTU_BOUND + 700.0F / 0.5F * VOLTAGE_BOUND);
+    }
+}
+
+void test_invalid_calibration_keeps_table()
+{
+    TurbidityTable table(entries_s);
+    TEST_ASSERT_FALSE(table.load_calibration(CALIBRATION_PATH));  // Missing
+
+    const char* invalid[] = {
+        "2.5 300\n2.0 1000\n",  // Falling voltage
+        "2.5 300\n",            // One point
+        "2.0 1000\n2.5 -1\n",   // Negative NTU
+        "2.0 1000\n2.5\n",      // No NTU
+        "2.0 1000\nvolts 2\n",  // No number
+    };
+    for (const char* text : invalid)
+    {
+        write_calibration(text);
+        TEST_ASSERT_FALSE(table.load_calibration(CALIBRATION_PATH));
+        TEST_ASSERT_FALSE(table.is_calibrated());
+    }
+
+    // A later invalid file keeps the last valid calibration
+    write_calibration("2.0 1000\n3.0 10\n");
+    TEST_ASSERT_TRUE(table.load_calibration(CALIBRATION_PATH));
+    float ntu = table.ntu(3'000);
+    write_calibration("3.0 10\n2.0 1000\n");
+    TEST_ASSERT_FALSE(table.load_calibration(CALIBRATION_PATH));
+    TEST_ASSERT_EQUAL_UINT8(2, table.calibration_points());
+    TEST_ASSERT_EQUAL_FLOAT(ntu, table.ntu(3'000));
+}
+
+void test_conversion_cost()
+{
+    constexpr uint32_t rounds = 2'000;
+
+    TurbidityTable table(entries_s);
+    volatile float sink = 0.0F;
+
+    auto start = std::chrono::steady_clock::now();
+    for (uint32_t round = 0; round < rounds; round++)
+    {
+        for (uint16_t code = 0; code < TURBIDITY_ADC_CODES; code++)
+        {
+            sink = sink + formula_ntu(SENSOR, formula_voltage(SENSOR, static_cast<uint16_t>(code ^ round)));
+        }
+    }
+    auto formulas_end = std::chrono::steady_clock::now();
+    for (uint32_t round = 0; round < rounds; round++)
+    {
+        for (uint16_t code = 0; code < TURBIDITY_ADC_CODES; code++)
+        {
+            sink = sink + table.ntu(static_cast<uint16_t>(code ^ round));
+        }
+    }
+    auto table_end = std::chrono::steady_clock::now();
+
+    double conversions = static_cast<double>(rounds) * TURBIDITY_ADC_CODES;
+    char   message[100];
+    snprintf(message,
+             sizeof(message),
+             "code to NTU: formulas %.2f ns, table %.2f ns per conversion",
+             std::chrono::duration<double, std::nano>(formulas_end - start).count() / conversions,
+             std::chrono::duration<double, std::nano>(table_end - formulas_end).count() / conversions);
+    TEST_MESSAGE(message);
+}
+
+int main(int argc, char** argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_table_matches_3v3_formulas);
+    RUN_TEST(test_table_matches_5v_formulas);
+    RUN_TEST(test_clean_decisions_agree);
+    RUN_TEST(test_calibration_replaces_ntu);
+    RUN_TEST(test_invalid_calibration_keeps_table);
+    RUN_TEST(test_conversion_cost);
+    return UNITY_END();
+}
@@ -0,0 +1,29 @@
+function showTurbidity(data) {
+    document.getElementById('turbidity').innerText = data.turbidity + ' NTU';
+    document.getElementById('avg_turbidity').innerText = data.avg_turbidity + ' NTU';
+    document.getElementById('voltage').innerText = data.voltage + ' V';
+    document.getElementById('avg_voltage').innerText = data.avg_voltage + ' V';
+}
+
+function updateTurbidity() {
+    fetch('/turbidity/data')
+        .then(response => response.json())
+        .then(showTurbidity)
+        .catch(error => {
+            console.error('Fout bij ophalen van turbidity data:', error);
+        });
+}
+
+// Live data is pushed over /turbidity/stream, polling is the fallback when the stream is unavailable
+var pollTimer = null;
+
+function startPolling() { if (pollTimer === null) { pollTimer = setInterval(updateTurbidity, 1000); } }
+function stopPolling() { if (pollTimer !== null) { clearInterval(pollTimer); pollTimer = null; } }
+
+if (window.EventSource) {
+    var stream = new EventSource('/turbidity/stream');
+    stream.onmessage = event => { stopPolling(); showTurbidity(JSON.parse(event.data)); };
+    stream.onerror = startPolling;
+} else {
+    startPolling();
+}